@@ -23,11 +23,13 @@ namespace fastdx {
 
     typedef std::shared_ptr<ID3D12CommandAllocator> ID3D12CommandAllocatorPtr;
     typedef std::shared_ptr<ID3D12CommandQueue> ID3D12CommandQueuePtr;
+    typedef std::shared_ptr<ID3D12CommandSignature> ID3D12CommandSignaturePtr;
     typedef std::shared_ptr<ID3D12DescriptorHeap> ID3D12DescriptorHeapPtr;
     typedef std::shared_ptr<ID3D12Device2> ID3D12DevicePtr;
     typedef std::shared_ptr<ID3D12Fence> ID3D12FencePtr;
     typedef std::shared_ptr<ID3D12GraphicsCommandList6> ID3D12GraphicsCommandListPtr;
     typedef std::shared_ptr<ID3D12PipelineState> ID3D12PipelineStatePtr;
+    typedef std::shared_ptr<ID3D12QueryHeap> ID3D12QueryHeapPtr;
     typedef std::shared_ptr<ID3D12Resource> ID3D12ResourcePtr;
     typedef std::shared_ptr<ID3D12RootSignature> ID3D12RootSignaturePtr;
     typedef std::shared_ptr<ID3DBlob> ID3DBlobPtr;
@@ -45,6 +47,7 @@ namespace fastdx {
         }
     };
     inline std::function<void()> onWindowDestroy = nullptr;
+    inline std::function<void(UINT, WPARAM, LPARAM)> onWindowMessage = nullptr;   // Every message, before default handling
 
 
     ///
@@ -75,18 +78,26 @@ namespace fastdx {
 
         ID3D12CommandQueuePtr createCommandQueue(D3D12_COMMAND_LIST_TYPE type, HRESULT* outResult = nullptr);
 
+        ID3D12CommandSignaturePtr createCommandSignature(const D3D12_COMMAND_SIGNATURE_DESC& desc,
+            ID3D12RootSignaturePtr optRootSignature, HRESULT* outResult = nullptr);
+
         ID3D12ResourcePtr createCommittedResource(const D3D12_HEAP_PROPERTIES& heapProperties,
             D3D12_HEAP_FLAGS heapFlags, const D3D12_RESOURCE_DESC& desc, D3D12_RESOURCE_STATES initialState,
             const D3D12_CLEAR_VALUE* optOptimalClearValue, HRESULT* outResult = nullptr);
 
         ID3D12FencePtr createFence(uint64_t initialValue, D3D12_FENCE_FLAGS flags, HRESULT* outResult = nullptr);
 
+        ID3D12PipelineStatePtr createComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc,
+            HRESULT* outResult = nullptr);
+
         ID3D12PipelineStatePtr createGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
             HRESULT* outResult = nullptr);
 
         ID3D12DescriptorHeapPtr createDescriptorHeap(int32_t count, D3D12_DESCRIPTOR_HEAP_TYPE heapType,
             HRESULT* outResult = nullptr);
 
+        ID3D12QueryHeapPtr createQueryHeap(uint32_t count, D3D12_QUERY_HEAP_TYPE heapType, HRESULT* outResult = nullptr);
+
         std::vector<ID3D12ResourcePtr> createRenderTargetViews(IDXGISwapChainPtr swapChain,
             ID3D12DescriptorHeapPtr heap, HRESULT* outResult = nullptr);
 
@@ -108,6 +119,9 @@ namespace fastdx {
         void createShaderResourceView(ID3D12ResourcePtr resource, const D3D12_SHADER_RESOURCE_VIEW_DESC& desc,
             D3D12_CPU_DESCRIPTOR_HANDLE handle);
 
+        void createUnorderedAccessView(ID3D12ResourcePtr resource, ID3D12ResourcePtr optCounterResource,
+            const D3D12_UNORDERED_ACCESS_VIEW_DESC& desc, D3D12_CPU_DESCRIPTOR_HANDLE handle);
+
         uint32_t getDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE descriptorHeapType);
 
     private:
@@ -121,6 +135,9 @@ namespace fastdx {
 namespace fastdxu {
     D3D12_BLEND_DESC defaultBlendDesc();
 
+    D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc(uint32_t byteStride,
+        const D3D12_INDIRECT_ARGUMENT_DESC* argumentDescs, uint32_t argumentCount);
+
     D3D12_DEPTH_STENCIL_DESC defaultDepthStencilDesc();
 
     D3D12_INDEX_BUFFER_VIEW indexBufferView(D3D12_GPU_VIRTUAL_ADDRESS BufferLocation, UINT SizeInBytes,
@@ -128,7 +145,8 @@ namespace fastdxu {
 
     D3D12_RASTERIZER_DESC defaultRasterizerDesc();
 
-    D3D12_RESOURCE_BARRIER resourceBarrierTransition(fastdx::ID3D12ResourcePtr resource, D3D12_RESOURCE_STATES beforeState, D3D12_RESOURCE_STATES afterState);
+    D3D12_RESOURCE_BARRIER resourceBarrierTransition(fastdx::ID3D12ResourcePtr resource, D3D12_RESOURCE_STATES beforeState,
+        D3D12_RESOURCE_STATES afterState, uint32_t subresource);
 
     D3D12_RESOURCE_DESC resourceBufferDesc(uint32_t width,
         D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE);
@@ -138,6 +156,8 @@ namespace fastdxu {
 
     D3D12_SHADER_RESOURCE_VIEW_DESC shaderResourceViewDesc(D3D12_SRV_DIMENSION dimension);
 
+    D3D12_UNORDERED_ACCESS_VIEW_DESC unorderedAccessViewDesc(D3D12_UAV_DIMENSION dimension, DXGI_FORMAT format);
+
     DXGI_SWAP_CHAIN_DESC1 swapChainDesc(const HWND hwnd, uint32_t bufferCount = 2,
         DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM);
 
@@ -203,6 +223,10 @@ namespace fastdx {
 
 
     LRESULT CALLBACK _WindowProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+        if (onWindowMessage) {
+            onWindowMessage(msg, wParam, lParam);
+        }
+
         switch (msg) {
         case WM_PAINT:
             break;
@@ -416,6 +440,18 @@ namespace fastdx {
     }
 
 
+    ID3D12CommandSignaturePtr D3D12DeviceWrapper::createCommandSignature(const D3D12_COMMAND_SIGNATURE_DESC& desc,
+        ID3D12RootSignaturePtr optRootSignature, HRESULT* outResult) {
+
+        // Root signature is only required when arguments change root constants or views
+        ID3D12CommandSignature* commandSignature = nullptr;
+        HRESULT hr = _device->CreateCommandSignature(&desc, optRootSignature.get(), IID_PPV_ARGS(&commandSignature));
+
+        CHECK_ASSIGN_RETURN_IF_FAILED(hr, outResult);
+        return ID3D12CommandSignaturePtr(commandSignature, PtrDeleter());
+    }
+
+
     ID3D12ResourcePtr D3D12DeviceWrapper::createCommittedResource(const D3D12_HEAP_PROPERTIES& heapProperties,
         D3D12_HEAP_FLAGS heapFlags, const D3D12_RESOURCE_DESC& desc, D3D12_RESOURCE_STATES initialState,
         const D3D12_CLEAR_VALUE* optOptimalClearValue, HRESULT* outResult) {
@@ -440,6 +476,16 @@ namespace fastdx {
     }
 
 
+    ID3D12PipelineStatePtr D3D12DeviceWrapper::createComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc,
+        HRESULT* outResult) {
+        ID3D12PipelineState* pipelineState = nullptr;
+        HRESULT hr = _device->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pipelineState));
+
+        CHECK_ASSIGN_RETURN_IF_FAILED(hr, outResult);
+        return ID3D12PipelineStatePtr(pipelineState, PtrDeleter());
+    }
+
+
     ID3D12PipelineStatePtr D3D12DeviceWrapper::createGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
         HRESULT* outResult) {
         ID3D12PipelineState* pipelineState = nullptr;
@@ -472,6 +518,18 @@ namespace fastdx {
     }
 
 
+    ID3D12QueryHeapPtr D3D12DeviceWrapper::createQueryHeap(uint32_t count, D3D12_QUERY_HEAP_TYPE heapType,
+        HRESULT* outResult) {
+
+        D3D12_QUERY_HEAP_DESC queryHeapDesc = { heapType, count, 0 };
+        ID3D12QueryHeap* queryHeap = nullptr;
+        HRESULT hr = _device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&queryHeap));
+
+        CHECK_ASSIGN_RETURN_IF_FAILED(hr, outResult);
+        return ID3D12QueryHeapPtr(queryHeap, PtrDeleter());
+    }
+
+
     std::vector<ID3D12ResourcePtr> D3D12DeviceWrapper::createRenderTargetViews(
         IDXGISwapChainPtr swapChain, ID3D12DescriptorHeapPtr heap, HRESULT* outResult) {
 
@@ -562,6 +620,12 @@ namespace fastdx {
         _device->CreateShaderResourceView(resource.get(), &desc, handle);
     }
 
+
+    void D3D12DeviceWrapper::createUnorderedAccessView(ID3D12ResourcePtr resource, ID3D12ResourcePtr optCounterResource,
+        const D3D12_UNORDERED_ACCESS_VIEW_DESC& desc, D3D12_CPU_DESCRIPTOR_HANDLE handle) {
+        _device->CreateUnorderedAccessView(resource.get(), optCounterResource.get(), &desc, handle);
+    }
+
     inline uint32_t D3D12DeviceWrapper::getDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE descriptorHeapType) {
         return _device->GetDescriptorHandleIncrementSize(descriptorHeapType);
     }
@@ -654,6 +718,17 @@ namespace fastdxu {
     }
 
 
+    inline D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc(uint32_t byteStride,
+        const D3D12_INDIRECT_ARGUMENT_DESC* argumentDescs, uint32_t argumentCount) {
+        return D3D12_COMMAND_SIGNATURE_DESC{
+            byteStride,
+            argumentCount,
+            argumentDescs,
+            0                                       // Single GPU node
+        };
+    }
+
+
     inline D3D12_INDEX_BUFFER_VIEW indexBufferView(
         D3D12_GPU_VIRTUAL_ADDRESS BufferLocation, UINT SizeInBytes, DXGI_FORMAT Format) {
         return D3D12_INDEX_BUFFER_VIEW{
@@ -666,19 +741,21 @@ namespace fastdxu {
 
     inline D3D12_RESOURCE_BARRIER resourceBarrierTransition(fastdx::ID3D12ResourcePtr resource,
         D3D12_RESOURCE_STATES beforeState = D3D12_RESOURCE_STATE_COMMON,
-        D3D12_RESOURCE_STATES afterState = D3D12_RESOURCE_STATE_COMMON) {
+        D3D12_RESOURCE_STATES afterState = D3D12_RESOURCE_STATE_COMMON,
+        uint32_t subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES) {
 
         return D3D12_RESOURCE_BARRIER{
             D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
             D3D12_RESOURCE_BARRIER_FLAG_NONE,
             // Transition
             resource.get(),
-            D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+            subresource,
             beforeState,
             afterState
         };
     }
 
+
     inline D3D12_RESOURCE_DESC resourceBufferDesc(uint32_t width, D3D12_RESOURCE_FLAGS flags) {
         return D3D12_RESOURCE_DESC{
             D3D12_RESOURCE_DIMENSION_BUFFER,
@@ -725,6 +802,18 @@ namespace fastdxu {
     }
 
 
+    struct DEFAULT_D3D12_UNORDERED_ACCESS_VIEW_DESC : public D3D12_UNORDERED_ACCESS_VIEW_DESC {
+        DEFAULT_D3D12_UNORDERED_ACCESS_VIEW_DESC(D3D12_UAV_DIMENSION dimension, DXGI_FORMAT format) {
+            memset(this, 0, sizeof(D3D12_UNORDERED_ACCESS_VIEW_DESC));
+            ViewDimension = dimension;
+            Format = format;
+        }
+    };
+    inline D3D12_UNORDERED_ACCESS_VIEW_DESC unorderedAccessViewDesc(D3D12_UAV_DIMENSION dimension, DXGI_FORMAT format) {
+        return DEFAULT_D3D12_UNORDERED_ACCESS_VIEW_DESC(dimension, format);
+    }
+
+
     struct DEFAULT_DXGI_SWAP_CHAIN_DESC1 : public DXGI_SWAP_CHAIN_DESC1 {
         DEFAULT_DXGI_SWAP_CHAIN_DESC1(const HWND hwnd, uint32_t bufferCount, DXGI_FORMAT format) {
             RECT windowRect;
@@ -0,0 +1,417 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+#if defined(FASTDX_INTEROP_CUDA)
+#include <cuda_runtime.h>
+#include "fastdx.h"
+#endif
+
+
+///
+/// fastdx_interop Header - Buffers Shared by a Producer API and D3D12, Ordered by Timeline Fences
+///
+/// A producer writes shared buffers that the consumer reads in place, without copies or host round trips. Both sides
+/// order their work with fences whose values only grow, each side waits on the other side's fence before touching a
+/// buffer. Backends:
+/// - D3D12Cuda, define FASTDX_INTEROP_CUDA before including: shared D3D12 resources and fences imported as CUDA
+///   external memory and external semaphores, the producer is a CUDA stream and the consumer a D3D12 queue.
+/// - Cpu: host memory and CPU fences, producer and consumer are host threads. Same protocol without a GPU, so it can
+///   be exercised on any machine.
+///
+namespace fastdx {
+    enum class InteropBackend {
+        Cpu,
+        D3D12Cuda,
+    };
+
+    /// data is where the producer writes: the CUDA device pointer of the imported memory, or host memory the CPU
+    /// consumer reads too. The D3D12 consumer reads resource instead, a buffer in D3D12_RESOURCE_STATE_COMMON whose
+    /// reads are implicit promotions, so no barrier is needed between the two APIs.
+    struct SharedBuffer {
+        virtual ~SharedBuffer() = default;
+
+        size_t sizeInBytes = 0;
+        void* data = nullptr;
+#if defined(FASTDX_INTEROP_CUDA)
+        ID3D12ResourcePtr resource;
+#endif
+    };
+    typedef std::shared_ptr<SharedBuffer> SharedBufferPtr;
+
+    class SharedFence {
+    public:
+        virtual ~SharedFence() = default;
+        virtual uint64_t completedValue() const = 0;
+    };
+    typedef std::shared_ptr<SharedFence> SharedFencePtr;
+
+    class InteropDevice;
+    typedef std::shared_ptr<InteropDevice> InteropDevicePtr;
+
+
+    ///
+    /// Interop Device
+    ///
+    InteropDevicePtr createCpuInterop();
+#if defined(FASTDX_INTEROP_CUDA)
+    InteropDevicePtr createD3D12CudaInterop(D3D12DeviceWrapperPtr device, ID3D12CommandQueuePtr consumerQueue,
+        cudaStream_t producerStream);
+#endif
+
+    /// Producer calls order the work of the producer stream, consumer calls the work of the consumer queue. On the
+    /// CPU backend waits block the calling thread instead. Fences passed in must come from the same device. Creation
+    /// returns nullptr on failure.
+    class InteropDevice {
+    public:
+        virtual ~InteropDevice() = default;
+
+        virtual InteropBackend backend() const = 0;
+
+        virtual SharedBufferPtr createSharedBuffer(size_t sizeInBytes) = 0;
+        virtual SharedFencePtr createSharedFence(uint64_t initialValue) = 0;
+
+        virtual void producerWait(SharedFencePtr fence, uint64_t value) = 0;
+        virtual void producerSignal(SharedFencePtr fence, uint64_t value) = 0;
+        virtual void consumerWait(SharedFencePtr fence, uint64_t value) = 0;
+        virtual void consumerSignal(SharedFencePtr fence, uint64_t value) = 0;
+
+        // Blocks the calling thread until the fence reaches value
+        virtual void hostWait(SharedFencePtr fence, uint64_t value) = 0;
+    };
+
+
+    ///
+    /// Shared Buffer Ring
+    ///
+    /// Frame f of the producer is written to slot f % slotCount. The producer reuses a slot once the consumer released
+    /// the frame slotCount before, the consumer reads a slot once the producer signaled its frame. Frame f signals
+    /// value f + 1 on either fence. Produce calls touch producer state only and consume calls consumer state only, so
+    /// the two sides may run on different threads.
+    class SharedBufferRing {
+    public:
+        // Fails for a null device or zero slots
+        bool create(InteropDevicePtr device, uint32_t slotCount, size_t sizeInBytes);
+
+        // Slot of the next frame, after its previous frame is released
+        uint32_t beginProduce();
+        void endProduce();
+
+        // Slot of the next frame, after it is produced
+        uint32_t beginConsume();
+        void endConsume();
+
+        // Producer side, every produced frame released. Blocks forever if one of them is never consumed.
+        void waitIdle();
+
+        inline SharedBufferPtr buffer(uint32_t slot) const { return _buffers[slot]; }
+        inline uint32_t slotCount() const { return static_cast<uint32_t>(_buffers.size()); }
+
+    private:
+        InteropDevicePtr _device;
+        std::vector<SharedBufferPtr> _buffers;
+        SharedFencePtr _producedFence;
+        SharedFencePtr _consumedFence;
+        uint64_t _producedCount = 0;
+        uint64_t _consumedCount = 0;
+    };
+}
+
+
+///
+/// Implementation
+///
+#if defined(FASTDX_INTEROP_IMPLEMENTATION)
+
+///
+/// CPU Backend
+///
+namespace fastdx {
+    const size_t kCpuSharedBufferAlignment = 64;
+
+    struct _CpuSharedBuffer : SharedBuffer {
+        ~_CpuSharedBuffer() override {
+            ::operator delete(data, std::align_val_t(kCpuSharedBufferAlignment));
+        }
+    };
+
+    // Signal publishes the writes made before it to the threads its value wakes up
+    class _CpuSharedFence : public SharedFence {
+    public:
+        _CpuSharedFence(uint64_t initialValue) : _value(initialValue) {}
+
+        uint64_t completedValue() const override {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _value;
+        }
+
+        void signal(uint64_t value) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _value = value;
+            }
+            _valueChanged.notify_all();
+        }
+
+        void wait(uint64_t value) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _valueChanged.wait(lock, [this, value]() { return _value >= value; });
+        }
+
+    private:
+        mutable std::mutex _mutex;
+        std::condition_variable _valueChanged;
+        uint64_t _value;
+    };
+
+    class _CpuInteropDevice : public InteropDevice {
+    public:
+        InteropBackend backend() const override {
+            return InteropBackend::Cpu;
+        }
+
+        SharedBufferPtr createSharedBuffer(size_t sizeInBytes) override {
+            auto buffer = std::make_shared<_CpuSharedBuffer>();
+            buffer->data = ::operator new(sizeInBytes, std::align_val_t(kCpuSharedBufferAlignment), std::nothrow);
+            if (!buffer->data) {
+                return nullptr;
+            }
+            buffer->sizeInBytes = sizeInBytes;
+            return buffer;
+        }
+
+        SharedFencePtr createSharedFence(uint64_t initialValue) override {
+            return std::make_shared<_CpuSharedFence>(initialValue);
+        }
+
+        void producerWait(SharedFencePtr fence, uint64_t value) override {
+            static_cast<_CpuSharedFence*>(fence.get())->wait(value);
+        }
+
+        void producerSignal(SharedFencePtr fence, uint64_t value) override {
+            static_cast<_CpuSharedFence*>(fence.get())->signal(value);
+        }
+
+        void consumerWait(SharedFencePtr fence, uint64_t value) override {
+            static_cast<_CpuSharedFence*>(fence.get())->wait(value);
+        }
+
+        void consumerSignal(SharedFencePtr fence, uint64_t value) override {
+            static_cast<_CpuSharedFence*>(fence.get())->signal(value);
+        }
+
+        void hostWait(SharedFencePtr fence, uint64_t value) override {
+            static_cast<_CpuSharedFence*>(fence.get())->wait(value);
+        }
+    };
+
+
+    InteropDevicePtr createCpuInterop() {
+        return std::make_shared<_CpuInteropDevice>();
+    }
+}
+
+
+///
+/// D3D12 CUDA Backend
+///
+#if defined(FASTDX_INTEROP_CUDA)
+namespace fastdx {
+    struct _D3D12CudaSharedBuffer : SharedBuffer {
+        ~_D3D12CudaSharedBuffer() override {
+            // The mapped range is released before the memory it maps, the resource last
+            cudaFree(data);
+            if (externalMemory) {
+                cudaDestroyExternalMemory(externalMemory);
+            }
+        }
+
+        cudaExternalMemory_t externalMemory = nullptr;
+    };
+
+    class _D3D12CudaSharedFence : public SharedFence {
+    public:
+        ~_D3D12CudaSharedFence() override {
+            if (semaphore) {
+                cudaDestroyExternalSemaphore(semaphore);
+            }
+        }
+
+        uint64_t completedValue() const override {
+            return fence->GetCompletedValue();
+        }
+
+        ID3D12FencePtr fence;
+        cudaExternalSemaphore_t semaphore = nullptr;
+    };
+
+    class _D3D12CudaInteropDevice : public InteropDevice {
+    public:
+        _D3D12CudaInteropDevice(D3D12DeviceWrapperPtr device, ID3D12CommandQueuePtr consumerQueue,
+            cudaStream_t producerStream) : _device(device), _consumerQueue(consumerQueue),
+            _producerStream(producerStream) {}
+
+        InteropBackend backend() const override {
+            return InteropBackend::D3D12Cuda;
+        }
+
+        SharedBufferPtr createSharedBuffer(size_t sizeInBytes) override {
+            D3D12_HEAP_PROPERTIES defaultHeapProps = { D3D12_HEAP_TYPE_DEFAULT };
+            D3D12_RESOURCE_DESC bufferDesc = fastdxu::resourceBufferDesc(static_cast<uint32_t>(sizeInBytes),
+                D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+            auto buffer = std::make_shared<_D3D12CudaSharedBuffer>();
+            buffer->resource = _device->createCommittedResource(defaultHeapProps, D3D12_HEAP_FLAG_SHARED, bufferDesc,
+                D3D12_RESOURCE_STATE_COMMON, nullptr);
+            HANDLE sharedHandle = nullptr;
+            if (!buffer->resource || FAILED(_device->d3dDevice()->CreateSharedHandle(buffer->resource.get(), nullptr,
+                GENERIC_ALL, nullptr, &sharedHandle))) {
+                return nullptr;
+            }
+
+            // A committed resource is a dedicated allocation, CUDA imports all of it and maps the buffer range.
+            // The handle stays owned by the application.
+            D3D12_RESOURCE_ALLOCATION_INFO allocationInfo = _device->d3dDevice()->GetResourceAllocationInfo(0, 1,
+                &bufferDesc);
+            cudaExternalMemoryHandleDesc memoryDesc = {};
+            memoryDesc.type = cudaExternalMemoryHandleTypeD3D12Resource;
+            memoryDesc.handle.win32.handle = sharedHandle;
+            memoryDesc.size = allocationInfo.SizeInBytes;
+            memoryDesc.flags = cudaExternalMemoryDedicated;
+            cudaError_t result = cudaImportExternalMemory(&buffer->externalMemory, &memoryDesc);
+            CloseHandle(sharedHandle);
+            if (result != cudaSuccess) {
+                return nullptr;
+            }
+
+            cudaExternalMemoryBufferDesc mappedDesc = {};
+            mappedDesc.offset = 0;
+            mappedDesc.size = sizeInBytes;
+            if (cudaExternalMemoryGetMappedBuffer(&buffer->data, buffer->externalMemory, &mappedDesc) != cudaSuccess) {
+                return nullptr;
+            }
+            buffer->sizeInBytes = sizeInBytes;
+            return buffer;
+        }
+
+        SharedFencePtr createSharedFence(uint64_t initialValue) override {
+            auto sharedFence = std::make_shared<_D3D12CudaSharedFence>();
+            sharedFence->fence = _device->createFence(initialValue, D3D12_FENCE_FLAG_SHARED);
+            HANDLE sharedHandle = nullptr;
+            if (!sharedFence->fence || FAILED(_device->d3dDevice()->CreateSharedHandle(sharedFence->fence.get(),
+                nullptr, GENERIC_ALL, nullptr, &sharedHandle))) {
+                return nullptr;
+            }
+
+            cudaExternalSemaphoreHandleDesc semaphoreDesc = {};
+            semaphoreDesc.type = cudaExternalSemaphoreHandleTypeD3D12Fence;
+            semaphoreDesc.handle.win32.handle = sharedHandle;
+            cudaError_t result = cudaImportExternalSemaphore(&sharedFence->semaphore, &semaphoreDesc);
+            CloseHandle(sharedHandle);
+            return result == cudaSuccess ? sharedFence : nullptr;
+        }
+
+        void producerWait(SharedFencePtr fence, uint64_t value) override {
+            cudaExternalSemaphoreWaitParams waitParams = {};
+            waitParams.params.fence.value = value;
+            cudaWaitExternalSemaphoresAsync(&_cast(fence)->semaphore, &waitParams, 1, _producerStream);
+        }
+
+        void producerSignal(SharedFencePtr fence, uint64_t value) override {
+            cudaExternalSemaphoreSignalParams signalParams = {};
+            signalParams.params.fence.value = value;
+            cudaSignalExternalSemaphoresAsync(&_cast(fence)->semaphore, &signalParams, 1, _producerStream);
+        }
+
+        void consumerWait(SharedFencePtr fence, uint64_t value) override {
+            _consumerQueue->Wait(_cast(fence)->fence.get(), value);
+        }
+
+        void consumerSignal(SharedFencePtr fence, uint64_t value) override {
+            _consumerQueue->Signal(_cast(fence)->fence.get(), value);
+        }
+
+        void hostWait(SharedFencePtr fence, uint64_t value) override {
+            // Without an event SetEventOnCompletion returns once the value is reached
+            _cast(fence)->fence->SetEventOnCompletion(value, nullptr);
+        }
+
+    private:
+        static _D3D12CudaSharedFence* _cast(const SharedFencePtr& fence) {
+            return static_cast<_D3D12CudaSharedFence*>(fence.get());
+        }
+
+        D3D12DeviceWrapperPtr _device;
+        ID3D12CommandQueuePtr _consumerQueue;
+        cudaStream_t _producerStream;
+    };
+
+
+    InteropDevicePtr createD3D12CudaInterop(D3D12DeviceWrapperPtr device, ID3D12CommandQueuePtr consumerQueue,
+        cudaStream_t producerStream) {
+        return std::make_shared<_D3D12CudaInteropDevice>(device, consumerQueue, producerStream);
+    }
+}
+#endif // FASTDX_INTEROP_CUDA
+
+
+///
+/// Shared Buffer Ring
+///
+namespace fastdx {
+    bool SharedBufferRing::create(InteropDevicePtr device, uint32_t slotCount, size_t sizeInBytes) {
+        *this = SharedBufferRing();
+        if (!device || slotCount == 0) {
+            return false;
+        }
+        _device = device;
+        _producedFence = device->createSharedFence(0);
+        _consumedFence = device->createSharedFence(0);
+        if (!_producedFence || !_consumedFence) {
+            return false;
+        }
+        for (uint32_t i = 0; i < slotCount; ++i) {
+            SharedBufferPtr buffer = device->createSharedBuffer(sizeInBytes);
+            if (!buffer) {
+                return false;
+            }
+            _buffers.push_back(buffer);
+        }
+        return true;
+    }
+
+
+    uint32_t SharedBufferRing::beginProduce() {
+        if (_producedCount >= _buffers.size()) {
+            _device->producerWait(_consumedFence, _producedCount - _buffers.size() + 1);
+        }
+        return static_cast<uint32_t>(_producedCount % _buffers.size());
+    }
+
+
+    void SharedBufferRing::endProduce() {
+        _device->producerSignal(_producedFence, ++_producedCount);
+    }
+
+
+    uint32_t SharedBufferRing::beginConsume() {
+        _device->consumerWait(_producedFence, _consumedCount + 1);
+        return static_cast<uint32_t>(_consumedCount % _buffers.size());
+    }
+
+
+    void SharedBufferRing::endConsume() {
+        _device->consumerSignal(_consumedFence, ++_consumedCount);
+    }
+
+
+    void SharedBufferRing::waitIdle() {
+        if (_device) {
+            _device->hostWait(_consumedFence, _producedCount);
+        }
+    }
+}
+#endif // FASTDX_INTEROP_IMPLEMENTATION
@@ -0,0 +1,182 @@
+// https://learn.microsoft.com/en-us/windows/win32/direct3d12/specifying-root-signatures-in-hlsl
+#define ROOT_SIG                                                                \
+    "RootFlags(0)"                                                              \
+    ", CBV(b0)"                                                                 \
+    ", SRV(t0)"                                                                 \
+    ", SRV(t1)"                                                                 \
+    ", SRV(t2)"                                                                 \
+    ", SRV(t3)"                                                                 \
+    ", SRV(t4)"                                                                 \
+    ", DescriptorTable(SRV(t5))"                                                \
+    ", UAV(u0)"                                                                 \
+    ", UAV(u1)"
+
+// Layouts must match culling.h and GltfDrawArguments
+struct CullingConstants {
+    float4x4 matPrevWVP;
+    float4 frustumPlanes[6];
+    uint instanceCount;
+    uint maxDrawCount;
+    uint hizMipCount;
+    uint useOcclusion;
+    float2 hizSize;
+    float2 padding;
+};
+
+struct MeshCullData {
+    float3 boundsMin;
+    uint clusterOffset;
+    float3 boundsMax;
+    uint clusterCount;
+};
+
+struct ClusterCullData {
+    float3 boundsMin;
+    uint drawTemplateIndex;
+    float3 boundsMax;
+    uint startIndex;
+    uint indexCount;
+};
+
+struct DrawArguments {
+    uint instanceOffset;
+    uint materialTextureOffset;
+    uint2 vertexBuffer;
+    uint2 indexBufferLocation;
+    uint indexBufferSize;
+    uint indexBufferFormat;
+    uint indexCountPerInstance;
+    uint instanceCount;
+    uint startIndexLocation;
+    int baseVertexLocation;
+    uint startInstanceLocation;
+    uint padding;
+};
+
+ConstantBuffer<CullingConstants> Constants : register(b0);
+StructuredBuffer<float4x4> instanceBuffer : register(t0);
+StructuredBuffer<uint> instanceMeshIds : register(t1);
+StructuredBuffer<MeshCullData> meshes : register(t2);
+StructuredBuffer<ClusterCullData> clusters : register(t3);
+StructuredBuffer<DrawArguments> drawTemplates : register(t4);
+Texture2D<float> hizTex : register(t5);
+RWStructuredBuffer<DrawArguments> culledDrawArguments : register(u0);
+RWByteAddressBuffer culledDrawCount : register(u1);
+
+void transformAabb(float3 boundsMin, float3 boundsMax, float4x4 matW, out float3 center, out float3 extent) {
+    float3 localCenter = (boundsMin + boundsMax) * 0.5f;
+    float3 localExtent = (boundsMax - boundsMin) * 0.5f;
+    center = mul(float4(localCenter, 1.0f), matW).xyz;
+    extent = abs(localExtent.x * matW[0].xyz) + abs(localExtent.y * matW[1].xyz) + abs(localExtent.z * matW[2].xyz);
+}
+
+bool isAabbInFrustum(float3 center, float3 extent) {
+    [unroll]
+    for (uint i = 0; i < 6; ++i) {
+        float4 plane = Constants.frustumPlanes[i];
+        if (dot(center, plane.xyz) + plane.w + dot(extent, abs(plane.xyz)) < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isAabbOccluded(float3 center, float3 extent) {
+    float2 minUv = 1.0f;
+    float2 maxUv = 0.0f;
+    float minDepth = 1.0f;
+
+    [unroll]
+    for (uint i = 0; i < 8; ++i) {
+        float3 corner = center + extent * float3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f,
+            (i & 4) ? 1.0f : -1.0f);
+        float4 clip = mul(float4(corner, 1.0f), Constants.matPrevWVP);
+
+        // Crossing the near plane, can't be reprojected
+        if (clip.w <= 0.0f) {
+            return false;
+        }
+
+        float2 uv = clip.xy / clip.w * float2(0.5f, -0.5f) + 0.5f;
+        minUv = min(minUv, uv);
+        maxUv = max(maxUv, uv);
+        minDepth = min(minDepth, clip.z / clip.w);
+    }
+
+    // Outside previous frame view, no depth information
+    if (any(maxUv < 0.0f) || any(minUv > 1.0f)) {
+        return false;
+    }
+
+    // Mip 0 texel rect within the rendered sub-rect, then pick the mip where it spans at most 2x2 texels
+    int2 hizSize = int2(Constants.hizSize);
+    int2 minTexel = min(int2(saturate(minUv) * Constants.hizSize), hizSize - 1);
+    int2 maxTexel = min(int2(saturate(maxUv) * Constants.hizSize), hizSize - 1);
+
+    uint mip = 0;
+    while (mip + 1 < Constants.hizMipCount && any((maxTexel >> mip) - (minTexel >> mip) > 1)) {
+        mip++;
+    }
+
+    uint mipWidth, mipHeight, mipCount;
+    hizTex.GetDimensions(mip, mipWidth, mipHeight, mipCount);
+    int2 mipMaxTexel = int2(mipWidth, mipHeight) - 1;
+
+    float maxDepth = 0.0f;
+    for (int y = minTexel.y >> mip; y <= (maxTexel.y >> mip); ++y) {
+        for (int x = minTexel.x >> mip; x <= (maxTexel.x >> mip); ++x) {
+            maxDepth = max(maxDepth, hizTex.Load(int3(min(int2(x, y), mipMaxTexel), mip)));
+        }
+    }
+
+    return minDepth > maxDepth;
+}
+
+bool isAabbVisible(float3 boundsMin, float3 boundsMax, float4x4 matW) {
+    float3 center, extent;
+    transformAabb(boundsMin, boundsMax, matW, center, extent);
+
+    if (!isAabbInFrustum(center, extent)) {
+        return false;
+    }
+    if (Constants.useOcclusion && isAabbOccluded(center, extent)) {
+        return false;
+    }
+    return true;
+}
+
+[RootSignature(ROOT_SIG)]
+[numthreads(64, 1, 1)]
+void main(uint3 dtid : SV_DispatchThreadID) {
+    uint instanceId = dtid.x;
+    if (instanceId >= Constants.instanceCount) {
+        return;
+    }
+
+    float4x4 matInstanceW = instanceBuffer[instanceId];
+    MeshCullData mesh = meshes[instanceMeshIds[instanceId]];
+    if (!isAabbVisible(mesh.boundsMin, mesh.boundsMax, matInstanceW)) {
+        return;
+    }
+
+    // Emit one single instance draw per visible cluster
+    for (uint i = 0; i < mesh.clusterCount; ++i) {
+        ClusterCullData cluster = clusters[mesh.clusterOffset + i];
+        if (!isAabbVisible(cluster.boundsMin, cluster.boundsMax, matInstanceW)) {
+            continue;
+        }
+
+        uint drawIndex;
+        culledDrawCount.InterlockedAdd(0, 1, drawIndex);
+        if (drawIndex >= Constants.maxDrawCount) {
+            return;
+        }
+
+        DrawArguments arguments = drawTemplates[cluster.drawTemplateIndex];
+        arguments.instanceOffset = instanceId;
+        arguments.indexCountPerInstance = cluster.indexCount;
+        arguments.instanceCount = 1;
+        arguments.startIndexLocation = cluster.startIndex;
+        culledDrawArguments[drawIndex] = arguments;
+    }
+}
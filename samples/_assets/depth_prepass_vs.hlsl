@@ -0,0 +1,43 @@
+// https://learn.microsoft.com/en-us/windows/win32/direct3d12/specifying-root-signatures-in-hlsl
+#define ROOT_SIG                                                                \
+    "RootFlags(0)"                                                              \
+    ", CBV(b0, visibility=SHADER_VISIBILITY_VERTEX, flags=DATA_STATIC)"         \
+    ", SRV(t0, visibility=SHADER_VISIBILITY_VERTEX)"                            \
+    ", DescriptorTable("                                                        \
+    "    SRV(t0, space=1, numDescriptors=unbounded)"                            \
+    "    , visibility=SHADER_VISIBILITY_PIXEL"                                  \
+    "  )"                                                                       \
+    ", RootConstants(num32BitConstants=2, b1)"                                  \
+    ", SRV(t2, visibility=SHADER_VISIBILITY_VERTEX)"                            \
+    ", StaticSampler(s0"                                                        \
+    "    , filter=FILTER_MIN_MAG_MIP_LINEAR"                                    \
+    "    , visibility=SHADER_VISIBILITY_PIXEL"                                  \
+    "  )"
+
+struct Constants {
+    float4x4 matW;
+    float4x4 matVP;
+};
+
+struct DrawConstants {
+    uint instanceOffset;
+    uint materialTextureOffset;
+};
+
+// Position only stream of the mesh part, 12B per vertex instead of the 32B interleaved vertex
+ConstantBuffer<Constants> Globals : register(b0);
+ConstantBuffer<DrawConstants> Draw : register(b1);
+StructuredBuffer<float3> positionBuffer : register(t0);
+StructuredBuffer<float4x4> instanceBuffer : register(t2);
+
+// Depth only, no pixel shader is bound
+[RootSignature(ROOT_SIG)]
+float4 main(uint vid : SV_VertexID, uint iid : SV_InstanceID) : SV_POSITION {
+    float3 position = positionBuffer[vid];
+    float4x4 matInstanceW = instanceBuffer[Draw.instanceOffset + iid];
+
+    // Precise and same operations as textured_vs.hlsl, so the EQUAL depth test passes in the main pass
+    precise float4 positionW = mul(mul(float4(position, 1.0f), matInstanceW), Globals.matW);
+    precise float4 positionClip = mul(positionW, Globals.matVP);
+    return positionClip;
+}
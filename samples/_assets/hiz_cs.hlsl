@@ -0,0 +1,45 @@
+// https://learn.microsoft.com/en-us/windows/win32/direct3d12/specifying-root-signatures-in-hlsl
+#define ROOT_SIG                                                                \
+    "RootFlags(0)"                                                              \
+    ", RootConstants(num32BitConstants=4, b0)"                                  \
+    ", DescriptorTable(SRV(t0))"                                                \
+    ", DescriptorTable(UAV(u0))"
+
+struct HiZConstants {
+    uint2 srcSize;
+    uint2 dstSize;
+};
+
+ConstantBuffer<HiZConstants> Constants : register(b0);
+Texture2D<float> srcDepth : register(t0);
+RWTexture2D<float> dstDepth : register(u0);
+
+[RootSignature(ROOT_SIG)]
+[numthreads(8, 8, 1)]
+void main(uint3 dtid : SV_DispatchThreadID) {
+    if (dtid.x >= Constants.dstSize.x || dtid.y >= Constants.dstSize.y) {
+        return;
+    }
+
+    // Mip 0 copies depth, next mips keep the max of 2x2 texels, last row/column absorbs odd texels
+    uint2 srcMin = dtid.xy;
+    uint2 srcMax = dtid.xy;
+    if (Constants.srcSize.x != Constants.dstSize.x || Constants.srcSize.y != Constants.dstSize.y) {
+        srcMin = dtid.xy * 2;
+        srcMax = srcMin + 1;
+        if (dtid.x == Constants.dstSize.x - 1) {
+            srcMax.x = Constants.srcSize.x - 1;
+        }
+        if (dtid.y == Constants.dstSize.y - 1) {
+            srcMax.y = Constants.srcSize.y - 1;
+        }
+    }
+
+    float maxDepth = 0.0f;
+    for (uint y = srcMin.y; y <= srcMax.y; ++y) {
+        for (uint x = srcMin.x; x <= srcMax.x; ++x) {
+            maxDepth = max(maxDepth, srcDepth.Load(int3(x, y, 0)));
+        }
+    }
+    dstDepth[dtid.xy] = maxDepth;
+}
@@ -0,0 +1,100 @@
+// https://learn.microsoft.com/en-us/windows/win32/direct3d12/specifying-root-signatures-in-hlsl
+#define ROOT_SIG                                                                \
+    "RootFlags(0)"                                                              \
+    ", RootConstants(num32BitConstants=2, b0)"                                  \
+    ", SRV(t0)"                                                                 \
+    ", SRV(t1)"                                                                 \
+    ", UAV(u0)"
+
+// Same math as skinning_kernel and skinning::skin_scalar, skinning_dx12_cuda_tensors.cpp validates against the latter
+static const uint kSkinningModeLinear = 0;              // skinning_mode::linear, 3 float4 rows per bone
+static const uint kSkinningModeDualQuaternion = 1;      // skinning_mode::dual_quaternion, real then dual part
+
+struct SkinningConstants {
+    uint vertexCount;
+    uint mode;
+};
+
+// Packed 60B a2v of skinning_types.h, the 4 bone indices are the bytes of boneIndices
+struct a2v {
+    float3 position;
+    float3 normal;
+    float4 boneWeight;
+    uint boneIndices;
+    float2 uv0;
+    float2 uv1;
+};
+
+// a2v of textured_vs.hlsl, the skinned buffer is its vertex buffer
+struct SkinnedVertex {
+    float3 position;
+    float3 normal;
+    float2 uv0;
+};
+
+ConstantBuffer<SkinningConstants> Constants : register(b0);
+StructuredBuffer<a2v> vertexBuffer : register(t0);
+StructuredBuffer<float4> bonePalette : register(t1);
+RWStructuredBuffer<SkinnedVertex> skinnedVertexBuffer : register(u0);
+
+void skinLinear(a2v IN, uint4 boneIndex, inout SkinnedVertex OUT) {
+    float4 rows[3];
+    [unroll]
+    for (uint r = 0; r < 3; ++r) {
+        rows[r] = bonePalette[boneIndex.x * 3 + r] * IN.boneWeight.x;
+        rows[r] += bonePalette[boneIndex.y * 3 + r] * IN.boneWeight.y;
+        rows[r] += bonePalette[boneIndex.z * 3 + r] * IN.boneWeight.z;
+        rows[r] += bonePalette[boneIndex.w * 3 + r] * IN.boneWeight.w;
+    }
+
+    float4 position = float4(IN.position, 1.0f);
+    OUT.position = float3(dot(rows[0], position), dot(rows[1], position), dot(rows[2], position));
+    OUT.normal = float3(dot(rows[0].xyz, IN.normal), dot(rows[1].xyz, IN.normal), dot(rows[2].xyz, IN.normal));
+}
+
+void skinDualQuaternion(a2v IN, uint4 boneIndex, inout SkinnedVertex OUT) {
+    // Later bones flipped into the hemisphere of the first one, so the blend takes the short way
+    float4 firstReal = bonePalette[boneIndex.x * 2];
+    float4 real = firstReal * IN.boneWeight.x;
+    float4 dual = bonePalette[boneIndex.x * 2 + 1] * IN.boneWeight.x;
+    [unroll]
+    for (uint i = 1; i < 4; ++i) {
+        float4 boneReal = bonePalette[boneIndex[i] * 2];
+        float weight = dot(boneReal, firstReal) < 0.0f ? -IN.boneWeight[i] : IN.boneWeight[i];
+        real += boneReal * weight;
+        dual += bonePalette[boneIndex[i] * 2 + 1] * weight;
+    }
+
+    float realLength = sqrt(dot(real, real));
+    float scale = realLength > 0.0f ? 1.0f / realLength : 0.0f;
+    real *= scale;
+    dual *= scale;
+
+    // v + 2 * q.xyz x (q.xyz x v + w * v), translation 2 * (w * d.xyz - d.w * q.xyz + q.xyz x d.xyz)
+    float3 translation = 2.0f * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+    OUT.position = IN.position + 2.0f * cross(real.xyz, cross(real.xyz, IN.position) + real.w * IN.position) +
+        translation;
+    OUT.normal = IN.normal + 2.0f * cross(real.xyz, cross(real.xyz, IN.normal) + real.w * IN.normal);
+}
+
+[RootSignature(ROOT_SIG)]
+[numthreads(64, 1, 1)]
+void main(uint3 dtid : SV_DispatchThreadID) {
+    uint vertexId = dtid.x;
+    if (vertexId >= Constants.vertexCount) {
+        return;
+    }
+
+    a2v IN = vertexBuffer[vertexId];
+    uint4 boneIndex = uint4(IN.boneIndices & 0xff, (IN.boneIndices >> 8) & 0xff, (IN.boneIndices >> 16) & 0xff,
+        IN.boneIndices >> 24);
+    SkinnedVertex OUT = (SkinnedVertex)0;
+    if (Constants.mode == kSkinningModeDualQuaternion) {
+        skinDualQuaternion(IN, boneIndex, OUT);
+    }
+    else {
+        skinLinear(IN, boneIndex, OUT);
+    }
+    OUT.uv0 = IN.uv0;
+    skinnedVertexBuffer[vertexId] = OUT;
+}
@@ -4,15 +4,24 @@
     ", CBV(b0, visibility=SHADER_VISIBILITY_VERTEX, flags=DATA_STATIC)"         \
     ", SRV(t0, visibility=SHADER_VISIBILITY_VERTEX)"                            \
     ", DescriptorTable("                                                        \
-    "    SRV(t1)"                                                               \
+    "    SRV(t0, space=1, numDescriptors=unbounded)"                            \
     "    , visibility=SHADER_VISIBILITY_PIXEL"                                  \
     "  )"                                                                       \
+    ", RootConstants(num32BitConstants=2, b1)"                                  \
+    ", SRV(t2, visibility=SHADER_VISIBILITY_VERTEX)"                            \
     ", StaticSampler(s0"                                                        \
     "    , filter=FILTER_MIN_MAG_MIP_LINEAR"                                    \
     "    , visibility=SHADER_VISIBILITY_PIXEL"                                  \
     "  )"
 
-Texture2D<float4> albedoTex : register(t1);
+struct DrawConstants {
+    uint instanceOffset;
+    uint materialTextureOffset;
+};
+
+// Material textures are contiguous, albedo first
+ConstantBuffer<DrawConstants> Draw : register(b1);
+Texture2D<float4> materialTextures[] : register(t0, space1);
 SamplerState linearSampler : register(s0);
 
 struct v2f {
@@ -22,6 +31,7 @@ struct v2f {
 
 [RootSignature(ROOT_SIG)]
 float4 main(v2f IN) : SV_TARGET0 {
+    Texture2D<float4> albedoTex = materialTextures[Draw.materialTextureOffset];
     return albedoTex.Sample(linearSampler, IN.uv0);
 }
 
@@ -4,9 +4,11 @@
     ", CBV(b0, visibility=SHADER_VISIBILITY_VERTEX, flags=DATA_STATIC)"         \
     ", SRV(t0, visibility=SHADER_VISIBILITY_VERTEX)"                            \
     ", DescriptorTable("                                                        \
-    "    SRV(t1)"                                                               \
+    "    SRV(t0, space=1, numDescriptors=unbounded)"                            \
     "    , visibility=SHADER_VISIBILITY_PIXEL"                                  \
     "  )"                                                                       \
+    ", RootConstants(num32BitConstants=2, b1)"                                  \
+    ", SRV(t2, visibility=SHADER_VISIBILITY_VERTEX)"                            \
     ", StaticSampler(s0"                                                        \
     "    , filter=FILTER_MIN_MAG_MIP_LINEAR"                                    \
     "    , visibility=SHADER_VISIBILITY_PIXEL"                                  \
@@ -17,6 +19,11 @@ struct Constants {
     float4x4 matVP;
 };
 
+struct DrawConstants {
+    uint instanceOffset;
+    uint materialTextureOffset;
+};
+
 struct a2v {
     float3 position;
     float3 normal;
@@ -29,15 +36,20 @@ struct v2f {
 };
 
 ConstantBuffer<Constants> Globals : register(b0);
+ConstantBuffer<DrawConstants> Draw : register(b1);
 StructuredBuffer<a2v> vertexBuffer : register(t0);
+StructuredBuffer<float4x4> instanceBuffer : register(t2);
 
 [RootSignature(ROOT_SIG)]
-v2f main(uint vid : SV_VertexID) {
+v2f main(uint vid : SV_VertexID, uint iid : SV_InstanceID) {
     a2v IN = vertexBuffer[vid];
+    float4x4 matInstanceW = instanceBuffer[Draw.instanceOffset + iid];
     v2f OUT;
 
-    float4 positionW = mul(float4(IN.position, 1.0f), Globals.matW);
-    OUT.position = mul(positionW, Globals.matVP);
+    // Precise and same operations as depth_prepass_vs.hlsl, so the EQUAL depth test passes after a prepass
+    precise float4 positionW = mul(mul(float4(IN.position, 1.0f), matInstanceW), Globals.matW);
+    precise float4 positionClip = mul(positionW, Globals.matVP);
+    OUT.position = positionClip;
     OUT.uv0 = IN.uv0;
 
     return OUT;
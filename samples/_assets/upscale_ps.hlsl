@@ -0,0 +1,35 @@
+// https://learn.microsoft.com/en-us/windows/win32/direct3d12/specifying-root-signatures-in-hlsl
+#define ROOT_SIG                                                                \
+    "RootFlags(0)"                                                              \
+    ", RootConstants(num32BitConstants=4, b0, visibility=SHADER_VISIBILITY_PIXEL)" \
+    ", DescriptorTable("                                                        \
+    "    SRV(t0)"                                                               \
+    "    , visibility=SHADER_VISIBILITY_PIXEL"                                  \
+    "  )"                                                                       \
+    ", StaticSampler(s0"                                                        \
+    "    , filter=FILTER_MIN_MAG_MIP_LINEAR"                                    \
+    "    , addressU=TEXTURE_ADDRESS_CLAMP"                                      \
+    "    , addressV=TEXTURE_ADDRESS_CLAMP"                                      \
+    "    , visibility=SHADER_VISIBILITY_PIXEL"                                  \
+    "  )"
+
+struct UpscaleConstants {
+    float2 uvScale;             // Rendered size over scene target size
+    float2 uvMax;               // Center of the last rendered texel, the rest of the target is stale
+};
+
+ConstantBuffer<UpscaleConstants> Upscale : register(b0);
+Texture2D<float4> sceneTex : register(t0);
+SamplerState linearSampler : register(s0);
+
+struct v2f {
+    float4 position     : SV_POSITION;
+    float2 uv0          : TEXCOORD0;
+};
+
+// Bilinear upscale of the rendered sub-rect of the scene target to the back buffer
+[RootSignature(ROOT_SIG)]
+float4 main(v2f IN) : SV_TARGET0 {
+    float2 uv = min(IN.uv0 * Upscale.uvScale, Upscale.uvMax);
+    return sceneTex.SampleLevel(linearSampler, uv, 0);
+}
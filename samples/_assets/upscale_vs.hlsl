@@ -0,0 +1,28 @@
+// https://learn.microsoft.com/en-us/windows/win32/direct3d12/specifying-root-signatures-in-hlsl
+#define ROOT_SIG                                                                \
+    "RootFlags(0)"                                                              \
+    ", RootConstants(num32BitConstants=4, b0, visibility=SHADER_VISIBILITY_PIXEL)" \
+    ", DescriptorTable("                                                        \
+    "    SRV(t0)"                                                               \
+    "    , visibility=SHADER_VISIBILITY_PIXEL"                                  \
+    "  )"                                                                       \
+    ", StaticSampler(s0"                                                        \
+    "    , filter=FILTER_MIN_MAG_MIP_LINEAR"                                    \
+    "    , addressU=TEXTURE_ADDRESS_CLAMP"                                      \
+    "    , addressV=TEXTURE_ADDRESS_CLAMP"                                      \
+    "    , visibility=SHADER_VISIBILITY_PIXEL"                                  \
+    "  )"
+
+struct v2f {
+    float4 position     : SV_POSITION;
+    float2 uv0          : TEXCOORD0;
+};
+
+// Single triangle covering the screen, uv is 0-1 over the back buffer
+[RootSignature(ROOT_SIG)]
+v2f main(uint vid : SV_VertexID) {
+    v2f OUT;
+    OUT.uv0 = float2((vid << 1) & 2, vid & 2);
+    OUT.position = float4(OUT.uv0 * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 0.0f, 1.0f);
+    return OUT;
+}
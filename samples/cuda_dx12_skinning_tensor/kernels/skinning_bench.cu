@@ -0,0 +1,814 @@
+// Skinning benchmark - sweeps vertex count, bone count, influence count and block size over the CUDA kernels and the
+// CPU paths, validates every run against fp32 skinning on the CPU and prints one JSON document on stdout.
+//
+// nvcc -O3 -std=c++17 -arch=sm_80 skinning_bench.cu -o skinning_bench
+// g++ -O2 -std=c++17 -pthread -x c++ skinning_bench.cu -o skinning_bench    (CPU backend only)
+//
+// skinning_bench [-vertices 65536,1048576] [-bones 58,256] [-influences 1,4,8] [-blocks 64,128,256]
+//     [-iterations 16] [-threads 0] [-backend all|cpu|cuda]
+//
+// Influences is the largest influence count of the generated vertices. The a2v kernels hold 4, so with more only the
+// compressed paths run. Batch runs skin 256 small characters in one launch or parallel-for and one call per
+// character, their vertex count is the batch output. Without a CUDA device the CUDA backend is skipped and reported as
+// unavailable. s2 frame runs time the pose upload, skeleton and vertex kernels of a crowd as direct launches and as one
+// CUDA graph replay, launch_ms is the CPU time spent issuing one iteration. dq runs skin with the dual quaternions of
+// the same palettes and are validated against dual quaternion skinning on the CPU. interop_ring pipelines skinning on
+// one thread with validation on another through the shared buffers and fences of fastdx_interop.h, CPU backend.
+// skeleton runs evaluate the palettes of the s2 crowd on the CPU, their vertex count is the joints evaluated.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "skinning_types.h"
+#define SKINNING_CPU_IMPLEMENTATION
+#include "skinning_cpu.h"
+#define SKINNING_COMPRESSED_IMPLEMENTATION
+#include "skinning_compressed.h"
+#define SKINNING_DQ_IMPLEMENTATION
+#include "skinning_dq.h"
+#define FASTDX_INTEROP_IMPLEMENTATION
+#include "../../../fastdx/fastdx_interop.h"
+#if defined(__CUDACC__)
+#include <cuda_runtime.h>
+#include "skinning_s0.cu"
+#include "skinning_s1.cu"
+#include "skinning_s2.cu"
+#include "skinning_s3.cu"
+#include "skinning_s4.cu"
+#include "skinning_s5.cu"
+#include "skinning_graph.cu"
+#endif
+
+// fp32 paths only differ from the reference by rounding order
+const float fp32_tolerance = 1e-4f;
+
+// s2 skins this many posed copies of the first vertex_count / crowd_instance_count vertices
+const int32_t crowd_instance_count = 16;
+
+// Batches are this many small characters of 1/2 to 5/4 of vertex_count / batch_instance_count vertices, 4 meshes
+// cut from the start of the vertices, each character with its own palette
+const int32_t batch_instance_count = 256;
+
+// Frames in flight of the interop_ring run, as many as the swap chain of the D3D12 sample
+const uint32_t interop_slot_count = 3;
+
+struct bench_config {
+    std::vector<uint32_t> vertex_counts = { 65536, 1024 * 1024 };
+    std::vector<int32_t> bone_counts = { 58, 256 };
+    std::vector<int32_t> influence_counts = { 1, 4, 8 };
+    std::vector<int32_t> block_sizes = { 64, 128, 256 };
+    uint32_t iterations = 16;
+    uint32_t thread_count = 0;
+    bool is_cpu_enabled = true;
+    bool is_cuda_enabled = true;
+};
+
+struct bench_case {
+    uint32_t vertex_count;
+    int32_t bone_count;
+    int32_t influence_count;
+};
+
+// Inputs of a case, shared by every backend
+struct bench_data {
+    bench_case config;
+    bool has_a2v;                           // At most 4 influences, the a2v kernels apply
+    std::vector<a2v> vertices;
+    std::vector<skinning::influences> influences;
+    std::vector<float> bones;
+    std::vector<v2f> reference;
+    std::vector<float> dual_quats;          // bones converted, only with has_a2v
+    std::vector<v2f> dq_reference;
+    skinning::compressed_mesh compressed[2];
+    std::vector<skinning::skin_instance> batch;     // Only with has_a2v
+    std::vector<float> batch_palettes;
+    std::vector<v2f> batch_reference;
+};
+
+struct bench_result {
+    const char* backend;
+    std::string kernel;
+    bench_case config;
+    int32_t block_size;                     // 0 for CPU runs
+    uint32_t thread_count;                  // 0 for CUDA runs
+    double ms;
+    double launch_ms;                       // CPU time issuing one iteration, 0 for CPU runs
+    double bytes_per_vertex;                // Input and output, for the effective bandwidth
+    float max_error;
+    float error_bound;
+};
+
+
+bool parse_list(const char* text, std::vector<int32_t>& out_values) {
+    out_values.clear();
+    for (const char* cursor = text; *cursor != '\0';) {
+        char* end = nullptr;
+        long value = strtol(cursor, &end, 10);
+        if (end == cursor || value <= 0) {
+            return false;
+        }
+        out_values.push_back(static_cast<int32_t>(value));
+        cursor = *end == ',' ? end + 1 : end;
+    }
+    return !out_values.empty();
+}
+
+
+bool parse_args(int argc, char** argv, bench_config& config) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::vector<int32_t> values;
+        const char* name = argv[i];
+        const char* value = argv[i + 1];
+        if (strcmp(name, "-backend") == 0) {
+            config.is_cpu_enabled = strcmp(value, "cuda") != 0;
+            config.is_cuda_enabled = strcmp(value, "cpu") != 0;
+            continue;
+        }
+        if (!parse_list(value, values) && strcmp(name, "-threads") != 0) {
+            return false;
+        }
+        if (strcmp(name, "-vertices") == 0) {
+            config.vertex_counts.assign(values.begin(), values.end());
+        }
+        else if (strcmp(name, "-bones") == 0) {
+            config.bone_counts = values;
+        }
+        else if (strcmp(name, "-influences") == 0) {
+            config.influence_counts = values;
+        }
+        else if (strcmp(name, "-blocks") == 0) {
+            config.block_sizes = values;
+        }
+        else if (strcmp(name, "-iterations") == 0) {
+            config.iterations = values[0];
+        }
+        else if (strcmp(name, "-threads") == 0) {
+            config.thread_count = static_cast<uint32_t>(atoi(value));
+        }
+        else {
+            return false;
+        }
+    }
+    for (int32_t bone_count : config.bone_counts) {
+        if (bone_count > skinning_max_bones) {
+            return false;
+        }
+    }
+    return (argc % 2) == 1;
+}
+
+
+void make_bench_data(const bench_case& config, bench_data& out_data) {
+    out_data.config = config;
+    out_data.has_a2v = config.influence_count <= 4;
+    out_data.vertices.resize(config.vertex_count);
+    out_data.influences.resize(config.vertex_count);
+    out_data.bones.resize(config.bone_count * skinning_floats_per_bone);
+    out_data.reference.resize(config.vertex_count);
+    skinning::generate_bones(out_data.bones.data(), config.bone_count, 1);
+    skinning::generate_vertices(out_data.vertices.data(), config.vertex_count, config.bone_count, 2);
+    skinning::generate_influences(out_data.influences.data(), config.vertex_count, config.bone_count,
+        config.influence_count, 3);
+
+    // a2v records carry the same first 4 influences, complete when has_a2v
+    for (uint32_t i = 0; i < config.vertex_count; ++i) {
+        for (int32_t j = 0; j < 4; ++j) {
+            out_data.vertices[i].bone_index[j] = out_data.influences[i].bone_index[j];
+            out_data.vertices[i].bone_weight[j] = out_data.influences[i].bone_weight[j];
+        }
+    }
+    skinning::skin_influences(out_data.vertices.data(), out_data.influences.data(), out_data.reference.data(),
+        config.vertex_count, out_data.bones.data());
+    for (int32_t f = 0; f < 2; ++f) {
+        skinning::compress_mesh(out_data.vertices.data(), out_data.influences.data(), config.vertex_count,
+            static_cast<skinning::weight_format>(f), out_data.compressed[f]);
+    }
+
+    if (out_data.has_a2v) {
+        out_data.dual_quats.resize(config.bone_count * skinning_floats_per_dual_quat);
+        out_data.dq_reference.resize(config.vertex_count);
+        skinning::palette_to_dual_quats(out_data.bones.data(), config.bone_count, out_data.dual_quats.data());
+        skinning::skin_dq_scalar(out_data.vertices.data(), out_data.dq_reference.data(), 0, config.vertex_count,
+            out_data.dual_quats.data());
+    }
+
+    out_data.batch.clear();
+    out_data.batch_reference.clear();
+    uint32_t batch_vertex_count = config.vertex_count / batch_instance_count;
+    if (!out_data.has_a2v || batch_vertex_count < 2) {
+        return;
+    }
+    uint32_t out_begin = 0;
+    out_data.batch_palettes.resize(batch_instance_count * config.bone_count * skinning_floats_per_bone);
+    for (int32_t i = 0; i < batch_instance_count; ++i) {
+        skinning::skin_instance instance;
+        instance.vertex_begin = (i % 4) * batch_vertex_count;
+        instance.vertex_count = batch_vertex_count * (2 + i % 4) / 4;
+        instance.palette_offset = i * config.bone_count;
+        instance.bone_count = config.bone_count;
+        instance.out_begin = out_begin;
+        out_begin += instance.vertex_count;
+        out_data.batch.push_back(instance);
+
+        float* palette = &out_data.batch_palettes[instance.palette_offset * skinning_floats_per_bone];
+        skinning::generate_bones(palette, config.bone_count, 10 + i);
+        out_data.batch_reference.resize(out_begin);
+        skinning::skin_influences(&out_data.vertices[instance.vertex_begin],
+            &out_data.influences[instance.vertex_begin], &out_data.batch_reference[instance.out_begin],
+            instance.vertex_count, palette);
+    }
+}
+
+
+template <typename Func>
+double measure_cpu_ms(uint32_t iterations, Func func) {
+    func();
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        func();
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end_time - start_time).count() / std::max(iterations, 1u);
+}
+
+
+// A producer thread skins frames into a ring of shared buffers, a consumer thread compares each with the reference.
+// Slots are cleared before skinning, so a frame read before it is produced, or rewritten while read, shows in the
+// error. Every slot is reused at least once. Returns ms per frame.
+double measure_interop_ring_ms(uint32_t iterations, const bench_data& data, float& out_error) {
+    uint32_t vertex_count = data.config.vertex_count;
+    uint32_t frame_count = iterations + interop_slot_count;
+    fastdx::SharedBufferRing ring;
+    out_error = INFINITY;
+    if (!ring.create(fastdx::createCpuInterop(), interop_slot_count, vertex_count * sizeof(v2f))) {
+        return 0.0;
+    }
+
+    float error = 0.0f;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    std::thread consumer([&]() {
+        for (uint32_t f = 0; f < frame_count; ++f) {
+            const v2f* vertices = static_cast<const v2f*>(ring.buffer(ring.beginConsume())->data);
+            error = std::max(error, skinning::max_error(data.reference.data(), vertices, vertex_count));
+            ring.endConsume();
+        }
+    });
+    for (uint32_t f = 0; f < frame_count; ++f) {
+        v2f* vertices = static_cast<v2f*>(ring.buffer(ring.beginProduce())->data);
+        memset(vertices, 0, vertex_count * sizeof(v2f));
+        skinning::skin_scalar(data.vertices.data(), vertices, 0, vertex_count, data.bones.data());
+        ring.endProduce();
+    }
+    ring.waitIdle();
+    consumer.join();
+    auto end_time = std::chrono::high_resolution_clock::now();
+
+    out_error = error;
+    return std::chrono::duration<double, std::milli>(end_time - start_time).count() / frame_count;
+}
+
+
+void run_cpu(const bench_config& config, const bench_data& data, std::vector<bench_result>& results) {
+    const bench_case& c = data.config;
+    const float* bones = data.bones.data();
+    uint32_t thread_count = config.thread_count > 0 ? config.thread_count :
+        std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<v2f> out_vertices(c.vertex_count);
+    skinning::soa_v2f soa_out_vertices;
+    soa_out_vertices.resize(c.vertex_count);
+
+    auto add_result = [&](const char* kernel, uint32_t threads, double ms, double bytes_per_vertex, float bound) {
+        float error = skinning::max_error(data.reference.data(), out_vertices.data(), c.vertex_count);
+        results.push_back({ "cpu", kernel, c, 0, threads, ms, 0.0, bytes_per_vertex, error, bound });
+    };
+
+    if (data.has_a2v) {
+        double a2v_bytes = sizeof(a2v) + sizeof(v2f);
+        skinning::soa_a2v soa_vertices;
+        skinning::to_soa(data.vertices.data(), c.vertex_count, soa_vertices);
+
+        double ms = measure_cpu_ms(config.iterations, [&]() {
+            skinning::skin_scalar(data.vertices.data(), out_vertices.data(), 0, c.vertex_count, bones);
+        });
+        add_result("scalar", 1, ms, a2v_bytes, fp32_tolerance);
+
+        struct soa_path { const char* name; skinning::cpu_variant variant; bool is_supported; uint32_t threads; };
+        const soa_path soa_paths[] = {
+            { "soa_scalar", skinning::cpu_variant::soa_scalar, true, 1 },
+            { "avx2", skinning::cpu_variant::avx2, skinning::has_avx2(), 1 },
+            { "avx512", skinning::cpu_variant::avx512, skinning::has_avx512(), 1 },
+            { "threaded", skinning::cpu_variant::best, true, thread_count },
+        };
+        for (const soa_path& path : soa_paths) {
+            if (!path.is_supported) {
+                continue;
+            }
+            ms = measure_cpu_ms(config.iterations, [&]() {
+                skinning::skin_soa(path.variant, soa_vertices, soa_out_vertices, bones, path.threads);
+            });
+            skinning::from_soa(soa_out_vertices, out_vertices.data());
+            add_result(path.name, path.threads, ms, a2v_bytes, fp32_tolerance);
+        }
+
+        float ring_error = 0.0f;
+        ms = measure_interop_ring_ms(config.iterations, data, ring_error);
+        results.push_back({ "cpu", "interop_ring", c, 0, 2, ms, 0.0, a2v_bytes, ring_error, fp32_tolerance });
+
+        // Dual quaternion skinning of the same palette, against its own scalar reference
+        auto add_dq_result = [&](const std::string& kernel, uint32_t threads, double dq_ms) {
+            float error = skinning::max_error(data.dq_reference.data(), out_vertices.data(), c.vertex_count);
+            results.push_back({ "cpu", kernel, c, 0, threads, dq_ms, 0.0, a2v_bytes, error, fp32_tolerance });
+        };
+        const float* dual_quats = data.dual_quats.data();
+        ms = measure_cpu_ms(config.iterations, [&]() {
+            skinning::skin_dq_scalar(data.vertices.data(), out_vertices.data(), 0, c.vertex_count, dual_quats);
+        });
+        add_dq_result("dq_scalar", 1, ms);
+        for (const soa_path& path : soa_paths) {
+            if (!path.is_supported) {
+                continue;
+            }
+            ms = measure_cpu_ms(config.iterations, [&]() {
+                skinning::skin_soa(skinning_mode::dual_quaternion, path.variant, soa_vertices, soa_out_vertices,
+                    dual_quats, path.threads);
+            });
+            skinning::from_soa(soa_out_vertices, out_vertices.data());
+            add_dq_result(std::string("dq_") + path.name, path.threads, ms);
+        }
+
+        ms = measure_cpu_ms(config.iterations, [&]() {
+            skinning::skin_gemm(skinning::gemm_precision::fp16, data.vertices.data(), out_vertices.data(), 0,
+                c.vertex_count, bones, c.bone_count);
+        });
+        add_result("gemm_fp16", 1, ms, a2v_bytes, skinning::gemm_error_bound(skinning::gemm_precision::fp16,
+            data.vertices.data(), c.vertex_count, bones, c.bone_count));
+
+        // Batch of small characters in one parallel-for, against one threaded call per character
+        if (!data.batch.empty()) {
+            bench_case batch_case = { static_cast<uint32_t>(data.batch_reference.size()), c.bone_count,
+                c.influence_count };
+            std::vector<v2f> batch_vertices(batch_case.vertex_count);
+            uint32_t instance_count = static_cast<uint32_t>(data.batch.size());
+            auto add_batch_result = [&](const char* kernel, double batch_ms) {
+                skinning::from_soa(soa_out_vertices, batch_vertices.data());
+                float error = skinning::max_error(data.batch_reference.data(), batch_vertices.data(),
+                    batch_case.vertex_count);
+                results.push_back({ "cpu", kernel, batch_case, 0, thread_count, batch_ms, 0.0, a2v_bytes, error,
+                    fp32_tolerance });
+            };
+
+            soa_out_vertices = skinning::soa_v2f();
+            soa_out_vertices.resize(batch_case.vertex_count);
+            ms = measure_cpu_ms(config.iterations, [&]() {
+                skinning::skin_batch(skinning::cpu_variant::best, soa_vertices, soa_out_vertices, data.batch.data(),
+                    instance_count, data.batch_palettes.data(), thread_count);
+            });
+            add_batch_result("batch", ms);
+
+            soa_out_vertices = skinning::soa_v2f();
+            soa_out_vertices.resize(batch_case.vertex_count);
+            ms = measure_cpu_ms(config.iterations, [&]() {
+                for (uint32_t i = 0; i < instance_count; ++i) {
+                    skinning::skin_batch(skinning::cpu_variant::best, soa_vertices, soa_out_vertices, &data.batch[i],
+                        1, data.batch_palettes.data(), thread_count);
+                }
+            });
+            add_batch_result("batch_per_instance", ms);
+            soa_out_vertices.resize(c.vertex_count);
+        }
+    }
+
+    std::vector<uint32_t> thread_counts = { 1 };
+    if (thread_count > 1) {
+        thread_counts.push_back(thread_count);
+    }
+    for (int32_t f = 0; f < 2; ++f) {
+        const skinning::compressed_mesh& mesh = data.compressed[f];
+        skinning::weight_format format = static_cast<skinning::weight_format>(f);
+        float bound = skinning::compressed_error_bound(format, data.vertices.data(), data.influences.data(),
+            c.vertex_count, bones, c.bone_count);
+        std::string name = f == 0 ? "compressed_unorm8" : "compressed_unorm16";
+        for (uint32_t threads : thread_counts) {
+            double ms = measure_cpu_ms(config.iterations, [&]() {
+                skinning::skin_compressed(skinning::cpu_variant::best, mesh, soa_out_vertices, bones, threads);
+            });
+            skinning::unsort_v2f(mesh, soa_out_vertices, out_vertices.data());
+            add_result((threads == 1 ? name : name + "_threaded").c_str(), threads, ms,
+                mesh.bytes_per_vertex() + sizeof(v2f), bound);
+        }
+    }
+
+    // Skeleton stage of the s2 crowd on its own, the vertex stage is timed above. Its vertex count is the joints
+    // evaluated, bytes are the local pose read and the palette entry written per joint.
+    skinning::skeleton rig;
+    skinning::generate_skeleton(rig, c.bone_count, 3);
+    uint32_t joint_count = crowd_instance_count * c.bone_count;
+    std::vector<joint_trs> poses(joint_count);
+    std::vector<float> reference_palettes(joint_count * skinning_floats_per_bone);
+    std::vector<float> palettes(reference_palettes.size());
+    skinning::generate_poses(rig, poses.data(), crowd_instance_count, 4);
+    for (int32_t instance = 0; instance < crowd_instance_count; ++instance) {
+        skinning::evaluate_skeleton(rig, &poses[instance * c.bone_count],
+            &reference_palettes[instance * c.bone_count * skinning_floats_per_bone]);
+    }
+    bench_case skeleton_case = { joint_count, c.bone_count, c.influence_count };
+    for (uint32_t threads : thread_counts) {
+        std::fill(palettes.begin(), palettes.end(), 0.0f);
+        double ms = measure_cpu_ms(config.iterations, [&]() {
+            skinning::evaluate_skeletons(rig, poses.data(), crowd_instance_count, palettes.data(), threads);
+        });
+        float error = 0.0f;
+        for (size_t i = 0; i < palettes.size(); ++i) {
+            error = std::max(error, fabsf(palettes[i] - reference_palettes[i]));
+        }
+        results.push_back({ "cpu", threads == 1 ? "skeleton" : "skeleton_threaded", skeleton_case, 0, threads, ms,
+            0.0, sizeof(joint_trs) + skinning_floats_per_bone * sizeof(float), error, fp32_tolerance });
+    }
+}
+
+
+#if defined(__CUDACC__)
+bool has_cuda_device() {
+    int32_t device_count = 0;
+    return cudaGetDeviceCount(&device_count) == cudaSuccess && device_count > 0;
+}
+
+
+void run_cuda(const bench_config& config, const bench_data& data, std::vector<bench_result>& results) {
+    const bench_case& c = data.config;
+    int32_t vertex_count = static_cast<int32_t>(c.vertex_count);
+    int32_t bone_count = c.bone_count;
+    size_t shared_mem_size = bone_palette_shared_size(bone_count);
+
+    palette_uploader uploader;
+    create_palette_uploader(uploader, skinning_max_bones);
+    const float4* device_bones = upload_palette(uploader, data.bones.data(), bone_count, 0);
+
+    // Packed records for s0, SoA streams for s1 to s3, compressed streams for s4
+    a2v* input_vertices = nullptr;
+    v2f* output_vertices = nullptr;
+    cudaMalloc(&input_vertices, vertex_count * sizeof(a2v));
+    cudaMalloc(&output_vertices, vertex_count * sizeof(v2f));
+    cudaMemcpy(input_vertices, data.vertices.data(), vertex_count * sizeof(a2v), cudaMemcpyHostToDevice);
+
+    skinning::soa_a2v_layout input_layout = skinning::make_a2v_layout(vertex_count);
+    skinning::soa_v2f_layout output_layout = skinning::make_v2f_layout(vertex_count);
+    std::vector<uint8_t> host_streams(input_layout.size_in_bytes);
+    skinning::pack_a2v(data.vertices.data(), vertex_count, input_layout, host_streams.data());
+    uint8_t* input_streams = nullptr;
+    uint8_t* output_streams = nullptr;
+    cudaMalloc(&input_streams, input_layout.size_in_bytes);
+    cudaMalloc(&output_streams, output_layout.size_in_bytes);
+    cudaMemcpy(input_streams, host_streams.data(), input_layout.size_in_bytes, cudaMemcpyHostToDevice);
+    a2v_streams input_soa = make_a2v_streams(input_streams, input_layout);
+    v2f_streams output_soa = make_v2f_streams(output_streams, output_layout);
+
+    uint8_t* compressed_buffers[2] = {};
+    compressed_streams compressed_soa[2];
+    for (int32_t f = 0; f < 2; ++f) {
+        skinning::compressed_layout layout = skinning::make_compressed_layout(data.compressed[f]);
+        std::vector<uint8_t> host_compressed(layout.size_in_bytes);
+        skinning::pack_compressed(data.compressed[f], layout, host_compressed.data());
+        cudaMalloc(&compressed_buffers[f], layout.size_in_bytes);
+        cudaMemcpy(compressed_buffers[f], host_compressed.data(), layout.size_in_bytes, cudaMemcpyHostToDevice);
+        compressed_soa[f] = make_compressed_streams(compressed_buffers[f], layout);
+    }
+
+    // s2 crowd: posed copies of one skeleton over the first crowd_vertex_count vertices, CPU palettes as reference
+    int32_t crowd_vertex_count = vertex_count / crowd_instance_count;
+    int32_t crowd_total_count = crowd_vertex_count * crowd_instance_count;
+    skinning::skeleton rig;
+    skinning::generate_skeleton(rig, bone_count, 3);
+    std::vector<joint_trs> host_poses(crowd_instance_count * bone_count);
+    std::vector<float> host_palettes(crowd_instance_count * bone_count * skinning_floats_per_bone);
+    std::vector<float> host_dual_quats(crowd_instance_count * bone_count * skinning_floats_per_dual_quat);
+    std::vector<v2f> crowd_reference(crowd_total_count), crowd_dq_reference(crowd_total_count);
+    skinning::generate_poses(rig, host_poses.data(), crowd_instance_count, 4);
+    skinning::evaluate_skeletons(rig, host_poses.data(), crowd_instance_count, host_palettes.data());
+    skinning::evaluate_skeletons_dq(rig, host_poses.data(), crowd_instance_count, host_dual_quats.data());
+    for (int32_t instance = 0; instance < crowd_instance_count; ++instance) {
+        skinning::skin_influences(data.vertices.data(), data.influences.data(),
+            &crowd_reference[instance * crowd_vertex_count], crowd_vertex_count,
+            &host_palettes[instance * bone_count * skinning_floats_per_bone]);
+        skinning::skin_dq_scalar(data.vertices.data(), &crowd_dq_reference[instance * crowd_vertex_count], 0,
+            crowd_vertex_count, &host_dual_quats[instance * bone_count * skinning_floats_per_dual_quat]);
+    }
+    skeleton_device device_rig;
+    joint_trs* device_poses = nullptr;
+    float4* device_palettes = nullptr;
+    create_skeleton_device(device_rig, rig);
+    cudaMalloc(&device_poses, host_poses.size() * sizeof(joint_trs));
+    cudaMalloc(&device_palettes, crowd_instance_count * shared_mem_size);
+    cudaMemcpy(device_poses, host_poses.data(), host_poses.size() * sizeof(joint_trs), cudaMemcpyHostToDevice);
+
+    // The same crowd as a frame, poses uploaded every iteration, issued directly and as a graph on a created stream
+    skinning_graph frame_graph;
+    cudaStream_t frame_stream;
+    create_skinning_graph(frame_graph, crowd_instance_count, bone_count);
+    cudaStreamCreate(&frame_stream);
+
+    // Batch instances share the input streams, palettes are uploaded once
+    float4* device_batch_palettes = nullptr;
+    if (!data.batch.empty()) {
+        cudaMalloc(&device_batch_palettes, data.batch_palettes.size() * sizeof(float));
+        cudaMemcpy(device_batch_palettes, data.batch_palettes.data(), data.batch_palettes.size() * sizeof(float),
+            cudaMemcpyHostToDevice);
+    }
+    auto offset_a2v = [](a2v_streams streams, size_t offset) {
+        for (int32_t i = 0; i < 3; ++i) {
+            streams.position[i] += offset;
+            streams.normal[i] += offset;
+        }
+        for (int32_t i = 0; i < 4; ++i) {
+            streams.bone_weight[i] += offset;
+            streams.uv[i] += offset;
+        }
+        streams.bone_index += offset;
+        return streams;
+    };
+    auto offset_v2f = [](v2f_streams streams, size_t offset) {
+        for (int32_t i = 0; i < 3; ++i) {
+            streams.position[i] += offset;
+            streams.normal[i] += offset;
+        }
+        for (int32_t i = 0; i < 4; ++i) {
+            streams.uv[i] += offset;
+        }
+        return streams;
+    };
+
+    cudaEvent_t start, stop;
+    cudaEventCreate(&start);
+    cudaEventCreate(&stop);
+    double launch_ms = 0.0;
+    auto measure_ms = [&](auto launch_kernel) {
+        launch_kernel();
+        cudaEventRecord(start);
+        auto start_time = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < config.iterations; ++i) {
+            launch_kernel();
+        }
+        auto end_time = std::chrono::high_resolution_clock::now();
+        launch_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count() /
+            std::max(config.iterations, 1u);
+        cudaEventRecord(stop);
+        cudaEventSynchronize(stop);
+
+        float elapsed_ms = 0.0f;
+        cudaEventElapsedTime(&elapsed_ms, start, stop);
+        return elapsed_ms / static_cast<float>(std::max(config.iterations, 1u));
+    };
+
+    // Outputs are cleared before every kernel, so a kernel that writes nothing can not pass on a previous result
+    std::vector<v2f> gpu_vertices(vertex_count), sorted_vertices(vertex_count);
+    std::vector<uint8_t> gpu_streams(output_layout.size_in_bytes);
+    auto read_streams = [&](size_t read_count) {
+        cudaMemcpy(gpu_streams.data(), output_streams, output_layout.size_in_bytes, cudaMemcpyDeviceToHost);
+        skinning::unpack_v2f(gpu_streams.data(), read_count, output_layout, gpu_vertices.data());
+    };
+    auto add_result = [&](const char* kernel, int32_t block_size, float ms, double bytes_per_vertex,
+        const std::vector<v2f>& reference, size_t compare_count, float bound) {
+        float error = skinning::max_error(reference.data(), gpu_vertices.data(), compare_count);
+        if (cudaGetLastError() != cudaSuccess) {
+            error = INFINITY;
+        }
+        // Crowds and batches skin fewer vertices than the case, throughput is per skinned vertex
+        bench_case run_case = c;
+        run_case.vertex_count = static_cast<uint32_t>(compare_count);
+        results.push_back({ "cuda", kernel, run_case, block_size, 0, ms, launch_ms, bytes_per_vertex, error, bound });
+    };
+
+    double a2v_bytes = sizeof(a2v) + sizeof(v2f);
+    for (int32_t block_size : config.block_sizes) {
+        int32_t block_count = (vertex_count + block_size - 1) / block_size;
+        if (data.has_a2v) {
+            cudaMemset(output_vertices, 0, vertex_count * sizeof(v2f));
+            float ms = measure_ms([&]() {
+                skinning_kernel<<<block_count, block_size, shared_mem_size>>>(input_vertices, output_vertices,
+                    vertex_count, device_bones, bone_count);
+            });
+            cudaMemcpy(gpu_vertices.data(), output_vertices, vertex_count * sizeof(v2f), cudaMemcpyDeviceToHost);
+            add_result("s0", block_size, ms, a2v_bytes, data.reference, vertex_count, fp32_tolerance);
+
+            cudaMemset(output_streams, 0, output_layout.size_in_bytes);
+            ms = measure_ms([&]() {
+                skinning_kernel_s1<<<block_count, block_size, shared_mem_size>>>(input_soa, output_soa, vertex_count,
+                    device_bones, bone_count);
+            });
+            read_streams(vertex_count);
+            add_result("s1", block_size, ms, a2v_bytes, data.reference, vertex_count, fp32_tolerance);
+
+            cudaMemset(output_streams, 0, output_layout.size_in_bytes);
+            ms = measure_ms([&]() {
+                const float4* frame_bones = upload_palette(uploader, data.bones.data(), bone_count, 0);
+                skinning_kernel_s1<<<block_count, block_size, shared_mem_size>>>(input_soa, output_soa, vertex_count,
+                    frame_bones, bone_count);
+            });
+            read_streams(vertex_count);
+            add_result("s1_palette_upload", block_size, ms, a2v_bytes, data.reference, vertex_count, fp32_tolerance);
+
+            cudaMemset(output_streams, 0, output_layout.size_in_bytes);
+            ms = measure_ms([&]() {
+                launch_skinning_s2(device_rig, device_poses, device_palettes, crowd_instance_count, input_soa,
+                    output_soa, crowd_vertex_count, block_size, 0);
+            });
+            read_streams(crowd_total_count);
+            add_result("s2_crowd", block_size, ms, a2v_bytes, crowd_reference, crowd_total_count, fp32_tolerance);
+
+            cudaMemset(output_streams, 0, output_layout.size_in_bytes);
+            ms = measure_ms([&]() {
+                launch_skinning_s2(device_rig, device_poses, device_palettes, crowd_instance_count, input_soa,
+                    output_soa, crowd_vertex_count, block_size, 0, skinning_mode::dual_quaternion);
+            });
+            read_streams(crowd_total_count);
+            add_result("s2_crowd_dq", block_size, ms, a2v_bytes, crowd_dq_reference, crowd_total_count,
+                fp32_tolerance);
+
+            skinning_frame frame = { device_rig, crowd_instance_count, input_soa, output_soa, crowd_vertex_count,
+                block_size, skinning_mode::linear };
+            cudaMemset(output_streams, 0, output_layout.size_in_bytes);
+            ms = measure_ms([&]() {
+                launch_skinning_frame(frame_graph, frame, host_poses.data(), frame_stream);
+            });
+            read_streams(crowd_total_count);
+            add_result("s2_frame", block_size, ms, a2v_bytes, crowd_reference, crowd_total_count, fp32_tolerance);
+
+            // A new block size is a new shape, the first replay captures again and updates the graph exec. A failed
+            // capture or launch is left in cudaGetLastError for add_result.
+            cudaMemset(output_streams, 0, output_layout.size_in_bytes);
+            ms = measure_ms([&]() {
+                launch_skinning_graph(frame_graph, frame, host_poses.data(), frame_stream);
+            });
+            read_streams(crowd_total_count);
+            add_result("s2_frame_graph", block_size, ms, a2v_bytes, crowd_reference, crowd_total_count,
+                fp32_tolerance);
+
+            int32_t warp_count = block_size / 32;
+            if (warp_count > 0) {
+                int32_t tensor_block_count = (vertex_count + warp_count * skinning_gemm_tile - 1) /
+                    (warp_count * skinning_gemm_tile);
+                cudaMemset(output_streams, 0, output_layout.size_in_bytes);
+                ms = measure_ms([&]() {
+                    skinning_kernel_s3<<<tensor_block_count, warp_count * 32,
+                        tensor_shared_size(bone_count, warp_count)>>>(input_soa, output_soa, vertex_count, device_bones,
+                        bone_count);
+                });
+                read_streams(vertex_count);
+                add_result("s3_tensor_fp16", block_size, ms, a2v_bytes, data.reference, vertex_count,
+                    skinning::gemm_error_bound(skinning::gemm_precision::fp16, data.vertices.data(), vertex_count,
+                        data.bones.data(), bone_count));
+            }
+
+            // Batch of small characters in one launch, against one s1 launch per character
+            if (!data.batch.empty()) {
+                size_t batch_count = data.batch_reference.size();
+                skin_batch_device batch;
+                create_skin_batch_device(batch, data.batch.data(), static_cast<int32_t>(data.batch.size()),
+                    block_size);
+                cudaMemset(output_streams, 0, output_layout.size_in_bytes);
+                ms = measure_ms([&]() {
+                    launch_skinning_s5(batch, input_soa, output_soa, device_batch_palettes, 0);
+                });
+                read_streams(batch_count);
+                add_result("s5_batch", block_size, ms, a2v_bytes, data.batch_reference, batch_count, fp32_tolerance);
+                destroy_skin_batch_device(batch);
+
+                cudaMemset(output_streams, 0, output_layout.size_in_bytes);
+                ms = measure_ms([&]() {
+                    for (const skinning::skin_instance& instance : data.batch) {
+                        int32_t instance_block_count = (instance.vertex_count + block_size - 1) / block_size;
+                        skinning_kernel_s1<<<instance_block_count, block_size, shared_mem_size>>>(
+                            offset_a2v(input_soa, instance.vertex_begin), offset_v2f(output_soa, instance.out_begin),
+                            instance.vertex_count, device_batch_palettes + size_t(instance.palette_offset) * 3,
+                            instance.bone_count);
+                    }
+                });
+                read_streams(batch_count);
+                add_result("s1_per_instance", block_size, ms, a2v_bytes, data.batch_reference, batch_count,
+                    fp32_tolerance);
+            }
+        }
+
+        for (int32_t f = 0; f < 2; ++f) {
+            const skinning::compressed_mesh& mesh = data.compressed[f];
+            cudaMemset(output_streams, 0, output_layout.size_in_bytes);
+            float ms = measure_ms([&]() {
+                launch_skinning_s4(mesh, compressed_soa[f], output_soa, device_bones, bone_count, block_size, 0);
+            });
+            cudaMemcpy(gpu_streams.data(), output_streams, output_layout.size_in_bytes, cudaMemcpyDeviceToHost);
+            skinning::unpack_v2f(gpu_streams.data(), vertex_count, output_layout, sorted_vertices.data());
+            for (int32_t i = 0; i < vertex_count; ++i) {
+                gpu_vertices[mesh.source_index[i]] = sorted_vertices[i];
+            }
+            add_result(f == 0 ? "s4_unorm8" : "s4_unorm16", block_size, ms, mesh.bytes_per_vertex() + sizeof(v2f),
+                data.reference, vertex_count, skinning::compressed_error_bound(static_cast<skinning::weight_format>(f),
+                    data.vertices.data(), data.influences.data(), vertex_count, data.bones.data(), bone_count));
+        }
+    }
+
+    cudaEventDestroy(start);
+    cudaEventDestroy(stop);
+    cudaFree(device_poses);
+    cudaFree(device_palettes);
+    cudaFree(device_batch_palettes);
+    cudaStreamDestroy(frame_stream);
+    destroy_skinning_graph(frame_graph);
+    destroy_skeleton_device(device_rig);
+    for (uint8_t* buffer : compressed_buffers) {
+        cudaFree(buffer);
+    }
+    cudaFree(input_vertices);
+    cudaFree(output_vertices);
+    cudaFree(input_streams);
+    cudaFree(output_streams);
+    destroy_palette_uploader(uploader);
+}
+#endif
+
+
+void print_json(const char* device_name, bool is_cuda_available, uint32_t thread_count,
+    const std::vector<bench_result>& results) {
+    printf("{\n");
+    printf("  \"device\": %s%s%s,\n", device_name ? "\"" : "", device_name ? device_name : "null",
+        device_name ? "\"" : "");
+    printf("  \"cuda_available\": %s,\n", is_cuda_available ? "true" : "false");
+    printf("  \"cpu_threads\": %u,\n", thread_count);
+    printf("  \"avx2\": %s,\n", skinning::has_avx2() ? "true" : "false");
+    printf("  \"avx512\": %s,\n", skinning::has_avx512() ? "true" : "false");
+    printf("  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const bench_result& r = results[i];
+        double vertices_per_second = r.ms > 0.0 ? r.config.vertex_count / (r.ms * 1e-3) : 0.0;
+        printf("    { \"backend\": \"%s\", \"kernel\": \"%s\", \"vertices\": %u, \"bones\": %d, \"influences\": %d, "
+            "\"block_size\": %d, \"threads\": %u, \"ms\": %.4f, \"launch_ms\": %.4f, "
+            "\"vertices_per_second\": %.4g, \"bytes_per_vertex\": %.2f, \"gb_per_second\": %.3f, \"max_error\": %g, "
+            "\"error_bound\": %g, \"valid\": %s }%s\n", r.backend, r.kernel.c_str(), r.config.vertex_count,
+            r.config.bone_count, r.config.influence_count, r.block_size, r.thread_count, r.ms, r.launch_ms,
+            vertices_per_second, r.bytes_per_vertex, vertices_per_second * r.bytes_per_vertex * 1e-9, r.max_error,
+            r.error_bound, r.max_error <= r.error_bound ? "true" : "false", i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+
+int main(int argc, char** argv) {
+    bench_config config;
+    if (!parse_args(argc, argv, config)) {
+        fprintf(stderr, "usage: %s [-vertices n,...] [-bones n,...] [-influences n,...] [-blocks n,...] "
+            "[-iterations n] [-threads n] [-backend all|cpu|cuda]\n", argv[0]);
+        return 1;
+    }
+
+    bool is_cuda_available = false;
+    const char* device_name = nullptr;
+#if defined(__CUDACC__)
+    cudaDeviceProp prop;
+    is_cuda_available = config.is_cuda_enabled && has_cuda_device();
+    if (is_cuda_available) {
+        printDeviceProp();
+        int32_t device = 0;
+        cudaGetDevice(&device);
+        cudaGetDeviceProperties(&prop, device);
+        device_name = prop.name;
+    }
+#endif
+
+    std::vector<bench_result> results;
+    bench_data data;
+    for (uint32_t vertex_count : config.vertex_counts) {
+        for (int32_t bone_count : config.bone_counts) {
+            for (int32_t influence_count : config.influence_counts) {
+                fprintf(stderr, "vertices %u, bones %d, influences %d\n", vertex_count, bone_count, influence_count);
+                make_bench_data({ vertex_count, bone_count, std::min(influence_count, 8) }, data);
+                if (config.is_cpu_enabled) {
+                    run_cpu(config, data, results);
+                }
+#if defined(__CUDACC__)
+                if (is_cuda_available) {
+                    run_cuda(config, data, results);
+                }
+#endif
+            }
+        }
+    }
+
+    uint32_t thread_count = config.thread_count > 0 ? config.thread_count :
+        std::max(std::thread::hardware_concurrency(), 1u);
+    print_json(device_name, is_cuda_available, thread_count, results);
+
+    size_t invalid_count = std::count_if(results.begin(), results.end(),
+        [](const bench_result& r) { return !(r.max_error <= r.error_bound); });
+#if defined(__CUDACC__)
+    if (is_cuda_available) {
+        cudaDeviceReset();
+    }
+#endif
+    return invalid_count == 0 ? 0 : 2;
+}
@@ -0,0 +1,650 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "skinning_types.h"
+#include "skinning_cpu.h"
+
+
+///
+/// skinning_compressed Header - Skinning input with quantized weights and vertices sorted by influence count
+///
+/// a2v spends 20 bytes on 4 float weights and 4 indices even for rigid vertices. Here weights are UNORM8 or UNORM16
+/// quantized so a vertex's weights sum exactly to 1, and vertices are sorted into buckets of 1, 2, 4 or 8 influences
+/// that each get a specialized loop, so a rigid vertex costs one index byte and no weight. Sorting permutes the mesh,
+/// source_index maps a sorted vertex back to its input vertex so index buffers can be remapped once at load.
+///
+namespace skinning {
+    enum class weight_format {
+        unorm8,
+        unorm16,
+    };
+
+    const int32_t influence_bucket_count = 4;
+    const int32_t influence_bucket_sizes[influence_bucket_count] = { 1, 2, 4, 8 };
+
+    /// Up to 8 influences of a vertex, unused ones with zero weight
+    struct influences {
+        uint8_t bone_index[8];
+        float bone_weight[8];
+    };
+
+    /// Sorted vertices [begin, end) with influence_count influences. Their indices and weights are slot major, slot s
+    /// of sorted vertex i at offset + s * (end - begin) + i - begin, so every slot is a coalesced stream.
+    struct influence_bucket {
+        int32_t influence_count;
+        size_t begin;
+        size_t end;
+        size_t index_offset;                // Into bone_index
+        size_t weight_offset;               // Into weights, in weight elements, 1 influence buckets store none
+
+        size_t size() const { return end - begin; }
+    };
+
+    struct compressed_mesh {
+        weight_format format;
+        influence_bucket buckets[influence_bucket_count];
+        std::vector<uint32_t> source_index;
+        std::vector<float> position[3];
+        std::vector<float> normal[3];
+        std::vector<float> uv[4];
+        std::vector<uint8_t> bone_index;
+        std::vector<uint8_t> weights;       // UNORM8 bytes or UNORM16 pairs of bytes
+
+        size_t size() const { return source_index.size(); }
+        size_t weight_size() const { return format == weight_format::unorm8 ? 1 : 2; }
+        /// Skinning input bytes, on average per vertex
+        double bytes_per_vertex() const;
+    };
+
+    /// Byte offsets of the compressed streams in one device buffer, 256 byte aligned like soa_a2v_layout
+    struct compressed_layout {
+        size_t position[3];
+        size_t normal[3];
+        size_t uv[4];
+        size_t bone_index;
+        size_t weights;
+        size_t size_in_bytes;
+    };
+
+    influences to_influences(const a2v& vertex);
+
+    /// Quantize weights, rounding residue going to the largest, and sort vertices into the smallest bucket that holds
+    /// their non zero weights. vertex_influences may be null to use the 4 influences of the a2v records.
+    void compress_mesh(const a2v* vertices, const influences* vertex_influences, size_t vertex_count,
+        weight_format format, compressed_mesh& out_mesh);
+
+    compressed_layout make_compressed_layout(const compressed_mesh& mesh);
+    void pack_compressed(const compressed_mesh& mesh, const compressed_layout& layout, uint8_t* out_buffer);
+
+    /// Skin sorted vertices [begin, end) of a mesh into streams of the same order
+    void skin_compressed_scalar(const compressed_mesh& mesh, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* bones);
+    void skin_compressed_avx2(const compressed_mesh& mesh, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* bones);
+    void skin_compressed_avx512(const compressed_mesh& mesh, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* bones);
+
+    /// Skin the whole mesh with a variant, chunked over thread_count threads, 0 uses every hardware thread
+    void skin_compressed(cpu_variant variant, const compressed_mesh& mesh, soa_v2f& out_vertices, const float* bones,
+        uint32_t thread_count = 0);
+
+    /// fp32 skinning of up to 8 influences, the reference for compressed meshes
+    void skin_influences(const a2v* vertices, const influences* vertex_influences, v2f* out_vertices,
+        size_t vertex_count, const float* bones);
+
+    /// Sorted output back to input order
+    void unsort_v2f(const compressed_mesh& mesh, const soa_v2f& vertices, v2f* out_vertices);
+
+    /// Largest absolute difference to skin_influences that weight quantization can cause. Quantized weights still sum
+    /// to 1, the residue going to the largest, so a vertex moves by the sum over its other influences of half a step
+    /// times the difference of their bone and the largest one applied to it. vertex_influences may be null as in
+    /// compress_mesh.
+    float compressed_error_bound(weight_format format, const a2v* vertices, const influences* vertex_influences,
+        size_t vertex_count, const float* bones, int32_t bone_count);
+
+    /// Random influences, mostly 1 or 2 but up to max_influence_count, on neighboring bones with weights summing to 1
+    void generate_influences(influences* out_influences, size_t vertex_count, int32_t bone_count,
+        int32_t max_influence_count, uint32_t seed);
+}
+
+
+///
+/// Implementation
+///
+#if defined(SKINNING_COMPRESSED_IMPLEMENTATION)
+#if !defined(SKINNING_CPU_IMPLEMENTATION)
+#error "SKINNING_COMPRESSED_IMPLEMENTATION uses skinning_cpu.h internals, define SKINNING_CPU_IMPLEMENTATION in the same file"
+#endif
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#include <thread>
+#if !defined(SKINNING_TARGET_AVX2)
+#if defined(_MSC_VER)
+#define SKINNING_TARGET_AVX2
+#define SKINNING_TARGET_AVX512
+#else
+#define SKINNING_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define SKINNING_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+namespace skinning {
+    double compressed_mesh::bytes_per_vertex() const {
+        size_t attribute_bytes = (3 + 3 + 4) * sizeof(float);
+        return size() == 0 ? 0.0 :
+            attribute_bytes + static_cast<double>(bone_index.size() + weights.size()) / static_cast<double>(size());
+    }
+
+
+    influences to_influences(const a2v& vertex) {
+        influences result = {};
+        for (int32_t i = 0; i < 4; ++i) {
+            result.bone_index[i] = vertex.bone_index[i];
+            result.bone_weight[i] = vertex.bone_weight[i];
+        }
+        return result;
+    }
+
+
+    // Weights of a vertex as integers summing to max_value, largest first, returns the non zero count
+    int32_t _quantize_weights(const influences& source, uint32_t max_value, uint8_t out_bone_index[8],
+        uint32_t out_weights[8]) {
+        int32_t order[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+        std::stable_sort(order, order + 8, [&source](int32_t a, int32_t b) {
+            return source.bone_weight[a] > source.bone_weight[b];
+        });
+
+        float weight_sum = 0.0f;
+        for (int32_t i = 0; i < 8; ++i) {
+            weight_sum += std::max(source.bone_weight[i], 0.0f);
+        }
+        int32_t quantized_sum = 0;
+        for (int32_t i = 0; i < 8; ++i) {
+            float weight = weight_sum > 0.0f ? std::max(source.bone_weight[order[i]], 0.0f) / weight_sum : 0.0f;
+            out_bone_index[i] = source.bone_index[order[i]];
+            out_weights[i] = static_cast<uint32_t>(std::lround(weight * max_value));
+            quantized_sum += out_weights[i];
+        }
+        if (weight_sum <= 0.0f) {
+            out_weights[0] = max_value;
+            quantized_sum = max_value;
+        }
+        out_weights[0] = static_cast<uint32_t>(static_cast<int32_t>(out_weights[0]) + static_cast<int32_t>(max_value) -
+            quantized_sum);
+
+        int32_t count = 0;
+        while (count < 8 && out_weights[count] > 0) {
+            count++;
+        }
+        return std::max(count, 1);
+    }
+
+
+    void compress_mesh(const a2v* vertices, const influences* vertex_influences, size_t vertex_count,
+        weight_format format, compressed_mesh& out_mesh) {
+        uint32_t max_value = format == weight_format::unorm8 ? 0xFF : 0xFFFF;
+        std::vector<uint8_t> sorted_index(vertex_count * 8);
+        std::vector<uint32_t> sorted_weights(vertex_count * 8);
+        std::vector<int32_t> vertex_bucket(vertex_count);
+        size_t bucket_counts[influence_bucket_count] = {};
+        for (size_t i = 0; i < vertex_count; ++i) {
+            influences source = vertex_influences ? vertex_influences[i] : to_influences(vertices[i]);
+            int32_t count = _quantize_weights(source, max_value, &sorted_index[i * 8], &sorted_weights[i * 8]);
+            int32_t bucket = 0;
+            while (influence_bucket_sizes[bucket] < count) {
+                bucket++;
+            }
+            vertex_bucket[i] = bucket;
+            bucket_counts[bucket]++;
+        }
+
+        out_mesh.format = format;
+        size_t begin = 0, index_offset = 0, weight_offset = 0;
+        for (int32_t b = 0; b < influence_bucket_count; ++b) {
+            influence_bucket& bucket = out_mesh.buckets[b];
+            bucket.influence_count = influence_bucket_sizes[b];
+            bucket.begin = begin;
+            bucket.end = begin + bucket_counts[b];
+            bucket.index_offset = index_offset;
+            bucket.weight_offset = weight_offset;
+            begin = bucket.end;
+            index_offset += bucket.size() * bucket.influence_count;
+            weight_offset += bucket.influence_count > 1 ? bucket.size() * bucket.influence_count : 0;
+        }
+
+        out_mesh.source_index.resize(vertex_count);
+        for (int32_t i = 0; i < 3; ++i) {
+            out_mesh.position[i].resize(vertex_count);
+            out_mesh.normal[i].resize(vertex_count);
+        }
+        for (int32_t i = 0; i < 4; ++i) {
+            out_mesh.uv[i].resize(vertex_count);
+        }
+        out_mesh.bone_index.assign(index_offset, 0);
+        out_mesh.weights.assign(weight_offset * out_mesh.weight_size(), 0);
+
+        size_t bucket_fill[influence_bucket_count] = {};
+        for (size_t source = 0; source < vertex_count; ++source) {
+            const influence_bucket& bucket = out_mesh.buckets[vertex_bucket[source]];
+            size_t slot_index = bucket_fill[vertex_bucket[source]]++;
+            size_t i = bucket.begin + slot_index;
+            const a2v& vertex = vertices[source];
+            out_mesh.source_index[i] = static_cast<uint32_t>(source);
+            out_mesh.position[0][i] = vertex.position.x;
+            out_mesh.position[1][i] = vertex.position.y;
+            out_mesh.position[2][i] = vertex.position.z;
+            out_mesh.normal[0][i] = vertex.normal.x;
+            out_mesh.normal[1][i] = vertex.normal.y;
+            out_mesh.normal[2][i] = vertex.normal.z;
+            out_mesh.uv[0][i] = vertex.uv0.x;
+            out_mesh.uv[1][i] = vertex.uv0.y;
+            out_mesh.uv[2][i] = vertex.uv1.x;
+            out_mesh.uv[3][i] = vertex.uv1.y;
+            for (int32_t s = 0; s < bucket.influence_count; ++s) {
+                size_t element = s * bucket.size() + slot_index;
+                out_mesh.bone_index[bucket.index_offset + element] = sorted_index[source * 8 + s];
+                if (bucket.influence_count == 1) {
+                    continue;
+                }
+                uint32_t weight = sorted_weights[source * 8 + s];
+                if (format == weight_format::unorm8) {
+                    out_mesh.weights[bucket.weight_offset + element] = static_cast<uint8_t>(weight);
+                }
+                else {
+                    uint16_t weight16 = static_cast<uint16_t>(weight);
+                    memcpy(&out_mesh.weights[(bucket.weight_offset + element) * 2], &weight16, sizeof(weight16));
+                }
+            }
+        }
+    }
+
+
+    compressed_layout make_compressed_layout(const compressed_mesh& mesh) {
+        auto add_stream = [](size_t& offset, size_t size_in_bytes) {
+            size_t stream_offset = offset;
+            offset = (offset + size_in_bytes + 255) & ~size_t(255);
+            return stream_offset;
+        };
+
+        compressed_layout layout;
+        size_t offset = 0;
+        size_t stream_size = mesh.size() * sizeof(float);
+        for (auto& stream : layout.position) stream = add_stream(offset, stream_size);
+        for (auto& stream : layout.normal) stream = add_stream(offset, stream_size);
+        for (auto& stream : layout.uv) stream = add_stream(offset, stream_size);
+        layout.bone_index = add_stream(offset, mesh.bone_index.size());
+        layout.weights = add_stream(offset, mesh.weights.size());
+        layout.size_in_bytes = offset;
+        return layout;
+    }
+
+
+    void pack_compressed(const compressed_mesh& mesh, const compressed_layout& layout, uint8_t* out_buffer) {
+        size_t stream_size = mesh.size() * sizeof(float);
+        for (int32_t i = 0; i < 3; ++i) {
+            memcpy(out_buffer + layout.position[i], mesh.position[i].data(), stream_size);
+            memcpy(out_buffer + layout.normal[i], mesh.normal[i].data(), stream_size);
+        }
+        for (int32_t i = 0; i < 4; ++i) {
+            memcpy(out_buffer + layout.uv[i], mesh.uv[i].data(), stream_size);
+        }
+        memcpy(out_buffer + layout.bone_index, mesh.bone_index.data(), mesh.bone_index.size());
+        memcpy(out_buffer + layout.weights, mesh.weights.data(), mesh.weights.size());
+    }
+
+
+    // Bucket part of [begin, end), as bucket relative element range
+    inline bool _bucket_range(const influence_bucket& bucket, size_t begin, size_t end, size_t& out_first,
+        size_t& out_last) {
+        out_first = std::max(begin, bucket.begin) - bucket.begin;
+        out_last = std::min(end, bucket.end);
+        out_last = out_last > bucket.begin ? out_last - bucket.begin : 0;
+        return out_first < out_last;
+    }
+
+
+    inline float _read_weight(const compressed_mesh& mesh, size_t element) {
+        if (mesh.format == weight_format::unorm8) {
+            return mesh.weights[element] * (1.0f / 255.0f);
+        }
+        uint16_t weight;
+        memcpy(&weight, &mesh.weights[element * 2], sizeof(weight));
+        return weight * (1.0f / 65535.0f);
+    }
+
+
+    inline void _transform_sorted(const compressed_mesh& mesh, soa_v2f& out_vertices, size_t i, const float m[12]) {
+        float px = mesh.position[0][i], py = mesh.position[1][i], pz = mesh.position[2][i];
+        float nx = mesh.normal[0][i], ny = mesh.normal[1][i], nz = mesh.normal[2][i];
+        for (int32_t r = 0; r < 3; ++r) {
+            const float* row = m + r * 4;
+            out_vertices.position[r][i] = px * row[0] + py * row[1] + pz * row[2] + row[3];
+            out_vertices.normal[r][i] = nx * row[0] + ny * row[1] + nz * row[2];
+        }
+    }
+
+
+    inline void _copy_sorted_uvs(const compressed_mesh& mesh, soa_v2f& out_vertices, size_t begin, size_t end) {
+        for (int32_t j = 0; j < 4; ++j) {
+            memcpy(&out_vertices.uv[j][begin], &mesh.uv[j][begin], (end - begin) * sizeof(float));
+        }
+    }
+
+
+    // Scalar loop over bucket elements [first, last), one instantiation per influence count
+    template <int32_t influence_count>
+    void _skin_bucket_scalar(const compressed_mesh& mesh, const influence_bucket& bucket, soa_v2f& out_vertices,
+        size_t first, size_t last, const float* bones) {
+        size_t stride = bucket.size();
+        for (size_t e = first; e < last; ++e) {
+            float m[12];
+            for (int32_t s = 0; s < influence_count; ++s) {
+                const float* bone = bones + mesh.bone_index[bucket.index_offset + s * stride + e] * skinning_floats_per_bone;
+                float weight = influence_count == 1 ? 1.0f : _read_weight(mesh, bucket.weight_offset + s * stride + e);
+                for (int32_t j = 0; j < 12; ++j) {
+                    m[j] = s == 0 ? bone[j] * weight : m[j] + bone[j] * weight;
+                }
+            }
+            _transform_sorted(mesh, out_vertices, bucket.begin + e, m);
+        }
+    }
+
+
+    void skin_compressed_scalar(const compressed_mesh& mesh, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* bones) {
+        auto bucket_funcs = { _skin_bucket_scalar<1>, _skin_bucket_scalar<2>, _skin_bucket_scalar<4>,
+            _skin_bucket_scalar<8> };
+        int32_t b = 0;
+        for (auto bucket_func : bucket_funcs) {
+            size_t first, last;
+            const influence_bucket& bucket = mesh.buckets[b++];
+            if (_bucket_range(bucket, begin, end, first, last)) {
+                bucket_func(mesh, bucket, out_vertices, first, last, bones);
+            }
+        }
+        _copy_sorted_uvs(mesh, out_vertices, begin, end);
+    }
+
+
+    // Bone offsets and weights of 8 slot elements from element, weights widened from UNORM8 or UNORM16
+    SKINNING_TARGET_AVX2 inline void _load_slot_avx2(const compressed_mesh& mesh, const uint8_t* bone_index,
+        const uint8_t* weights, size_t element, bool has_weights, __m256i& out_bone_offset, __m256& out_weight) {
+        __m128i packed_index = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(bone_index + element));
+        out_bone_offset = _mm256_mullo_epi32(_mm256_cvtepu8_epi32(packed_index),
+            _mm256_set1_epi32(skinning_floats_per_bone));
+        out_weight = _mm256_set1_ps(1.0f);
+        if (has_weights) {
+            __m256i quantized = mesh.format == weight_format::unorm8 ?
+                _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(weights + element))) :
+                _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + element * 2)));
+            out_weight = _mm256_mul_ps(_mm256_cvtepi32_ps(quantized), _mm256_set1_ps(
+                mesh.format == weight_format::unorm8 ? 1.0f / 255.0f : 1.0f / 65535.0f));
+        }
+    }
+
+
+    // 8 lanes of bucket elements from e, the first slot initializes the blend
+    template <int32_t influence_count>
+    SKINNING_TARGET_AVX2 void _skin_bucket_avx2(const compressed_mesh& mesh, const influence_bucket& bucket,
+        soa_v2f& out_vertices, size_t first, size_t last, const float* bones) {
+        size_t stride = bucket.size();
+        const uint8_t* bone_index = mesh.bone_index.data() + bucket.index_offset;
+        const uint8_t* weights = mesh.weights.data() + bucket.weight_offset * mesh.weight_size();
+
+        size_t e = first;
+        for (; e + 8 <= last; e += 8) {
+            __m256 m[12];
+            __m256i bone_offset;
+            __m256 weight;
+            _load_slot_avx2(mesh, bone_index, weights, e, influence_count > 1, bone_offset, weight);
+            for (int32_t j = 0; j < 12; ++j) {
+                __m256 value = _mm256_i32gather_ps(bones + j, bone_offset, 4);
+                m[j] = influence_count == 1 ? value : _mm256_mul_ps(value, weight);
+            }
+            for (int32_t s = 1; s < influence_count; ++s) {
+                _load_slot_avx2(mesh, bone_index, weights, s * stride + e, true, bone_offset, weight);
+                for (int32_t j = 0; j < 12; ++j) {
+                    m[j] = _mm256_fmadd_ps(_mm256_i32gather_ps(bones + j, bone_offset, 4), weight, m[j]);
+                }
+            }
+
+            size_t i = bucket.begin + e;
+            __m256 px = _mm256_loadu_ps(&mesh.position[0][i]);
+            __m256 py = _mm256_loadu_ps(&mesh.position[1][i]);
+            __m256 pz = _mm256_loadu_ps(&mesh.position[2][i]);
+            __m256 nx = _mm256_loadu_ps(&mesh.normal[0][i]);
+            __m256 ny = _mm256_loadu_ps(&mesh.normal[1][i]);
+            __m256 nz = _mm256_loadu_ps(&mesh.normal[2][i]);
+            for (int32_t r = 0; r < 3; ++r) {
+                const __m256* row = m + r * 4;
+                __m256 position = _mm256_fmadd_ps(pz, row[2], _mm256_fmadd_ps(py, row[1], _mm256_fmadd_ps(px, row[0], row[3])));
+                __m256 normal = _mm256_fmadd_ps(nz, row[2], _mm256_fmadd_ps(ny, row[1], _mm256_mul_ps(nx, row[0])));
+                _mm256_storeu_ps(&out_vertices.position[r][i], position);
+                _mm256_storeu_ps(&out_vertices.normal[r][i], normal);
+            }
+        }
+        _skin_bucket_scalar<influence_count>(mesh, bucket, out_vertices, e, last, bones);
+    }
+
+
+    void skin_compressed_avx2(const compressed_mesh& mesh, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* bones) {
+        auto bucket_funcs = { _skin_bucket_avx2<1>, _skin_bucket_avx2<2>, _skin_bucket_avx2<4>, _skin_bucket_avx2<8> };
+        int32_t b = 0;
+        for (auto bucket_func : bucket_funcs) {
+            size_t first, last;
+            const influence_bucket& bucket = mesh.buckets[b++];
+            if (_bucket_range(bucket, begin, end, first, last)) {
+                bucket_func(mesh, bucket, out_vertices, first, last, bones);
+            }
+        }
+        _copy_sorted_uvs(mesh, out_vertices, begin, end);
+    }
+
+
+    // Zero masked conversions and gathers over all 16 lanes, the unmasked forms pass an undefined register through
+    // that GCC 12 reports as maybe uninitialized
+    SKINNING_TARGET_AVX512 inline void _load_slot_avx512(const compressed_mesh& mesh, const uint8_t* bone_index,
+        const uint8_t* weights, size_t element, bool has_weights, __m512i& out_bone_offset, __m512& out_weight) {
+        __m128i packed_index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bone_index + element));
+        out_bone_offset = _mm512_mullo_epi32(_mm512_maskz_cvtepu8_epi32(0xFFFF, packed_index),
+            _mm512_set1_epi32(skinning_floats_per_bone));
+        out_weight = _mm512_set1_ps(1.0f);
+        if (has_weights) {
+            __m512i quantized = mesh.format == weight_format::unorm8 ?
+                _mm512_maskz_cvtepu8_epi32(0xFFFF,
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + element))) :
+                _mm512_maskz_cvtepu16_epi32(0xFFFF,
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + element * 2)));
+            out_weight = _mm512_mul_ps(_mm512_maskz_cvtepi32_ps(0xFFFF, quantized), _mm512_set1_ps(
+                mesh.format == weight_format::unorm8 ? 1.0f / 255.0f : 1.0f / 65535.0f));
+        }
+    }
+
+
+    SKINNING_TARGET_AVX512 inline __m512 _gather_bone_avx512(__m512i bone_offset, const float* bone_row) {
+        return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xFFFF, bone_offset, bone_row, 4);
+    }
+
+
+    template <int32_t influence_count>
+    SKINNING_TARGET_AVX512 void _skin_bucket_avx512(const compressed_mesh& mesh, const influence_bucket& bucket,
+        soa_v2f& out_vertices, size_t first, size_t last, const float* bones) {
+        size_t stride = bucket.size();
+        const uint8_t* bone_index = mesh.bone_index.data() + bucket.index_offset;
+        const uint8_t* weights = mesh.weights.data() + bucket.weight_offset * mesh.weight_size();
+
+        size_t e = first;
+        for (; e + 16 <= last; e += 16) {
+            __m512 m[12];
+            __m512i bone_offset;
+            __m512 weight;
+            _load_slot_avx512(mesh, bone_index, weights, e, influence_count > 1, bone_offset, weight);
+            for (int32_t j = 0; j < 12; ++j) {
+                __m512 value = _gather_bone_avx512(bone_offset, bones + j);
+                m[j] = influence_count == 1 ? value : _mm512_mul_ps(value, weight);
+            }
+            for (int32_t s = 1; s < influence_count; ++s) {
+                _load_slot_avx512(mesh, bone_index, weights, s * stride + e, true, bone_offset, weight);
+                for (int32_t j = 0; j < 12; ++j) {
+                    m[j] = _mm512_fmadd_ps(_gather_bone_avx512(bone_offset, bones + j), weight, m[j]);
+                }
+            }
+
+            size_t i = bucket.begin + e;
+            __m512 px = _mm512_loadu_ps(&mesh.position[0][i]);
+            __m512 py = _mm512_loadu_ps(&mesh.position[1][i]);
+            __m512 pz = _mm512_loadu_ps(&mesh.position[2][i]);
+            __m512 nx = _mm512_loadu_ps(&mesh.normal[0][i]);
+            __m512 ny = _mm512_loadu_ps(&mesh.normal[1][i]);
+            __m512 nz = _mm512_loadu_ps(&mesh.normal[2][i]);
+            for (int32_t r = 0; r < 3; ++r) {
+                const __m512* row = m + r * 4;
+                __m512 position = _mm512_fmadd_ps(pz, row[2], _mm512_fmadd_ps(py, row[1], _mm512_fmadd_ps(px, row[0], row[3])));
+                __m512 normal = _mm512_fmadd_ps(nz, row[2], _mm512_fmadd_ps(ny, row[1], _mm512_mul_ps(nx, row[0])));
+                _mm512_storeu_ps(&out_vertices.position[r][i], position);
+                _mm512_storeu_ps(&out_vertices.normal[r][i], normal);
+            }
+        }
+        _skin_bucket_scalar<influence_count>(mesh, bucket, out_vertices, e, last, bones);
+    }
+
+
+    void skin_compressed_avx512(const compressed_mesh& mesh, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* bones) {
+        auto bucket_funcs = { _skin_bucket_avx512<1>, _skin_bucket_avx512<2>, _skin_bucket_avx512<4>,
+            _skin_bucket_avx512<8> };
+        int32_t b = 0;
+        for (auto bucket_func : bucket_funcs) {
+            size_t first, last;
+            const influence_bucket& bucket = mesh.buckets[b++];
+            if (_bucket_range(bucket, begin, end, first, last)) {
+                bucket_func(mesh, bucket, out_vertices, first, last, bones);
+            }
+        }
+        _copy_sorted_uvs(mesh, out_vertices, begin, end);
+    }
+
+
+    void skin_compressed(cpu_variant variant, const compressed_mesh& mesh, soa_v2f& out_vertices, const float* bones,
+        uint32_t thread_count) {
+        if (variant == cpu_variant::best) {
+            variant = has_avx512() ? cpu_variant::avx512 : (has_avx2() ? cpu_variant::avx2 : cpu_variant::soa_scalar);
+        }
+        auto skin_func = skin_compressed_scalar;
+        if (variant == cpu_variant::avx2) {
+            skin_func = skin_compressed_avx2;
+        }
+        else if (variant == cpu_variant::avx512) {
+            skin_func = skin_compressed_avx512;
+        }
+
+        out_vertices.resize(mesh.size());
+        _parallel_chunks(mesh.size(), 64, thread_count, [&](size_t begin, size_t end) {
+            skin_func(mesh, out_vertices, begin, end, bones);
+        });
+    }
+
+
+    void skin_influences(const a2v* vertices, const influences* vertex_influences, v2f* out_vertices,
+        size_t vertex_count, const float* bones) {
+        for (size_t i = 0; i < vertex_count; ++i) {
+            influences source = vertex_influences ? vertex_influences[i] : to_influences(vertices[i]);
+            float m[12] = {};
+            for (int32_t s = 0; s < 8; ++s) {
+                const float* bone = bones + source.bone_index[s] * skinning_floats_per_bone;
+                for (int32_t j = 0; j < 12; ++j) {
+                    m[j] += bone[j] * source.bone_weight[s];
+                }
+            }
+            _transform_vertex(vertices[i], m, out_vertices[i]);
+        }
+    }
+
+
+    void unsort_v2f(const compressed_mesh& mesh, const soa_v2f& vertices, v2f* out_vertices) {
+        for (size_t i = 0; i < mesh.size(); ++i) {
+            v2f& out = out_vertices[mesh.source_index[i]];
+            out.position = { vertices.position[0][i], vertices.position[1][i], vertices.position[2][i] };
+            out.normal = { vertices.normal[0][i], vertices.normal[1][i], vertices.normal[2][i] };
+            out.uv0 = { vertices.uv[0][i], vertices.uv[1][i] };
+            out.uv1 = { vertices.uv[2][i], vertices.uv[3][i] };
+        }
+    }
+
+
+    float compressed_error_bound(weight_format format, const a2v* vertices, const influences* vertex_influences,
+        size_t vertex_count, const float* bones, int32_t bone_count) {
+        float max_bone = 0.0f;
+        for (int32_t i = 0; i < bone_count * skinning_floats_per_bone; ++i) {
+            max_bone = std::max(max_bone, std::fabs(bones[i]));
+        }
+
+        float half_step = format == weight_format::unorm8 ? 0.5f / 255.0f : 0.5f / 65535.0f;
+        float bound = 0.0f;
+        for (size_t i = 0; i < vertex_count; ++i) {
+            influences source = vertex_influences ? vertex_influences[i] : to_influences(vertices[i]);
+            int32_t largest = 0;
+            for (int32_t s = 1; s < 8; ++s) {
+                largest = source.bone_weight[s] > source.bone_weight[largest] ? s : largest;
+            }
+            const float3& p = vertices[i].position;
+            const float3& n = vertices[i].normal;
+            const float position[4] = { p.x, p.y, p.z, 1.0f };
+            const float normal[4] = { n.x, n.y, n.z, 0.0f };
+            const float* pivot = bones + source.bone_index[largest] * skinning_floats_per_bone;
+            for (int32_t r = 0; r < 3; ++r) {
+                float position_error = 0.0f, normal_error = 0.0f;
+                for (int32_t s = 0; s < 8; ++s) {
+                    if (s == largest || source.bone_weight[s] <= 0.0f) {
+                        continue;
+                    }
+                    const float* bone = bones + source.bone_index[s] * skinning_floats_per_bone;
+                    float position_delta = 0.0f, normal_delta = 0.0f;
+                    for (int32_t c = 0; c < 4; ++c) {
+                        float delta = bone[r * 4 + c] - pivot[r * 4 + c];
+                        position_delta += delta * position[c];
+                        normal_delta += delta * normal[c];
+                    }
+                    position_error += std::fabs(position_delta);
+                    normal_error += std::fabs(normal_delta);
+                }
+                // Plus a few fp32 roundings of the blend and the transform
+                float max_coordinate = std::max({ 1.0f, std::fabs(p.x), std::fabs(p.y), std::fabs(p.z) });
+                float rounding = max_bone * 32.0f / 16777216.0f * (3.0f * max_coordinate + 1.0f);
+                bound = std::max(bound, half_step * std::max(position_error, normal_error) + rounding);
+            }
+        }
+        return bound;
+    }
+
+
+    void generate_influences(influences* out_influences, size_t vertex_count, int32_t bone_count,
+        int32_t max_influence_count, uint32_t seed) {
+        for (size_t i = 0; i < vertex_count; ++i) {
+            // Rigid parts dominate a character, a few vertices near joints blend many bones
+            float influence_roll = _random_float(seed, 0.0f, 1.0f);
+            int32_t influence_count = influence_roll < 0.45f ? 1 : (influence_roll < 0.75f ? 2 :
+                (influence_roll < 0.9f ? 3 + static_cast<int32_t>(_random_float(seed, 0.0f, 1.99f)) :
+                5 + static_cast<int32_t>(_random_float(seed, 0.0f, 3.99f))));
+            influence_count = std::min({ influence_count, max_influence_count, bone_count, 8 });
+            int32_t first_bone = static_cast<int32_t>(_random_float(seed, 0.0f, static_cast<float>(bone_count)));
+            influences& vertex = out_influences[i];
+            float weight_sum = 0.0f;
+            for (int32_t j = 0; j < 8; ++j) {
+                bool is_used = j < influence_count;
+                vertex.bone_index[j] = static_cast<uint8_t>(is_used ? (first_bone + j) % bone_count : 0);
+                vertex.bone_weight[j] = is_used ? _random_float(seed, 0.1f, 1.0f) : 0.0f;
+                weight_sum += vertex.bone_weight[j];
+            }
+            for (int32_t j = 0; j < 8; ++j) {
+                vertex.bone_weight[j] /= weight_sum;
+            }
+        }
+    }
+}
+#endif // SKINNING_COMPRESSED_IMPLEMENTATION
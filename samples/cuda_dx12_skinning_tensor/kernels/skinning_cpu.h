@@ -0,0 +1,891 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "skinning_types.h"
+
+
+///
+/// skinning_cpu Header - CPU linear blend skinning, same a2v -> v2f math as skinning_kernel
+///
+/// The scalar path reads the packed a2v records and is the correctness oracle for the GPU kernels. SIMD paths read
+/// SoA streams, 8 (AVX2) or 16 (AVX-512) vertices per iteration with bone rows gathered per lane, and every path can
+/// be split into vertex chunks over worker threads. The skeleton stage turns per-joint local TRS poses into the
+/// palettes the vertex stage reads, one forward pass since parents come before their children.
+///
+/// Batches skin many instances at once, each a vertex range of shared input streams with its own palette and output
+/// range. They are cut in tiles of one instance so threads, like the blocks of the s5 kernel, balance small and large
+/// instances without a call per instance.
+///
+/// The GEMM path is the reference of the tensor core kernel: blended transforms of 16 vertices are a dense
+/// (16 x bones) weight tile times the (bones x 12) palette, both rounded to fp16 or bf16 with fp32 accumulation.
+///
+namespace skinning {
+    enum class cpu_variant {
+        scalar,                             // Packed a2v records, one vertex at a time
+        soa_scalar,                         // SoA streams, one vertex at a time
+        avx2,
+        avx512,
+        best,                               // Widest SIMD the CPU supports
+    };
+
+    /// Element type of the weight and palette GEMM operands, accumulation is always fp32
+    enum class gemm_precision {
+        fp16,                               // 10 bit mantissa, WMMA on sm_70 and later
+        bf16,                               // 7 bit mantissa, WMMA on sm_80 and later
+    };
+
+    /// a2v as streams, the 4 bone indices of a vertex packed in one uint32_t, lowest byte first
+    struct soa_a2v {
+        std::vector<float> position[3];
+        std::vector<float> normal[3];
+        std::vector<float> bone_weight[4];
+        std::vector<uint32_t> bone_index;
+        std::vector<float> uv[4];           // uv0.x, uv0.y, uv1.x, uv1.y
+
+        size_t size() const { return bone_index.size(); }
+        void resize(size_t vertex_count);
+    };
+
+    struct soa_v2f {
+        std::vector<float> position[3];
+        std::vector<float> normal[3];
+        std::vector<float> uv[4];
+
+        size_t size() const { return position[0].size(); }
+        void resize(size_t vertex_count);
+    };
+
+    /// Byte offsets of the a2v streams in one device buffer, each 256 byte aligned so a warp reads whole segments
+    struct soa_a2v_layout {
+        size_t position[3];
+        size_t normal[3];
+        size_t bone_weight[4];
+        size_t bone_index;                  // uint32_t, 4 indices packed like soa_a2v
+        size_t uv[4];
+        size_t size_in_bytes;
+    };
+
+    struct soa_v2f_layout {
+        size_t position[3];
+        size_t normal[3];
+        size_t uv[4];
+        size_t size_in_bytes;
+    };
+
+    /// Joint hierarchy and bind pose, parents[j] < j for every non-root joint
+    struct skeleton {
+        std::vector<int32_t> parents;       // -1 for roots
+        std::vector<float> inverse_bind;    // skinning_floats_per_bone per joint, model space to joint space
+        std::vector<joint_trs> bind_pose;   // Local rest pose the inverse binds were computed from
+
+        int32_t joint_count() const { return static_cast<int32_t>(parents.size()); }
+    };
+
+    /// One instance of a batch: input vertices [vertex_begin, vertex_begin + vertex_count) skinned with the palette
+    /// at bone palette_offset of the batch palettes, written from out_begin
+    struct skin_instance {
+        uint32_t vertex_begin;
+        uint32_t vertex_count;
+        uint32_t palette_offset;
+        uint32_t bone_count;
+        uint32_t out_begin;
+    };
+
+    /// Up to a tile size of vertices of one instance, from vertex_offset within it
+    struct skin_tile {
+        uint32_t instance;
+        uint32_t vertex_offset;
+        uint32_t vertex_count;
+    };
+
+    bool has_avx2();
+    bool has_avx512();
+
+    void to_soa(const a2v* vertices, size_t vertex_count, soa_a2v& out_vertices);
+    void from_soa(const soa_v2f& vertices, v2f* out_vertices);
+
+    soa_a2v_layout make_a2v_layout(size_t vertex_count);
+    soa_v2f_layout make_v2f_layout(size_t vertex_count);
+
+    /// Packed records to and from the streams of a layout buffer, the s1 kernel input and output
+    void pack_a2v(const a2v* vertices, size_t vertex_count, const soa_a2v_layout& layout, uint8_t* out_buffer);
+    void unpack_a2v(const uint8_t* buffer, size_t vertex_count, const soa_a2v_layout& layout, a2v* out_vertices);
+    void unpack_v2f(const uint8_t* buffer, size_t vertex_count, const soa_v2f_layout& layout, v2f* out_vertices);
+
+    /// Skin vertices [begin, end), bones is the palette of skinning_floats_per_bone floats per bone. SoA outputs go to
+    /// [begin + out_offset, end + out_offset).
+    void skin_scalar(const a2v* vertices, v2f* out_vertices, size_t begin, size_t end, const float* bones);
+    void skin_soa_scalar(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* bones, ptrdiff_t out_offset = 0);
+    void skin_soa_avx2(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin, size_t end, const float* bones,
+        ptrdiff_t out_offset = 0);
+    void skin_soa_avx512(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* bones, ptrdiff_t out_offset = 0);
+
+    /// Round to the nearest value with the mantissa of precision, ties to even. Exponent range is not reduced, weights
+    /// and palette entries are far from the fp16 limits.
+    float round_to(gemm_precision precision, float value);
+
+    /// Blocked GEMM formulation of skin_scalar, in the operand precision and tile order of the s3 kernel
+    void skin_gemm(gemm_precision precision, const a2v* vertices, v2f* out_vertices, size_t begin, size_t end,
+        const float* bones, int32_t bone_count);
+
+    /// Largest absolute difference to fp32 skinning that rounding weights and palette to precision can cause.
+    /// Blended entries are off by at most max|bone entry| * (2u + u^2) for the unit roundoff u, since the weights of a
+    /// vertex sum to 1, and a position sums 3 such entries times max|coordinate| plus the translation.
+    float gemm_error_bound(gemm_precision precision, const a2v* vertices, size_t vertex_count, const float* bones,
+        int32_t bone_count);
+
+    /// Skin all vertices with a SoA variant, chunked over thread_count threads, 0 uses every hardware thread
+    void skin_soa(cpu_variant variant, const soa_a2v& vertices, soa_v2f& out_vertices, const float* bones,
+        uint32_t thread_count = 0);
+
+    /// Cut every instance in tiles of at most tile_size vertices, in instance order
+    void make_skin_tiles(const skin_instance* instances, uint32_t instance_count, uint32_t tile_size,
+        std::vector<skin_tile>& out_tiles);
+
+    /// Skin a batch in one parallel-for over its tiles. palettes holds bone_count palette entries per instance from
+    /// palette_offset, out_vertices grows to the last output of the batch.
+    void skin_batch(cpu_variant variant, const soa_a2v& vertices, soa_v2f& out_vertices,
+        const skin_instance* instances, uint32_t instance_count, const float* palettes, uint32_t thread_count = 0);
+
+    /// Palette of one pose: parent model transform times local TRS, then times inverse bind, per joint
+    void evaluate_skeleton(const skeleton& rig, const joint_trs* local_poses, float* out_palette);
+
+    /// Palettes of instance_count poses of the same skeleton, joint_count consecutive poses and palette entries per
+    /// instance, instances chunked over thread_count threads
+    void evaluate_skeletons(const skeleton& rig, const joint_trs* local_poses, uint32_t instance_count,
+        float* out_palettes, uint32_t thread_count = 0);
+
+    /// Hierarchy depth per joint, 0 for roots, returns the level count. Joints of one level have no dependency
+    /// between them, so the GPU skeleton stage resolves a whole level per step.
+    int32_t joint_depths(const skeleton& rig, std::vector<uint8_t>& out_depths);
+
+    /// Largest absolute difference between two outputs over positions, normals and uvs
+    float max_error(const v2f* a, const v2f* b, size_t vertex_count);
+
+    /// Random rigid bone transforms, so skinned normals stay unit length
+    void generate_bones(float* out_bones, int32_t bone_count, uint32_t seed);
+
+    /// Random skeleton whose joints hang off one of the few previous joints, so the hierarchy is deep like limbs
+    void generate_skeleton(skeleton& out_rig, int32_t joint_count, uint32_t seed);
+
+    /// Random poses around the bind pose, joint_count per instance
+    void generate_poses(const skeleton& rig, joint_trs* out_poses, uint32_t instance_count, uint32_t seed);
+
+    /// Random vertices with 1 to 4 influences on neighboring bones and weights summing to 1
+    void generate_vertices(a2v* out_vertices, size_t vertex_count, int32_t bone_count, uint32_t seed);
+}
+
+
+///
+/// Implementation
+///
+#if defined(SKINNING_CPU_IMPLEMENTATION)
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#include <thread>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SKINNING_TARGET_AVX2
+#define SKINNING_TARGET_AVX512
+#else
+#define SKINNING_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define SKINNING_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+namespace skinning {
+    bool has_avx2() {
+#if defined(_MSC_VER)
+        int32_t info[4];
+        __cpuid(info, 1);
+        bool has_osxsave = (info[2] & (1 << 27)) != 0;
+        bool has_fma = (info[2] & (1 << 12)) != 0;
+        if (!has_osxsave || !has_fma || (_xgetbv(0) & 0x6) != 0x6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    }
+
+
+    bool has_avx512() {
+#if defined(_MSC_VER)
+        int32_t info[4];
+        __cpuid(info, 1);
+        bool has_osxsave = (info[2] & (1 << 27)) != 0;
+        if (!has_osxsave || (_xgetbv(0) & 0xE6) != 0xE6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 16)) != 0;
+#else
+        return __builtin_cpu_supports("avx512f");
+#endif
+    }
+
+
+    void soa_a2v::resize(size_t vertex_count) {
+        for (auto& stream : position) stream.resize(vertex_count);
+        for (auto& stream : normal) stream.resize(vertex_count);
+        for (auto& stream : bone_weight) stream.resize(vertex_count);
+        for (auto& stream : uv) stream.resize(vertex_count);
+        bone_index.resize(vertex_count);
+    }
+
+
+    void soa_v2f::resize(size_t vertex_count) {
+        for (auto& stream : position) stream.resize(vertex_count);
+        for (auto& stream : normal) stream.resize(vertex_count);
+        for (auto& stream : uv) stream.resize(vertex_count);
+    }
+
+
+    void to_soa(const a2v* vertices, size_t vertex_count, soa_a2v& out_vertices) {
+        out_vertices.resize(vertex_count);
+        for (size_t i = 0; i < vertex_count; ++i) {
+            const a2v& vertex = vertices[i];
+            out_vertices.position[0][i] = vertex.position.x;
+            out_vertices.position[1][i] = vertex.position.y;
+            out_vertices.position[2][i] = vertex.position.z;
+            out_vertices.normal[0][i] = vertex.normal.x;
+            out_vertices.normal[1][i] = vertex.normal.y;
+            out_vertices.normal[2][i] = vertex.normal.z;
+            for (int32_t j = 0; j < 4; ++j) {
+                out_vertices.bone_weight[j][i] = vertex.bone_weight[j];
+            }
+            out_vertices.bone_index[i] = vertex.bone_index[0] | (vertex.bone_index[1] << 8) |
+                (vertex.bone_index[2] << 16) | (static_cast<uint32_t>(vertex.bone_index[3]) << 24);
+            out_vertices.uv[0][i] = vertex.uv0.x;
+            out_vertices.uv[1][i] = vertex.uv0.y;
+            out_vertices.uv[2][i] = vertex.uv1.x;
+            out_vertices.uv[3][i] = vertex.uv1.y;
+        }
+    }
+
+
+    void from_soa(const soa_v2f& vertices, v2f* out_vertices) {
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            v2f& vertex = out_vertices[i];
+            vertex.position = { vertices.position[0][i], vertices.position[1][i], vertices.position[2][i] };
+            vertex.normal = { vertices.normal[0][i], vertices.normal[1][i], vertices.normal[2][i] };
+            vertex.uv0 = { vertices.uv[0][i], vertices.uv[1][i] };
+            vertex.uv1 = { vertices.uv[2][i], vertices.uv[3][i] };
+        }
+    }
+
+
+    inline size_t _add_stream(size_t& offset, size_t size_in_bytes) {
+        size_t stream_offset = offset;
+        offset = (offset + size_in_bytes + 255) & ~size_t(255);
+        return stream_offset;
+    }
+
+
+    soa_a2v_layout make_a2v_layout(size_t vertex_count) {
+        soa_a2v_layout layout = {};
+        size_t offset = 0;
+        size_t stream_size = vertex_count * sizeof(float);
+        for (auto& stream : layout.position) stream = _add_stream(offset, stream_size);
+        for (auto& stream : layout.normal) stream = _add_stream(offset, stream_size);
+        for (auto& stream : layout.bone_weight) stream = _add_stream(offset, stream_size);
+        layout.bone_index = _add_stream(offset, vertex_count * sizeof(uint32_t));
+        for (auto& stream : layout.uv) stream = _add_stream(offset, stream_size);
+        layout.size_in_bytes = offset;
+        return layout;
+    }
+
+
+    soa_v2f_layout make_v2f_layout(size_t vertex_count) {
+        soa_v2f_layout layout = {};
+        size_t offset = 0;
+        size_t stream_size = vertex_count * sizeof(float);
+        for (auto& stream : layout.position) stream = _add_stream(offset, stream_size);
+        for (auto& stream : layout.normal) stream = _add_stream(offset, stream_size);
+        for (auto& stream : layout.uv) stream = _add_stream(offset, stream_size);
+        layout.size_in_bytes = offset;
+        return layout;
+    }
+
+
+    void pack_a2v(const a2v* vertices, size_t vertex_count, const soa_a2v_layout& layout, uint8_t* out_buffer) {
+        auto stream = [out_buffer](size_t offset) { return reinterpret_cast<float*>(out_buffer + offset); };
+        uint32_t* bone_index = reinterpret_cast<uint32_t*>(out_buffer + layout.bone_index);
+        for (size_t i = 0; i < vertex_count; ++i) {
+            const a2v& vertex = vertices[i];
+            stream(layout.position[0])[i] = vertex.position.x;
+            stream(layout.position[1])[i] = vertex.position.y;
+            stream(layout.position[2])[i] = vertex.position.z;
+            stream(layout.normal[0])[i] = vertex.normal.x;
+            stream(layout.normal[1])[i] = vertex.normal.y;
+            stream(layout.normal[2])[i] = vertex.normal.z;
+            for (int32_t j = 0; j < 4; ++j) {
+                stream(layout.bone_weight[j])[i] = vertex.bone_weight[j];
+            }
+            bone_index[i] = vertex.bone_index[0] | (vertex.bone_index[1] << 8) | (vertex.bone_index[2] << 16) |
+                (static_cast<uint32_t>(vertex.bone_index[3]) << 24);
+            stream(layout.uv[0])[i] = vertex.uv0.x;
+            stream(layout.uv[1])[i] = vertex.uv0.y;
+            stream(layout.uv[2])[i] = vertex.uv1.x;
+            stream(layout.uv[3])[i] = vertex.uv1.y;
+        }
+    }
+
+
+    void unpack_a2v(const uint8_t* buffer, size_t vertex_count, const soa_a2v_layout& layout, a2v* out_vertices) {
+        auto stream = [buffer](size_t offset) { return reinterpret_cast<const float*>(buffer + offset); };
+        const uint32_t* bone_index = reinterpret_cast<const uint32_t*>(buffer + layout.bone_index);
+        for (size_t i = 0; i < vertex_count; ++i) {
+            a2v& vertex = out_vertices[i];
+            vertex.position = { stream(layout.position[0])[i], stream(layout.position[1])[i],
+                stream(layout.position[2])[i] };
+            vertex.normal = { stream(layout.normal[0])[i], stream(layout.normal[1])[i], stream(layout.normal[2])[i] };
+            for (int32_t j = 0; j < 4; ++j) {
+                vertex.bone_weight[j] = stream(layout.bone_weight[j])[i];
+                vertex.bone_index[j] = static_cast<uint8_t>(bone_index[i] >> (j * 8));
+            }
+            vertex.uv0 = { stream(layout.uv[0])[i], stream(layout.uv[1])[i] };
+            vertex.uv1 = { stream(layout.uv[2])[i], stream(layout.uv[3])[i] };
+        }
+    }
+
+
+    void unpack_v2f(const uint8_t* buffer, size_t vertex_count, const soa_v2f_layout& layout, v2f* out_vertices) {
+        auto stream = [buffer](size_t offset) { return reinterpret_cast<const float*>(buffer + offset); };
+        for (size_t i = 0; i < vertex_count; ++i) {
+            v2f& vertex = out_vertices[i];
+            vertex.position = { stream(layout.position[0])[i], stream(layout.position[1])[i],
+                stream(layout.position[2])[i] };
+            vertex.normal = { stream(layout.normal[0])[i], stream(layout.normal[1])[i], stream(layout.normal[2])[i] };
+            vertex.uv0 = { stream(layout.uv[0])[i], stream(layout.uv[1])[i] };
+            vertex.uv1 = { stream(layout.uv[2])[i], stream(layout.uv[3])[i] };
+        }
+    }
+
+
+    /// Weighted sum of the bone rows of a vertex, in the same order as skinning_kernel
+    inline void _blend_bones(const float* bones, const uint8_t bone_index[4], const float bone_weight[4],
+        float out_rows[12]) {
+        const float* bone = bones + bone_index[0] * skinning_floats_per_bone;
+        for (int32_t j = 0; j < 12; ++j) {
+            out_rows[j] = bone[j] * bone_weight[0];
+        }
+        for (int32_t i = 1; i < 4; ++i) {
+            bone = bones + bone_index[i] * skinning_floats_per_bone;
+            for (int32_t j = 0; j < 12; ++j) {
+                out_rows[j] += bone[j] * bone_weight[i];
+            }
+        }
+    }
+
+
+    // Vertex through a blended 3x4 transform, rows m[0..3], m[4..7], m[8..11]
+    inline void _transform_vertex(const a2v& vertex, const float* m, v2f& out) {
+        const float3& p = vertex.position;
+        const float3& n = vertex.normal;
+        out.position = {
+            p.x * m[0] + p.y * m[1] + p.z * m[2] + m[3],
+            p.x * m[4] + p.y * m[5] + p.z * m[6] + m[7],
+            p.x * m[8] + p.y * m[9] + p.z * m[10] + m[11],
+        };
+        out.normal = {
+            n.x * m[0] + n.y * m[1] + n.z * m[2],
+            n.x * m[4] + n.y * m[5] + n.z * m[6],
+            n.x * m[8] + n.y * m[9] + n.z * m[10],
+        };
+        out.uv0 = vertex.uv0;
+        out.uv1 = vertex.uv1;
+    }
+
+
+    void skin_scalar(const a2v* vertices, v2f* out_vertices, size_t begin, size_t end, const float* bones) {
+        for (size_t i = begin; i < end; ++i) {
+            float m[12];
+            _blend_bones(bones, vertices[i].bone_index, vertices[i].bone_weight, m);
+            _transform_vertex(vertices[i], m, out_vertices[i]);
+        }
+    }
+
+
+    float round_to(gemm_precision precision, float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t dropped_bits = precision == gemm_precision::fp16 ? 13 : 16;
+        if ((bits & 0x7F800000u) != 0x7F800000u) {
+            uint32_t lsb = (bits >> dropped_bits) & 1;
+            bits += (1u << (dropped_bits - 1)) - 1 + lsb;
+        }
+        bits &= ~((1u << dropped_bits) - 1);
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+
+    void skin_gemm(gemm_precision precision, const a2v* vertices, v2f* out_vertices, size_t begin, size_t end,
+        const float* bones, int32_t bone_count) {
+        // B operand: (padded bones x 16) palette, columns 12 to 15 and padding bones zero like the kernel tile
+        const int32_t tile = skinning_gemm_tile;
+        int32_t padded_bone_count = (bone_count + tile - 1) / tile * tile;
+        std::vector<float> palette(padded_bone_count * tile, 0.0f);
+        for (int32_t bone = 0; bone < bone_count; ++bone) {
+            for (int32_t column = 0; column < skinning_floats_per_bone; ++column) {
+                palette[bone * tile + column] = round_to(precision, bones[bone * skinning_floats_per_bone + column]);
+            }
+        }
+
+        std::vector<float> weights(tile * padded_bone_count);
+        for (size_t tile_begin = begin; tile_begin < end; tile_begin += tile) {
+            // A operand: dense (16 x padded bones) weights, and the K tiles any of the 16 vertices references
+            size_t row_count = std::min<size_t>(tile, end - tile_begin);
+            uint32_t k_tile_mask = 0;
+            std::fill(weights.begin(), weights.end(), 0.0f);
+            for (size_t row = 0; row < row_count; ++row) {
+                const a2v& vertex = vertices[tile_begin + row];
+                for (int32_t j = 0; j < 4; ++j) {
+                    if (vertex.bone_weight[j] != 0.0f) {
+                        float& weight = weights[row * padded_bone_count + vertex.bone_index[j]];
+                        weight = round_to(precision, weight + vertex.bone_weight[j]);
+                        k_tile_mask |= 1u << (vertex.bone_index[j] / tile);
+                    }
+                }
+            }
+
+            // C = A * B over the referenced K tiles only, the rest multiplies zeros
+            float blended[skinning_gemm_tile][skinning_gemm_tile] = {};
+            for (int32_t k_begin = 0; k_begin < padded_bone_count; k_begin += tile) {
+                if ((k_tile_mask & (1u << (k_begin / tile))) == 0) {
+                    continue;
+                }
+                for (size_t row = 0; row < row_count; ++row) {
+                    for (int32_t k = k_begin; k < k_begin + tile; ++k) {
+                        float weight = weights[row * padded_bone_count + k];
+                        for (int32_t column = 0; column < tile; ++column) {
+                            blended[row][column] += weight * palette[k * tile + column];
+                        }
+                    }
+                }
+            }
+            for (size_t row = 0; row < row_count; ++row) {
+                _transform_vertex(vertices[tile_begin + row], blended[row], out_vertices[tile_begin + row]);
+            }
+        }
+    }
+
+
+    float gemm_error_bound(gemm_precision precision, const a2v* vertices, size_t vertex_count, const float* bones,
+        int32_t bone_count) {
+        float max_bone = 0.0f;
+        for (int32_t i = 0; i < bone_count * skinning_floats_per_bone; ++i) {
+            max_bone = std::max(max_bone, std::fabs(bones[i]));
+        }
+        float max_coordinate = 1.0f;
+        for (size_t i = 0; i < vertex_count; ++i) {
+            const float3& p = vertices[i].position;
+            max_coordinate = std::max({ max_coordinate, std::fabs(p.x), std::fabs(p.y), std::fabs(p.z) });
+        }
+
+        // Unit roundoff of the operands, plus a few fp32 roundings of the accumulation and the transform
+        float u = precision == gemm_precision::fp16 ? 1.0f / 2048.0f : 1.0f / 256.0f;
+        float blend_error = max_bone * (2.0f * u + u * u + 16.0f / 16777216.0f);
+        return (3.0f * max_coordinate + 1.0f) * blend_error;
+    }
+
+
+    inline void _copy_uvs(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin, size_t end,
+        ptrdiff_t out_offset) {
+        for (int32_t j = 0; j < 4; ++j) {
+            memcpy(&out_vertices.uv[j][begin + out_offset], &vertices.uv[j][begin], (end - begin) * sizeof(float));
+        }
+    }
+
+
+    void skin_soa_scalar(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* bones, ptrdiff_t out_offset) {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t packed_index = vertices.bone_index[i];
+            uint8_t bone_index[4] = { static_cast<uint8_t>(packed_index), static_cast<uint8_t>(packed_index >> 8),
+                static_cast<uint8_t>(packed_index >> 16), static_cast<uint8_t>(packed_index >> 24) };
+            float bone_weight[4] = { vertices.bone_weight[0][i], vertices.bone_weight[1][i],
+                vertices.bone_weight[2][i], vertices.bone_weight[3][i] };
+            float m[12];
+            _blend_bones(bones, bone_index, bone_weight, m);
+
+            float px = vertices.position[0][i], py = vertices.position[1][i], pz = vertices.position[2][i];
+            float nx = vertices.normal[0][i], ny = vertices.normal[1][i], nz = vertices.normal[2][i];
+            for (int32_t r = 0; r < 3; ++r) {
+                const float* row = m + r * 4;
+                out_vertices.position[r][i + out_offset] = px * row[0] + py * row[1] + pz * row[2] + row[3];
+                out_vertices.normal[r][i + out_offset] = nx * row[0] + ny * row[1] + nz * row[2];
+            }
+        }
+        _copy_uvs(vertices, out_vertices, begin, end, out_offset);
+    }
+
+
+    SKINNING_TARGET_AVX2 void skin_soa_avx2(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* bones, ptrdiff_t out_offset) {
+        const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+        const __m256i floats_per_bone = _mm256_set1_epi32(skinning_floats_per_bone);
+
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            // 12 blended row values per lane, each gathered from the 4 bones of every vertex
+            __m256i packed_index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&vertices.bone_index[i]));
+            __m256 m[12];
+            for (int32_t k = 0; k < 4; ++k) {
+                __m256i bone_index = _mm256_and_si256(_mm256_srli_epi32(packed_index, k * 8), byte_mask);
+                __m256i bone_offset = _mm256_mullo_epi32(bone_index, floats_per_bone);
+                __m256 weight = _mm256_loadu_ps(&vertices.bone_weight[k][i]);
+                for (int32_t j = 0; j < 12; ++j) {
+                    __m256 value = _mm256_i32gather_ps(bones + j, bone_offset, 4);
+                    m[j] = (k == 0) ? _mm256_mul_ps(value, weight) : _mm256_fmadd_ps(value, weight, m[j]);
+                }
+            }
+
+            __m256 px = _mm256_loadu_ps(&vertices.position[0][i]);
+            __m256 py = _mm256_loadu_ps(&vertices.position[1][i]);
+            __m256 pz = _mm256_loadu_ps(&vertices.position[2][i]);
+            __m256 nx = _mm256_loadu_ps(&vertices.normal[0][i]);
+            __m256 ny = _mm256_loadu_ps(&vertices.normal[1][i]);
+            __m256 nz = _mm256_loadu_ps(&vertices.normal[2][i]);
+            for (int32_t r = 0; r < 3; ++r) {
+                const __m256* row = m + r * 4;
+                __m256 position = _mm256_fmadd_ps(pz, row[2], _mm256_fmadd_ps(py, row[1], _mm256_fmadd_ps(px, row[0], row[3])));
+                __m256 normal = _mm256_fmadd_ps(nz, row[2], _mm256_fmadd_ps(ny, row[1], _mm256_mul_ps(nx, row[0])));
+                _mm256_storeu_ps(&out_vertices.position[r][i + out_offset], position);
+                _mm256_storeu_ps(&out_vertices.normal[r][i + out_offset], normal);
+            }
+        }
+        skin_soa_scalar(vertices, out_vertices, i, end, bones, out_offset);
+        _copy_uvs(vertices, out_vertices, begin, i, out_offset);
+    }
+
+
+    SKINNING_TARGET_AVX512 void skin_soa_avx512(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin,
+        size_t end, const float* bones, ptrdiff_t out_offset) {
+        const __m512i byte_mask = _mm512_set1_epi32(0xFF);
+        const __m512i floats_per_bone = _mm512_set1_epi32(skinning_floats_per_bone);
+
+        size_t i = begin;
+        for (; i + 16 <= end; i += 16) {
+            __m512i packed_index = _mm512_loadu_si512(&vertices.bone_index[i]);
+            __m512 m[12];
+            for (int32_t k = 0; k < 4; ++k) {
+                // Zero masked over all lanes, GCC 12 flags the undefined pass-through of the unmasked forms
+                __m512i bone_index = _mm512_and_si512(_mm512_maskz_srli_epi32(0xFFFF, packed_index, k * 8), byte_mask);
+                __m512i bone_offset = _mm512_mullo_epi32(bone_index, floats_per_bone);
+                __m512 weight = _mm512_loadu_ps(&vertices.bone_weight[k][i]);
+                for (int32_t j = 0; j < 12; ++j) {
+                    __m512 value = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xFFFF, bone_offset, bones + j, 4);
+                    m[j] = (k == 0) ? _mm512_mul_ps(value, weight) : _mm512_fmadd_ps(value, weight, m[j]);
+                }
+            }
+
+            __m512 px = _mm512_loadu_ps(&vertices.position[0][i]);
+            __m512 py = _mm512_loadu_ps(&vertices.position[1][i]);
+            __m512 pz = _mm512_loadu_ps(&vertices.position[2][i]);
+            __m512 nx = _mm512_loadu_ps(&vertices.normal[0][i]);
+            __m512 ny = _mm512_loadu_ps(&vertices.normal[1][i]);
+            __m512 nz = _mm512_loadu_ps(&vertices.normal[2][i]);
+            for (int32_t r = 0; r < 3; ++r) {
+                const __m512* row = m + r * 4;
+                __m512 position = _mm512_fmadd_ps(pz, row[2], _mm512_fmadd_ps(py, row[1], _mm512_fmadd_ps(px, row[0], row[3])));
+                __m512 normal = _mm512_fmadd_ps(nz, row[2], _mm512_fmadd_ps(ny, row[1], _mm512_mul_ps(nx, row[0])));
+                _mm512_storeu_ps(&out_vertices.position[r][i + out_offset], position);
+                _mm512_storeu_ps(&out_vertices.normal[r][i + out_offset], normal);
+            }
+        }
+        skin_soa_scalar(vertices, out_vertices, i, end, bones, out_offset);
+        _copy_uvs(vertices, out_vertices, begin, i, out_offset);
+    }
+
+
+    // Split [0, count) in one chunk per thread, chunk sizes a multiple of alignment, the calling thread takes the first
+    template <typename Func>
+    void _parallel_chunks(size_t count, size_t alignment, uint32_t thread_count, Func func) {
+        if (thread_count == 0) {
+            thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        size_t chunk_size = ((count + thread_count - 1) / thread_count + alignment - 1) / alignment * alignment;
+        if (thread_count == 1 || chunk_size >= count) {
+            func(size_t(0), count);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t begin = chunk_size; begin < count; begin += chunk_size) {
+            workers.emplace_back(func, begin, std::min(begin + chunk_size, count));
+        }
+        func(size_t(0), chunk_size);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+
+    inline auto _soa_skin_func(cpu_variant variant) {
+        if (variant == cpu_variant::best) {
+            variant = has_avx512() ? cpu_variant::avx512 : (has_avx2() ? cpu_variant::avx2 : cpu_variant::soa_scalar);
+        }
+        auto skin_func = skin_soa_scalar;
+        if (variant == cpu_variant::avx2) {
+            skin_func = skin_soa_avx2;
+        }
+        else if (variant == cpu_variant::avx512) {
+            skin_func = skin_soa_avx512;
+        }
+        return skin_func;
+    }
+
+
+    void skin_soa(cpu_variant variant, const soa_a2v& vertices, soa_v2f& out_vertices, const float* bones,
+        uint32_t thread_count) {
+        auto skin_func = _soa_skin_func(variant);
+
+        // Chunks are whole 64 vertex blocks, so only the last chunk has a scalar tail
+        out_vertices.resize(vertices.size());
+        _parallel_chunks(vertices.size(), 64, thread_count, [&](size_t begin, size_t end) {
+            skin_func(vertices, out_vertices, begin, end, bones, 0);
+        });
+    }
+
+
+    void make_skin_tiles(const skin_instance* instances, uint32_t instance_count, uint32_t tile_size,
+        std::vector<skin_tile>& out_tiles) {
+        out_tiles.clear();
+        for (uint32_t instance = 0; instance < instance_count; ++instance) {
+            uint32_t vertex_count = instances[instance].vertex_count;
+            for (uint32_t offset = 0; offset < vertex_count; offset += tile_size) {
+                out_tiles.push_back({ instance, offset, std::min(tile_size, vertex_count - offset) });
+            }
+        }
+    }
+
+
+    void skin_batch(cpu_variant variant, const soa_a2v& vertices, soa_v2f& out_vertices,
+        const skin_instance* instances, uint32_t instance_count, const float* palettes, uint32_t thread_count) {
+        // Tiles of 1024 vertices keep the SIMD loops long and still split a batch of small characters evenly
+        const uint32_t tile_size = 1024;
+        auto skin_func = _soa_skin_func(variant);
+        std::vector<skin_tile> tiles;
+        make_skin_tiles(instances, instance_count, tile_size, tiles);
+
+        size_t out_count = 0;
+        for (uint32_t i = 0; i < instance_count; ++i) {
+            out_count = std::max(out_count, size_t(instances[i].out_begin) + instances[i].vertex_count);
+        }
+        if (out_vertices.size() < out_count) {
+            out_vertices.resize(out_count);
+        }
+
+        _parallel_chunks(tiles.size(), 1, thread_count, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; ++t) {
+                const skin_tile& tile = tiles[t];
+                const skin_instance& instance = instances[tile.instance];
+                size_t vertex_begin = size_t(instance.vertex_begin) + tile.vertex_offset;
+                ptrdiff_t out_offset = ptrdiff_t(instance.out_begin) - ptrdiff_t(instance.vertex_begin);
+                skin_func(vertices, out_vertices, vertex_begin, vertex_begin + tile.vertex_count,
+                    palettes + size_t(instance.palette_offset) * skinning_floats_per_bone, out_offset);
+            }
+        });
+    }
+
+
+    void evaluate_skeleton(const skeleton& rig, const joint_trs* local_poses, float* out_palette) {
+        int32_t joint_count = rig.joint_count();
+        std::vector<float> model(joint_count * skinning_floats_per_bone);
+        for (int32_t joint = 0; joint < joint_count; ++joint) {
+            float* joint_model = &model[joint * skinning_floats_per_bone];
+            int32_t parent = rig.parents[joint];
+            if (parent < 0) {
+                trs_to_affine(local_poses[joint], joint_model);
+            }
+            else {
+                float local[skinning_floats_per_bone];
+                trs_to_affine(local_poses[joint], local);
+                multiply_affine(&model[parent * skinning_floats_per_bone], local, joint_model);
+            }
+            multiply_affine(joint_model, &rig.inverse_bind[joint * skinning_floats_per_bone],
+                out_palette + joint * skinning_floats_per_bone);
+        }
+    }
+
+
+    void evaluate_skeletons(const skeleton& rig, const joint_trs* local_poses, uint32_t instance_count,
+        float* out_palettes, uint32_t thread_count) {
+        size_t joint_count = rig.joint_count();
+        _parallel_chunks(instance_count, 1, thread_count, [&](size_t begin, size_t end) {
+            for (size_t instance = begin; instance < end; ++instance) {
+                evaluate_skeleton(rig, local_poses + instance * joint_count,
+                    out_palettes + instance * joint_count * skinning_floats_per_bone);
+            }
+        });
+    }
+
+
+    int32_t joint_depths(const skeleton& rig, std::vector<uint8_t>& out_depths) {
+        int32_t level_count = 0;
+        out_depths.resize(rig.joint_count());
+        for (int32_t joint = 0; joint < rig.joint_count(); ++joint) {
+            int32_t parent = rig.parents[joint];
+            out_depths[joint] = parent < 0 ? 0 : static_cast<uint8_t>(out_depths[parent] + 1);
+            level_count = std::max(level_count, out_depths[joint] + 1);
+        }
+        return level_count;
+    }
+
+
+    float max_error(const v2f* a, const v2f* b, size_t vertex_count) {
+        static_assert(sizeof(v2f) == 10 * sizeof(float), "v2f must be made of floats only");
+        float error = 0.0f;
+        const float* values_a = reinterpret_cast<const float*>(a);
+        const float* values_b = reinterpret_cast<const float*>(b);
+        for (size_t i = 0; i < vertex_count * 10; ++i) {
+            error = std::max(error, std::fabs(values_a[i] - values_b[i]));
+        }
+        return error;
+    }
+
+
+    // Uniform in [min_value, max_value), LCG shared by the generators so a seed gives the same data everywhere
+    inline float _random_float(uint32_t& seed, float min_value, float max_value) {
+        seed = seed * 1664525u + 1013904223u;
+        return min_value + (max_value - min_value) * static_cast<float>(seed >> 8) / static_cast<float>(1 << 24);
+    }
+
+
+    // Quaternion of a random axis and an angle up to max_angle radians either way
+    void _random_rotation(float (&out_rotation)[4], float max_angle, uint32_t& seed) {
+        float x = _random_float(seed, -1.0f, 1.0f);
+        float y = _random_float(seed, -1.0f, 1.0f);
+        float z = _random_float(seed, -1.0f, 1.0f);
+        float length = std::sqrt(x * x + y * y + z * z);
+        if (length < 1e-3f) {
+            x = length = 1.0f;
+            y = z = 0.0f;
+        }
+        float half_angle = _random_float(seed, -max_angle, max_angle) * 0.5f;
+        float s = std::sin(half_angle) / length;
+        out_rotation[0] = x * s;
+        out_rotation[1] = y * s;
+        out_rotation[2] = z * s;
+        out_rotation[3] = std::cos(half_angle);
+    }
+
+
+    // Inverse of a rotation plus translation: transposed rotation and negated, inverse rotated translation
+    void _invert_rigid(const float m[12], float out[12]) {
+        for (int32_t r = 0; r < 3; ++r) {
+            for (int32_t c = 0; c < 3; ++c) {
+                out[r * 4 + c] = m[c * 4 + r];
+            }
+            out[r * 4 + 3] = -(m[r] * m[3] + m[4 + r] * m[7] + m[8 + r] * m[11]);
+        }
+    }
+
+
+    void generate_bones(float* out_bones, int32_t bone_count, uint32_t seed) {
+        for (int32_t bone = 0; bone < bone_count; ++bone) {
+            joint_trs trs;
+            _random_rotation(trs.rotation, 3.14159265f, seed);
+            for (int32_t i = 0; i < 3; ++i) {
+                trs.translation[i] = _random_float(seed, -1.0f, 1.0f);
+                trs.scale[i] = 1.0f;
+            }
+            trs_to_affine(trs, out_bones + bone * skinning_floats_per_bone);
+        }
+    }
+
+
+    void generate_skeleton(skeleton& out_rig, int32_t joint_count, uint32_t seed) {
+        out_rig.parents.resize(joint_count);
+        out_rig.bind_pose.resize(joint_count);
+        out_rig.inverse_bind.resize(joint_count * skinning_floats_per_bone);
+        std::vector<float> bind_model(joint_count * skinning_floats_per_bone);
+        for (int32_t joint = 0; joint < joint_count; ++joint) {
+            int32_t parent_offset = static_cast<int32_t>(_random_float(seed, 0.0f,
+                static_cast<float>(std::min(joint, 4))));
+            int32_t parent = joint == 0 ? -1 : joint - 1 - std::min(parent_offset, joint - 1);
+            out_rig.parents[joint] = parent;
+
+            // Rigid bind pose, bones about a tenth of the model long
+            joint_trs& trs = out_rig.bind_pose[joint];
+            _random_rotation(trs.rotation, 0.5f, seed);
+            for (int32_t i = 0; i < 3; ++i) {
+                trs.translation[i] = _random_float(seed, -0.1f, 0.1f);
+                trs.scale[i] = 1.0f;
+            }
+
+            float* joint_model = &bind_model[joint * skinning_floats_per_bone];
+            if (parent < 0) {
+                trs_to_affine(trs, joint_model);
+            }
+            else {
+                float local[skinning_floats_per_bone];
+                trs_to_affine(trs, local);
+                multiply_affine(&bind_model[parent * skinning_floats_per_bone], local, joint_model);
+            }
+            _invert_rigid(joint_model, &out_rig.inverse_bind[joint * skinning_floats_per_bone]);
+        }
+    }
+
+
+    void generate_poses(const skeleton& rig, joint_trs* out_poses, uint32_t instance_count, uint32_t seed) {
+        // Bind rotation turned a little further per joint, delta * bind, with some squash and stretch
+        size_t joint_count = rig.joint_count();
+        for (size_t i = 0; i < instance_count * joint_count; ++i) {
+            const joint_trs& bind = rig.bind_pose[i % joint_count];
+            const float* q = bind.rotation;
+            float d[4];
+            _random_rotation(d, 0.6f, seed);
+            joint_trs& pose = out_poses[i];
+            pose.rotation[0] = d[3] * q[0] + d[0] * q[3] + d[1] * q[2] - d[2] * q[1];
+            pose.rotation[1] = d[3] * q[1] - d[0] * q[2] + d[1] * q[3] + d[2] * q[0];
+            pose.rotation[2] = d[3] * q[2] + d[0] * q[1] - d[1] * q[0] + d[2] * q[3];
+            pose.rotation[3] = d[3] * q[3] - d[0] * q[0] - d[1] * q[1] - d[2] * q[2];
+            for (int32_t j = 0; j < 3; ++j) {
+                pose.translation[j] = bind.translation[j];
+                pose.scale[j] = _random_float(seed, 0.9f, 1.1f);
+            }
+        }
+    }
+
+
+    void generate_vertices(a2v* out_vertices, size_t vertex_count, int32_t bone_count, uint32_t seed) {
+        for (size_t i = 0; i < vertex_count; ++i) {
+            a2v& vertex = out_vertices[i];
+            vertex.position = { _random_float(seed, -1.0f, 1.0f), _random_float(seed, -1.0f, 1.0f),
+                _random_float(seed, -1.0f, 1.0f) };
+            float nx = _random_float(seed, -1.0f, 1.0f);
+            float ny = _random_float(seed, -1.0f, 1.0f);
+            float nz = _random_float(seed, -1.0f, 1.0f);
+            float length = std::max(std::sqrt(nx * nx + ny * ny + nz * nz), 1e-3f);
+            vertex.normal = { nx / length, ny / length, nz / length };
+
+            // Mostly 1 or 2 influences like a character mesh, on bones close to each other in the hierarchy
+            float influence_roll = _random_float(seed, 0.0f, 1.0f);
+            int32_t influence_count = influence_roll < 0.4f ? 1 : (influence_roll < 0.7f ? 2 : (influence_roll < 0.9f ? 3 : 4));
+            int32_t first_bone = static_cast<int32_t>(_random_float(seed, 0.0f, static_cast<float>(bone_count)));
+            float weight_sum = 0.0f;
+            for (int32_t j = 0; j < 4; ++j) {
+                bool is_used = j < influence_count;
+                vertex.bone_index[j] = static_cast<uint8_t>(is_used ? (first_bone + j) % bone_count : 0);
+                vertex.bone_weight[j] = is_used ? _random_float(seed, 0.1f, 1.0f) : 0.0f;
+                weight_sum += vertex.bone_weight[j];
+            }
+            for (int32_t j = 0; j < 4; ++j) {
+                vertex.bone_weight[j] /= weight_sum;
+            }
+            vertex.uv0 = { _random_float(seed, 0.0f, 1.0f), _random_float(seed, 0.0f, 1.0f) };
+            vertex.uv1 = { _random_float(seed, 0.0f, 1.0f), _random_float(seed, 0.0f, 1.0f) };
+        }
+    }
+}
+#endif // SKINNING_CPU_IMPLEMENTATION
@@ -0,0 +1,49 @@
+// Dual quaternion vertex path, the device side of skinning_dq.h
+//
+// Palettes are 2 float4 per bone, real then dual part, written by the s2 skeleton kernel in
+// skinning_mode::dual_quaternion. Staged palettes take two thirds of the shared memory of 3x4 rows, and the 4
+// influences of a vertex read 8 floats each instead of 12.
+
+#pragma once
+
+#include <cuda_runtime.h>
+#include <stdint.h>
+#include "cutil_math.cu"
+#include "skinning_types.h"
+#include "skinning_palette.cu"
+#include "skinning_s1.cu"
+
+// One vertex of IN skinned with staged dual quaternions, written at out_id of OUT. Later influences are flipped into
+// the hemisphere of the first one, as in skinning::skin_dq_scalar.
+__device__ inline void skin_vertex_dq_soa(const a2v_streams& IN, const v2f_streams& OUT, int32_t vertex_id,
+    size_t out_id, const float4* dual_quats) {
+    uint32_t bone_indices = __ldg(&IN.bone_index[vertex_id]);
+    float4 first = dual_quats[(bone_indices & 0xFF) * 2];
+    float4 real = make_float4(0.0f), dual = make_float4(0.0f);
+#pragma unroll
+    for (int32_t i = 0; i < 4; ++i) {
+        int bone_index = (bone_indices >> (i * 8)) & 0xFF;
+        float bone_weight = __ldg(&IN.bone_weight[i][vertex_id]);
+        float4 bone_real = dual_quats[bone_index * 2 + 0];
+        bone_weight = dot(bone_real, first) < 0.0f ? -bone_weight : bone_weight;
+        real += bone_real * bone_weight;
+        dual += dual_quats[bone_index * 2 + 1] * bone_weight;
+    }
+
+    float dq[8] = { real.x, real.y, real.z, real.w, dual.x, dual.y, dual.z, dual.w };
+    float position[3] = { __ldg(&IN.position[0][vertex_id]), __ldg(&IN.position[1][vertex_id]),
+        __ldg(&IN.position[2][vertex_id]) };
+    float normal[3] = { __ldg(&IN.normal[0][vertex_id]), __ldg(&IN.normal[1][vertex_id]),
+        __ldg(&IN.normal[2][vertex_id]) };
+    float out_position[3], out_normal[3];
+    dual_quat_transform(dq, position, normal, out_position, out_normal);
+#pragma unroll
+    for (int32_t i = 0; i < 3; ++i) {
+        OUT.position[i][out_id] = out_position[i];
+        OUT.normal[i][out_id] = out_normal[i];
+    }
+#pragma unroll
+    for (int32_t i = 0; i < 4; ++i) {
+        OUT.uv[i][out_id] = __ldg(&IN.uv[i][vertex_id]);
+    }
+}
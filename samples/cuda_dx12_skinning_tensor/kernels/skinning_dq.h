@@ -0,0 +1,346 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "skinning_types.h"
+#include "skinning_cpu.h"
+
+
+///
+/// skinning_dq Header - CPU dual quaternion skinning, the rigid alternative to linear blend skinning
+///
+/// The skeleton stage converts every palette entry to a unit dual quaternion (affine_to_dual_quat), 8 floats instead
+/// of 12. A vertex blends the dual quaternions of its bones, each flipped into the hemisphere of its first bone so
+/// the blend takes the short way, then normalizes and applies the result as a rotation followed by a translation.
+/// Joints twisted far apart keep their volume where blended matrices collapse towards the axis. Palettes are rigid,
+/// scale in a palette entry is dropped by the conversion.
+///
+/// Paths mirror the linear ones of skinning_cpu.h: packed scalar reference, SoA scalar, AVX2 and AVX-512 gathering 8
+/// components per influence instead of 12. skinning_mode selects linear or dual quaternion skinning per mesh.
+///
+namespace skinning {
+    /// Dual quaternions of bone_count palette entries, skinning_floats_per_dual_quat floats each
+    void palette_to_dual_quats(const float* bones, int32_t bone_count, float* out_dual_quats);
+
+    /// evaluate_skeletons with its palettes converted, joint_count dual quaternions per instance
+    void evaluate_skeletons_dq(const skeleton& rig, const joint_trs* local_poses, uint32_t instance_count,
+        float* out_dual_quats, uint32_t thread_count = 0);
+
+    /// Skin vertices [begin, end) with skinning_floats_per_dual_quat floats per bone, as skin_scalar and skin_soa_*
+    void skin_dq_scalar(const a2v* vertices, v2f* out_vertices, size_t begin, size_t end, const float* dual_quats);
+    void skin_dq_soa_scalar(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* dual_quats, ptrdiff_t out_offset = 0);
+    void skin_dq_soa_avx2(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* dual_quats, ptrdiff_t out_offset = 0);
+    void skin_dq_soa_avx512(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* dual_quats, ptrdiff_t out_offset = 0);
+
+    /// Skin all vertices in the mode of the mesh, palette holds skinning_floats_per_bone or
+    /// skinning_floats_per_dual_quat floats per bone to match. Chunked over thread_count threads like skin_soa.
+    void skin_soa(skinning_mode mode, cpu_variant variant, const soa_a2v& vertices, soa_v2f& out_vertices,
+        const float* palette, uint32_t thread_count = 0);
+}
+
+
+///
+/// Implementation
+///
+#if defined(SKINNING_DQ_IMPLEMENTATION)
+#if !defined(SKINNING_CPU_IMPLEMENTATION)
+#error "SKINNING_DQ_IMPLEMENTATION uses skinning_cpu.h internals, define SKINNING_CPU_IMPLEMENTATION in the same file"
+#endif
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#if !defined(SKINNING_TARGET_AVX2)
+#if defined(_MSC_VER)
+#define SKINNING_TARGET_AVX2
+#define SKINNING_TARGET_AVX512
+#else
+#define SKINNING_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define SKINNING_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+namespace skinning {
+    void palette_to_dual_quats(const float* bones, int32_t bone_count, float* out_dual_quats) {
+        for (int32_t bone = 0; bone < bone_count; ++bone) {
+            affine_to_dual_quat(bones + bone * skinning_floats_per_bone,
+                out_dual_quats + bone * skinning_floats_per_dual_quat);
+        }
+    }
+
+
+    void evaluate_skeletons_dq(const skeleton& rig, const joint_trs* local_poses, uint32_t instance_count,
+        float* out_dual_quats, uint32_t thread_count) {
+        size_t joint_count = rig.joint_count();
+        _parallel_chunks(instance_count, 1, thread_count, [&](size_t begin, size_t end) {
+            std::vector<float> palette(joint_count * skinning_floats_per_bone);
+            for (size_t instance = begin; instance < end; ++instance) {
+                evaluate_skeleton(rig, local_poses + instance * joint_count, palette.data());
+                palette_to_dual_quats(palette.data(), static_cast<int32_t>(joint_count),
+                    out_dual_quats + instance * joint_count * skinning_floats_per_dual_quat);
+            }
+        });
+    }
+
+
+    // Weighted sum of the dual quaternions of 4 bones, signs of the later ones matched to the first real part
+    inline void _blend_dual_quats(const float* dual_quats, const uint8_t bone_index[4], const float bone_weight[4],
+        float out_dq[8]) {
+        const float* first = dual_quats + bone_index[0] * skinning_floats_per_dual_quat;
+        for (int32_t j = 0; j < 8; ++j) {
+            out_dq[j] = first[j] * bone_weight[0];
+        }
+        for (int32_t i = 1; i < 4; ++i) {
+            const float* dq = dual_quats + bone_index[i] * skinning_floats_per_dual_quat;
+            float hemisphere = dq[0] * first[0] + dq[1] * first[1] + dq[2] * first[2] + dq[3] * first[3];
+            float weight = hemisphere < 0.0f ? -bone_weight[i] : bone_weight[i];
+            for (int32_t j = 0; j < 8; ++j) {
+                out_dq[j] += dq[j] * weight;
+            }
+        }
+    }
+
+
+    void skin_dq_scalar(const a2v* vertices, v2f* out_vertices, size_t begin, size_t end, const float* dual_quats) {
+        for (size_t i = begin; i < end; ++i) {
+            const a2v& vertex = vertices[i];
+            float dq[8];
+            _blend_dual_quats(dual_quats, vertex.bone_index, vertex.bone_weight, dq);
+            float p[3] = { vertex.position.x, vertex.position.y, vertex.position.z };
+            float n[3] = { vertex.normal.x, vertex.normal.y, vertex.normal.z };
+            float out_p[3], out_n[3];
+            dual_quat_transform(dq, p, n, out_p, out_n);
+            v2f& out = out_vertices[i];
+            out.position = { out_p[0], out_p[1], out_p[2] };
+            out.normal = { out_n[0], out_n[1], out_n[2] };
+            out.uv0 = vertex.uv0;
+            out.uv1 = vertex.uv1;
+        }
+    }
+
+
+    void skin_dq_soa_scalar(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin, size_t end,
+        const float* dual_quats, ptrdiff_t out_offset) {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t packed_index = vertices.bone_index[i];
+            uint8_t bone_index[4] = { static_cast<uint8_t>(packed_index), static_cast<uint8_t>(packed_index >> 8),
+                static_cast<uint8_t>(packed_index >> 16), static_cast<uint8_t>(packed_index >> 24) };
+            float bone_weight[4] = { vertices.bone_weight[0][i], vertices.bone_weight[1][i],
+                vertices.bone_weight[2][i], vertices.bone_weight[3][i] };
+            float dq[8];
+            _blend_dual_quats(dual_quats, bone_index, bone_weight, dq);
+
+            float p[3] = { vertices.position[0][i], vertices.position[1][i], vertices.position[2][i] };
+            float n[3] = { vertices.normal[0][i], vertices.normal[1][i], vertices.normal[2][i] };
+            float out_p[3], out_n[3];
+            dual_quat_transform(dq, p, n, out_p, out_n);
+            for (int32_t r = 0; r < 3; ++r) {
+                out_vertices.position[r][i + out_offset] = out_p[r];
+                out_vertices.normal[r][i + out_offset] = out_n[r];
+            }
+        }
+        _copy_uvs(vertices, out_vertices, begin, end, out_offset);
+    }
+
+
+    SKINNING_TARGET_AVX2 void skin_dq_soa_avx2(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin,
+        size_t end, const float* dual_quats, ptrdiff_t out_offset) {
+        const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+        const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 two = _mm256_set1_ps(2.0f);
+
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            // 8 blended components per lane, gathered from the 4 bones of every vertex
+            __m256i packed_index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&vertices.bone_index[i]));
+            __m256 dq[8], first[4];
+            {
+                __m256i bone_offset = _mm256_slli_epi32(_mm256_and_si256(packed_index, byte_mask), 3);
+                __m256 weight = _mm256_loadu_ps(&vertices.bone_weight[0][i]);
+                for (int32_t j = 0; j < 8; ++j) {
+                    __m256 value = _mm256_i32gather_ps(dual_quats + j, bone_offset, 4);
+                    if (j < 4) {
+                        first[j] = value;
+                    }
+                    dq[j] = _mm256_mul_ps(value, weight);
+                }
+            }
+            for (int32_t k = 1; k < 4; ++k) {
+                __m256i bone_index = _mm256_and_si256(_mm256_srli_epi32(packed_index, k * 8), byte_mask);
+                __m256i bone_offset = _mm256_slli_epi32(bone_index, 3);
+                __m256 weight = _mm256_loadu_ps(&vertices.bone_weight[k][i]);
+                __m256 value[8];
+                for (int32_t j = 0; j < 8; ++j) {
+                    value[j] = _mm256_i32gather_ps(dual_quats + j, bone_offset, 4);
+                }
+                __m256 hemisphere = _mm256_fmadd_ps(value[3], first[3], _mm256_fmadd_ps(value[2], first[2],
+                    _mm256_fmadd_ps(value[1], first[1], _mm256_mul_ps(value[0], first[0]))));
+                weight = _mm256_xor_ps(weight, _mm256_and_ps(hemisphere, sign_mask));
+                for (int32_t j = 0; j < 8; ++j) {
+                    dq[j] = _mm256_fmadd_ps(value[j], weight, dq[j]);
+                }
+            }
+
+            __m256 length_sq = _mm256_fmadd_ps(dq[3], dq[3], _mm256_fmadd_ps(dq[2], dq[2],
+                _mm256_fmadd_ps(dq[1], dq[1], _mm256_mul_ps(dq[0], dq[0]))));
+            __m256 scale = _mm256_and_ps(_mm256_div_ps(one, _mm256_sqrt_ps(length_sq)),
+                _mm256_cmp_ps(length_sq, zero, _CMP_GT_OQ));
+            __m256 x = _mm256_mul_ps(dq[0], scale), y = _mm256_mul_ps(dq[1], scale);
+            __m256 z = _mm256_mul_ps(dq[2], scale), w = _mm256_mul_ps(dq[3], scale);
+            __m256 dx = _mm256_mul_ps(dq[4], scale), dy = _mm256_mul_ps(dq[5], scale);
+            __m256 dz = _mm256_mul_ps(dq[6], scale), dw = _mm256_mul_ps(dq[7], scale);
+
+            // Translation 2 * (w * d.xyz - d.w * q.xyz + q.xyz x d.xyz)
+            __m256 t[3] = {
+                _mm256_mul_ps(two, _mm256_fmsub_ps(y, dz, _mm256_fmadd_ps(z, dy, _mm256_fmsub_ps(dw, x,
+                    _mm256_mul_ps(w, dx))))),
+                _mm256_mul_ps(two, _mm256_fmsub_ps(z, dx, _mm256_fmadd_ps(x, dz, _mm256_fmsub_ps(dw, y,
+                    _mm256_mul_ps(w, dy))))),
+                _mm256_mul_ps(two, _mm256_fmsub_ps(x, dy, _mm256_fmadd_ps(y, dx, _mm256_fmsub_ps(dw, z,
+                    _mm256_mul_ps(w, dz))))),
+            };
+
+            // v + 2 * q.xyz x (q.xyz x v + w * v), for the position then the normal
+            for (int32_t a = 0; a < 2; ++a) {
+                const std::vector<float>* in_streams = a == 0 ? vertices.position : vertices.normal;
+                std::vector<float>* out_streams = a == 0 ? out_vertices.position : out_vertices.normal;
+                __m256 vx = _mm256_loadu_ps(&in_streams[0][i]);
+                __m256 vy = _mm256_loadu_ps(&in_streams[1][i]);
+                __m256 vz = _mm256_loadu_ps(&in_streams[2][i]);
+                __m256 cx = _mm256_fmadd_ps(w, vx, _mm256_fmsub_ps(y, vz, _mm256_mul_ps(z, vy)));
+                __m256 cy = _mm256_fmadd_ps(w, vy, _mm256_fmsub_ps(z, vx, _mm256_mul_ps(x, vz)));
+                __m256 cz = _mm256_fmadd_ps(w, vz, _mm256_fmsub_ps(x, vy, _mm256_mul_ps(y, vx)));
+                __m256 rx = _mm256_fmadd_ps(two, _mm256_fmsub_ps(y, cz, _mm256_mul_ps(z, cy)), vx);
+                __m256 ry = _mm256_fmadd_ps(two, _mm256_fmsub_ps(z, cx, _mm256_mul_ps(x, cz)), vy);
+                __m256 rz = _mm256_fmadd_ps(two, _mm256_fmsub_ps(x, cy, _mm256_mul_ps(y, cx)), vz);
+                if (a == 0) {
+                    rx = _mm256_add_ps(rx, t[0]);
+                    ry = _mm256_add_ps(ry, t[1]);
+                    rz = _mm256_add_ps(rz, t[2]);
+                }
+                _mm256_storeu_ps(&out_streams[0][i + out_offset], rx);
+                _mm256_storeu_ps(&out_streams[1][i + out_offset], ry);
+                _mm256_storeu_ps(&out_streams[2][i + out_offset], rz);
+            }
+        }
+        skin_dq_soa_scalar(vertices, out_vertices, i, end, dual_quats, out_offset);
+        _copy_uvs(vertices, out_vertices, begin, i, out_offset);
+    }
+
+
+    SKINNING_TARGET_AVX512 void skin_dq_soa_avx512(const soa_a2v& vertices, soa_v2f& out_vertices, size_t begin,
+        size_t end, const float* dual_quats, ptrdiff_t out_offset) {
+        const __m512i byte_mask = _mm512_set1_epi32(0xFF);
+        const __m512i sign_mask = _mm512_set1_epi32(static_cast<int32_t>(0x80000000u));
+        const __m512 two = _mm512_set1_ps(2.0f);
+        const __m512 zero = _mm512_setzero_ps();
+
+        size_t i = begin;
+        for (; i + 16 <= end; i += 16) {
+            __m512i packed_index = _mm512_loadu_si512(&vertices.bone_index[i]);
+            __m512 dq[8], first[4];
+            // Shifts, gathers and the square root are zero masked over all lanes, GCC 12 flags the undefined
+            // pass-through of the unmasked forms
+            {
+                __m512i bone_offset = _mm512_maskz_slli_epi32(0xFFFF, _mm512_and_si512(packed_index, byte_mask), 3);
+                __m512 weight = _mm512_loadu_ps(&vertices.bone_weight[0][i]);
+                for (int32_t j = 0; j < 8; ++j) {
+                    __m512 value = _mm512_mask_i32gather_ps(zero, 0xFFFF, bone_offset, dual_quats + j, 4);
+                    if (j < 4) {
+                        first[j] = value;
+                    }
+                    dq[j] = _mm512_mul_ps(value, weight);
+                }
+            }
+            for (int32_t k = 1; k < 4; ++k) {
+                __m512i bone_index = _mm512_and_si512(_mm512_maskz_srli_epi32(0xFFFF, packed_index, k * 8), byte_mask);
+                __m512i bone_offset = _mm512_maskz_slli_epi32(0xFFFF, bone_index, 3);
+                __m512 weight = _mm512_loadu_ps(&vertices.bone_weight[k][i]);
+                __m512 value[8];
+                for (int32_t j = 0; j < 8; ++j) {
+                    value[j] = _mm512_mask_i32gather_ps(zero, 0xFFFF, bone_offset, dual_quats + j, 4);
+                }
+                __m512 hemisphere = _mm512_fmadd_ps(value[3], first[3], _mm512_fmadd_ps(value[2], first[2],
+                    _mm512_fmadd_ps(value[1], first[1], _mm512_mul_ps(value[0], first[0]))));
+                __m512i sign = _mm512_and_si512(_mm512_castps_si512(hemisphere), sign_mask);
+                weight = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(weight), sign));
+                for (int32_t j = 0; j < 8; ++j) {
+                    dq[j] = _mm512_fmadd_ps(value[j], weight, dq[j]);
+                }
+            }
+
+            __m512 length_sq = _mm512_fmadd_ps(dq[3], dq[3], _mm512_fmadd_ps(dq[2], dq[2],
+                _mm512_fmadd_ps(dq[1], dq[1], _mm512_mul_ps(dq[0], dq[0]))));
+            __mmask16 is_valid = _mm512_cmp_ps_mask(length_sq, _mm512_setzero_ps(), _CMP_GT_OQ);
+            __m512 scale = _mm512_maskz_div_ps(is_valid, _mm512_set1_ps(1.0f), _mm512_maskz_sqrt_ps(0xFFFF, length_sq));
+            __m512 x = _mm512_mul_ps(dq[0], scale), y = _mm512_mul_ps(dq[1], scale);
+            __m512 z = _mm512_mul_ps(dq[2], scale), w = _mm512_mul_ps(dq[3], scale);
+            __m512 dx = _mm512_mul_ps(dq[4], scale), dy = _mm512_mul_ps(dq[5], scale);
+            __m512 dz = _mm512_mul_ps(dq[6], scale), dw = _mm512_mul_ps(dq[7], scale);
+
+            __m512 t[3] = {
+                _mm512_mul_ps(two, _mm512_fmsub_ps(y, dz, _mm512_fmadd_ps(z, dy, _mm512_fmsub_ps(dw, x,
+                    _mm512_mul_ps(w, dx))))),
+                _mm512_mul_ps(two, _mm512_fmsub_ps(z, dx, _mm512_fmadd_ps(x, dz, _mm512_fmsub_ps(dw, y,
+                    _mm512_mul_ps(w, dy))))),
+                _mm512_mul_ps(two, _mm512_fmsub_ps(x, dy, _mm512_fmadd_ps(y, dx, _mm512_fmsub_ps(dw, z,
+                    _mm512_mul_ps(w, dz))))),
+            };
+
+            for (int32_t a = 0; a < 2; ++a) {
+                const std::vector<float>* in_streams = a == 0 ? vertices.position : vertices.normal;
+                std::vector<float>* out_streams = a == 0 ? out_vertices.position : out_vertices.normal;
+                __m512 vx = _mm512_loadu_ps(&in_streams[0][i]);
+                __m512 vy = _mm512_loadu_ps(&in_streams[1][i]);
+                __m512 vz = _mm512_loadu_ps(&in_streams[2][i]);
+                __m512 cx = _mm512_fmadd_ps(w, vx, _mm512_fmsub_ps(y, vz, _mm512_mul_ps(z, vy)));
+                __m512 cy = _mm512_fmadd_ps(w, vy, _mm512_fmsub_ps(z, vx, _mm512_mul_ps(x, vz)));
+                __m512 cz = _mm512_fmadd_ps(w, vz, _mm512_fmsub_ps(x, vy, _mm512_mul_ps(y, vx)));
+                __m512 rx = _mm512_fmadd_ps(two, _mm512_fmsub_ps(y, cz, _mm512_mul_ps(z, cy)), vx);
+                __m512 ry = _mm512_fmadd_ps(two, _mm512_fmsub_ps(z, cx, _mm512_mul_ps(x, cz)), vy);
+                __m512 rz = _mm512_fmadd_ps(two, _mm512_fmsub_ps(x, cy, _mm512_mul_ps(y, cx)), vz);
+                if (a == 0) {
+                    rx = _mm512_add_ps(rx, t[0]);
+                    ry = _mm512_add_ps(ry, t[1]);
+                    rz = _mm512_add_ps(rz, t[2]);
+                }
+                _mm512_storeu_ps(&out_streams[0][i + out_offset], rx);
+                _mm512_storeu_ps(&out_streams[1][i + out_offset], ry);
+                _mm512_storeu_ps(&out_streams[2][i + out_offset], rz);
+            }
+        }
+        skin_dq_soa_scalar(vertices, out_vertices, i, end, dual_quats, out_offset);
+        _copy_uvs(vertices, out_vertices, begin, i, out_offset);
+    }
+
+
+    void skin_soa(skinning_mode mode, cpu_variant variant, const soa_a2v& vertices, soa_v2f& out_vertices,
+        const float* palette, uint32_t thread_count) {
+        if (mode == skinning_mode::linear) {
+            skin_soa(variant, vertices, out_vertices, palette, thread_count);
+            return;
+        }
+        if (variant == cpu_variant::best) {
+            variant = has_avx512() ? cpu_variant::avx512 : (has_avx2() ? cpu_variant::avx2 : cpu_variant::soa_scalar);
+        }
+        auto skin_func = skin_dq_soa_scalar;
+        if (variant == cpu_variant::avx2) {
+            skin_func = skin_dq_soa_avx2;
+        }
+        else if (variant == cpu_variant::avx512) {
+            skin_func = skin_dq_soa_avx512;
+        }
+
+        out_vertices.resize(vertices.size());
+        _parallel_chunks(vertices.size(), 64, thread_count, [&](size_t begin, size_t end) {
+            skin_func(vertices, out_vertices, begin, end, palette, 0);
+        });
+    }
+}
+#endif // SKINNING_DQ_IMPLEMENTATION
@@ -0,0 +1,188 @@
+// Graph - the s2 frame captured once into a CUDA graph and replayed every frame
+//
+// A skinned frame always issues the same three operations: local pose upload, skeleton kernel, vertex kernel. Issued
+// one by one each pays its own launch cost on the CPU, so skinning_graph captures them once and replays the
+// instantiated graph instead. Poses go through two pinned staging buffers as in palette_uploader and the upload node
+// is pointed at this frame buffer before the replay. A frame with other streams, counts, block size or mode is captured
+// again and updates the executable graph in place, it is only instantiated again when the update is refused.
+
+#pragma once
+
+#include <cuda_runtime.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "skinning_types.h"
+#include "skinning_s2.cu"
+
+// Everything a frame launches with except the poses, a change is a new graph shape
+struct skinning_frame {
+    skeleton_device rig;
+    int32_t instance_count;
+    a2v_streams IN;
+    v2f_streams OUT;
+    int32_t vertex_count;
+    int32_t block_size;
+    skinning_mode mode;
+};
+
+struct skinning_graph {
+    joint_trs* staging[2];                  // Pinned, max_pose_count poses each
+    cudaEvent_t copy_done[2];
+    joint_trs* poses;
+    float4* palettes;                       // 3 rows per pose, 2 parts in skinning_mode::dual_quaternion
+    size_t max_pose_count;
+    uint32_t frame;
+    cudaGraph_t graph;                      // The graph exec was instantiated from, owner of upload_node
+    cudaGraphExec_t exec;
+    cudaGraphNode_t upload_node;
+    skinning_frame shape;
+    uint32_t capture_count;
+    uint32_t instantiate_count;
+};
+
+inline size_t frame_pose_count(const skinning_frame& frame) {
+    return size_t(frame.instance_count) * frame.rig.joint_count;
+}
+
+inline bool is_same_frame_shape(const skinning_frame& a, const skinning_frame& b) {
+    return memcmp(&a.rig, &b.rig, sizeof(skeleton_device)) == 0 && a.instance_count == b.instance_count &&
+        memcmp(&a.IN, &b.IN, sizeof(a2v_streams)) == 0 && memcmp(&a.OUT, &b.OUT, sizeof(v2f_streams)) == 0 &&
+        a.vertex_count == b.vertex_count && a.block_size == b.block_size && a.mode == b.mode;
+}
+
+cudaError_t create_skinning_graph(skinning_graph& out_graph, int32_t max_instance_count, int32_t max_joint_count) {
+    out_graph = {};
+    out_graph.max_pose_count = size_t(max_instance_count) * max_joint_count;
+    for (int32_t i = 0; i < 2; ++i) {
+        cudaError_t result = cudaHostAlloc(&out_graph.staging[i], out_graph.max_pose_count * sizeof(joint_trs),
+            cudaHostAllocWriteCombined);
+        if (result == cudaSuccess) {
+            result = cudaEventCreateWithFlags(&out_graph.copy_done[i], cudaEventDisableTiming);
+        }
+        if (result != cudaSuccess) {
+            return result;
+        }
+    }
+    cudaError_t result = cudaMalloc(&out_graph.poses, out_graph.max_pose_count * sizeof(joint_trs));
+    if (result == cudaSuccess) {
+        result = cudaMalloc(&out_graph.palettes, out_graph.max_pose_count * skinning_floats_per_bone * sizeof(float));
+    }
+    return result;
+}
+
+void destroy_skinning_graph(skinning_graph& graph) {
+    if (graph.exec != nullptr) {
+        cudaGraphExecDestroy(graph.exec);
+    }
+    if (graph.graph != nullptr) {
+        cudaGraphDestroy(graph.graph);
+    }
+    for (int32_t i = 0; i < 2; ++i) {
+        cudaFreeHost(graph.staging[i]);
+        cudaEventDestroy(graph.copy_done[i]);
+    }
+    cudaFree(graph.poses);
+    cudaFree(graph.palettes);
+    graph = {};
+}
+
+// Copy the poses to the next staging buffer, waiting only when its previous upload is still in flight
+uint32_t _stage_frame_poses(skinning_graph& graph, const joint_trs* host_poses, size_t pose_count) {
+    uint32_t slot = graph.frame++ & 1;
+    cudaEventSynchronize(graph.copy_done[slot]);
+    memcpy(graph.staging[slot], host_poses, pose_count * sizeof(joint_trs));
+    return slot;
+}
+
+void _enqueue_frame(const skinning_graph& graph, const skinning_frame& frame, uint32_t slot, cudaStream_t stream) {
+    cudaMemcpyAsync(graph.poses, graph.staging[slot], frame_pose_count(frame) * sizeof(joint_trs),
+        cudaMemcpyHostToDevice, stream);
+    launch_skinning_s2(frame.rig, graph.poses, graph.palettes, frame.instance_count, frame.IN, frame.OUT,
+        frame.vertex_count, frame.block_size, stream, frame.mode);
+}
+
+cudaError_t _capture_frame(skinning_graph& graph, const skinning_frame& frame, cudaStream_t stream) {
+    cudaGraph_t captured = nullptr;
+    cudaError_t result = cudaStreamBeginCapture(stream, cudaStreamCaptureModeThreadLocal);
+    if (result != cudaSuccess) {
+        return result;
+    }
+    _enqueue_frame(graph, frame, 0, stream);
+    result = cudaStreamEndCapture(stream, &captured);
+    if (result != cudaSuccess) {
+        return result;
+    }
+    ++graph.capture_count;
+    graph.shape = frame;
+
+    // Same topology, only kernel and copy parameters differ, so the update normally succeeds and the node handles
+    // of the graph exec was instantiated from stay valid
+    if (graph.exec != nullptr) {
+#if CUDART_VERSION >= 12000
+        cudaGraphExecUpdateResultInfo update_info;
+        result = cudaGraphExecUpdate(graph.exec, captured, &update_info);
+#else
+        cudaGraphNode_t error_node = nullptr;
+        cudaGraphExecUpdateResult update_result;
+        result = cudaGraphExecUpdate(graph.exec, captured, &error_node, &update_result);
+#endif
+        if (result == cudaSuccess) {
+            cudaGraphDestroy(captured);
+            return cudaSuccess;
+        }
+        cudaGetLastError();
+        cudaGraphExecDestroy(graph.exec);
+        cudaGraphDestroy(graph.graph);
+        graph.exec = nullptr;
+    }
+
+    // The upload is the only memcpy node of a frame
+    size_t node_count = 0;
+    cudaGraphGetNodes(captured, nullptr, &node_count);
+    std::vector<cudaGraphNode_t> nodes(node_count);
+    cudaGraphGetNodes(captured, nodes.data(), &node_count);
+    graph.upload_node = nullptr;
+    for (cudaGraphNode_t node : nodes) {
+        cudaGraphNodeType type;
+        if (cudaGraphNodeGetType(node, &type) == cudaSuccess && type == cudaGraphNodeTypeMemcpy) {
+            graph.upload_node = node;
+        }
+    }
+    graph.graph = captured;
+    ++graph.instantiate_count;
+    return cudaGraphInstantiateWithFlags(&graph.exec, captured, 0);
+}
+
+// The frame as direct launches, what the graph replays. stream may be the default stream.
+void launch_skinning_frame(skinning_graph& graph, const skinning_frame& frame, const joint_trs* host_poses,
+    cudaStream_t stream) {
+    uint32_t slot = _stage_frame_poses(graph, host_poses, frame_pose_count(frame));
+    _enqueue_frame(graph, frame, slot, stream);
+    cudaEventRecord(graph.copy_done[slot], stream);
+}
+
+// The frame as one graph launch, captured on the first frame and after a shape change. Capture needs a created
+// stream, the legacy default stream can not be captured.
+cudaError_t launch_skinning_graph(skinning_graph& graph, const skinning_frame& frame, const joint_trs* host_poses,
+    cudaStream_t stream) {
+    size_t pose_count = frame_pose_count(frame);
+    if (pose_count > graph.max_pose_count) {
+        return cudaErrorInvalidValue;
+    }
+    if (graph.exec == nullptr || !is_same_frame_shape(graph.shape, frame)) {
+        cudaError_t result = _capture_frame(graph, frame, stream);
+        if (result != cudaSuccess) {
+            return result;
+        }
+    }
+
+    uint32_t slot = _stage_frame_poses(graph, host_poses, pose_count);
+    cudaError_t result = cudaGraphExecMemcpyNodeSetParams1D(graph.exec, graph.upload_node, graph.poses,
+        graph.staging[slot], pose_count * sizeof(joint_trs), cudaMemcpyHostToDevice);
+    if (result == cudaSuccess) {
+        result = cudaGraphLaunch(graph.exec, stream);
+    }
+    cudaEventRecord(graph.copy_done[slot], stream);
+    return result;
+}
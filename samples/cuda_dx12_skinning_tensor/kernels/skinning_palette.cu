@@ -0,0 +1,81 @@
+// Bone palettes, staged once per block into shared memory and uploaded once per frame through pinned memory
+#pragma once
+
+#include <cuda_runtime.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "skinning_types.h"
+
+// Every thread of the block copies a strided part of the palette, 3 float4 rows per bone or 2 per dual quaternion.
+// Call before any early return, all threads must reach the barrier.
+__device__ inline const float4* stage_bone_palette(const float4* __restrict__ bones, int32_t bone_count,
+    int32_t rows_per_bone = 3) {
+    extern __shared__ uint8_t shared_mem[];
+    float4* shared_rows = reinterpret_cast<float4*>(shared_mem);
+    for (int32_t i = threadIdx.x; i < bone_count * rows_per_bone; i += blockDim.x) {
+        shared_rows[i] = __ldg(&bones[i]);
+    }
+    __syncthreads();
+    return shared_rows;
+}
+
+inline size_t bone_palette_shared_size(int32_t bone_count) {
+    return bone_count * skinning_floats_per_bone * sizeof(float);
+}
+
+inline size_t bone_palette_shared_size(skinning_mode mode, int32_t bone_count) {
+    int32_t floats_per_bone = mode == skinning_mode::linear ? skinning_floats_per_bone : skinning_floats_per_dual_quat;
+    return bone_count * floats_per_bone * sizeof(float);
+}
+
+// Two pinned staging buffers and two device palettes. The CPU fills one staging buffer while the copy of the other
+// may still be in flight, and a kernel reading the previous palette is never overwritten by the next upload.
+struct palette_uploader {
+    float* staging[2];
+    float4* palettes[2];
+    cudaEvent_t copy_done[2];
+    int32_t max_bone_count;
+    uint32_t frame;
+};
+
+cudaError_t create_palette_uploader(palette_uploader& uploader, int32_t max_bone_count) {
+    uploader = {};
+    uploader.max_bone_count = max_bone_count;
+    size_t size_in_bytes = bone_palette_shared_size(max_bone_count);
+    for (int32_t i = 0; i < 2; ++i) {
+        cudaError_t result = cudaHostAlloc(&uploader.staging[i], size_in_bytes, cudaHostAllocWriteCombined);
+        if (result == cudaSuccess) {
+            result = cudaMalloc(&uploader.palettes[i], size_in_bytes);
+        }
+        if (result == cudaSuccess) {
+            result = cudaEventCreateWithFlags(&uploader.copy_done[i], cudaEventDisableTiming);
+        }
+        if (result != cudaSuccess) {
+            return result;
+        }
+    }
+    return cudaSuccess;
+}
+
+void destroy_palette_uploader(palette_uploader& uploader) {
+    for (int32_t i = 0; i < 2; ++i) {
+        cudaFreeHost(uploader.staging[i]);
+        cudaFree(uploader.palettes[i]);
+        cudaEventDestroy(uploader.copy_done[i]);
+    }
+    uploader = {};
+}
+
+// Queue this frame palette copy on stream and return the device palette to skin with. Only blocks when the CPU is
+// two uploads ahead of the copies. Dual quaternion palettes are 8 floats per bone and fit the linear sized buffers.
+const float4* upload_palette(palette_uploader& uploader, const float* bones, int32_t bone_count, cudaStream_t stream,
+    skinning_mode mode = skinning_mode::linear) {
+    uint32_t slot = uploader.frame++ & 1;
+    size_t size_in_bytes = bone_palette_shared_size(mode, std::min(bone_count, uploader.max_bone_count));
+    cudaEventSynchronize(uploader.copy_done[slot]);
+    memcpy(uploader.staging[slot], bones, size_in_bytes);
+    cudaMemcpyAsync(uploader.palettes[slot], uploader.staging[slot], size_in_bytes, cudaMemcpyHostToDevice, stream);
+    cudaEventRecord(uploader.copy_done[slot], stream);
+    return uploader.palettes[slot];
+}
@@ -36,43 +36,32 @@
 //     return OUT;
 // }
 
+#pragma once
+
 #include <cuda_runtime.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "../cutil_math.cuh"
-
-#pragma pack(push, 1)
-struct a2v {
-    float3 position;
-    float3 normal;
-    float bone_weight[4];
-    uint8_t bone_index[4];
-    float2 uv0;
-    float2 uv1;
-} __align__(1);
-
-struct v2f {
-    float3 position;
-    float3 normal;
-    float2 uv0;
-    float2 uv1;
-} __align__(1);
-#pragma pack(pop)
+#include "cutil_math.cu"
+#include "skinning_types.h"
+#include "skinning_palette.cu"
 
-__device__ float4 float4_from(float* data, float scale) {
+__device__ float4 float4_from(const float* data, float scale) {
     return make_float4(data[0] * scale, data[1] * scale, data[2] * scale, data[3] * scale);
 }
 
-__global__ void skinning_kernel(const a2v* IN, v2f* OUT) {
+__global__ void skinning_kernel(const a2v* IN, v2f* OUT, int32_t vertex_count, const float4* bones,
+    int32_t bone_count) {
     int bid = blockIdx.x;
     int bsize = blockDim.x;
     int tid = threadIdx.x;
     int vertex_id = bid * bsize + tid;
 
     // Up to 256 bones
-    extern __shared__ uint8_t shared_mem[];
-    float* bones_mat = reinterpret_cast<float*>(shared_mem);
+    const float* bones_mat = reinterpret_cast<const float*>(stage_bone_palette(bones, bone_count));
     int32_t floats_per_bone = 12;
+    if (vertex_id >= vertex_count) {
+        return;
+    }
 
     const a2v& vertex = IN[vertex_id];
     int bone_index = vertex.bone_index[0];
@@ -115,56 +104,14 @@ void printDeviceProp() {
     cudaDeviceProp prop;
     cudaGetDeviceProperties(&prop, device);
 
-    printf("Device: %s\n", prop.name);
-    printf("Capability: %d.%d\n", prop.major, prop.minor);
-    printf("  totalGlobalMem:\t %lu MB\n", prop.totalGlobalMem / 1024 / 1024);
-    printf("  sharedMemPerBlock:\t %lu KB\n", prop.sharedMemPerBlock / 1024);
-    printf("  totalConstMem:\t %lu KB\n", prop.totalConstMem / 1024);
-    printf("  l2CacheSize:\t\t %d KB\n\n", prop.l2CacheSize / 1024);
+    fprintf(stderr, "Device: %s\n", prop.name);
+    fprintf(stderr, "Capability: %d.%d\n", prop.major, prop.minor);
+    fprintf(stderr, "  totalGlobalMem:\t %lu MB\n", prop.totalGlobalMem / 1024 / 1024);
+    fprintf(stderr, "  sharedMemPerBlock:\t %lu KB\n", prop.sharedMemPerBlock / 1024);
+    fprintf(stderr, "  totalConstMem:\t %lu KB\n", prop.totalConstMem / 1024);
+    fprintf(stderr, "  l2CacheSize:\t\t %d KB\n\n", prop.l2CacheSize / 1024);
 
-    printf("  multiProcessorCount:\t %d\n", prop.multiProcessorCount);
-    printf("  maxThreadsPerBlock:\t %d\n", prop.maxThreadsPerBlock);
-    printf("  warpSize:\t\t %d\n\n", prop.warpSize);
+    fprintf(stderr, "  multiProcessorCount:\t %d\n", prop.multiProcessorCount);
+    fprintf(stderr, "  maxThreadsPerBlock:\t %d\n", prop.maxThreadsPerBlock);
+    fprintf(stderr, "  warpSize:\t\t %d\n\n", prop.warpSize);
 }
-
-
-int main() {
-    printDeviceProp();
-
-    a2v* input_vertices = nullptr;
-    v2f* output_vertices = nullptr;
-
-    int32_t vertex_count = 1024 * 1024; // 1M
-    cudaMalloc(&input_vertices, vertex_count * sizeof(a2v));
-    cudaMalloc(&output_vertices, vertex_count * sizeof(v2f));
-
-    int32_t block_size = 16; // match FB32 ALU units, faster than warp_size (32)
-    int32_t block_count = (vertex_count + block_size - 1) / block_size;
-    int32_t shared_mem_size = 256 * 12 * sizeof(float);
-
-    printf("blocks %d, threads %d\n", block_count, block_size);
-
-    cudaEvent_t start, stop;
-    cudaEventCreate(&start);
-    cudaEventCreate(&stop);
-
-    cudaEventRecord(start);
-    int32_t kernel_count = 16;
-    for (int32_t i=0; i < kernel_count; ++i) {
-        skinning_kernel<<<block_count, block_size, shared_mem_size>>>(input_vertices, output_vertices);
-    }
-    cudaEventRecord(stop);
-
-    cudaDeviceSynchronize();
-
-    float elapsedMs = 0.0f;
-    cudaEventElapsedTime(&elapsedMs, start, stop);
-    printf("elapsed_time_ms: %.3fms\n", elapsedMs/(float)kernel_count);
-
-    cudaFree(input_vertices);
-    cudaFree(output_vertices);
-
-    cudaDeviceReset();
-
-    return 0;
-}
\ No newline at end of file
@@ -0,0 +1,99 @@
+// s1 - Same skinning as skinning_kernel over SoA streams
+//
+// a2v is a 60 byte packed record, so s0 threads issue misaligned scalar loads and a warp reading one field touches
+// its whole 1920 byte span. Here every field is its own 256 byte aligned stream (see skinning::make_a2v_layout),
+// so a warp reads each one as 128 contiguous bytes, and writes v2f streams the same way.
+
+#pragma once
+
+#include <cuda_runtime.h>
+#include <stdint.h>
+#include "cutil_math.cu"
+#include "skinning_types.h"
+#include "skinning_cpu.h"
+#include "skinning_palette.cu"
+
+struct a2v_streams {
+    const float* __restrict__ position[3];
+    const float* __restrict__ normal[3];
+    const float* __restrict__ bone_weight[4];
+    const uint32_t* __restrict__ bone_index;
+    const float* __restrict__ uv[4];
+};
+
+struct v2f_streams {
+    float* __restrict__ position[3];
+    float* __restrict__ normal[3];
+    float* __restrict__ uv[4];
+};
+
+a2v_streams make_a2v_streams(const uint8_t* buffer, const skinning::soa_a2v_layout& layout) {
+    a2v_streams streams;
+    auto stream = [buffer](size_t offset) { return reinterpret_cast<const float*>(buffer + offset); };
+    for (int32_t i = 0; i < 3; ++i) {
+        streams.position[i] = stream(layout.position[i]);
+        streams.normal[i] = stream(layout.normal[i]);
+    }
+    for (int32_t i = 0; i < 4; ++i) {
+        streams.bone_weight[i] = stream(layout.bone_weight[i]);
+        streams.uv[i] = stream(layout.uv[i]);
+    }
+    streams.bone_index = reinterpret_cast<const uint32_t*>(buffer + layout.bone_index);
+    return streams;
+}
+
+v2f_streams make_v2f_streams(uint8_t* buffer, const skinning::soa_v2f_layout& layout) {
+    v2f_streams streams;
+    auto stream = [buffer](size_t offset) { return reinterpret_cast<float*>(buffer + offset); };
+    for (int32_t i = 0; i < 3; ++i) {
+        streams.position[i] = stream(layout.position[i]);
+        streams.normal[i] = stream(layout.normal[i]);
+    }
+    for (int32_t i = 0; i < 4; ++i) {
+        streams.uv[i] = stream(layout.uv[i]);
+    }
+    return streams;
+}
+
+// One vertex of IN skinned with a staged palette, written at out_id of OUT
+__device__ inline void skin_vertex_soa(const a2v_streams& IN, const v2f_streams& OUT, int32_t vertex_id, size_t out_id,
+    const float4* bones_mat) {
+    // 4 bone indices in one coalesced 32-bit load
+    uint32_t bone_indices = __ldg(&IN.bone_index[vertex_id]);
+    float4 c0 = make_float4(0.0f), c1 = make_float4(0.0f), c2 = make_float4(0.0f);
+#pragma unroll
+    for (int32_t i = 0; i < 4; ++i) {
+        int bone_index = (bone_indices >> (i * 8)) & 0xFF;
+        float bone_weight = __ldg(&IN.bone_weight[i][vertex_id]);
+        c0 += bones_mat[bone_index * 3 + 0] * bone_weight;
+        c1 += bones_mat[bone_index * 3 + 1] * bone_weight;
+        c2 += bones_mat[bone_index * 3 + 2] * bone_weight;
+    }
+
+    float4 position = make_float4(__ldg(&IN.position[0][vertex_id]), __ldg(&IN.position[1][vertex_id]),
+        __ldg(&IN.position[2][vertex_id]), 1.0f);
+    float3 normal = make_float3(__ldg(&IN.normal[0][vertex_id]), __ldg(&IN.normal[1][vertex_id]),
+        __ldg(&IN.normal[2][vertex_id]));
+    OUT.position[0][out_id] = dot(position, c0);
+    OUT.position[1][out_id] = dot(position, c1);
+    OUT.position[2][out_id] = dot(position, c2);
+    OUT.normal[0][out_id] = dot(normal, make_float3(c0));
+    OUT.normal[1][out_id] = dot(normal, make_float3(c1));
+    OUT.normal[2][out_id] = dot(normal, make_float3(c2));
+#pragma unroll
+    for (int32_t i = 0; i < 4; ++i) {
+        OUT.uv[i][out_id] = __ldg(&IN.uv[i][vertex_id]);
+    }
+}
+
+__global__ void skinning_kernel_s1(a2v_streams IN, v2f_streams OUT, int32_t vertex_count, const float4* bones,
+    int32_t bone_count) {
+    // Up to 256 bones
+    const float4* bones_mat = stage_bone_palette(bones, bone_count);
+
+    int vertex_id = blockIdx.x * blockDim.x + threadIdx.x;
+    if (vertex_id >= vertex_count) {
+        return;
+    }
+    skin_vertex_soa(IN, OUT, vertex_id, vertex_id, bones_mat);
+}
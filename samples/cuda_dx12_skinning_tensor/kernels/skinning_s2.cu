@@ -0,0 +1,204 @@
+// s2 - Two kernels, skeleton evaluation then vertex skinning at 2 vertices per thread
+//
+// The skeleton kernel turns local joint poses into palettes on the GPU, so only 40 bytes of TRS per joint are
+// uploaded and many instances of a skeleton are evaluated in one launch. It runs one block per instance and one
+// thread per joint, resolving the hierarchy one depth level at a time with model transforms kept in shared memory.
+// The vertex kernel then skins the same SoA mesh once per instance, gridDim.y being the instance, and amortizes the
+// per-block palette staging over twice as many vertices as s1. In skinning_mode::dual_quaternion the skeleton kernel
+// writes dual quaternion palettes and the vertex kernel blends them, see skinning_dq.cu.
+
+#pragma once
+
+#include <cuda_runtime.h>
+#include <stdint.h>
+#include <vector>
+#include "cutil_math.cu"
+#include "skinning_types.h"
+#include "skinning_cpu.h"
+#include "skinning_palette.cu"
+#include "skinning_s1.cu"
+#include "skinning_dq.cu"
+
+const int32_t skinning_s2_vertices_per_thread = 2;
+
+struct skeleton_device {
+    const float4* inverse_bind;             // 3 rows per joint
+    const int32_t* parents;
+    const uint8_t* depths;
+    int32_t joint_count;
+    int32_t level_count;
+};
+
+cudaError_t create_skeleton_device(skeleton_device& out_skeleton, const skinning::skeleton& rig) {
+    out_skeleton = {};
+    std::vector<uint8_t> depths;
+    out_skeleton.joint_count = rig.joint_count();
+    out_skeleton.level_count = skinning::joint_depths(rig, depths);
+
+    float4* inverse_bind = nullptr;
+    int32_t* parents = nullptr;
+    uint8_t* device_depths = nullptr;
+    cudaError_t result = cudaMalloc(&inverse_bind, rig.inverse_bind.size() * sizeof(float));
+    if (result == cudaSuccess) {
+        result = cudaMalloc(&parents, rig.parents.size() * sizeof(int32_t));
+    }
+    if (result == cudaSuccess) {
+        result = cudaMalloc(&device_depths, depths.size());
+    }
+    out_skeleton.inverse_bind = inverse_bind;
+    out_skeleton.parents = parents;
+    out_skeleton.depths = device_depths;
+    if (result != cudaSuccess) {
+        return result;
+    }
+
+    cudaMemcpy(inverse_bind, rig.inverse_bind.data(), rig.inverse_bind.size() * sizeof(float), cudaMemcpyHostToDevice);
+    cudaMemcpy(parents, rig.parents.data(), rig.parents.size() * sizeof(int32_t), cudaMemcpyHostToDevice);
+    return cudaMemcpy(device_depths, depths.data(), depths.size(), cudaMemcpyHostToDevice);
+}
+
+void destroy_skeleton_device(skeleton_device& skeleton) {
+    cudaFree(const_cast<float4*>(skeleton.inverse_bind));
+    cudaFree(const_cast<int32_t*>(skeleton.parents));
+    cudaFree(const_cast<uint8_t*>(skeleton.depths));
+    skeleton = {};
+}
+
+inline size_t skeleton_shared_size(int32_t joint_count) {
+    return joint_count * skinning_floats_per_bone * sizeof(float);
+}
+
+// Launch with one block per instance and at least joint_count threads, skeleton_shared_size bytes of shared memory.
+// Palettes are written instance after instance, joint_count entries of 3 rows or 2 dual quaternion parts each.
+template <skinning_mode mode>
+__global__ void skeleton_kernel_s2(skeleton_device rig, const joint_trs* __restrict__ local_poses,
+    float4* __restrict__ palettes) {
+    extern __shared__ uint8_t shared_mem[];
+    float* model = reinterpret_cast<float*>(shared_mem);
+
+    int32_t joint = threadIdx.x;
+    size_t first_joint = size_t(blockIdx.x) * rig.joint_count;
+    bool is_joint = joint < rig.joint_count;
+    float local[skinning_floats_per_bone];
+    int32_t parent = -1;
+    int32_t depth = -1;
+    if (is_joint) {
+        trs_to_affine(local_poses[first_joint + joint], local);
+        parent = __ldg(&rig.parents[joint]);
+        depth = __ldg(&rig.depths[joint]);
+    }
+
+    // Parents are one level up, so their model transform is complete after the previous barrier
+    for (int32_t level = 0; level < rig.level_count; ++level) {
+        if (depth == level) {
+            float* joint_model = model + joint * skinning_floats_per_bone;
+            if (parent < 0) {
+                for (int32_t i = 0; i < skinning_floats_per_bone; ++i) {
+                    joint_model[i] = local[i];
+                }
+            }
+            else {
+                multiply_affine(model + parent * skinning_floats_per_bone, local, joint_model);
+            }
+        }
+        __syncthreads();
+    }
+
+    if (is_joint) {
+        float inverse_bind[skinning_floats_per_bone];
+        float palette[skinning_floats_per_bone];
+        for (int32_t r = 0; r < 3; ++r) {
+            float4 row = __ldg(&rig.inverse_bind[joint * 3 + r]);
+            inverse_bind[r * 4 + 0] = row.x;
+            inverse_bind[r * 4 + 1] = row.y;
+            inverse_bind[r * 4 + 2] = row.z;
+            inverse_bind[r * 4 + 3] = row.w;
+        }
+        multiply_affine(model + joint * skinning_floats_per_bone, inverse_bind, palette);
+        if (mode == skinning_mode::linear) {
+            for (int32_t r = 0; r < 3; ++r) {
+                palettes[(first_joint + joint) * 3 + r] = make_float4(palette[r * 4 + 0], palette[r * 4 + 1],
+                    palette[r * 4 + 2], palette[r * 4 + 3]);
+            }
+        }
+        else {
+            float dq[skinning_floats_per_dual_quat];
+            affine_to_dual_quat(palette, dq);
+            palettes[(first_joint + joint) * 2 + 0] = make_float4(dq[0], dq[1], dq[2], dq[3]);
+            palettes[(first_joint + joint) * 2 + 1] = make_float4(dq[4], dq[5], dq[6], dq[7]);
+        }
+    }
+}
+
+// Grid of (vertex tiles, instances). A block covers blockDim.x * skinning_s2_vertices_per_thread vertices, a thread
+// takes every blockDim.x-th of them so each pass over the tile stays coalesced. Instance y skins with palette y and
+// writes vertices [y * vertex_count, (y + 1) * vertex_count) of OUT.
+template <skinning_mode mode>
+__global__ void skinning_kernel_s2(a2v_streams IN, v2f_streams OUT, int32_t vertex_count, const float4* palettes,
+    int32_t bone_count) {
+    const int32_t rows_per_bone = mode == skinning_mode::linear ? 3 : 2;
+    size_t instance = blockIdx.y;
+    const float4* bones_mat = stage_bone_palette(palettes + instance * bone_count * rows_per_bone, bone_count,
+        rows_per_bone);
+
+    int32_t tile_begin = blockIdx.x * blockDim.x * skinning_s2_vertices_per_thread;
+#pragma unroll
+    for (int32_t i = 0; i < skinning_s2_vertices_per_thread; ++i) {
+        int32_t vertex_id = tile_begin + i * blockDim.x + threadIdx.x;
+        if (vertex_id >= vertex_count) {
+            continue;
+        }
+        if (mode == skinning_mode::linear) {
+            skin_vertex_soa(IN, OUT, vertex_id, instance * vertex_count + vertex_id, bones_mat);
+        }
+        else {
+            skin_vertex_dq_soa(IN, OUT, vertex_id, instance * vertex_count + vertex_id, bones_mat);
+        }
+    }
+}
+
+template <skinning_mode mode>
+void _launch_skinning_s2(const skeleton_device& rig, const joint_trs* local_poses, float4* palettes,
+    int32_t instance_count, a2v_streams IN, v2f_streams OUT, int32_t vertex_count, int32_t block_size,
+    cudaStream_t stream) {
+    int32_t skeleton_block_size = (rig.joint_count + 31) & ~31;
+    skeleton_kernel_s2<mode><<<instance_count, skeleton_block_size, skeleton_shared_size(rig.joint_count),
+        stream>>>(rig, local_poses, palettes);
+
+    int32_t vertices_per_block = block_size * skinning_s2_vertices_per_thread;
+    dim3 grid((vertex_count + vertices_per_block - 1) / vertices_per_block, instance_count);
+    skinning_kernel_s2<mode><<<grid, block_size, bone_palette_shared_size(mode, rig.joint_count), stream>>>(IN, OUT,
+        vertex_count, palettes, rig.joint_count);
+}
+
+// Vertex kernel alone, for palettes evaluated elsewhere, e.g. on the CPU and staged through palette_uploader.
+// palettes holds instance_count * bone_count entries of the mode, 12 or 8 floats each.
+void launch_skinning_s2_vertices(const float4* palettes, int32_t bone_count, int32_t instance_count, a2v_streams IN,
+    v2f_streams OUT, int32_t vertex_count, int32_t block_size, cudaStream_t stream,
+    skinning_mode mode = skinning_mode::linear) {
+    int32_t vertices_per_block = block_size * skinning_s2_vertices_per_thread;
+    dim3 grid((vertex_count + vertices_per_block - 1) / vertices_per_block, instance_count);
+    size_t shared_mem_size = bone_palette_shared_size(mode, bone_count);
+    if (mode == skinning_mode::linear) {
+        skinning_kernel_s2<skinning_mode::linear><<<grid, block_size, shared_mem_size, stream>>>(IN, OUT,
+            vertex_count, palettes, bone_count);
+    }
+    else {
+        skinning_kernel_s2<skinning_mode::dual_quaternion><<<grid, block_size, shared_mem_size, stream>>>(IN, OUT,
+            vertex_count, palettes, bone_count);
+    }
+}
+
+// palettes holds instance_count * joint_count entries of the mode, 12 or 8 floats each
+void launch_skinning_s2(const skeleton_device& rig, const joint_trs* local_poses, float4* palettes,
+    int32_t instance_count, a2v_streams IN, v2f_streams OUT, int32_t vertex_count, int32_t block_size,
+    cudaStream_t stream, skinning_mode mode = skinning_mode::linear) {
+    if (mode == skinning_mode::linear) {
+        _launch_skinning_s2<skinning_mode::linear>(rig, local_poses, palettes, instance_count, IN, OUT, vertex_count,
+            block_size, stream);
+    }
+    else {
+        _launch_skinning_s2<skinning_mode::dual_quaternion>(rig, local_poses, palettes, instance_count, IN, OUT,
+            vertex_count, block_size, stream);
+    }
+}
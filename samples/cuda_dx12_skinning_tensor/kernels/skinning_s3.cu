@@ -0,0 +1,125 @@
+// s3 - Tensor cores, blended bone transforms as a weights x palette GEMM
+//
+// Each warp skins 16 vertices. Their weights form a dense (16 x bones) fp16 A tile, the palette is a shared
+// (bones x 16) fp16 B matrix with 12 used columns, and WMMA 16x16x16 steps accumulate the 16 blended 3x4 transforms
+// in fp32. Only K tiles some vertex of the warp references are multiplied, neighboring influences keep that to one or
+// two. Positions and normals are transformed in fp32, skinning::skin_gemm is the reference and
+// skinning::gemm_error_bound the accuracy bound to fp32 skinning. Needs sm_70 or later.
+
+#pragma once
+
+#include <cuda_fp16.h>
+#include <cuda_runtime.h>
+#include <mma.h>
+#include <stdint.h>
+#include "cutil_math.cu"
+#include "skinning_types.h"
+#include "skinning_cpu.h"
+#include "skinning_s1.cu"
+
+__host__ __device__ inline int32_t tensor_bone_count(int32_t bone_count) {
+    return (bone_count + skinning_gemm_tile - 1) / skinning_gemm_tile * skinning_gemm_tile;
+}
+
+// Shared fp16 palette, then a weight tile and a blended transform tile per warp. Every part is a multiple of 512
+// bytes, so all WMMA pointers keep the 32 byte alignment of the dynamic shared memory base.
+inline size_t tensor_shared_size(int32_t bone_count, int32_t warp_count) {
+    size_t padded_bone_count = tensor_bone_count(bone_count);
+    size_t weight_tile_size = skinning_gemm_tile * padded_bone_count * sizeof(half);
+    size_t blended_tile_size = skinning_gemm_tile * skinning_gemm_tile * sizeof(float);
+    return padded_bone_count * skinning_gemm_tile * sizeof(half) + warp_count * (weight_tile_size + blended_tile_size);
+}
+
+// Block of whole warps, 16 vertices per warp, tensor_shared_size bytes of shared memory
+__global__ void skinning_kernel_s3(a2v_streams IN, v2f_streams OUT, int32_t vertex_count, const float4* bones,
+    int32_t bone_count) {
+#if __CUDA_ARCH__ >= 700
+    using namespace nvcuda;
+    const int32_t tile = skinning_gemm_tile;
+    extern __shared__ uint8_t shared_mem[];
+    int32_t padded_bone_count = tensor_bone_count(bone_count);
+    int32_t warp = threadIdx.x / 32;
+    int32_t lane = threadIdx.x % 32;
+    half* palette = reinterpret_cast<half*>(shared_mem);
+    half* weights = palette + padded_bone_count * tile + warp * tile * padded_bone_count;
+    float* blended = reinterpret_cast<float*>(palette + padded_bone_count * tile * (1 + blockDim.x / 32)) +
+        warp * tile * tile;
+
+    // Palette as the B matrix, columns 12 to 15 and padding bones zero
+    const float* bone_values = reinterpret_cast<const float*>(bones);
+    for (int32_t i = threadIdx.x; i < padded_bone_count * tile; i += blockDim.x) {
+        int32_t bone = i / tile;
+        int32_t column = i % tile;
+        bool is_used = bone < bone_count && column < skinning_floats_per_bone;
+        palette[i] = __float2half_rn(is_used ? __ldg(&bone_values[bone * skinning_floats_per_bone + column]) : 0.0f);
+    }
+    half2* weight_pairs = reinterpret_cast<half2*>(weights);
+    for (int32_t i = lane; i < tile * padded_bone_count / 2; i += 32) {
+        weight_pairs[i] = __float2half2_rn(0.0f);
+    }
+    __syncthreads();
+
+    // Lanes 0 to 15 scatter the weights of their vertex into its A row and flag the K tiles they touch
+    int32_t row = lane % tile;
+    int32_t vertex_id = (blockIdx.x * (blockDim.x / 32) + warp) * tile + row;
+    bool is_vertex = vertex_id < vertex_count;
+    uint32_t k_tile_mask = 0;
+    if (lane < tile && is_vertex) {
+        uint32_t bone_indices = __ldg(&IN.bone_index[vertex_id]);
+#pragma unroll
+        for (int32_t i = 0; i < 4; ++i) {
+            int32_t bone_index = (bone_indices >> (i * 8)) & 0xFF;
+            float bone_weight = __ldg(&IN.bone_weight[i][vertex_id]);
+            if (bone_weight != 0.0f) {
+                half& weight = weights[row * padded_bone_count + bone_index];
+                weight = __float2half_rn(__half2float(weight) + bone_weight);
+                k_tile_mask |= 1u << (bone_index / tile);
+            }
+        }
+    }
+    for (int32_t offset = 16; offset > 0; offset /= 2) {
+        k_tile_mask |= __shfl_xor_sync(0xFFFFFFFF, k_tile_mask, offset);
+    }
+    __syncwarp();
+
+    wmma::fragment<wmma::matrix_a, 16, 16, 16, half, wmma::row_major> a;
+    wmma::fragment<wmma::matrix_b, 16, 16, 16, half, wmma::row_major> b;
+    wmma::fragment<wmma::accumulator, 16, 16, 16, float> c;
+    wmma::fill_fragment(c, 0.0f);
+    for (uint32_t mask = k_tile_mask; mask != 0; mask &= mask - 1) {
+        int32_t k_begin = (__ffs(mask) - 1) * tile;
+        wmma::load_matrix_sync(a, weights + k_begin, padded_bone_count);
+        wmma::load_matrix_sync(b, palette + k_begin * tile, tile);
+        wmma::mma_sync(c, a, b, c);
+    }
+    wmma::store_matrix_sync(blended, c, tile, wmma::mem_row_major);
+    __syncwarp();
+
+    // Two lanes per vertex, the lower writes the position and the upper the normal and uvs
+    if (!is_vertex) {
+        return;
+    }
+    const float* m = blended + row * tile;
+    float4 c0 = make_float4(m[0], m[1], m[2], m[3]);
+    float4 c1 = make_float4(m[4], m[5], m[6], m[7]);
+    float4 c2 = make_float4(m[8], m[9], m[10], m[11]);
+    if (lane < tile) {
+        float4 position = make_float4(__ldg(&IN.position[0][vertex_id]), __ldg(&IN.position[1][vertex_id]),
+            __ldg(&IN.position[2][vertex_id]), 1.0f);
+        OUT.position[0][vertex_id] = dot(position, c0);
+        OUT.position[1][vertex_id] = dot(position, c1);
+        OUT.position[2][vertex_id] = dot(position, c2);
+    }
+    else {
+        float3 normal = make_float3(__ldg(&IN.normal[0][vertex_id]), __ldg(&IN.normal[1][vertex_id]),
+            __ldg(&IN.normal[2][vertex_id]));
+        OUT.normal[0][vertex_id] = dot(normal, make_float3(c0));
+        OUT.normal[1][vertex_id] = dot(normal, make_float3(c1));
+        OUT.normal[2][vertex_id] = dot(normal, make_float3(c2));
+#pragma unroll
+        for (int32_t i = 0; i < 4; ++i) {
+            OUT.uv[i][vertex_id] = __ldg(&IN.uv[i][vertex_id]);
+        }
+    }
+#endif
+}
@@ -0,0 +1,133 @@
+// s4 - Compressed weights, one kernel per influence count bucket
+//
+// Input is a skinning::compressed_mesh packed with skinning::make_compressed_layout. Every bucket launch is a kernel
+// specialized on its influence count and weight format, with fully unrolled slot loops and no per-vertex count or
+// zero weight tests. The 1 influence bucket reads no weight at all. Output streams are in sorted vertex order.
+
+#pragma once
+
+#include <cuda_runtime.h>
+#include <stdint.h>
+#include "cutil_math.cu"
+#include "skinning_types.h"
+#include "skinning_cpu.h"
+#include "skinning_compressed.h"
+#include "skinning_palette.cu"
+#include "skinning_s1.cu"
+
+struct compressed_streams {
+    const float* __restrict__ position[3];
+    const float* __restrict__ normal[3];
+    const float* __restrict__ uv[4];
+    const uint8_t* __restrict__ bone_index;
+    const uint8_t* __restrict__ weights;
+};
+
+// Bucket range, indices and weights relative to the bucket streams
+struct bucket_streams {
+    int32_t begin;
+    int32_t vertex_count;
+    const uint8_t* __restrict__ bone_index;
+    const void* __restrict__ weights;
+};
+
+compressed_streams make_compressed_streams(const uint8_t* buffer, const skinning::compressed_layout& layout) {
+    compressed_streams streams;
+    auto stream = [buffer](size_t offset) { return reinterpret_cast<const float*>(buffer + offset); };
+    for (int32_t i = 0; i < 3; ++i) {
+        streams.position[i] = stream(layout.position[i]);
+        streams.normal[i] = stream(layout.normal[i]);
+    }
+    for (int32_t i = 0; i < 4; ++i) {
+        streams.uv[i] = stream(layout.uv[i]);
+    }
+    streams.bone_index = buffer + layout.bone_index;
+    streams.weights = buffer + layout.weights;
+    return streams;
+}
+
+template <int32_t influence_count, typename weight_t>
+__global__ void skinning_kernel_s4(compressed_streams IN, bucket_streams bucket, v2f_streams OUT,
+    const float4* bones, int32_t bone_count) {
+    const float4* bones_mat = stage_bone_palette(bones, bone_count);
+
+    int32_t element = blockIdx.x * blockDim.x + threadIdx.x;
+    if (element >= bucket.vertex_count) {
+        return;
+    }
+
+    const weight_t* weights = reinterpret_cast<const weight_t*>(bucket.weights);
+    const float weight_scale = 1.0f / static_cast<weight_t>(~weight_t(0));
+    float4 c0 = make_float4(0.0f), c1 = make_float4(0.0f), c2 = make_float4(0.0f);
+#pragma unroll
+    for (int32_t s = 0; s < influence_count; ++s) {
+        int32_t slot_element = s * bucket.vertex_count + element;
+        int bone_index = __ldg(&bucket.bone_index[slot_element]);
+        float bone_weight = influence_count == 1 ? 1.0f : __ldg(&weights[slot_element]) * weight_scale;
+        c0 += bones_mat[bone_index * 3 + 0] * bone_weight;
+        c1 += bones_mat[bone_index * 3 + 1] * bone_weight;
+        c2 += bones_mat[bone_index * 3 + 2] * bone_weight;
+    }
+
+    int32_t vertex_id = bucket.begin + element;
+    float4 position = make_float4(__ldg(&IN.position[0][vertex_id]), __ldg(&IN.position[1][vertex_id]),
+        __ldg(&IN.position[2][vertex_id]), 1.0f);
+    float3 normal = make_float3(__ldg(&IN.normal[0][vertex_id]), __ldg(&IN.normal[1][vertex_id]),
+        __ldg(&IN.normal[2][vertex_id]));
+    OUT.position[0][vertex_id] = dot(position, c0);
+    OUT.position[1][vertex_id] = dot(position, c1);
+    OUT.position[2][vertex_id] = dot(position, c2);
+    OUT.normal[0][vertex_id] = dot(normal, make_float3(c0));
+    OUT.normal[1][vertex_id] = dot(normal, make_float3(c1));
+    OUT.normal[2][vertex_id] = dot(normal, make_float3(c2));
+#pragma unroll
+    for (int32_t i = 0; i < 4; ++i) {
+        OUT.uv[i][vertex_id] = __ldg(&IN.uv[i][vertex_id]);
+    }
+}
+
+template <typename weight_t>
+void launch_bucket_s4(int32_t influence_count, compressed_streams IN, bucket_streams bucket, v2f_streams OUT,
+    const float4* bones, int32_t bone_count, int32_t block_size, cudaStream_t stream) {
+    int32_t block_count = (bucket.vertex_count + block_size - 1) / block_size;
+    size_t shared_mem_size = bone_palette_shared_size(bone_count);
+    switch (influence_count) {
+    case 1:
+        skinning_kernel_s4<1, weight_t><<<block_count, block_size, shared_mem_size, stream>>>(IN, bucket, OUT, bones,
+            bone_count);
+        break;
+    case 2:
+        skinning_kernel_s4<2, weight_t><<<block_count, block_size, shared_mem_size, stream>>>(IN, bucket, OUT, bones,
+            bone_count);
+        break;
+    case 4:
+        skinning_kernel_s4<4, weight_t><<<block_count, block_size, shared_mem_size, stream>>>(IN, bucket, OUT, bones,
+            bone_count);
+        break;
+    case 8:
+        skinning_kernel_s4<8, weight_t><<<block_count, block_size, shared_mem_size, stream>>>(IN, bucket, OUT, bones,
+            bone_count);
+        break;
+    }
+}
+
+// One launch per non empty bucket, all on stream
+void launch_skinning_s4(const skinning::compressed_mesh& mesh, compressed_streams IN, v2f_streams OUT,
+    const float4* bones, int32_t bone_count, int32_t block_size, cudaStream_t stream) {
+    for (const skinning::influence_bucket& bucket : mesh.buckets) {
+        if (bucket.size() == 0) {
+            continue;
+        }
+        bucket_streams streams;
+        streams.begin = static_cast<int32_t>(bucket.begin);
+        streams.vertex_count = static_cast<int32_t>(bucket.size());
+        streams.bone_index = IN.bone_index + bucket.index_offset;
+        streams.weights = IN.weights + bucket.weight_offset * mesh.weight_size();
+        if (mesh.format == skinning::weight_format::unorm8) {
+            launch_bucket_s4<uint8_t>(bucket.influence_count, IN, streams, OUT, bones, bone_count, block_size, stream);
+        }
+        else {
+            launch_bucket_s4<uint16_t>(bucket.influence_count, IN, streams, OUT, bones, bone_count, block_size, stream);
+        }
+    }
+}
@@ -0,0 +1,87 @@
+// s5 - Batched instances, one launch for many skinned characters
+//
+// An instance table gives each character its vertex range in shared SoA input streams, its palette in a batch
+// palette buffer and its output range. The batch is cut in tiles of one instance (skinning::make_skin_tiles) and
+// every block skins one tile with that instance palette staged, so hundreds of small characters cost one launch and
+// the partial last tile of an instance overlaps the tiles of the others instead of idling the tail of its own grid.
+
+#pragma once
+
+#include <cuda_runtime.h>
+#include <stdint.h>
+#include <vector>
+#include "cutil_math.cu"
+#include "skinning_types.h"
+#include "skinning_cpu.h"
+#include "skinning_palette.cu"
+#include "skinning_s1.cu"
+
+const int32_t skinning_s5_vertices_per_thread = 2;
+
+// Device copies of an instance table and its tiles
+struct skin_batch_device {
+    skinning::skin_instance* instances;
+    skinning::skin_tile* tiles;
+    int32_t instance_count;
+    int32_t tile_count;
+    int32_t max_bone_count;
+    int32_t block_size;                     // Tiles hold block_size * skinning_s5_vertices_per_thread vertices
+};
+
+cudaError_t create_skin_batch_device(skin_batch_device& out_batch, const skinning::skin_instance* instances,
+    int32_t instance_count, int32_t block_size) {
+    out_batch = {};
+    std::vector<skinning::skin_tile> tiles;
+    skinning::make_skin_tiles(instances, instance_count, block_size * skinning_s5_vertices_per_thread, tiles);
+    out_batch.instance_count = instance_count;
+    out_batch.tile_count = static_cast<int32_t>(tiles.size());
+    out_batch.block_size = block_size;
+    for (int32_t i = 0; i < instance_count; ++i) {
+        out_batch.max_bone_count = std::max(out_batch.max_bone_count, static_cast<int32_t>(instances[i].bone_count));
+    }
+
+    cudaError_t result = cudaMalloc(&out_batch.instances, instance_count * sizeof(skinning::skin_instance));
+    if (result == cudaSuccess) {
+        result = cudaMalloc(&out_batch.tiles, tiles.size() * sizeof(skinning::skin_tile));
+    }
+    if (result != cudaSuccess) {
+        return result;
+    }
+    cudaMemcpy(out_batch.instances, instances, instance_count * sizeof(skinning::skin_instance),
+        cudaMemcpyHostToDevice);
+    return cudaMemcpy(out_batch.tiles, tiles.data(), tiles.size() * sizeof(skinning::skin_tile),
+        cudaMemcpyHostToDevice);
+}
+
+void destroy_skin_batch_device(skin_batch_device& batch) {
+    cudaFree(batch.instances);
+    cudaFree(batch.tiles);
+    batch = {};
+}
+
+// One block per tile, bone_palette_shared_size(max bone count) bytes of shared memory. Palettes hold 3 rows per bone,
+// an instance palette starts at row palette_offset * 3.
+__global__ void skinning_kernel_s5(a2v_streams IN, v2f_streams OUT, const skinning::skin_tile* __restrict__ tiles,
+    const skinning::skin_instance* __restrict__ instances, const float4* palettes) {
+    skinning::skin_tile tile = tiles[blockIdx.x];
+    skinning::skin_instance instance = instances[tile.instance];
+    const float4* bones_mat = stage_bone_palette(palettes + size_t(instance.palette_offset) * 3, instance.bone_count);
+
+    // Strided by blockDim.x so each pass over the tile stays coalesced, as in s2
+#pragma unroll
+    for (int32_t i = 0; i < skinning_s5_vertices_per_thread; ++i) {
+        uint32_t vertex = tile.vertex_offset + i * blockDim.x + threadIdx.x;
+        if (vertex < tile.vertex_offset + tile.vertex_count) {
+            skin_vertex_soa(IN, OUT, instance.vertex_begin + vertex, size_t(instance.out_begin) + vertex, bones_mat);
+        }
+    }
+}
+
+void launch_skinning_s5(const skin_batch_device& batch, a2v_streams IN, v2f_streams OUT, const float4* palettes,
+    cudaStream_t stream) {
+    if (batch.tile_count == 0) {
+        return;
+    }
+    skinning_kernel_s5<<<batch.tile_count, batch.block_size, bone_palette_shared_size(batch.max_bone_count),
+        stream>>>(IN, OUT, batch.tiles, batch.instances, palettes);
+}
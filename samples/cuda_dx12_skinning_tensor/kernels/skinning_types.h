@@ -0,0 +1,174 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+// Vertex formats shared by the CUDA kernels and the CPU reference, host only builds get the CUDA vector types layout
+#if defined(__CUDACC__)
+#include <vector_types.h>
+#define SKINNING_HOST_DEVICE __host__ __device__
+#else
+struct float2 { float x, y; };
+struct float3 { float x, y, z; };
+struct float4 { float x, y, z, w; };
+#ifndef __align__
+#define __align__(n)
+#endif
+#define SKINNING_HOST_DEVICE
+#endif
+
+// Bone palette entry is the reference effect float4x3 stored as 3 rows of float4, so that
+// position' = (dot(row0, p), dot(row1, p), dot(row2, p)) with p = (position, 1)
+const int32_t skinning_max_bones = 256;
+const int32_t skinning_floats_per_bone = 12;
+
+// Dual quaternion palette entry, real part xyzw then dual part xyzw, see affine_to_dual_quat
+const int32_t skinning_floats_per_dual_quat = 8;
+
+// Per mesh choice of palette and vertex math
+enum class skinning_mode : uint8_t {
+    linear,                                 // Blended 3x4 matrices, skinning_floats_per_bone palette entries
+    dual_quaternion,                        // Blended unit dual quaternions, skinning_floats_per_dual_quat entries
+};
+
+// Vertices per WMMA 16x16x16 step of the tensor core kernel and its CPU reference, also the K step over bones
+const int32_t skinning_gemm_tile = 16;
+
+#pragma pack(push, 1)
+struct a2v {
+    float3 position;
+    float3 normal;
+    float bone_weight[4];
+    uint8_t bone_index[4];
+    float2 uv0;
+    float2 uv1;
+} __align__(1);
+
+struct v2f {
+    float3 position;
+    float3 normal;
+    float2 uv0;
+    float2 uv1;
+} __align__(1);
+#pragma pack(pop)
+
+static_assert(sizeof(a2v) == 60, "Packed a2v layout");
+static_assert(sizeof(v2f) == 40, "Packed v2f layout");
+
+// Joint pose relative to its parent, as in glTF node TRS
+struct joint_trs {
+    float rotation[4];                      // Quaternion x, y, z, w
+    float translation[3];
+    float scale[3];
+};
+
+static_assert(sizeof(joint_trs) == 40, "joint_trs layout");
+
+// Joint TRS to the 3x4 rows of T * R * S, same layout as a bone palette entry
+SKINNING_HOST_DEVICE inline void trs_to_affine(const joint_trs& trs, float out[12]) {
+    float x = trs.rotation[0], y = trs.rotation[1], z = trs.rotation[2], w = trs.rotation[3];
+    float rotation[3][3] = {
+        { 1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y - w * z), 2.0f * (x * z + w * y) },
+        { 2.0f * (x * y + w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z - w * x) },
+        { 2.0f * (x * z - w * y), 2.0f * (y * z + w * x), 1.0f - 2.0f * (x * x + y * y) },
+    };
+    for (int32_t r = 0; r < 3; ++r) {
+        out[r * 4 + 0] = rotation[r][0] * trs.scale[0];
+        out[r * 4 + 1] = rotation[r][1] * trs.scale[1];
+        out[r * 4 + 2] = rotation[r][2] * trs.scale[2];
+        out[r * 4 + 3] = trs.translation[r];
+    }
+}
+
+// a * b of two 3x4 affine transforms with an implicit (0, 0, 0, 1) last row, b applied first
+SKINNING_HOST_DEVICE inline void multiply_affine(const float a[12], const float b[12], float out[12]) {
+    for (int32_t r = 0; r < 3; ++r) {
+        const float* row = a + r * 4;
+        for (int32_t c = 0; c < 4; ++c) {
+            out[r * 4 + c] = row[0] * b[c] + row[1] * b[4 + c] + row[2] * b[8 + c] + (c == 3 ? row[3] : 0.0f);
+        }
+    }
+}
+
+// Rotation and translation of a 3x4 palette entry as a unit dual quaternion: real part the rotation, dual part
+// 0.5 * (translation, 0) * real. Columns are normalized first, dual quaternions are rigid and the scale is dropped.
+SKINNING_HOST_DEVICE inline void affine_to_dual_quat(const float m[12], float out[8]) {
+    float r[3][3];
+    for (int32_t c = 0; c < 3; ++c) {
+        float length = sqrtf(m[c] * m[c] + m[4 + c] * m[4 + c] + m[8 + c] * m[8 + c]);
+        float scale = length > 0.0f ? 1.0f / length : 0.0f;
+        for (int32_t row = 0; row < 3; ++row) {
+            r[row][c] = m[row * 4 + c] * scale;
+        }
+    }
+
+    // Largest of w, x, y, z computed from the diagonal, the others from the off diagonal terms
+    float q[4];
+    float trace = r[0][0] + r[1][1] + r[2][2];
+    if (trace > 0.0f) {
+        float s = sqrtf(trace + 1.0f) * 2.0f;
+        q[0] = (r[2][1] - r[1][2]) / s;
+        q[1] = (r[0][2] - r[2][0]) / s;
+        q[2] = (r[1][0] - r[0][1]) / s;
+        q[3] = 0.25f * s;
+    }
+    else if (r[0][0] > r[1][1] && r[0][0] > r[2][2]) {
+        float s = sqrtf(1.0f + r[0][0] - r[1][1] - r[2][2]) * 2.0f;
+        q[0] = 0.25f * s;
+        q[1] = (r[0][1] + r[1][0]) / s;
+        q[2] = (r[0][2] + r[2][0]) / s;
+        q[3] = (r[2][1] - r[1][2]) / s;
+    }
+    else if (r[1][1] > r[2][2]) {
+        float s = sqrtf(1.0f + r[1][1] - r[0][0] - r[2][2]) * 2.0f;
+        q[0] = (r[0][1] + r[1][0]) / s;
+        q[1] = 0.25f * s;
+        q[2] = (r[1][2] + r[2][1]) / s;
+        q[3] = (r[0][2] - r[2][0]) / s;
+    }
+    else {
+        float s = sqrtf(1.0f + r[2][2] - r[0][0] - r[1][1]) * 2.0f;
+        q[0] = (r[0][2] + r[2][0]) / s;
+        q[1] = (r[1][2] + r[2][1]) / s;
+        q[2] = 0.25f * s;
+        q[3] = (r[1][0] - r[0][1]) / s;
+    }
+    float length = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (int32_t i = 0; i < 4; ++i) {
+        out[i] = q[i] / length;
+    }
+
+    float t[3] = { m[3], m[7], m[11] };
+    const float* v = out;
+    out[4] = 0.5f * (out[3] * t[0] + t[1] * v[2] - t[2] * v[1]);
+    out[5] = 0.5f * (out[3] * t[1] + t[2] * v[0] - t[0] * v[2]);
+    out[6] = 0.5f * (out[3] * t[2] + t[0] * v[1] - t[1] * v[0]);
+    out[7] = -0.5f * (t[0] * v[0] + t[1] * v[1] + t[2] * v[2]);
+}
+
+// Position and normal through a blended dual quaternion, normalized here: rotated by the real part, then translated
+// by 2 * (w * dual.xyz - dual.w * real.xyz + real.xyz x dual.xyz) with w = real.w
+SKINNING_HOST_DEVICE inline void dual_quat_transform(const float dq[8], const float p[3], const float n[3],
+    float out_p[3], float out_n[3]) {
+    float length = sqrtf(dq[0] * dq[0] + dq[1] * dq[1] + dq[2] * dq[2] + dq[3] * dq[3]);
+    float scale = length > 0.0f ? 1.0f / length : 0.0f;
+    float x = dq[0] * scale, y = dq[1] * scale, z = dq[2] * scale, w = dq[3] * scale;
+    float dx = dq[4] * scale, dy = dq[5] * scale, dz = dq[6] * scale, dw = dq[7] * scale;
+
+    // v + 2 * q.xyz x (q.xyz x v + w * v)
+    float px = y * p[2] - z * p[1] + w * p[0];
+    float py = z * p[0] - x * p[2] + w * p[1];
+    float pz = x * p[1] - y * p[0] + w * p[2];
+    float nx = y * n[2] - z * n[1] + w * n[0];
+    float ny = z * n[0] - x * n[2] + w * n[1];
+    float nz = x * n[1] - y * n[0] + w * n[2];
+    float tx = 2.0f * (w * dx - dw * x + y * dz - z * dy);
+    float ty = 2.0f * (w * dy - dw * y + z * dx - x * dz);
+    float tz = 2.0f * (w * dz - dw * z + x * dy - y * dx);
+    out_p[0] = p[0] + 2.0f * (y * pz - z * py) + tx;
+    out_p[1] = p[1] + 2.0f * (z * px - x * pz) + ty;
+    out_p[2] = p[2] + 2.0f * (x * py - y * px) + tz;
+    out_n[0] = n[0] + 2.0f * (y * nz - z * ny);
+    out_n[1] = n[1] + 2.0f * (z * nx - x * nz);
+    out_n[2] = n[2] + 2.0f * (x * ny - y * nx);
+}
@@ -0,0 +1,91 @@
+// Skinning kernels first, windows.h of fastdx.h defines min and max macros that break their std::min and std::max
+#include <cuda_runtime.h>
+#include "kernels/skinning_s2.cu"
+#include "skinning_dx12_cuda.h"
+#define FASTDX_INTEROP_CUDA
+#define FASTDX_INTEROP_IMPLEMENTATION
+#include "../../fastdx/fastdx_interop.h"
+
+const int32_t kCudaBlockSize = 128;
+
+cudaStream_t cudaStream = nullptr;
+fastdx::InteropDevicePtr cudaInterop;
+fastdx::SharedBufferRing cudaSkinnedRing;
+palette_uploader cudaPaletteUploader;
+int32_t cudaBoneCount = 0;
+uint8_t* cudaInputStreams = nullptr;
+uint8_t* cudaOutputStreams = nullptr;
+a2v_streams cudaInput;
+v2f_streams cudaOutput;
+int32_t cudaVertexCount = 0;
+
+
+bool initializeCudaSkinning(fastdx::D3D12DeviceWrapperPtr device, fastdx::ID3D12CommandQueuePtr commandQueue,
+    const a2v* vertices, size_t vertexCount, int32_t boneCount, uint32_t frameCount) {
+    int32_t deviceCount = 0;
+    if (cudaGetDeviceCount(&deviceCount) != cudaSuccess || deviceCount == 0) {
+        OutputDebugStringA("No CUDA device, only the compute shader skinning backend is available\n");
+        return false;
+    }
+
+    cudaVertexCount = static_cast<int32_t>(vertexCount);
+    skinning::soa_a2v_layout inputLayout = skinning::make_a2v_layout(vertexCount);
+    skinning::soa_v2f_layout outputLayout = skinning::make_v2f_layout(vertexCount);
+    std::vector<uint8_t> hostInputStreams(inputLayout.size_in_bytes);
+    skinning::pack_a2v(vertices, vertexCount, inputLayout, hostInputStreams.data());
+
+    cudaBoneCount = boneCount;
+    create_palette_uploader(cudaPaletteUploader, boneCount);
+    cudaMalloc(&cudaInputStreams, inputLayout.size_in_bytes);
+    cudaMalloc(&cudaOutputStreams, outputLayout.size_in_bytes);
+    cudaMemcpy(cudaInputStreams, hostInputStreams.data(), inputLayout.size_in_bytes, cudaMemcpyHostToDevice);
+    cudaInput = make_a2v_streams(cudaInputStreams, inputLayout);
+    cudaOutput = make_v2f_streams(cudaOutputStreams, outputLayout);
+
+    cudaStreamCreateWithFlags(&cudaStream, cudaStreamNonBlocking);
+    cudaInterop = fastdx::createD3D12CudaInterop(device, commandQueue, cudaStream);
+    bool isRingCreated = cudaSkinnedRing.create(cudaInterop, frameCount, vertexCount * sizeof(SkinnedVertex));
+    return isRingCreated && cudaGetLastError() == cudaSuccess;
+}
+
+void destroyCudaSkinning() {
+    if (!cudaStream) {
+        return;
+    }
+    cudaStreamSynchronize(cudaStream);
+    cudaSkinnedRing = fastdx::SharedBufferRing();
+    cudaInterop = nullptr;
+    cudaStreamDestroy(cudaStream);
+    cudaStream = nullptr;
+    destroy_palette_uploader(cudaPaletteUploader);
+    cudaFree(cudaInputStreams);
+    cudaFree(cudaOutputStreams);
+}
+
+/// Interleave the s2 output streams into the SkinnedVertex layout of textured_vs.hlsl
+__global__ void packSkinnedVertices(v2f_streams IN, SkinnedVertex* OUT, int32_t vertexCount) {
+    int32_t vertexId = blockIdx.x * blockDim.x + threadIdx.x;
+    if (vertexId >= vertexCount) {
+        return;
+    }
+    OUT[vertexId].position = make_float3(IN.position[0][vertexId], IN.position[1][vertexId], IN.position[2][vertexId]);
+    OUT[vertexId].normal = make_float3(IN.normal[0][vertexId], IN.normal[1][vertexId], IN.normal[2][vertexId]);
+    OUT[vertexId].uv0 = make_float2(IN.uv[0][vertexId], IN.uv[1][vertexId]);
+}
+
+fastdx::ID3D12ResourcePtr skinWithCuda(const float* palette, skinning_mode mode) {
+    fastdx::SharedBufferPtr skinnedVertices = cudaSkinnedRing.buffer(cudaSkinnedRing.beginProduce());
+    const float4* devicePalette = upload_palette(cudaPaletteUploader, palette, cudaBoneCount, cudaStream, mode);
+    launch_skinning_s2_vertices(devicePalette, cudaBoneCount, 1, cudaInput, cudaOutput, cudaVertexCount,
+        kCudaBlockSize, cudaStream, mode);
+    packSkinnedVertices<<<(cudaVertexCount + kCudaBlockSize - 1) / kCudaBlockSize, kCudaBlockSize, 0, cudaStream>>>(
+        cudaOutput, static_cast<SkinnedVertex*>(skinnedVertices->data), cudaVertexCount);
+    cudaSkinnedRing.endProduce();
+
+    // Same slot, producer and consumer advance together on this thread
+    return cudaSkinnedRing.buffer(cudaSkinnedRing.beginConsume())->resource;
+}
+
+void endCudaSkinningFrame() {
+    cudaSkinnedRing.endConsume();
+}
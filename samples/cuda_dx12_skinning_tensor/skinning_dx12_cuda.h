@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "kernels/skinning_types.h"
+#include "../../fastdx/fastdx.h"
+
+
+///
+/// CUDA skinning backend of the sample, compiled by nvcc from skinning_dx12_cuda.cu
+///
+/// Skins into a ring of buffers shared with D3D12 through fastdx_interop, one per frame in flight, that the draw reads
+/// in place. The CUDA stream waits until the direct queue released a buffer and the direct queue until CUDA wrote it,
+/// nothing blocks the host. Only plain C++ types cross this header, so the rest of the sample stays a cl.exe file.
+///
+
+/// a2v of textured_vs.hlsl and SkinnedVertex of skinning_cs.hlsl, what either backend writes
+struct SkinnedVertex {
+    float3 position;
+    float3 normal;
+    float2 uv0;
+};
+static_assert(sizeof(SkinnedVertex) == 32, "SkinnedVertex must match the textured_vs.hlsl vertex stride");
+
+/// Mesh as SoA streams, the palette uploader and the shared ring on the CUDA device. False without a CUDA device or
+/// when the ring can't be shared, the backend stays off then.
+bool initializeCudaSkinning(fastdx::D3D12DeviceWrapperPtr device, fastdx::ID3D12CommandQueuePtr commandQueue,
+    const a2v* vertices, size_t vertexCount, int32_t boneCount, uint32_t frameCount);
+
+/// s2 vertex kernel into the next buffer of the ring, returns it for the draw. The palette is the one the compute
+/// shader gets, skinning_floats_per_bone or skinning_floats_per_dual_quat per bone for the mode, staged through the
+/// pinned double buffer of palette_uploader. The frame releases the buffer with endCudaSkinningFrame once its command
+/// list is submitted.
+fastdx::ID3D12ResourcePtr skinWithCuda(const float* palette, skinning_mode mode);
+
+void endCudaSkinningFrame();
+
+/// Call once the direct queue is idle, every frame CUDA produced has been released then
+void destroyCudaSkinning();
@@ -0,0 +1,612 @@
+// Skinning headers first, windows.h of fastdx.h defines min and max macros that break their std::min and std::max
+#define SKINNING_CPU_IMPLEMENTATION
+#include "kernels/skinning_cpu.h"
+#define SKINNING_DQ_IMPLEMENTATION
+#include "kernels/skinning_dq.h"
+#define FASTDX_IMPLEMENTATION
+#include "../../fastdx/fastdx.h"
+#include "skinning_dx12_cuda.h"
+#include <DirectXMath.h>
+#include <filesystem>
+#include <fstream>
+using namespace std;
+
+const int32_t kFrameCount = 3;
+const DXGI_FORMAT kFrameFormat = DXGI_FORMAT_R10G10B10A2_UNORM;
+const D3D12_CLEAR_VALUE kClearDepth = { DXGI_FORMAT_D32_FLOAT, {1.0f, 0} };
+const D3D12_CLEAR_VALUE kClearRenderTarget = { kFrameFormat, { 0.0f, 0.2f, 0.4f, 1.0f } };
+const int32_t kTubeJointCount = 6;            // Chain along +Y, one joint every kTubeJointLength
+const float kTubeJointLength = 1.0f;
+const float kTubeRadius = 0.4f;
+const int32_t kTubeRingsPerJoint = 8;
+const int32_t kTubeSegments = 32;
+const int32_t kCheckerSize = 64;              // Albedo of textured_ps, 8x8 texel squares
+const int32_t kSkinningGroupSize = 64;        // numthreads of skinning_cs.hlsl
+const float kSkinningTolerance = 1e-4f;       // fp32 paths only differ from the reference by rounding order
+fastdx::WindowProperties windowProp;
+
+fastdx::D3D12DeviceWrapperPtr device;
+fastdx::ID3D12CommandQueuePtr commandQueue;
+fastdx::ID3D12CommandAllocatorPtr commandAllocators[kFrameCount];
+fastdx::ID3D12GraphicsCommandListPtr commandList;
+fastdx::IDXGISwapChainPtr swapChain;
+fastdx::ID3D12DescriptorHeapPtr swapChainRtvHeap;
+fastdx::ID3D12DescriptorHeapPtr depthStencilViewHeap;
+fastdx::ID3D12DescriptorHeapPtr textureViewHeap;
+fastdx::ID3D12PipelineStatePtr pipelineState;
+fastdx::ID3D12RootSignaturePtr pipelineRootSignature;
+fastdx::ID3D12PipelineStatePtr skinningPipelineState;
+fastdx::ID3D12RootSignaturePtr skinningRootSignature;
+vector<fastdx::ID3D12ResourcePtr> renderTargets;
+fastdx::ID3D12ResourcePtr depthStencilTarget;
+vector<uint8_t> vertexShader, pixelShader, skinningShader;
+fastdx::ID3D12ResourcePtr sceneConstantBuffer;
+fastdx::ID3D12ResourcePtr instanceBuffer;
+fastdx::ID3D12ResourcePtr checkerTexture;
+vector<fastdx::ID3D12ResourcePtr> uploadBuffers;
+
+// Frame Sync
+int32_t frameIndex = 0;
+HANDLE fenceEvent;
+fastdx::ID3D12FencePtr swapFence;
+uint64_t swapFenceCounter = 0;
+uint64_t swapFenceWaitValue[kFrameCount] = {};
+
+// Scene Constant Buffer
+struct SceneGlobals { // On x64 we can guarantee 16B alignment
+    DirectX::XMMATRIX matW;
+    DirectX::XMMATRIX matVP;
+};
+
+// Root constants of skinning_cs.hlsl, mode is the skinning_mode value
+struct SkinningConstants {
+    uint32_t vertexCount;
+    uint32_t mode;
+};
+
+/// Where the skinned vertex buffer comes from. Both write the SkinnedVertex buffer textured_vs.hlsl pulls from, B
+/// switches backend and M skinning mode. The CUDA backend lives in skinning_dx12_cuda.cu and needs a CUDA device.
+enum class SkinningBackend {
+    ComputeShader,                      // skinning_cs.hlsl from CPU evaluated palettes
+    Cuda,                               // s2 vertex kernel from the same palettes, skinning_dx12_cuda.cu
+};
+const size_t kSkinningBackendCount = 2;
+SkinningBackend skinningBackend = SkinningBackend::ComputeShader;
+skinning_mode skinningMode = skinning_mode::linear;
+bool isCudaAvailable = false;
+// Per backend, read back its next frame and compare it with the CPU reference. A pending check of the backend that
+// is not shown borrows one frame, both draw the same vertices.
+bool isValidationPending[kSkinningBackendCount] = { true, false };
+
+// Skinned tube, input a2v records and the animated skeleton
+skinning::skeleton tubeSkeleton;
+vector<a2v> tubeVertices;
+vector<uint16_t> tubeIndices;
+vector<joint_trs> tubePose;
+vector<float> tubePalette;              // skinning_floats_per_bone per joint
+vector<float> tubeDualQuats;            // skinning_floats_per_dual_quat per joint
+float tubeTimeMs = 0.0f;
+
+// Skinning resources. The skinned buffer is the UAV of the compute shader and the vertex SRV of the draw,
+// skinnedVertexState tracks which.
+fastdx::ID3D12ResourcePtr inputVertexBuffer;
+fastdx::ID3D12ResourcePtr skinnedVertexBuffer;
+D3D12_RESOURCE_STATES skinnedVertexState = D3D12_RESOURCE_STATE_COMMON;
+fastdx::ID3D12ResourcePtr paletteBuffers[kFrameCount];         // Upload heap, persistently mapped
+uint8_t* paletteMapPtrs[kFrameCount] = {};
+fastdx::ID3D12ResourcePtr readbackBuffer;
+fastdx::ID3D12ResourcePtr indexBuffer;
+D3D12_INDEX_BUFFER_VIEW indexBufferView;
+
+
+wstring getPathInModule(const wstring& filePath) {
+    WCHAR modulePathBuffer[2048];
+    GetModuleFileName(nullptr, modulePathBuffer, _countof(modulePathBuffer));
+    return filesystem::path(modulePathBuffer).parent_path() / filePath;
+}
+
+HRESULT readShader(const wstring& filePath, vector<uint8_t>& outShaderData) {
+    auto fullFilePath = getPathInModule(filePath);
+    ifstream file(fullFilePath, ios::binary);
+    if (file) {
+        uintmax_t fileSize = filesystem::file_size(fullFilePath);
+        outShaderData.resize(fileSize);
+        file.read(reinterpret_cast<char*>(outShaderData.data()), fileSize);
+    }
+    return file ? S_OK : E_FAIL;
+}
+
+void initializeD3d(HWND hwnd) {
+    // Create a device and queue to dispatch command lists
+    device = fastdx::createDevice(D3D_FEATURE_LEVEL_12_2);
+    commandQueue = device->createCommandQueue(D3D12_COMMAND_LIST_TYPE_DIRECT);
+
+    // Create a triple frame buffer swap chain for window
+    DXGI_SWAP_CHAIN_DESC1 swapChainDesc = fastdxu::swapChainDesc(hwnd, kFrameCount, kFrameFormat);
+    swapChain = device->createSwapChainForHwnd(commandQueue, swapChainDesc, hwnd);
+    windowProp.width = swapChainDesc.Width;
+    windowProp.height = swapChainDesc.Height;
+
+    // Create heaps for render target views, depth stencil and the albedo texture
+    swapChainRtvHeap = device->createDescriptorHeap(kFrameCount, D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+    renderTargets = device->createRenderTargetViews(swapChain, swapChainRtvHeap);
+    depthStencilViewHeap = device->createDescriptorHeap(1, D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
+    textureViewHeap = device->createDescriptorHeap(1, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    // Create depth stencil resource and its view
+    D3D12_HEAP_PROPERTIES defaultHeapProps = { D3D12_HEAP_TYPE_DEFAULT };
+    D3D12_RESOURCE_DESC depthStencilResourceDesc = fastdxu::resourceTexDesc(D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+        swapChainDesc.Width, swapChainDesc.Height, 1, DXGI_FORMAT_D32_FLOAT, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+    depthStencilTarget = device->createCommittedResource(defaultHeapProps, D3D12_HEAP_FLAG_NONE,
+        depthStencilResourceDesc, D3D12_RESOURCE_STATE_DEPTH_WRITE, &kClearDepth);
+
+    D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
+    depthStencilDesc.Format = DXGI_FORMAT_D32_FLOAT;
+    depthStencilDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+    device->createDepthStencilView(depthStencilTarget, depthStencilDesc,
+        depthStencilViewHeap->GetCPUDescriptorHandleForHeapStart());
+
+    // Create one command allocator per frame buffer
+    for (int32_t i = 0; i < kFrameCount; ++i) {
+        commandAllocators[i] = device->createCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT);
+    }
+
+    // Single command list will reuse all allocators
+    commandList = device->createCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocators[0]);
+    commandList->Close();
+
+    // Fence to wait for a completed frame to reuse
+    swapFence = device->createFence(swapFenceCounter++, D3D12_FENCE_FLAG_NONE);
+    fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+
+    // Vertex pulling pipeline of the glTF sample. The tube is open, its inside shows through the ends.
+    readShader(L"textured_vs.cso", vertexShader);
+    readShader(L"textured_ps.cso", pixelShader);
+    pipelineRootSignature = device->createRootSignature(0, vertexShader.data(), vertexShader.size());
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC pipelineDesc = fastdxu::defaultGraphicsPipelineDesc(kFrameFormat);
+    pipelineDesc.pRootSignature = pipelineRootSignature.get();
+    pipelineDesc.VS = { vertexShader.data(), vertexShader.size() };
+    pipelineDesc.PS = { pixelShader.data(), pixelShader.size() };
+    pipelineDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+    pipelineState = device->createGraphicsPipelineState(pipelineDesc);
+
+    // Compute skinning into the vertex buffer of the pipeline above
+    readShader(L"skinning_cs.cso", skinningShader);
+    skinningRootSignature = device->createRootSignature(0, skinningShader.data(), skinningShader.size());
+
+    D3D12_COMPUTE_PIPELINE_STATE_DESC computePipelineDesc = {};
+    computePipelineDesc.pRootSignature = skinningRootSignature.get();
+    computePipelineDesc.CS = { skinningShader.data(), skinningShader.size() };
+    skinningPipelineState = device->createComputePipelineState(computePipelineDesc);
+}
+
+void startCommandList() {
+    // Get and reset allocator for current frame, then point command list to it
+    auto commandAllocator = commandAllocators[frameIndex];
+    commandAllocator->Reset();
+    commandList->Reset(commandAllocator.get(), nullptr);
+}
+
+void executeCommandList() {
+    // Close and dispatch command
+    commandList->Close();
+    ID3D12CommandList* commandLists[] = { commandList.get() };
+    commandQueue->ExecuteCommandLists(_countof(commandLists), commandLists);
+}
+
+void waitGpu(bool forceWait = false) {
+    // Queue always signal increasing counter values
+    commandQueue->Signal(swapFence.get(), swapFenceCounter);
+    swapFenceWaitValue[frameIndex] = swapFenceCounter++;
+
+    // Wait if next frame not ready
+    int32_t nextFrameIndex = swapChain->GetCurrentBackBufferIndex();
+    if (swapFence->GetCompletedValue() < swapFenceWaitValue[nextFrameIndex] || forceWait) {
+        swapFence->SetEventOnCompletion(swapFenceWaitValue[nextFrameIndex], fenceEvent);
+        WaitForSingleObjectEx(fenceEvent, INFINITE, FALSE);
+    }
+    frameIndex = nextFrameIndex;
+}
+
+/// Wait until everything submitted so far is done, for initialization uploads and validation readbacks
+void waitGpuIdle() {
+    commandQueue->Signal(swapFence.get(), swapFenceCounter);
+    swapFence->SetEventOnCompletion(swapFenceCounter++, fenceEvent);
+    WaitForSingleObjectEx(fenceEvent, INFINITE, FALSE);
+}
+
+fastdx::ID3D12ResourcePtr createUploadBuffer(uint32_t sizeInBytes, uint8_t** outMapPtr) {
+    D3D12_HEAP_PROPERTIES uploadHeapProps = { D3D12_HEAP_TYPE_UPLOAD };
+    fastdx::ID3D12ResourcePtr resource = device->createCommittedResource(uploadHeapProps, D3D12_HEAP_FLAG_NONE,
+        fastdxu::resourceBufferDesc(sizeInBytes), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr);
+    resource->Map(0, nullptr, reinterpret_cast<void**>(outMapPtr));
+    return resource;
+}
+
+/// Default heap buffer filled through an upload buffer, the copy is recorded on the open command list
+fastdx::ID3D12ResourcePtr createBufferResource(const void* dataPtr, uint32_t sizeInBytes,
+    D3D12_RESOURCE_STATES bufferState) {
+    uint8_t* dataMapPtr = nullptr;
+    fastdx::ID3D12ResourcePtr cpuToGpuResource = createUploadBuffer(sizeInBytes, &dataMapPtr);
+    memcpy(dataMapPtr, dataPtr, sizeInBytes);
+    cpuToGpuResource->Unmap(0, nullptr);
+
+    D3D12_HEAP_PROPERTIES defaultHeapProps = { D3D12_HEAP_TYPE_DEFAULT };
+    fastdx::ID3D12ResourcePtr resource = device->createCommittedResource(defaultHeapProps, D3D12_HEAP_FLAG_NONE,
+        fastdxu::resourceBufferDesc(sizeInBytes), D3D12_RESOURCE_STATE_COPY_DEST, nullptr);
+    commandList->CopyResource(resource.get(), cpuToGpuResource.get());
+
+    D3D12_RESOURCE_BARRIER transitionBarrier = fastdxu::resourceBarrierTransition(resource,
+        D3D12_RESOURCE_STATE_COPY_DEST, bufferState, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+    commandList->ResourceBarrier(1, &transitionBarrier);
+
+    uploadBuffers.push_back(cpuToGpuResource);
+    return resource;
+}
+
+/// Checker albedo so the deformation shows, in the first slot of the textured_ps material table
+void createCheckerTexture() {
+    vector<uint32_t> texels(kCheckerSize * kCheckerSize);
+    for (int32_t y = 0; y < kCheckerSize; ++y) {
+        for (int32_t x = 0; x < kCheckerSize; ++x) {
+            texels[y * kCheckerSize + x] = ((x / 8 + y / 8) & 1) ? 0xffe0e0e0 : 0xff404040;
+        }
+    }
+
+    D3D12_RESOURCE_DESC textureDesc = fastdxu::resourceTexDesc(D3D12_RESOURCE_DIMENSION_TEXTURE2D, kCheckerSize,
+        kCheckerSize, 1, DXGI_FORMAT_R8G8B8A8_UNORM, D3D12_RESOURCE_FLAG_NONE);
+    textureDesc.MipLevels = 1;
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT resourceFootprint;
+    uint64_t uploadSizeInBytes = 0;
+    device->d3dDevice()->GetCopyableFootprints(&textureDesc, 0, 1, 0, &resourceFootprint, nullptr, nullptr,
+        &uploadSizeInBytes);
+
+    // Rows of the upload buffer are aligned to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+    uint8_t* dataMapPtr = nullptr;
+    fastdx::ID3D12ResourcePtr cpuToGpuResource = createUploadBuffer(static_cast<uint32_t>(uploadSizeInBytes),
+        &dataMapPtr);
+    for (int32_t y = 0; y < kCheckerSize; ++y) {
+        memcpy(dataMapPtr + y * resourceFootprint.Footprint.RowPitch, &texels[y * kCheckerSize],
+            kCheckerSize * sizeof(uint32_t));
+    }
+    cpuToGpuResource->Unmap(0, nullptr);
+
+    D3D12_HEAP_PROPERTIES defaultHeapProps = { D3D12_HEAP_TYPE_DEFAULT };
+    checkerTexture = device->createCommittedResource(defaultHeapProps, D3D12_HEAP_FLAG_NONE, textureDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr);
+    D3D12_TEXTURE_COPY_LOCATION srcRegion = { cpuToGpuResource.get(), D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
+        resourceFootprint };
+    D3D12_TEXTURE_COPY_LOCATION dstRegion = { checkerTexture.get(), D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX, 0 };
+    commandList->CopyTextureRegion(&dstRegion, 0, 0, 0, &srcRegion, nullptr);
+
+    D3D12_RESOURCE_BARRIER transitionBarrier = fastdxu::resourceBarrierTransition(checkerTexture,
+        D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+        D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+    commandList->ResourceBarrier(1, &transitionBarrier);
+    uploadBuffers.push_back(cpuToGpuResource);
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC textureViewDesc = fastdxu::shaderResourceViewDesc(
+        D3D12_SRV_DIMENSION_TEXTURE2D, DXGI_FORMAT_R8G8B8A8_UNORM);
+    textureViewDesc.Texture2D.MipLevels = 1;
+    device->createShaderResourceView(checkerTexture, textureViewDesc,
+        textureViewHeap->GetCPUDescriptorHandleForHeapStart());
+}
+
+/// Open tube around a chain of joints along +Y. A ring between two joints is weighted linearly between them, so the
+/// bends are smooth and dual quaternion skinning keeps the volume linear blending loses.
+void createTube() {
+    tubeSkeleton = {};
+    for (int32_t joint = 0; joint < kTubeJointCount; ++joint) {
+        joint_trs bind = { { 0.0f, 0.0f, 0.0f, 1.0f }, { 0.0f, joint == 0 ? 0.0f : kTubeJointLength, 0.0f },
+            { 1.0f, 1.0f, 1.0f } };
+        float inverseBind[skinning_floats_per_bone] = {
+            1.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 1.0f, 0.0f, -joint * kTubeJointLength,
+            0.0f, 0.0f, 1.0f, 0.0f,
+        };
+        tubeSkeleton.parents.push_back(joint - 1);
+        tubeSkeleton.bind_pose.push_back(bind);
+        tubeSkeleton.inverse_bind.insert(tubeSkeleton.inverse_bind.end(), inverseBind,
+            inverseBind + skinning_floats_per_bone);
+    }
+    tubePose = tubeSkeleton.bind_pose;
+    tubePalette.resize(kTubeJointCount * skinning_floats_per_bone);
+    tubeDualQuats.resize(kTubeJointCount * skinning_floats_per_dual_quat);
+
+    int32_t ringCount = (kTubeJointCount - 1) * kTubeRingsPerJoint + 1;
+    float height = (kTubeJointCount - 1) * kTubeJointLength;
+    tubeVertices.clear();
+    for (int32_t ring = 0; ring < ringCount; ++ring) {
+        int32_t joint = min(ring / kTubeRingsPerJoint, kTubeJointCount - 2);
+        float t = (ring - joint * kTubeRingsPerJoint) / static_cast<float>(kTubeRingsPerJoint);
+        float y = ring * kTubeJointLength / kTubeRingsPerJoint;
+
+        // One more column than segments, the seam has its own u = 1 vertices
+        for (int32_t segment = 0; segment <= kTubeSegments; ++segment) {
+            float angle = segment * DirectX::XM_2PI / kTubeSegments;
+            a2v vertex = {};
+            vertex.position = { kTubeRadius * cosf(angle), y, kTubeRadius * sinf(angle) };
+            vertex.normal = { cosf(angle), 0.0f, sinf(angle) };
+            vertex.bone_index[0] = static_cast<uint8_t>(joint);
+            vertex.bone_index[1] = static_cast<uint8_t>(joint + 1);
+            vertex.bone_weight[0] = 1.0f - t;
+            vertex.bone_weight[1] = t;
+            vertex.uv0 = { segment / static_cast<float>(kTubeSegments), 1.0f - y / height };
+            vertex.uv1 = vertex.uv0;
+            tubeVertices.push_back(vertex);
+        }
+    }
+
+    tubeIndices.clear();
+    int32_t columnCount = kTubeSegments + 1;
+    for (int32_t ring = 0; ring + 1 < ringCount; ++ring) {
+        for (int32_t segment = 0; segment < kTubeSegments; ++segment) {
+            uint16_t i0 = static_cast<uint16_t>(ring * columnCount + segment);
+            uint16_t i1 = static_cast<uint16_t>(i0 + columnCount);
+            uint16_t quad[] = { i0, i1, static_cast<uint16_t>(i0 + 1), static_cast<uint16_t>(i0 + 1), i1,
+                static_cast<uint16_t>(i1 + 1) };
+            tubeIndices.insert(tubeIndices.end(), quad, quad + _countof(quad));
+        }
+    }
+}
+
+void createScene() {
+    startCommandList();
+    createTube();
+    createCheckerTexture();
+
+    uint32_t vertexCount = static_cast<uint32_t>(tubeVertices.size());
+    inputVertexBuffer = createBufferResource(tubeVertices.data(), static_cast<uint32_t>(vertexCount * sizeof(a2v)),
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    indexBuffer = createBufferResource(tubeIndices.data(), static_cast<uint32_t>(tubeIndices.size() *
+        sizeof(uint16_t)), D3D12_RESOURCE_STATE_INDEX_BUFFER);
+    indexBufferView = fastdxu::indexBufferView(indexBuffer->GetGPUVirtualAddress(),
+        static_cast<UINT>(tubeIndices.size() * sizeof(uint16_t)), DXGI_FORMAT_R16_UINT);
+
+    D3D12_HEAP_PROPERTIES defaultHeapProps = { D3D12_HEAP_TYPE_DEFAULT };
+    skinnedVertexBuffer = device->createCommittedResource(defaultHeapProps, D3D12_HEAP_FLAG_NONE,
+        fastdxu::resourceBufferDesc(static_cast<uint32_t>(vertexCount * sizeof(SkinnedVertex)),
+            D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+        D3D12_RESOURCE_STATE_COMMON, nullptr);
+    skinnedVertexState = D3D12_RESOURCE_STATE_COMMON;
+
+    // Palettes are written every frame, sized for the larger linear entries
+    for (int32_t i = 0; i < kFrameCount; ++i) {
+        paletteBuffers[i] = createUploadBuffer(static_cast<uint32_t>(kTubeJointCount * skinning_floats_per_bone *
+            sizeof(float)), &paletteMapPtrs[i]);
+    }
+    D3D12_HEAP_PROPERTIES readbackHeapProps = { D3D12_HEAP_TYPE_READBACK };
+    readbackBuffer = device->createCommittedResource(readbackHeapProps, D3D12_HEAP_FLAG_NONE,
+        fastdxu::resourceBufferDesc(static_cast<uint32_t>(vertexCount * sizeof(SkinnedVertex))),
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr);
+
+    // Camera in front of the tube, world and single instance transforms are identity
+    SceneGlobals sceneGlobals;
+    DirectX::XMFLOAT3 eye(0.0f, 2.5f, -7.0f);
+    DirectX::XMFLOAT3 lookAt(0.0f, 2.5f, 0.0f);
+    DirectX::XMFLOAT3 upVec(0.0f, 1.0f, 0.0f);
+    auto matView = DirectX::XMMatrixLookAtLH(XMLoadFloat3(&eye), XMLoadFloat3(&lookAt), XMLoadFloat3(&upVec));
+    auto matProj = DirectX::XMMatrixPerspectiveFovLH(DirectX::XM_PI / 3.0f, windowProp.aspectRatio(), 0.1f, 100.0f);
+    sceneGlobals.matW = DirectX::XMMatrixIdentity();
+    sceneGlobals.matVP = DirectX::XMMatrixTranspose(matView * matProj); // HLSL expects column-major
+    sceneConstantBuffer = createBufferResource(&sceneGlobals, sizeof(sceneGlobals),
+        D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+
+    DirectX::XMFLOAT4X4 instanceTransform;
+    DirectX::XMStoreFloat4x4(&instanceTransform, DirectX::XMMatrixIdentity());
+    instanceBuffer = createBufferResource(&instanceTransform, sizeof(instanceTransform),
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+    executeCommandList();
+    waitGpuIdle();
+    uploadBuffers.clear();
+}
+
+/// The CUDA backend stays off without a device, otherwise it is validated next to the compute shader
+void initializeCuda() {
+    isCudaAvailable = initializeCudaSkinning(device, commandQueue, tubeVertices.data(), tubeVertices.size(),
+        kTubeJointCount, kFrameCount);
+    isValidationPending[static_cast<size_t>(SkinningBackend::Cuda)] = isCudaAvailable;
+}
+
+void update(float elapsedTimeMs) {
+    tubeTimeMs += elapsedTimeMs;
+}
+
+/// Pose of the chain at the current time, a wave travelling up the tube, and its palettes in both skinning modes
+void poseTube() {
+    float time = tubeTimeMs * 0.001f;
+    for (int32_t joint = 1; joint < kTubeJointCount; ++joint) {
+        float angle = 0.6f * sinf(2.0f * time - 0.8f * joint);
+        tubePose[joint].rotation[0] = 0.0f;
+        tubePose[joint].rotation[1] = 0.0f;
+        tubePose[joint].rotation[2] = sinf(angle * 0.5f);
+        tubePose[joint].rotation[3] = cosf(angle * 0.5f);
+    }
+    skinning::evaluate_skeleton(tubeSkeleton, tubePose.data(), tubePalette.data());
+    skinning::palette_to_dual_quats(tubePalette.data(), kTubeJointCount, tubeDualQuats.data());
+}
+
+void transitionSkinnedVertices(D3D12_RESOURCE_STATES state) {
+    if (skinnedVertexState == state) {
+        return;
+    }
+    D3D12_RESOURCE_BARRIER transitionBarrier = fastdxu::resourceBarrierTransition(skinnedVertexBuffer,
+        skinnedVertexState, state, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+    commandList->ResourceBarrier(1, &transitionBarrier);
+    skinnedVertexState = state;
+}
+
+/// skinning_cs.hlsl over every vertex, palette of this frame in the mode layout
+void skinWithComputeShader() {
+    const vector<float>& palette = skinningMode == skinning_mode::linear ? tubePalette : tubeDualQuats;
+    memcpy(paletteMapPtrs[frameIndex], palette.data(), palette.size() * sizeof(float));
+
+    transitionSkinnedVertices(D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    SkinningConstants constants = { static_cast<uint32_t>(tubeVertices.size()),
+        static_cast<uint32_t>(skinningMode) };
+    commandList->SetPipelineState(skinningPipelineState.get());
+    commandList->SetComputeRootSignature(skinningRootSignature.get());
+    commandList->SetComputeRoot32BitConstants(0, 2, &constants, 0);
+    commandList->SetComputeRootShaderResourceView(1, inputVertexBuffer->GetGPUVirtualAddress());
+    commandList->SetComputeRootShaderResourceView(2, paletteBuffers[frameIndex]->GetGPUVirtualAddress());
+    commandList->SetComputeRootUnorderedAccessView(3, skinnedVertexBuffer->GetGPUVirtualAddress());
+    commandList->Dispatch((constants.vertexCount + kSkinningGroupSize - 1) / kSkinningGroupSize, 1, 1);
+    transitionSkinnedVertices(D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+}
+
+/// Compare the read back skinned buffer with skinning::skin_scalar or skin_dq_scalar of the same palette. The
+/// textured_vs.hlsl vertex has no uv1, it is taken from the input so the whole v2f can be compared.
+void validateSkinning(SkinningBackend backend) {
+    size_t vertexCount = tubeVertices.size();
+    vector<v2f> reference(vertexCount), gpuVertices(vertexCount);
+    if (skinningMode == skinning_mode::linear) {
+        skinning::skin_scalar(tubeVertices.data(), reference.data(), 0, vertexCount, tubePalette.data());
+    }
+    else {
+        skinning::skin_dq_scalar(tubeVertices.data(), reference.data(), 0, vertexCount, tubeDualQuats.data());
+    }
+
+    SkinnedVertex* readbackPtr = nullptr;
+    D3D12_RANGE readRange = { 0, vertexCount * sizeof(SkinnedVertex) };
+    readbackBuffer->Map(0, &readRange, reinterpret_cast<void**>(&readbackPtr));
+    for (size_t i = 0; i < vertexCount; ++i) {
+        gpuVertices[i] = { readbackPtr[i].position, readbackPtr[i].normal, readbackPtr[i].uv0, tubeVertices[i].uv1 };
+    }
+    D3D12_RANGE writtenRange = { 0, 0 };
+    readbackBuffer->Unmap(0, &writtenRange);
+
+    float error = skinning::max_error(reference.data(), gpuVertices.data(), vertexCount);
+    char message[256];
+    snprintf(message, sizeof(message), "Skinning %s %s, %zu vertices: max error %g, tolerance %g, %s\n",
+        backend == SkinningBackend::Cuda ? "CUDA" : "compute shader",
+        skinningMode == skinning_mode::linear ? "linear" : "dual quaternion", vertexCount, error, kSkinningTolerance,
+        error <= kSkinningTolerance ? "valid" : "INVALID");
+    OutputDebugStringA(message);
+}
+
+void draw() {
+    static D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = swapChainRtvHeap->GetCPUDescriptorHandleForHeapStart();
+    static D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle = depthStencilViewHeap->GetCPUDescriptorHandleForHeapStart();
+    static size_t heapDescriptorSize = device->getDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+    D3D12_CPU_DESCRIPTOR_HANDLE frameRtvHandle = { rtvHandle.ptr + frameIndex * heapDescriptorSize };
+
+    poseTube();
+    startCommandList();
+    SkinningBackend frameBackend = skinningBackend;
+    SkinningBackend otherBackend = skinningBackend == SkinningBackend::Cuda ? SkinningBackend::ComputeShader :
+        SkinningBackend::Cuda;
+    if (!isValidationPending[static_cast<size_t>(frameBackend)] &&
+        isValidationPending[static_cast<size_t>(otherBackend)]) {
+        frameBackend = otherBackend;
+    }
+
+    fastdx::ID3D12ResourcePtr skinnedVertices = skinnedVertexBuffer;
+    bool isCudaFrame = frameBackend == SkinningBackend::Cuda;
+    if (isCudaFrame) {
+        const float* palette = skinningMode == skinning_mode::linear ? tubePalette.data() : tubeDualQuats.data();
+        skinnedVertices = skinWithCuda(palette, skinningMode);
+    }
+    else {
+        skinWithComputeShader();
+    }
+
+    // Shared buffers stay in the common state, the copy and the draw read them through implicit promotions
+    bool isValidating = isValidationPending[static_cast<size_t>(frameBackend)];
+    if (isValidating) {
+        bool isSkinnedVertexBuffer = skinnedVertices == skinnedVertexBuffer;
+        if (isSkinnedVertexBuffer) {
+            transitionSkinnedVertices(D3D12_RESOURCE_STATE_COPY_SOURCE);
+        }
+        commandList->CopyResource(readbackBuffer.get(), skinnedVertices.get());
+        if (isSkinnedVertexBuffer) {
+            transitionSkinnedVertices(D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        }
+        isValidationPending[static_cast<size_t>(frameBackend)] = false;
+    }
+
+    D3D12_RESOURCE_BARRIER transitionBarrier = fastdxu::resourceBarrierTransition(renderTargets[frameIndex],
+        D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+    commandList->ResourceBarrier(1, &transitionBarrier);
+
+    D3D12_VIEWPORT viewport = { 0, 0, static_cast<float>(windowProp.width), static_cast<float>(windowProp.height),
+        D3D12_MIN_DEPTH, D3D12_MAX_DEPTH };
+    D3D12_RECT scissorRect = { 0, 0, windowProp.width, windowProp.height };
+    commandList->SetPipelineState(pipelineState.get());
+    commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    commandList->RSSetViewports(1, &viewport);
+    commandList->RSSetScissorRects(1, &scissorRect);
+    commandList->OMSetRenderTargets(1, &frameRtvHandle, FALSE, &dsvHandle);
+    commandList->ClearRenderTargetView(frameRtvHandle, kClearRenderTarget.Color, 0, nullptr);
+    commandList->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, kClearDepth.DepthStencil.Depth,
+        kClearDepth.DepthStencil.Stencil, 0, nullptr);
+
+    // Skinned vertices are pulled by SV_VertexID like any static vertex buffer of the glTF sample
+    ID3D12DescriptorHeap* textureHeaps[] = { textureViewHeap.get() };
+    commandList->SetGraphicsRootSignature(pipelineRootSignature.get());
+    commandList->SetDescriptorHeaps(_countof(textureHeaps), textureHeaps);
+    commandList->SetGraphicsRootConstantBufferView(0, sceneConstantBuffer->GetGPUVirtualAddress());
+    commandList->SetGraphicsRootShaderResourceView(1, skinnedVertices->GetGPUVirtualAddress());
+    commandList->SetGraphicsRootDescriptorTable(2, textureViewHeap->GetGPUDescriptorHandleForHeapStart());
+    commandList->SetGraphicsRoot32BitConstant(3, 0, 0);
+    commandList->SetGraphicsRoot32BitConstant(3, 0, 1);
+    commandList->SetGraphicsRootShaderResourceView(4, instanceBuffer->GetGPUVirtualAddress());
+    commandList->IASetIndexBuffer(&indexBufferView);
+    commandList->DrawIndexedInstanced(static_cast<UINT>(tubeIndices.size()), 1, 0, 0, 0);
+
+    transitionBarrier = fastdxu::resourceBarrierTransition(renderTargets[frameIndex],
+        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+    commandList->ResourceBarrier(1, &transitionBarrier);
+
+    executeCommandList();
+    if (isCudaFrame) {
+        endCudaSkinningFrame();
+    }
+    swapChain->Present(1, 0);
+    if (isValidating) {
+        waitGpuIdle();
+        validateSkinning(frameBackend);
+    }
+    waitGpu();
+}
+
+/// B switches the skinning backend, M the skinning mode. A backend switch validates the shown backend, a mode switch
+/// every available one.
+void onWindowMessage(UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (msg != WM_KEYDOWN) {
+        return;
+    }
+    if (wParam == 'B') {
+        if (skinningBackend == SkinningBackend::Cuda) {
+            skinningBackend = SkinningBackend::ComputeShader;
+        }
+        else if (isCudaAvailable) {
+            skinningBackend = SkinningBackend::Cuda;
+        }
+        else {
+            OutputDebugStringA("CUDA skinning backend unavailable, no CUDA device or the ring could not be shared\n");
+            return;
+        }
+        isValidationPending[static_cast<size_t>(skinningBackend)] = true;
+    }
+    else if (wParam == 'M') {
+        skinningMode = skinningMode == skinning_mode::linear ? skinning_mode::dual_quaternion : skinning_mode::linear;
+        isValidationPending[static_cast<size_t>(SkinningBackend::ComputeShader)] = true;
+        isValidationPending[static_cast<size_t>(SkinningBackend::Cuda)] = isCudaAvailable;
+    }
+}
+
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    HWND hwnd = fastdx::createWindow(windowProp);
+    fastdx::onWindowDestroy = []() {
+        waitGpu(true);
+        destroyCudaSkinning();
+    };
+    fastdx::onWindowMessage = onWindowMessage;
+    initializeD3d(hwnd);
+    createScene();
+    initializeCuda();
+
+    return fastdx::runMainLoop(update, draw);
+}
@@ -0,0 +1,978 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+///
+/// animation Header - Skeletal animation clips sampled into joint poses and skinning palettes
+///
+/// Keyframes of all tracks of a clip are stored back to back as structure of arrays, one stream for the times and
+/// one per value component. Tracks are sorted by path, so consecutive rotation, translation or scale tracks are
+/// sampled four at a time with SSE. Each instance keeps the last key of every track, playback moves forward a key
+/// or two per frame and a cursor turns the keyframe search into one or two compares.
+///
+/// Compressed clips drop keys that linear interpolation of their neighbors reproduces within a tolerance and store
+/// the remaining ones in 16 bits per component, smallest-three rotations and translations or scales normalized to
+/// the range of their track. They are decoded by the sampler in the same SSE registers they are interpolated in.
+///
+/// Palettes use the bone palette layout of the skinning sample: 12 floats per joint, the three rows of a 3x4 affine
+/// matrix in the column-vector convention (p' = M * p), so model * inverse bind is applied to vertices as is.
+///
+namespace animation {
+    enum class Path : uint8_t {
+        Rotation,
+        Translation,
+        Scale,
+        Count
+    };
+
+    enum class Interpolation : uint8_t {
+        Step,
+        Linear
+    };
+
+    /// Same layout as joint_trs of the skinning sample, rotation is a unit xyzw quaternion
+    struct JointPose {
+        float rotation[4];
+        float translation[3];
+        float scale[3];
+    };
+
+    struct Skeleton {
+        std::vector<int32_t> parents;       // -1 for roots, any order, see order
+        std::vector<float> inverseBind;     // 12 floats per joint, 3x4 rows
+        std::vector<JointPose> restPose;    // Local pose of joints no track animates
+        std::vector<uint32_t> order;        // Joints sorted parents first, built by computeOrder
+
+        uint32_t jointCount() const { return static_cast<uint32_t>(parents.size()); }
+
+        void computeOrder();
+    };
+
+    struct Track {
+        uint32_t joint;
+        Path path;
+        Interpolation interpolation;
+        uint32_t keyOffset;                 // First key in Clip times and values
+        uint32_t keyCount;
+    };
+
+    struct Clip {
+        std::vector<Track> tracks;          // Sorted by path once finalized
+        std::vector<float> times;
+        std::vector<float> values[4];       // x, y, z and w streams indexed like times, w only used by rotations
+        uint32_t pathBegin[static_cast<uint32_t>(Path::Count) + 1] = {};
+        float duration = 0.0f;
+
+        /// Times in seconds and increasing, values are keyCount vec3 or xyzw quaternions
+        void addTrack(uint32_t joint, Path path, Interpolation interpolation, const float* keyTimes,
+            const float* keyValues, uint32_t keyCount);
+
+        /// Sort tracks by path and compute the duration, call once after the last addTrack
+        void finalize();
+
+        size_t sizeInBytes() const;
+    };
+
+    struct CompressionSettings {
+        float rotationTolerance = 2e-4f;    // Largest quaternion component error of a removed key
+        float translationTolerance = 1e-4f; // Scene units
+        float scaleTolerance = 1e-4f;
+    };
+
+    /// Rotation keys keep the three smallest components in the high 15 bits of each value, the low bits of the first
+    /// two are the index of the dropped largest one. Other keys are 16 bit fractions of the track range.
+    struct CompressedTrack {
+        uint32_t joint;
+        Path path;
+        Interpolation interpolation;
+        uint32_t keyOffset;                 // First key in CompressedClip times and values
+        uint32_t keyCount;
+        float rangeMin[3];
+        float rangeExtent[3];
+    };
+
+    struct CompressedClip {
+        std::vector<CompressedTrack> tracks;    // Sorted by path, like the source clip
+        std::vector<uint16_t> times;            // Ticks, 65535 per clip duration
+        std::vector<uint16_t> values[3];
+        uint32_t pathBegin[static_cast<uint32_t>(Path::Count) + 1] = {};
+        float duration = 0.0f;
+        float ticksPerSecond = 0.0f;
+
+        size_t sizeInBytes() const;
+    };
+
+    /// Playback state of many characters sharing a skeleton, each with a clip, a time and one cursor per track
+    struct Instances {
+        std::vector<uint32_t> clips;
+        std::vector<float> times;           // Seconds, wrapped to the clip duration
+        std::vector<uint32_t> cursorOffsets;
+        std::vector<uint32_t> cursors;      // Last key found for each track of the instance clip
+
+        size_t size() const { return clips.size(); }
+
+        /// Clip is an index in allClips, a Clip or CompressedClip vector
+        template <typename ClipType>
+        uint32_t add(const std::vector<ClipType>& allClips, uint32_t clip, float time) {
+            clips.push_back(clip);
+            times.push_back(time);
+            cursorOffsets.push_back(static_cast<uint32_t>(cursors.size()));
+            cursors.resize(cursors.size() + allClips[clip].tracks.size(), 0);
+            return static_cast<uint32_t>(size() - 1);
+        }
+    };
+
+    struct AnimationBenchmark {
+        uint32_t characterCount;
+        uint32_t jointCount;
+        uint32_t trackCount;
+        double scalarSampleMs;              // Binary search and exact slerp, one track at a time
+        double sampleMs;                    // Cursors and SSE, four tracks at a time
+        double evaluateMs;                  // Sampling and palettes, one thread
+        double threadedEvaluateMs;
+        uint32_t threadCount;
+        float maxRotationError;             // Largest component difference of SSE to scalar rotations
+        double compressedSampleMs;          // As sampleMs, decoding compressed clips
+        double compressedEvaluateMs;        // As threadedEvaluateMs, from compressed clips
+        size_t rawBytes;                    // Keys of all clips
+        size_t compressedBytes;
+        float maxCompressedRotationError;   // Largest component difference of compressed to scalar rotations
+        float maxCompressedVectorError;     // Same for translations and scales
+    };
+
+    /// Exact reference, binary search of every track and slerp, overwrites the poses of animated joints
+    void sampleClipScalar(const Clip& clip, float time, JointPose* inOutPoses);
+
+    /// Cursor search and SSE interpolation, slerp is approximated by nlerp with a corrected parameter
+    void sampleClip(const Clip& clip, float time, uint32_t* inOutCursors, JointPose* inOutPoses);
+
+    /// Remove keys within tolerance of the interpolation of their neighbors and quantize the others
+    CompressedClip compressClip(const Clip& clip, const CompressionSettings& settings);
+
+    /// sampleClip with the keys decoded in the SSE lanes they are interpolated in
+    void sampleClip(const CompressedClip& clip, float time, uint32_t* inOutCursors, JointPose* inOutPoses);
+
+    /// Model transforms composed parents first, then multiplied by the inverse bind matrices
+    void computePalettes(const Skeleton& skeleton, const JointPose* poses, float* outPalettes);
+
+    /// Linear blend skinning by four palettes per vertex, joints and weights as in JOINTS_0 and WEIGHTS_0. Normals
+    /// are transformed by the blended 3x3 and renormalized, either normal pointer may be null.
+    void skinVertices(const float* palettes, const uint16_t* joints, const float* weights, uint32_t vertexCount,
+        const float* positions, const float* optNormals, float* outPositions, float* optOutNormals);
+
+    /// Advance every instance by deltaTime and sample its clip on top of the rest pose. Poses and palettes are
+    /// written instance after instance, jointCount entries each, either output may be null. Zero threadCount uses
+    /// every hardware thread.
+    void evaluateInstances(const Skeleton& skeleton, const std::vector<Clip>& clips, Instances& instances,
+        float deltaTime, JointPose* optOutPoses, float* optOutPalettes, uint32_t threadCount);
+
+    void evaluateInstances(const Skeleton& skeleton, const std::vector<CompressedClip>& clips, Instances& instances,
+        float deltaTime, JointPose* optOutPoses, float* optOutPalettes, uint32_t threadCount);
+
+    AnimationBenchmark benchmarkAnimation(uint32_t characterCount, uint32_t iterations);
+}
+
+
+///
+/// Implementation
+///
+#if defined(ANIMATION_IMPLEMENTATION)
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <emmintrin.h>
+
+namespace animation {
+    const uint32_t kLinearSearchKeys = 4;  // Keys stepped over from the cursor before falling back to binary search
+    const float kSmallestThreeRange = 0.70710678f;  // Bound of the three smallest components of a unit quaternion
+
+    inline uint32_t _componentCount(Path path) {
+        return path == Path::Rotation ? 4 : 3;
+    }
+
+    inline float* _poseValue(JointPose& pose, Path path) {
+        switch (path) {
+        case Path::Rotation: return pose.rotation;
+        case Path::Translation: return pose.translation;
+        default: return pose.scale;
+        }
+    }
+
+    /// Key k with times[k] <= time < times[k + 1], clamped to [0, keyCount - 2]. Playback usually stays on the
+    /// cursor key or steps over one, anything further away or backwards is a binary search. Times are seconds, or
+    /// ticks for compressed clips.
+    template <typename TimeType>
+    inline uint32_t _findKey(const TimeType* times, uint32_t keyCount, float time, uint32_t cursor) {
+        if (keyCount < 2) {
+            return 0;
+        }
+        uint32_t lastKey = keyCount - 2;
+        uint32_t key = std::min(cursor, lastKey);
+        uint32_t searchBegin = 0;
+        uint32_t searchEnd = key;
+        if (time >= times[key]) {
+            for (uint32_t i = 0; i < kLinearSearchKeys; ++i) {
+                if (key == lastKey || time < times[key + 1]) {
+                    return key;
+                }
+                key++;
+            }
+            searchBegin = key;
+            searchEnd = lastKey + 1;
+        }
+        const TimeType* upper = std::upper_bound(times + searchBegin, times + searchEnd + 1, time);
+        return upper == times ? 0 : std::min(static_cast<uint32_t>(upper - times) - 1, lastKey);
+    }
+
+    /// Interpolation factor between key and the next key, which is key itself for single key tracks
+    template <typename TimeType>
+    inline float _keyFactor(const TimeType* times, uint32_t keyCount, Interpolation interpolation, uint32_t key,
+        float time, uint32_t* outNextKey) {
+        uint32_t nextKey = std::min(key + 1, keyCount - 1);
+        *outNextKey = nextKey;
+        float keyTime = static_cast<float>(times[key]);
+        float nextKeyTime = static_cast<float>(times[nextKey]);
+        if (interpolation == Interpolation::Step || nextKeyTime <= keyTime) {
+            return time >= nextKeyTime ? 1.0f : 0.0f;
+        }
+        return std::min(std::max((time - keyTime) / (nextKeyTime - keyTime), 0.0f), 1.0f);
+    }
+
+    /// Key search of four tracks of one path from first, lanes past laneCount repeat the last track. Keys are
+    /// indices in the clip key streams.
+    template <typename ClipType>
+    inline __m128 _searchLanes(const ClipType& clip, uint32_t first, uint32_t laneCount, float time,
+        uint32_t* inOutCursors, uint32_t outKeys[4], uint32_t outNextKeys[4]) {
+        alignas(16) float factors[4];
+        for (uint32_t lane = 0; lane < 4; ++lane) {
+            uint32_t trackId = first + std::min(lane, laneCount - 1);
+            const auto& track = clip.tracks[trackId];
+            const auto* times = clip.times.data() + track.keyOffset;
+            uint32_t key = _findKey(times, track.keyCount, time, inOutCursors[trackId]);
+            uint32_t nextKey;
+            inOutCursors[trackId] = key;
+            factors[lane] = _keyFactor(times, track.keyCount, track.interpolation, key, time, &nextKey);
+            outKeys[lane] = track.keyOffset + key;
+            outNextKeys[lane] = track.keyOffset + nextKey;
+        }
+        return _mm_load_ps(factors);
+    }
+
+    /// Shortest arc, then nlerp with t moved along the cubic fitted to slerp for the angle between the keys
+    inline void _interpolateRotations(const __m128 a[4], const __m128 b[4], __m128 t, __m128 outValues[4]) {
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        __m128 cosTheta = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])),
+            _mm_add_ps(_mm_mul_ps(a[2], b[2]), _mm_mul_ps(a[3], b[3])));
+        __m128 sign = _mm_and_ps(cosTheta, signMask);
+        __m128 d = _mm_andnot_ps(signMask, cosTheta);
+        __m128 k0 = _mm_add_ps(_mm_set1_ps(1.0904f), _mm_mul_ps(d, _mm_add_ps(_mm_set1_ps(-3.2452f),
+            _mm_mul_ps(d, _mm_sub_ps(_mm_set1_ps(3.55645f), _mm_mul_ps(d, _mm_set1_ps(1.43519f)))))));
+        __m128 k1 = _mm_add_ps(_mm_set1_ps(0.848013f), _mm_mul_ps(d, _mm_add_ps(_mm_set1_ps(-1.06021f),
+            _mm_mul_ps(d, _mm_set1_ps(0.215638f)))));
+        __m128 centered = _mm_sub_ps(t, half);
+        __m128 k = _mm_add_ps(_mm_mul_ps(k0, _mm_mul_ps(centered, centered)), k1);
+        __m128 adjusted = _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(t, centered), _mm_mul_ps(_mm_sub_ps(t, one), k)));
+
+        __m128 lengthSq = _mm_setzero_ps();
+        for (uint32_t c = 0; c < 4; ++c) {
+            __m128 target = _mm_xor_ps(b[c], sign);
+            outValues[c] = _mm_add_ps(a[c], _mm_mul_ps(_mm_sub_ps(target, a[c]), adjusted));
+            lengthSq = _mm_add_ps(lengthSq, _mm_mul_ps(outValues[c], outValues[c]));
+        }
+        __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+        for (uint32_t c = 0; c < 4; ++c) {
+            outValues[c] = _mm_mul_ps(outValues[c], invLength);
+        }
+    }
+
+    inline void _interpolateVectors(const __m128 a[3], const __m128 b[3], __m128 t, __m128 outValues[3]) {
+        for (uint32_t c = 0; c < 3; ++c) {
+            outValues[c] = _mm_add_ps(a[c], _mm_mul_ps(_mm_sub_ps(b[c], a[c]), t));
+        }
+    }
+
+    template <typename TrackType>
+    inline void _storeLanes(const TrackType* tracks, uint32_t laneCount, Path path, const __m128* values,
+        JointPose* inOutPoses) {
+        uint32_t componentCount = _componentCount(path);
+        alignas(16) float results[4][4];
+        for (uint32_t c = 0; c < componentCount; ++c) {
+            _mm_store_ps(results[c], values[c]);
+        }
+        for (uint32_t lane = 0; lane < laneCount; ++lane) {
+            float* value = _poseValue(inOutPoses[tracks[lane].joint], path);
+            for (uint32_t c = 0; c < componentCount; ++c) {
+                value[c] = results[c][lane];
+            }
+        }
+    }
+
+    /// Exact slerp along the shortest arc
+    inline void _slerp(const float a[4], const float b[4], float t, float outValue[4]) {
+        float cosTheta = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+        float sign = cosTheta < 0.0f ? -1.0f : 1.0f;
+        cosTheta *= sign;
+        float weightA = 1.0f - t;
+        float weightB = t;
+        if (cosTheta < 0.9995f) {
+            float theta = std::acos(cosTheta);
+            float sinTheta = std::sin(theta);
+            weightA = std::sin(weightA * theta) / sinTheta;
+            weightB = std::sin(weightB * theta) / sinTheta;
+        }
+        float lengthSq = 0.0f;
+        for (uint32_t c = 0; c < 4; ++c) {
+            outValue[c] = a[c] * weightA + b[c] * sign * weightB;
+            lengthSq += outValue[c] * outValue[c];
+        }
+        float invLength = 1.0f / std::sqrt(lengthSq);
+        for (uint32_t c = 0; c < 4; ++c) {
+            outValue[c] *= invLength;
+        }
+    }
+
+    /// Key of a raw clip, interpolated the way the samplers do
+    inline void _interpolateKeys(const Clip& clip, Path path, uint32_t key, uint32_t nextKey, float t,
+        float outValue[4]) {
+        float a[4], b[4];
+        for (uint32_t c = 0; c < 4; ++c) {
+            a[c] = clip.values[c][key];
+            b[c] = clip.values[c][nextKey];
+        }
+        if (path == Path::Rotation) {
+            _slerp(a, b, t, outValue);
+            return;
+        }
+        for (uint32_t c = 0; c < 3; ++c) {
+            outValue[c] = a[c] + (b[c] - a[c]) * t;
+        }
+    }
+
+
+    void Skeleton::computeOrder() {
+        // Depth first from the roots, so any joint comes after its parent
+        uint32_t count = jointCount();
+        std::vector<std::vector<uint32_t>> children(count);
+        std::vector<uint32_t> stack;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (parents[i] >= 0) {
+                children[parents[i]].push_back(i);
+            }
+            else {
+                stack.push_back(i);
+            }
+        }
+        std::reverse(stack.begin(), stack.end());
+
+        order.clear();
+        order.reserve(count);
+        while (!stack.empty()) {
+            uint32_t joint = stack.back();
+            stack.pop_back();
+            order.push_back(joint);
+            stack.insert(stack.end(), children[joint].rbegin(), children[joint].rend());
+        }
+        assert(order.size() == count);
+    }
+
+
+    void Clip::addTrack(uint32_t joint, Path path, Interpolation interpolation, const float* keyTimes,
+        const float* keyValues, uint32_t keyCount) {
+        if (keyCount == 0) {
+            return;
+        }
+        Track track = { joint, path, interpolation, static_cast<uint32_t>(times.size()), keyCount };
+        tracks.push_back(track);
+
+        uint32_t componentCount = _componentCount(path);
+        times.insert(times.end(), keyTimes, keyTimes + keyCount);
+        for (uint32_t c = 0; c < 4; ++c) {
+            for (uint32_t i = 0; i < keyCount; ++i) {
+                values[c].push_back(c < componentCount ? keyValues[i * componentCount + c] : 0.0f);
+            }
+        }
+    }
+
+
+    void Clip::finalize() {
+        std::stable_sort(tracks.begin(), tracks.end(), [](const Track& a, const Track& b) { return a.path < b.path; });
+
+        duration = 0.0f;
+        for (const Track& track : tracks) {
+            duration = std::max(duration, times[track.keyOffset + track.keyCount - 1]);
+        }
+        for (uint32_t p = 0; p <= static_cast<uint32_t>(Path::Count); ++p) {
+            pathBegin[p] = static_cast<uint32_t>(std::lower_bound(tracks.begin(), tracks.end(), static_cast<Path>(p),
+                [](const Track& track, Path path) { return track.path < path; }) - tracks.begin());
+        }
+    }
+
+
+    size_t Clip::sizeInBytes() const {
+        size_t valueCount = values[0].size() + values[1].size() + values[2].size() + values[3].size();
+        return tracks.size() * sizeof(Track) + (times.size() + valueCount) * sizeof(float);
+    }
+
+
+    size_t CompressedClip::sizeInBytes() const {
+        size_t valueCount = values[0].size() + values[1].size() + values[2].size();
+        return tracks.size() * sizeof(CompressedTrack) + (times.size() + valueCount) * sizeof(uint16_t);
+    }
+
+
+    void sampleClipScalar(const Clip& clip, float time, JointPose* inOutPoses) {
+        for (const Track& track : clip.tracks) {
+            const float* times = clip.times.data() + track.keyOffset;
+            uint32_t key = _findKey(times, track.keyCount, time, 0);
+            uint32_t nextKey;
+            float t = _keyFactor(times, track.keyCount, track.interpolation, key, time, &nextKey);
+            float value[4];
+            _interpolateKeys(clip, track.path, track.keyOffset + key, track.keyOffset + nextKey, t, value);
+            memcpy(_poseValue(inOutPoses[track.joint], track.path), value, _componentCount(track.path) * sizeof(float));
+        }
+    }
+
+
+    void sampleClip(const Clip& clip, float time, uint32_t* inOutCursors, JointPose* inOutPoses) {
+        for (uint32_t p = 0; p < static_cast<uint32_t>(Path::Count); ++p) {
+            Path path = static_cast<Path>(p);
+            uint32_t componentCount = _componentCount(path);
+            for (uint32_t first = clip.pathBegin[p]; first < clip.pathBegin[p + 1]; first += 4) {
+                uint32_t laneCount = std::min(clip.pathBegin[p + 1] - first, 4u);
+                uint32_t keys[4], nextKeys[4];
+                __m128 t = _searchLanes(clip, first, laneCount, time, inOutCursors, keys, nextKeys);
+
+                __m128 a[4], b[4], results[4];
+                for (uint32_t c = 0; c < componentCount; ++c) {
+                    const float* values = clip.values[c].data();
+                    a[c] = _mm_setr_ps(values[keys[0]], values[keys[1]], values[keys[2]], values[keys[3]]);
+                    b[c] = _mm_setr_ps(values[nextKeys[0]], values[nextKeys[1]], values[nextKeys[2]],
+                        values[nextKeys[3]]);
+                }
+                if (path == Path::Rotation) {
+                    _interpolateRotations(a, b, t, results);
+                }
+                else {
+                    _interpolateVectors(a, b, t, results);
+                }
+                _storeLanes(clip.tracks.data() + first, laneCount, path, results, inOutPoses);
+            }
+        }
+    }
+
+
+    /// Keys kept by growing each segment while its end points reproduce every key it skips within tolerance
+    inline void _reduceKeys(const Clip& clip, const Track& track, float tolerance, std::vector<uint32_t>& outKeys) {
+        const float* times = clip.times.data() + track.keyOffset;
+        uint32_t componentCount = _componentCount(track.path);
+        auto isWithinTolerance = [&](uint32_t begin, uint32_t end) {
+            for (uint32_t key = begin + 1; key < end; ++key) {
+                float t = 0.0f;
+                if (track.interpolation == Interpolation::Linear && times[end] > times[begin]) {
+                    t = (times[key] - times[begin]) / (times[end] - times[begin]);
+                }
+                float value[4];
+                _interpolateKeys(clip, track.path, track.keyOffset + begin, track.keyOffset + end, t, value);
+
+                // Either sign of a quaternion is the same rotation
+                float sign = 1.0f;
+                if (track.path == Path::Rotation) {
+                    float cosTheta = 0.0f;
+                    for (uint32_t c = 0; c < 4; ++c) {
+                        cosTheta += value[c] * clip.values[c][track.keyOffset + key];
+                    }
+                    sign = cosTheta < 0.0f ? -1.0f : 1.0f;
+                }
+                for (uint32_t c = 0; c < componentCount; ++c) {
+                    if (std::abs(value[c] * sign - clip.values[c][track.keyOffset + key]) > tolerance) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        };
+
+        outKeys.assign(1, 0);
+        for (uint32_t begin = 0; begin + 1 < track.keyCount;) {
+            uint32_t end = begin + 1;
+            while (end + 1 < track.keyCount && isWithinTolerance(begin, end + 1)) {
+                end++;
+            }
+            outKeys.push_back(end);
+            begin = end;
+        }
+    }
+
+    /// Three smallest components of the positive largest one sign, 15 bits each, largest index in two low bits
+    inline void _encodeRotation(const float rotation[4], uint16_t outValues[3]) {
+        float lengthSq = 0.0f;
+        uint32_t largest = 0;
+        for (uint32_t c = 0; c < 4; ++c) {
+            lengthSq += rotation[c] * rotation[c];
+            largest = std::abs(rotation[c]) > std::abs(rotation[largest]) ? c : largest;
+        }
+        float scale = (rotation[largest] < 0.0f ? -1.0f : 1.0f) / std::sqrt(lengthSq);
+
+        uint32_t quantized[3];
+        for (uint32_t c = 0, slot = 0; c < 4; ++c) {
+            if (c != largest) {
+                float value = std::min(std::max(rotation[c] * scale, -kSmallestThreeRange), kSmallestThreeRange);
+                quantized[slot++] = static_cast<uint32_t>(std::lround((value + kSmallestThreeRange) /
+                    (2.0f * kSmallestThreeRange) * 32767.0f));
+            }
+        }
+        outValues[0] = static_cast<uint16_t>((quantized[0] << 1) | (largest & 1));
+        outValues[1] = static_cast<uint16_t>((quantized[1] << 1) | (largest >> 1));
+        outValues[2] = static_cast<uint16_t>(quantized[2] << 1);
+    }
+
+
+    CompressedClip compressClip(const Clip& clip, const CompressionSettings& settings) {
+        CompressedClip result;
+        result.duration = clip.duration;
+        result.ticksPerSecond = clip.duration > 0.0f ? 65535.0f / clip.duration : 0.0f;
+        memcpy(result.pathBegin, clip.pathBegin, sizeof(result.pathBegin));
+
+        std::vector<uint32_t> keys;
+        for (const Track& track : clip.tracks) {
+            float tolerance = track.path == Path::Rotation ? settings.rotationTolerance :
+                (track.path == Path::Translation ? settings.translationTolerance : settings.scaleTolerance);
+            _reduceKeys(clip, track, tolerance, keys);
+
+            CompressedTrack compressedTrack = { track.joint, track.path, track.interpolation,
+                static_cast<uint32_t>(result.times.size()), static_cast<uint32_t>(keys.size()), {}, {} };
+            for (uint32_t key : keys) {
+                float ticks = clip.times[track.keyOffset + key] * result.ticksPerSecond;
+                result.times.push_back(static_cast<uint16_t>(std::lround(std::min(std::max(ticks, 0.0f), 65535.0f))));
+            }
+
+            if (track.path == Path::Rotation) {
+                for (uint32_t key : keys) {
+                    float rotation[4];
+                    uint16_t encoded[3];
+                    for (uint32_t c = 0; c < 4; ++c) {
+                        rotation[c] = clip.values[c][track.keyOffset + key];
+                    }
+                    _encodeRotation(rotation, encoded);
+                    for (uint32_t c = 0; c < 3; ++c) {
+                        result.values[c].push_back(encoded[c]);
+                    }
+                }
+                result.tracks.push_back(compressedTrack);
+                continue;
+            }
+
+            for (uint32_t c = 0; c < 3; ++c) {
+                const float* values = clip.values[c].data() + track.keyOffset;
+                auto range = std::minmax_element(values, values + track.keyCount);
+                compressedTrack.rangeMin[c] = *range.first;
+                compressedTrack.rangeExtent[c] = *range.second - *range.first;
+                float scale = compressedTrack.rangeExtent[c] > 0.0f ? 65535.0f / compressedTrack.rangeExtent[c] : 0.0f;
+                for (uint32_t key : keys) {
+                    long quantized = std::lround((values[key] - *range.first) * scale);
+                    result.values[c].push_back(static_cast<uint16_t>(quantized));
+                }
+            }
+            result.tracks.push_back(compressedTrack);
+        }
+        return result;
+    }
+
+    /// Smallest-three keys of four lanes back to unit quaternions
+    inline void _decodeRotations(const CompressedClip& clip, const uint32_t keys[4], __m128 outValues[4]) {
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128 scale = _mm_set1_ps(2.0f * kSmallestThreeRange / 32767.0f);
+        const __m128 offset = _mm_set1_ps(kSmallestThreeRange);
+        __m128i packed[3];
+        __m128 smallest[3];
+        __m128 lengthSq = _mm_setzero_ps();
+        for (uint32_t c = 0; c < 3; ++c) {
+            const uint16_t* values = clip.values[c].data();
+            packed[c] = _mm_setr_epi32(values[keys[0]], values[keys[1]], values[keys[2]], values[keys[3]]);
+            smallest[c] = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(packed[c], 1)), scale), offset);
+            lengthSq = _mm_add_ps(lengthSq, _mm_mul_ps(smallest[c], smallest[c]));
+        }
+        __m128i largest = _mm_or_si128(_mm_and_si128(packed[0], one), _mm_slli_epi32(_mm_and_si128(packed[1], one), 1));
+        __m128 largestValue = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.0f), lengthSq), _mm_setzero_ps()));
+
+        // Component c is the largest, the smallest in slot c when the largest comes later, or in slot c - 1
+        for (uint32_t c = 0; c < 4; ++c) {
+            __m128i index = _mm_set1_epi32(static_cast<int32_t>(c));
+            __m128 isLargest = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, index));
+            __m128 isBefore = _mm_castsi128_ps(_mm_cmpgt_epi32(largest, index));
+            __m128 value = _mm_or_ps(_mm_and_ps(isBefore, c < 3 ? smallest[c] : largestValue),
+                _mm_andnot_ps(isBefore, c > 0 ? smallest[c - 1] : largestValue));
+            outValues[c] = _mm_or_ps(_mm_and_ps(isLargest, largestValue), _mm_andnot_ps(isLargest, value));
+        }
+    }
+
+    /// Range reduced keys of four lanes, lanes past laneCount repeat the last track
+    inline void _decodeVectors(const CompressedClip& clip, uint32_t first, uint32_t laneCount, const uint32_t keys[4],
+        __m128 outValues[3]) {
+        const CompressedTrack* lanes[4];
+        for (uint32_t lane = 0; lane < 4; ++lane) {
+            lanes[lane] = &clip.tracks[first + std::min(lane, laneCount - 1)];
+        }
+        for (uint32_t c = 0; c < 3; ++c) {
+            const uint16_t* values = clip.values[c].data();
+            __m128 rangeMin = _mm_setr_ps(lanes[0]->rangeMin[c], lanes[1]->rangeMin[c], lanes[2]->rangeMin[c],
+                lanes[3]->rangeMin[c]);
+            __m128 rangeExtent = _mm_setr_ps(lanes[0]->rangeExtent[c], lanes[1]->rangeExtent[c],
+                lanes[2]->rangeExtent[c], lanes[3]->rangeExtent[c]);
+            __m128 quantized = _mm_cvtepi32_ps(_mm_setr_epi32(values[keys[0]], values[keys[1]], values[keys[2]],
+                values[keys[3]]));
+            outValues[c] = _mm_add_ps(rangeMin, _mm_mul_ps(_mm_mul_ps(quantized, _mm_set1_ps(1.0f / 65535.0f)),
+                rangeExtent));
+        }
+    }
+
+
+    void sampleClip(const CompressedClip& clip, float time, uint32_t* inOutCursors, JointPose* inOutPoses) {
+        float ticks = time * clip.ticksPerSecond;
+        for (uint32_t p = 0; p < static_cast<uint32_t>(Path::Count); ++p) {
+            Path path = static_cast<Path>(p);
+            for (uint32_t first = clip.pathBegin[p]; first < clip.pathBegin[p + 1]; first += 4) {
+                uint32_t laneCount = std::min(clip.pathBegin[p + 1] - first, 4u);
+                uint32_t keys[4], nextKeys[4];
+                __m128 t = _searchLanes(clip, first, laneCount, ticks, inOutCursors, keys, nextKeys);
+
+                __m128 a[4], b[4], results[4];
+                if (path == Path::Rotation) {
+                    _decodeRotations(clip, keys, a);
+                    _decodeRotations(clip, nextKeys, b);
+                    _interpolateRotations(a, b, t, results);
+                }
+                else {
+                    _decodeVectors(clip, first, laneCount, keys, a);
+                    _decodeVectors(clip, first, laneCount, nextKeys, b);
+                    _interpolateVectors(a, b, t, results);
+                }
+                _storeLanes(clip.tracks.data() + first, laneCount, path, results, inOutPoses);
+            }
+        }
+    }
+
+
+    /// 3x4 rows of translation * rotation * scale
+    inline void _poseToAffine(const JointPose& pose, float outMatrix[12]) {
+        float x = pose.rotation[0], y = pose.rotation[1], z = pose.rotation[2], w = pose.rotation[3];
+        const float* s = pose.scale;
+        outMatrix[0] = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+        outMatrix[1] = 2.0f * (x * y - w * z) * s[1];
+        outMatrix[2] = 2.0f * (x * z + w * y) * s[2];
+        outMatrix[3] = pose.translation[0];
+        outMatrix[4] = 2.0f * (x * y + w * z) * s[0];
+        outMatrix[5] = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+        outMatrix[6] = 2.0f * (y * z - w * x) * s[2];
+        outMatrix[7] = pose.translation[1];
+        outMatrix[8] = 2.0f * (x * z - w * y) * s[0];
+        outMatrix[9] = 2.0f * (y * z + w * x) * s[1];
+        outMatrix[10] = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+        outMatrix[11] = pose.translation[2];
+    }
+
+    /// a * b of 3x4 affine rows, b applied first
+    inline void _multiplyAffine(const float* a, const float* b, float* outMatrix) {
+        __m128 b0 = _mm_loadu_ps(b + 0);
+        __m128 b1 = _mm_loadu_ps(b + 4);
+        __m128 b2 = _mm_loadu_ps(b + 8);
+        const __m128 b3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+        for (int32_t i = 0; i < 3; ++i) {
+            __m128 row = _mm_mul_ps(_mm_set1_ps(a[i * 4 + 0]), b0);
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 1]), b1));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 2]), b2));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 3]), b3));
+            _mm_storeu_ps(outMatrix + i * 4, row);
+        }
+    }
+
+
+    void computePalettes(const Skeleton& skeleton, const JointPose* poses, float* outPalettes) {
+        // Model transforms go to the palettes first, the inverse bind is applied in place once all are known
+        for (uint32_t joint : skeleton.order) {
+            float local[12];
+            _poseToAffine(poses[joint], local);
+            int32_t parent = skeleton.parents[joint];
+            if (parent >= 0) {
+                _multiplyAffine(outPalettes + parent * 12, local, outPalettes + joint * 12);
+            }
+            else {
+                memcpy(outPalettes + joint * 12, local, sizeof(local));
+            }
+        }
+        for (uint32_t joint = 0; joint < skeleton.jointCount(); ++joint) {
+            float model[12];
+            memcpy(model, outPalettes + joint * 12, sizeof(model));
+            _multiplyAffine(model, skeleton.inverseBind.data() + joint * 12, outPalettes + joint * 12);
+        }
+    }
+
+
+    void skinVertices(const float* palettes, const uint16_t* joints, const float* weights, uint32_t vertexCount,
+        const float* positions, const float* optNormals, float* outPositions, float* optOutNormals) {
+        bool hasNormals = optNormals && optOutNormals;
+        for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+            // Weighted sum of the rows, then one affine transform per vertex
+            __m128 rows[3] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+            for (uint32_t i = 0; i < 4; ++i) {
+                float weight = weights[vertex * 4 + i];
+                if (weight == 0.0f) {
+                    continue;
+                }
+                const float* palette = palettes + size_t(joints[vertex * 4 + i]) * 12;
+                __m128 w = _mm_set1_ps(weight);
+                for (int32_t r = 0; r < 3; ++r) {
+                    rows[r] = _mm_add_ps(rows[r], _mm_mul_ps(w, _mm_loadu_ps(palette + r * 4)));
+                }
+            }
+            float m[12];
+            for (int32_t r = 0; r < 3; ++r) {
+                _mm_storeu_ps(m + r * 4, rows[r]);
+            }
+
+            const float* p = positions + size_t(vertex) * 3;
+            float* outP = outPositions + size_t(vertex) * 3;
+            for (int32_t r = 0; r < 3; ++r) {
+                outP[r] = m[r * 4 + 0] * p[0] + m[r * 4 + 1] * p[1] + m[r * 4 + 2] * p[2] + m[r * 4 + 3];
+            }
+            if (hasNormals) {
+                const float* n = optNormals + size_t(vertex) * 3;
+                float* outN = optOutNormals + size_t(vertex) * 3;
+                for (int32_t r = 0; r < 3; ++r) {
+                    outN[r] = m[r * 4 + 0] * n[0] + m[r * 4 + 1] * n[1] + m[r * 4 + 2] * n[2];
+                }
+                float lengthSq = outN[0] * outN[0] + outN[1] * outN[1] + outN[2] * outN[2];
+                float scale = lengthSq > 0.0f ? 1.0f / std::sqrt(lengthSq) : 0.0f;
+                for (int32_t r = 0; r < 3; ++r) {
+                    outN[r] *= scale;
+                }
+            }
+        }
+    }
+
+
+    template <typename ClipType>
+    void _evaluateInstances(const Skeleton& skeleton, const std::vector<ClipType>& clips, Instances& instances,
+        float deltaTime, JointPose* optOutPoses, float* optOutPalettes, uint32_t threadCount) {
+        uint32_t instanceCount = static_cast<uint32_t>(instances.size());
+        uint32_t jointCount = skeleton.jointCount();
+        if (threadCount == 0) {
+            threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        auto evaluateRange = [&](uint32_t begin, uint32_t end) {
+            std::vector<JointPose> scratchPoses(optOutPoses == nullptr ? jointCount : 0);
+            for (uint32_t i = begin; i < end; ++i) {
+                const ClipType& clip = clips[instances.clips[i]];
+                float time = instances.times[i] + deltaTime;
+                if (clip.duration > 0.0f) {
+                    time = std::fmod(time, clip.duration);
+                    time += time < 0.0f ? clip.duration : 0.0f;
+                }
+                instances.times[i] = time;
+
+                JointPose* poses = optOutPoses != nullptr ? optOutPoses + size_t(i) * jointCount : scratchPoses.data();
+                memcpy(poses, skeleton.restPose.data(), jointCount * sizeof(JointPose));
+                sampleClip(clip, time, instances.cursors.data() + instances.cursorOffsets[i], poses);
+                if (optOutPalettes != nullptr) {
+                    computePalettes(skeleton, poses, optOutPalettes + size_t(i) * jointCount * 12);
+                }
+            }
+        };
+
+        // Contiguous ranges, instances are independent and of similar cost
+        uint32_t workerCount = std::min(threadCount, instanceCount);
+        if (workerCount <= 1) {
+            evaluateRange(0, instanceCount);
+            return;
+        }
+        std::vector<std::thread> workers;
+        uint32_t rangeSize = (instanceCount + workerCount - 1) / workerCount;
+        for (uint32_t begin = rangeSize; begin < instanceCount; begin += rangeSize) {
+            workers.emplace_back(evaluateRange, begin, std::min(begin + rangeSize, instanceCount));
+        }
+        evaluateRange(0, std::min(rangeSize, instanceCount));
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+
+    void evaluateInstances(const Skeleton& skeleton, const std::vector<Clip>& clips, Instances& instances,
+        float deltaTime, JointPose* optOutPoses, float* optOutPalettes, uint32_t threadCount) {
+        _evaluateInstances(skeleton, clips, instances, deltaTime, optOutPoses, optOutPalettes, threadCount);
+    }
+
+
+    void evaluateInstances(const Skeleton& skeleton, const std::vector<CompressedClip>& clips, Instances& instances,
+        float deltaTime, JointPose* optOutPoses, float* optOutPalettes, uint32_t threadCount) {
+        _evaluateInstances(skeleton, clips, instances, deltaTime, optOutPoses, optOutPalettes, threadCount);
+    }
+
+
+    AnimationBenchmark benchmarkAnimation(uint32_t characterCount, uint32_t iterations) {
+        // Humanoid sized rig, a spine of 8 joints and 7 limbs of 8, every joint rotated at 30 keys per second,
+        // roots and limb tips translated and every fourth joint scaled
+        const uint32_t kLimbCount = 8;
+        const uint32_t kLimbLength = 8;
+        const uint32_t kKeyCount = 61;
+        const float kKeyInterval = 1.0f / 30.0f;
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> angleDistribution(-0.6f, 0.6f);
+
+        Skeleton skeleton;
+        for (uint32_t limb = 0; limb < kLimbCount; ++limb) {
+            for (uint32_t i = 0; i < kLimbLength; ++i) {
+                int32_t parent = i > 0 ? static_cast<int32_t>(skeleton.jointCount()) - 1 :
+                    (limb > 0 ? static_cast<int32_t>(limb) : -1);
+                skeleton.parents.push_back(parent);
+                JointPose pose = { { 0.0f, 0.0f, 0.0f, 1.0f }, { 0.0f, 0.1f, 0.0f }, { 1.0f, 1.0f, 1.0f } };
+                skeleton.restPose.push_back(pose);
+                float inverseBind[12] = { 1, 0, 0, 0, 0, 1, 0, -0.1f * (i + 1), 0, 0, 1, 0 };
+                skeleton.inverseBind.insert(skeleton.inverseBind.end(), inverseBind, inverseBind + 12);
+            }
+        }
+        skeleton.computeOrder();
+        uint32_t jointCount = skeleton.jointCount();
+
+        std::vector<float> keyTimes(kKeyCount), keyValues(kKeyCount * 4);
+        for (uint32_t i = 0; i < kKeyCount; ++i) {
+            keyTimes[i] = i * kKeyInterval;
+        }
+        std::vector<Clip> clips(4);
+        for (Clip& clip : clips) {
+            for (uint32_t joint = 0; joint < jointCount; ++joint) {
+                float axis[3] = { angleDistribution(random), angleDistribution(random), angleDistribution(random) };
+                float phase = angleDistribution(random) * 5.0f;
+                for (uint32_t i = 0; i < kKeyCount; ++i) {
+                    float angle = 1.5f * std::sin(phase + keyTimes[i] * 3.0f);
+                    float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]) + 1e-6f;
+                    float s = std::sin(angle * 0.5f) / axisLength;
+                    float q[4] = { axis[0] * s, axis[1] * s, axis[2] * s, std::cos(angle * 0.5f) };
+                    memcpy(&keyValues[i * 4], q, sizeof(q));
+                }
+                clip.addTrack(joint, Path::Rotation, Interpolation::Linear, keyTimes.data(), keyValues.data(),
+                    kKeyCount);
+
+                bool isTranslated = skeleton.parents[joint] < 0 || joint % kLimbLength == kLimbLength - 1;
+                bool isScaled = joint % 4 == 0;
+                for (uint32_t i = 0; i < kKeyCount; ++i) {
+                    float offset = 0.05f * std::sin(phase + keyTimes[i] * 2.0f);
+                    keyValues[i * 3 + 0] = (isTranslated ? offset : 1.0f + offset);
+                    keyValues[i * 3 + 1] = (isTranslated ? 0.1f : 1.0f + offset);
+                    keyValues[i * 3 + 2] = (isTranslated ? -offset : 1.0f + offset);
+                }
+                if (isTranslated || isScaled) {
+                    clip.addTrack(joint, isTranslated ? Path::Translation : Path::Scale, Interpolation::Linear,
+                        keyTimes.data(), keyValues.data(), kKeyCount);
+                }
+            }
+            clip.finalize();
+        }
+
+        Instances instances;
+        std::uniform_real_distribution<float> timeDistribution(0.0f, clips[0].duration);
+        for (uint32_t i = 0; i < characterCount; ++i) {
+            instances.add(clips, i % clips.size(), timeDistribution(random));
+        }
+
+        std::vector<JointPose> poses(size_t(characterCount) * jointCount);
+        std::vector<JointPose> referencePoses(jointCount);
+        std::vector<float> palettes(size_t(characterCount) * jointCount * 12);
+        const float kFrameTime = 1.0f / 60.0f;
+
+        AnimationBenchmark result = {};
+        result.characterCount = characterCount;
+        result.jointCount = jointCount;
+        result.trackCount = static_cast<uint32_t>(clips[0].tracks.size());
+        result.threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+        auto measureMs = [&](auto&& function) {
+            function();
+            auto startTime = std::chrono::high_resolution_clock::now();
+            for (uint32_t frame = 0; frame < iterations; ++frame) {
+                function();
+            }
+            auto endTime = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(endTime - startTime).count() / std::max(iterations, 1u);
+        };
+
+        result.scalarSampleMs = measureMs([&]() {
+            for (uint32_t i = 0; i < characterCount; ++i) {
+                sampleClipScalar(clips[instances.clips[i]], instances.times[i], poses.data() + size_t(i) * jointCount);
+            }
+        });
+        result.sampleMs = measureMs([&]() {
+            for (uint32_t i = 0; i < characterCount; ++i) {
+                sampleClip(clips[instances.clips[i]], instances.times[i],
+                    instances.cursors.data() + instances.cursorOffsets[i], poses.data() + size_t(i) * jointCount);
+            }
+        });
+        result.evaluateMs = measureMs([&]() {
+            evaluateInstances(skeleton, clips, instances, kFrameTime, poses.data(), palettes.data(), 1);
+        });
+        result.threadedEvaluateMs = measureMs([&]() {
+            evaluateInstances(skeleton, clips, instances, kFrameTime, poses.data(), palettes.data(),
+                result.threadCount);
+        });
+
+        // Poses of the last evaluation against the scalar reference at the same times, quaternions sign aligned
+        auto measureError = [&](const Instances& sampledInstances, float* outRotationError, float* outVectorError) {
+            for (uint32_t i = 0; i < characterCount; ++i) {
+                const JointPose* instancePoses = poses.data() + size_t(i) * jointCount;
+                memcpy(referencePoses.data(), skeleton.restPose.data(), jointCount * sizeof(JointPose));
+                sampleClipScalar(clips[sampledInstances.clips[i]], sampledInstances.times[i], referencePoses.data());
+                for (uint32_t joint = 0; joint < jointCount; ++joint) {
+                    const JointPose& pose = instancePoses[joint];
+                    const JointPose& reference = referencePoses[joint];
+                    float cosTheta = 0.0f;
+                    for (uint32_t c = 0; c < 4; ++c) {
+                        cosTheta += pose.rotation[c] * reference.rotation[c];
+                    }
+                    for (uint32_t c = 0; c < 4; ++c) {
+                        float rotation = cosTheta < 0.0f ? -pose.rotation[c] : pose.rotation[c];
+                        *outRotationError = std::max(*outRotationError, std::abs(rotation - reference.rotation[c]));
+                    }
+                    for (uint32_t c = 0; c < 3; ++c) {
+                        *outVectorError = std::max(*outVectorError,
+                            std::abs(pose.translation[c] - reference.translation[c]));
+                        *outVectorError = std::max(*outVectorError, std::abs(pose.scale[c] - reference.scale[c]));
+                    }
+                }
+            }
+        };
+        float vectorError = 0.0f;
+        measureError(instances, &result.maxRotationError, &vectorError);
+
+        std::vector<CompressedClip> compressedClips;
+        for (const Clip& clip : clips) {
+            compressedClips.push_back(compressClip(clip, CompressionSettings()));
+            result.rawBytes += clip.sizeInBytes();
+            result.compressedBytes += compressedClips.back().sizeInBytes();
+        }
+        Instances compressedInstances = instances;
+        result.compressedSampleMs = measureMs([&]() {
+            for (uint32_t i = 0; i < characterCount; ++i) {
+                sampleClip(compressedClips[compressedInstances.clips[i]], compressedInstances.times[i],
+                    compressedInstances.cursors.data() + compressedInstances.cursorOffsets[i],
+                    poses.data() + size_t(i) * jointCount);
+            }
+        });
+        result.compressedEvaluateMs = measureMs([&]() {
+            evaluateInstances(skeleton, compressedClips, compressedInstances, kFrameTime, poses.data(),
+                palettes.data(), result.threadCount);
+        });
+        measureError(compressedInstances, &result.maxCompressedRotationError, &result.maxCompressedVectorError);
+        return result;
+    }
+}
+#endif // ANIMATION_IMPLEMENTATION
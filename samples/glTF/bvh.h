@@ -0,0 +1,763 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "culling.h"
+
+
+///
+/// bvh Header - Bounding volume hierarchy over world AABBs for frustum, ray and nearest item queries
+///
+/// Built top down with binned SAH splits, subtrees above a size threshold are handed to worker threads. Children of
+/// an interior node are adjacent and always stored after it, so refit is a single reverse pass over the nodes.
+/// Leaves copy their item bounds in leaf order, queries never read the source AABBs. Items under a node are contiguous
+/// in leaf order, so a frustum query accepts a subtree fully inside with a single copy of its item ids.
+///
+namespace bvh {
+    const uint32_t kBinCount = 16;
+    const uint32_t kMaxLeafSize = 4;
+    const uint32_t kMaxDepth = 64;          // Traversal stack size, build falls back to median splits to stay below
+
+    struct Node {
+        float boundsMin[3];
+        uint32_t firstChildOrItem;          // Left child of interior nodes, right child follows it
+        float boundsMax[3];
+        uint32_t itemCount;                 // Zero for interior nodes
+    };
+
+    static_assert(sizeof(Node) == 32, "Two nodes per cache line");
+
+    struct Aabb {
+        float boundsMin[3];
+        float boundsMax[3];
+    };
+
+    struct ItemRange {
+        uint32_t firstItem;
+        uint32_t itemCount;
+    };
+
+    struct Ray {
+        float origin[3];
+        float direction[3];
+        float maxDistance;                  // In direction lengths
+    };
+
+    struct RayHit {
+        uint32_t itemId;
+        float distance;                     // Entry distance in direction lengths, zero when starting inside
+    };
+
+    struct Bvh {
+        std::vector<Node> nodes;            // Root first
+        std::vector<uint32_t> itemIds;      // Source AABB index of each leaf slot
+        std::vector<Aabb> itemBounds;       // Bounds of each leaf slot
+        std::vector<ItemRange> subtreeItems;  // Leaf slots under each node
+
+        size_t size() const { return itemIds.size(); }
+
+        /// Build over all AABBs, threadCount 0 uses every hardware thread
+        void build(const culling::AabbSoA& aabbs, uint32_t threadCount = 0);
+
+        /// Recompute bounds after items moved, keeping the topology. Quality degrades with large motions, rebuild then.
+        void refit(const culling::AabbSoA& aabbs);
+
+        /// Write ids of the AABBs intersecting the frustum in no particular order, outItemIds holds size() entries
+        uint32_t queryFrustum(const float planes[6][4], uint32_t* outItemIds) const;
+
+        /// Closest AABB hit along the ray
+        bool raycast(const Ray& ray, RayHit* outHit) const;
+
+        /// Closest AABB to a point within maxDistance, distance is zero inside the AABB
+        bool findNearest(const float point[3], float maxDistance, uint32_t* outItemId, float* outDistance) const;
+    };
+
+    struct BvhBenchmark {
+        uint32_t itemCount;
+        uint32_t nodeCount;
+        uint32_t threadCount;
+        double buildMs;                     // Single thread
+        double threadedBuildMs;
+        double refitMs;
+        double frustumQueryMs;
+        double frustumLinearMs;             // culling::cullAabbs over all AABBs
+        double raycastUs;                   // Per ray
+        double raycastLinearUs;
+        double nearestUs;                   // Per query
+    };
+
+    BvhBenchmark benchmarkBvh(uint32_t itemCount, uint32_t iterations);
+}
+
+
+///
+/// Implementation
+///
+#if defined(BVH_IMPLEMENTATION)
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+#include <thread>
+
+namespace bvh {
+    namespace {
+        const uint32_t kThreadedBuildMinItems = 16384;  // Smaller subtrees stay on the thread that split them
+
+        struct BuildTask {
+            uint32_t node;
+            uint32_t firstItem;
+            uint32_t itemCount;
+            uint32_t depth;
+        };
+
+        /// Items are partitioned in place, so each pass over a node reads a contiguous range. Bounds load as SSE
+        /// vectors, the fourth lane is ignored.
+        struct alignas(16) BuildItem {
+            float boundsMin[3];
+            uint32_t itemId;
+            float boundsMax[3];
+            uint32_t padding;
+        };
+
+        struct BuildContext {
+            BuildItem* items;
+            Node* nodes;
+            ItemRange* subtreeItems;
+            std::atomic<uint32_t> nodeCount;
+            std::atomic<int32_t> freeThreadCount;
+        };
+
+        struct Bin {
+            __m128 boundsMin;
+            __m128 boundsMax;
+            uint32_t count;
+        };
+
+        inline void resetBounds(float* boundsMin, float* boundsMax) {
+            for (int32_t i = 0; i < 3; ++i) {
+                boundsMin[i] = FLT_MAX;
+                boundsMax[i] = -FLT_MAX;
+            }
+        }
+
+        inline void growBounds(float* boundsMin, float* boundsMax, const float* otherMin, const float* otherMax) {
+            for (int32_t i = 0; i < 3; ++i) {
+                boundsMin[i] = std::min(boundsMin[i], otherMin[i]);
+                boundsMax[i] = std::max(boundsMax[i], otherMax[i]);
+            }
+        }
+
+        /// Twice the centroid, the scale doesn't matter for binning
+        inline float centroid2(const BuildItem& item, int32_t axis) {
+            return item.boundsMin[axis] + item.boundsMax[axis];
+        }
+
+        /// Bin of the item centroid along each axis
+        inline __m128i binIndices(const BuildItem& item, __m128 centroidMin, __m128 binScales) {
+            __m128 centroid = _mm_add_ps(_mm_load_ps(item.boundsMin), _mm_load_ps(item.boundsMax));
+            __m128 bin = _mm_mul_ps(_mm_sub_ps(centroid, centroidMin), binScales);
+            bin = _mm_min_ps(_mm_max_ps(bin, _mm_setzero_ps()), _mm_set1_ps(kBinCount - 1.0f));
+            return _mm_cvttps_epi32(bin);
+        }
+
+        inline float halfArea(__m128 boundsMin, __m128 boundsMax) {
+            alignas(16) float size[4];
+            _mm_store_ps(size, _mm_sub_ps(boundsMax, boundsMin));
+            return (size[0] < 0.0f) ? 0.0f : size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+        }
+
+        /// Compute node bounds and split its items in two, returns the left item count or 0 to keep it as a leaf
+        uint32_t splitNode(BuildContext& context, const BuildTask& task) {
+            BuildItem* items = context.items + task.firstItem;
+            Node& node = context.nodes[task.node];
+
+            __m128 boundsMin = _mm_set1_ps(FLT_MAX), boundsMax = _mm_set1_ps(-FLT_MAX);
+            __m128 centroidMinV = _mm_set1_ps(FLT_MAX), centroidMaxV = _mm_set1_ps(-FLT_MAX);
+            for (uint32_t i = 0; i < task.itemCount; ++i) {
+                __m128 itemMin = _mm_load_ps(items[i].boundsMin), itemMax = _mm_load_ps(items[i].boundsMax);
+                __m128 centroid = _mm_add_ps(itemMin, itemMax);
+                boundsMin = _mm_min_ps(boundsMin, itemMin);
+                boundsMax = _mm_max_ps(boundsMax, itemMax);
+                centroidMinV = _mm_min_ps(centroidMinV, centroid);
+                centroidMaxV = _mm_max_ps(centroidMaxV, centroid);
+            }
+            alignas(16) float nodeMin[4], nodeMax[4], centroidMin[4], centroidMax[4];
+            _mm_store_ps(nodeMin, boundsMin);
+            _mm_store_ps(nodeMax, boundsMax);
+            _mm_store_ps(centroidMin, centroidMinV);
+            _mm_store_ps(centroidMax, centroidMaxV);
+            for (int32_t i = 0; i < 3; ++i) {
+                node.boundsMin[i] = nodeMin[i];
+                node.boundsMax[i] = nodeMax[i];
+            }
+            if (task.itemCount <= kMaxLeafSize) {
+                return 0;
+            }
+
+            // Bin all axes in a single pass over the items
+            bool isMedianSplit = task.depth >= kMaxDepth / 2;
+            Bin bins[3][kBinCount];
+            alignas(16) float binScales[4] = {};
+            for (int32_t axis = 0; axis < 3; ++axis) {
+                float extent = centroidMax[axis] - centroidMin[axis];
+                binScales[axis] = extent > 0.0f ? kBinCount / extent : 0.0f;
+                for (auto& bin : bins[axis]) {
+                    bin = { _mm_set1_ps(FLT_MAX), _mm_set1_ps(-FLT_MAX), 0 };
+                }
+            }
+            __m128 binScalesV = _mm_load_ps(binScales);
+            for (uint32_t i = 0; i < task.itemCount && !isMedianSplit; ++i) {
+                alignas(16) int32_t binIds[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(binIds), binIndices(items[i], centroidMinV, binScalesV));
+                __m128 itemMin = _mm_load_ps(items[i].boundsMin), itemMax = _mm_load_ps(items[i].boundsMax);
+                for (int32_t axis = 0; axis < 3; ++axis) {
+                    Bin& bin = bins[axis][binIds[axis]];
+                    bin.boundsMin = _mm_min_ps(bin.boundsMin, itemMin);
+                    bin.boundsMax = _mm_max_ps(bin.boundsMax, itemMax);
+                    bin.count++;
+                }
+            }
+
+            // Lowest SAH cost over bin boundaries, cost of a side is its item count times its area. A right to left
+            // sweep keeps suffix costs, then a left to right sweep completes each candidate.
+            int32_t bestAxis = -1;
+            uint32_t bestSplit = 0;
+            float bestCost = FLT_MAX;
+            for (int32_t axis = 0; axis < 3 && !isMedianSplit; ++axis) {
+                if (binScales[axis] == 0.0f) {
+                    continue;
+                }
+
+                float rightCosts[kBinCount];
+                __m128 sweepMin = _mm_set1_ps(FLT_MAX), sweepMax = _mm_set1_ps(-FLT_MAX);
+                uint32_t sweepCount = 0;
+                for (uint32_t i = kBinCount - 1; i > 0; --i) {
+                    sweepMin = _mm_min_ps(sweepMin, bins[axis][i].boundsMin);
+                    sweepMax = _mm_max_ps(sweepMax, bins[axis][i].boundsMax);
+                    sweepCount += bins[axis][i].count;
+                    rightCosts[i] = sweepCount > 0 ? sweepCount * halfArea(sweepMin, sweepMax) : -1.0f;
+                }
+
+                sweepCount = 0;
+                sweepMin = _mm_set1_ps(FLT_MAX);
+                sweepMax = _mm_set1_ps(-FLT_MAX);
+                for (uint32_t i = 0; i < kBinCount - 1; ++i) {
+                    sweepMin = _mm_min_ps(sweepMin, bins[axis][i].boundsMin);
+                    sweepMax = _mm_max_ps(sweepMax, bins[axis][i].boundsMax);
+                    sweepCount += bins[axis][i].count;
+                    if (sweepCount == 0 || rightCosts[i + 1] < 0.0f) {
+                        continue;
+                    }
+                    float cost = sweepCount * halfArea(sweepMin, sweepMax) + rightCosts[i + 1];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = i + 1;
+                    }
+                }
+            }
+
+            if (bestAxis >= 0) {
+                // Same bin computation as binning, so both sides match the evaluated split
+                BuildItem* middle = std::partition(items, items + task.itemCount, [&](const BuildItem& item) {
+                    alignas(16) int32_t binIds[4];
+                    _mm_store_si128(reinterpret_cast<__m128i*>(binIds), binIndices(item, centroidMinV, binScalesV));
+                    return static_cast<uint32_t>(binIds[bestAxis]) < bestSplit;
+                });
+                return static_cast<uint32_t>(middle - items);
+            }
+
+            // Deep or all centroids equal, halve by count along the widest axis
+            int32_t axis = 0;
+            for (int32_t i = 1; i < 3; ++i) {
+                if (centroidMax[i] - centroidMin[i] > centroidMax[axis] - centroidMin[axis]) {
+                    axis = i;
+                }
+            }
+            uint32_t leftCount = task.itemCount / 2;
+            std::nth_element(items, items + leftCount, items + task.itemCount,
+                [axis](const BuildItem& a, const BuildItem& b) { return centroid2(a, axis) < centroid2(b, axis); });
+            return leftCount;
+        }
+
+        void buildSubtree(BuildContext& context, BuildTask rootTask) {
+            std::vector<std::thread> workers;
+            std::vector<BuildTask> tasks = { rootTask };
+            while (!tasks.empty()) {
+                BuildTask task = tasks.back();
+                tasks.pop_back();
+
+                Node& node = context.nodes[task.node];
+                context.subtreeItems[task.node] = { task.firstItem, task.itemCount };
+                uint32_t leftCount = splitNode(context, task);
+                if (leftCount == 0) {
+                    node.firstChildOrItem = task.firstItem;
+                    node.itemCount = task.itemCount;
+                    continue;
+                }
+
+                uint32_t leftChild = context.nodeCount.fetch_add(2);
+                node.firstChildOrItem = leftChild;
+                node.itemCount = 0;
+
+                BuildTask leftTask = { leftChild, task.firstItem, leftCount, task.depth + 1 };
+                BuildTask rightTask = { leftChild + 1, task.firstItem + leftCount, task.itemCount - leftCount,
+                    task.depth + 1 };
+                if (leftTask.itemCount >= kThreadedBuildMinItems && context.freeThreadCount.fetch_sub(1) > 0) {
+                    workers.emplace_back([&context, leftTask]() {
+                        buildSubtree(context, leftTask);
+                        context.freeThreadCount.fetch_add(1);
+                    });
+                }
+                else {
+                    if (leftTask.itemCount >= kThreadedBuildMinItems) {
+                        context.freeThreadCount.fetch_add(1);
+                    }
+                    tasks.push_back(leftTask);
+                }
+                tasks.push_back(rightTask);
+            }
+
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        inline bool intersectRayAabb(const float* origin, const float* invDirection, const float* boundsMin,
+            const float* boundsMax, float maxDistance, float* outDistance) {
+            float entry = 0.0f, exit = maxDistance;
+            for (int32_t i = 0; i < 3; ++i) {
+                float t0 = (boundsMin[i] - origin[i]) * invDirection[i];
+                float t1 = (boundsMax[i] - origin[i]) * invDirection[i];
+                entry = std::max(entry, std::min(t0, t1));
+                exit = std::min(exit, std::max(t0, t1));
+            }
+            *outDistance = entry;
+            return entry <= exit;
+        }
+
+        /// Frustum planes as SSE columns, planes 0 to 3 in the first vector and 4, 5 in the second. The two padding
+        /// lanes are zero planes every box is inside of, they are never part of a plane mask.
+        struct FrustumSoA {
+            __m128 normal[2][3];
+            __m128 absNormal[2][3];
+            __m128 distance[2];
+        };
+
+        FrustumSoA loadFrustum(const float planes[6][4]) {
+            alignas(16) float columns[7][8] = {};
+            for (int32_t i = 0; i < 6; ++i) {
+                for (int32_t j = 0; j < 3; ++j) {
+                    columns[j][i] = planes[i][j];
+                    columns[3 + j][i] = std::fabs(planes[i][j]);
+                }
+                columns[6][i] = planes[i][3];
+            }
+
+            FrustumSoA frustum;
+            for (int32_t k = 0; k < 2; ++k) {
+                for (int32_t j = 0; j < 3; ++j) {
+                    frustum.normal[k][j] = _mm_load_ps(&columns[j][k * 4]);
+                    frustum.absNormal[k][j] = _mm_load_ps(&columns[3 + j][k * 4]);
+                }
+                frustum.distance[k] = _mm_load_ps(&columns[6][k * 4]);
+            }
+            return frustum;
+        }
+
+        /// Box against all planes at once, false when outside one of inOutPlaneMask. Planes the box is fully inside of
+        /// are cleared from the mask. Same center/extent test as culling::cullAabbs.
+        inline bool classifyAabb(const FrustumSoA& frustum, const float* boundsMin, const float* boundsMax,
+            uint32_t* inOutPlaneMask) {
+            __m128 center[3], extent[3];
+            for (int32_t j = 0; j < 3; ++j) {
+                center[j] = _mm_set1_ps((boundsMin[j] + boundsMax[j]) * 0.5f);
+                extent[j] = _mm_set1_ps((boundsMax[j] - boundsMin[j]) * 0.5f);
+            }
+
+            uint32_t outsideMask = 0, insideMask = 0;
+            for (int32_t k = 0; k < 2; ++k) {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(center[0], frustum.normal[k][0]),
+                    _mm_mul_ps(center[1], frustum.normal[k][1])), _mm_mul_ps(center[2], frustum.normal[k][2])),
+                    frustum.distance[k]);
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(extent[0], frustum.absNormal[k][0]),
+                    _mm_mul_ps(extent[1], frustum.absNormal[k][1])), _mm_mul_ps(extent[2], frustum.absNormal[k][2]));
+                outsideMask |= static_cast<uint32_t>(_mm_movemask_ps(
+                    _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()))) << (k * 4);
+                insideMask |= static_cast<uint32_t>(_mm_movemask_ps(
+                    _mm_cmpge_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()))) << (k * 4);
+            }
+            if (outsideMask & *inOutPlaneMask) {
+                return false;
+            }
+            *inOutPlaneMask &= ~insideMask;
+            return true;
+        }
+
+        inline float distanceSqToAabb(const float* point, const float* boundsMin, const float* boundsMax) {
+            float distanceSq = 0.0f;
+            for (int32_t i = 0; i < 3; ++i) {
+                float outside = std::max(std::max(boundsMin[i] - point[i], point[i] - boundsMax[i]), 0.0f);
+                distanceSq += outside * outside;
+            }
+            return distanceSq;
+        }
+    }
+
+
+    void Bvh::build(const culling::AabbSoA& aabbs, uint32_t threadCount) {
+        uint32_t itemCount = static_cast<uint32_t>(aabbs.size());
+        nodes.clear();
+        subtreeItems.clear();
+        itemIds.resize(itemCount);
+        itemBounds.resize(itemCount);
+        if (itemCount == 0) {
+            return;
+        }
+
+        if (threadCount == 0) {
+            threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        // A binary tree with one item per leaf at most has 2N - 1 nodes
+        nodes.resize(itemCount * 2);
+        subtreeItems.resize(itemCount * 2);
+        std::vector<BuildItem> items(itemCount);
+        for (uint32_t i = 0; i < itemCount; ++i) {
+            items[i] = { { aabbs.minX[i], aabbs.minY[i], aabbs.minZ[i] }, i,
+                { aabbs.maxX[i], aabbs.maxY[i], aabbs.maxZ[i] }, 0 };
+        }
+
+        BuildContext context;
+        context.items = items.data();
+        context.nodes = nodes.data();
+        context.subtreeItems = subtreeItems.data();
+        context.nodeCount = 1;
+        context.freeThreadCount = static_cast<int32_t>(threadCount) - 1;
+        buildSubtree(context, { 0, 0, itemCount, 0 });
+        nodes.resize(context.nodeCount);
+        subtreeItems.resize(context.nodeCount);
+
+        for (uint32_t slot = 0; slot < itemCount; ++slot) {
+            const BuildItem& item = items[slot];
+            itemIds[slot] = item.itemId;
+            itemBounds[slot] = { { item.boundsMin[0], item.boundsMin[1], item.boundsMin[2] },
+                { item.boundsMax[0], item.boundsMax[1], item.boundsMax[2] } };
+        }
+    }
+
+
+    void Bvh::refit(const culling::AabbSoA& aabbs) {
+        for (size_t slot = 0; slot < itemIds.size(); ++slot) {
+            uint32_t itemId = itemIds[slot];
+            itemBounds[slot] = { { aabbs.minX[itemId], aabbs.minY[itemId], aabbs.minZ[itemId] },
+                { aabbs.maxX[itemId], aabbs.maxY[itemId], aabbs.maxZ[itemId] } };
+        }
+
+        // Children are stored after their parent
+        for (size_t i = nodes.size(); i-- > 0;) {
+            Node& node = nodes[i];
+            resetBounds(node.boundsMin, node.boundsMax);
+            if (node.itemCount > 0) {
+                for (uint32_t slot = node.firstChildOrItem; slot < node.firstChildOrItem + node.itemCount; ++slot) {
+                    growBounds(node.boundsMin, node.boundsMax, itemBounds[slot].boundsMin, itemBounds[slot].boundsMax);
+                }
+            }
+            else {
+                const Node& left = nodes[node.firstChildOrItem];
+                const Node& right = nodes[node.firstChildOrItem + 1];
+                growBounds(node.boundsMin, node.boundsMax, left.boundsMin, left.boundsMax);
+                growBounds(node.boundsMin, node.boundsMax, right.boundsMin, right.boundsMax);
+            }
+        }
+    }
+
+
+    uint32_t Bvh::queryFrustum(const float planes[6][4], uint32_t* outItemIds) const {
+        if (nodes.empty()) {
+            return 0;
+        }
+
+        // Planes a node is fully inside of are dropped for its whole subtree, an empty mask accepts all its items.
+        // Children are classified before they are pushed, so the stack only holds intersecting nodes.
+        FrustumSoA frustum = loadFrustum(planes);
+        struct Entry {
+            uint32_t node;
+            uint32_t planeMask;
+        };
+        Entry stack[kMaxDepth];
+        uint32_t stackSize = 0;
+        uint32_t rootPlaneMask = 0x3F;
+        if (!classifyAabb(frustum, nodes[0].boundsMin, nodes[0].boundsMax, &rootPlaneMask)) {
+            return 0;
+        }
+        stack[stackSize++] = { 0, rootPlaneMask };
+
+        uint32_t visibleCount = 0;
+        while (stackSize > 0) {
+            Entry entry = stack[--stackSize];
+            if (entry.planeMask == 0) {
+                const ItemRange& range = subtreeItems[entry.node];
+                std::copy_n(itemIds.data() + range.firstItem, range.itemCount, outItemIds + visibleCount);
+                visibleCount += range.itemCount;
+                continue;
+            }
+
+            const Node& node = nodes[entry.node];
+            if (node.itemCount == 0) {
+                for (uint32_t child = node.firstChildOrItem + 2; child-- > node.firstChildOrItem;) {
+                    uint32_t planeMask = entry.planeMask;
+                    if (classifyAabb(frustum, nodes[child].boundsMin, nodes[child].boundsMax, &planeMask)) {
+                        stack[stackSize++] = { child, planeMask };
+                    }
+                }
+                continue;
+            }
+            for (uint32_t slot = node.firstChildOrItem; slot < node.firstChildOrItem + node.itemCount; ++slot) {
+                uint32_t planeMask = entry.planeMask;
+                if (classifyAabb(frustum, itemBounds[slot].boundsMin, itemBounds[slot].boundsMax, &planeMask)) {
+                    outItemIds[visibleCount++] = itemIds[slot];
+                }
+            }
+        }
+        return visibleCount;
+    }
+
+
+    bool Bvh::raycast(const Ray& ray, RayHit* outHit) const {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        // Zero components would make 0 * inf NaNs on slab planes, a huge finite inverse behaves the same otherwise
+        float invDirection[3];
+        for (int32_t i = 0; i < 3; ++i) {
+            invDirection[i] = std::fabs(ray.direction[i]) > 1e-20f ? 1.0f / ray.direction[i] : 1e20f;
+        }
+
+        float closestDistance = ray.maxDistance;
+        uint32_t closestItemId = ~0u;
+        float distance;
+        if (!intersectRayAabb(ray.origin, invDirection, nodes[0].boundsMin, nodes[0].boundsMax, closestDistance,
+            &distance)) {
+            return false;
+        }
+
+        // Nearer child first, entries keep their entry distance to skip them once a closer hit is found
+        struct Entry {
+            uint32_t node;
+            float distance;
+        };
+        Entry stack[kMaxDepth];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = { 0, distance };
+        while (stackSize > 0) {
+            Entry entry = stack[--stackSize];
+            if (entry.distance > closestDistance) {
+                continue;
+            }
+
+            const Node& node = nodes[entry.node];
+            if (node.itemCount > 0) {
+                for (uint32_t slot = node.firstChildOrItem; slot < node.firstChildOrItem + node.itemCount; ++slot) {
+                    if (intersectRayAabb(ray.origin, invDirection, itemBounds[slot].boundsMin, itemBounds[slot].boundsMax,
+                        closestDistance, &distance) && (distance < closestDistance || closestItemId == ~0u)) {
+                        closestDistance = distance;
+                        closestItemId = itemIds[slot];
+                    }
+                }
+                continue;
+            }
+
+            uint32_t near = node.firstChildOrItem, far = node.firstChildOrItem + 1;
+            float nearDistance, farDistance;
+            bool isNearHit = intersectRayAabb(ray.origin, invDirection, nodes[near].boundsMin, nodes[near].boundsMax,
+                closestDistance, &nearDistance);
+            bool isFarHit = intersectRayAabb(ray.origin, invDirection, nodes[far].boundsMin, nodes[far].boundsMax,
+                closestDistance, &farDistance);
+            if (isNearHit && isFarHit && farDistance < nearDistance) {
+                std::swap(near, far);
+                std::swap(nearDistance, farDistance);
+            }
+            else if (!isNearHit) {
+                std::swap(near, far);
+                std::swap(nearDistance, farDistance);
+                std::swap(isNearHit, isFarHit);
+            }
+            if (isFarHit) {
+                stack[stackSize++] = { far, farDistance };
+            }
+            if (isNearHit) {
+                stack[stackSize++] = { near, nearDistance };
+            }
+        }
+
+        if (closestItemId == ~0u) {
+            return false;
+        }
+        outHit->itemId = closestItemId;
+        outHit->distance = closestDistance;
+        return true;
+    }
+
+
+    bool Bvh::findNearest(const float point[3], float maxDistance, uint32_t* outItemId, float* outDistance) const {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        float closestDistanceSq = maxDistance * maxDistance;
+        uint32_t closestItemId = ~0u;
+
+        struct Entry {
+            uint32_t node;
+            float distanceSq;
+        };
+        Entry stack[kMaxDepth];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = { 0, distanceSqToAabb(point, nodes[0].boundsMin, nodes[0].boundsMax) };
+        while (stackSize > 0) {
+            Entry entry = stack[--stackSize];
+            if (entry.distanceSq > closestDistanceSq) {
+                continue;
+            }
+
+            const Node& node = nodes[entry.node];
+            if (node.itemCount > 0) {
+                for (uint32_t slot = node.firstChildOrItem; slot < node.firstChildOrItem + node.itemCount; ++slot) {
+                    float distanceSq = distanceSqToAabb(point, itemBounds[slot].boundsMin, itemBounds[slot].boundsMax);
+                    if (distanceSq < closestDistanceSq || (distanceSq == closestDistanceSq && closestItemId == ~0u)) {
+                        closestDistanceSq = distanceSq;
+                        closestItemId = itemIds[slot];
+                    }
+                }
+                continue;
+            }
+
+            // Visit the closer child first, it most likely shrinks the search radius
+            uint32_t near = node.firstChildOrItem, far = node.firstChildOrItem + 1;
+            float nearDistanceSq = distanceSqToAabb(point, nodes[near].boundsMin, nodes[near].boundsMax);
+            float farDistanceSq = distanceSqToAabb(point, nodes[far].boundsMin, nodes[far].boundsMax);
+            if (farDistanceSq < nearDistanceSq) {
+                std::swap(near, far);
+                std::swap(nearDistanceSq, farDistanceSq);
+            }
+            if (farDistanceSq <= closestDistanceSq) {
+                stack[stackSize++] = { far, farDistanceSq };
+            }
+            if (nearDistanceSq <= closestDistanceSq) {
+                stack[stackSize++] = { near, nearDistanceSq };
+            }
+        }
+
+        if (closestItemId == ~0u) {
+            return false;
+        }
+        *outItemId = closestItemId;
+        *outDistance = std::sqrt(closestDistanceSq);
+        return true;
+    }
+
+
+    BvhBenchmark benchmarkBvh(uint32_t itemCount, uint32_t iterations) {
+        // Unit boxes scattered in a 200^3 volume, same scene as culling::benchmarkFrustumCulling
+        uint32_t seed = 1;
+        auto random = [&seed](float minValue, float maxValue) {
+            seed = seed * 1664525u + 1013904223u;
+            return minValue + (maxValue - minValue) * static_cast<float>(seed >> 8) / static_cast<float>(1 << 24);
+        };
+
+        culling::AabbSoA aabbs;
+        aabbs.reserve(itemCount);
+        for (uint32_t i = 0; i < itemCount; ++i) {
+            float center[3] = { random(-100.0f, 100.0f), random(-100.0f, 100.0f), random(-100.0f, 100.0f) };
+            float boundsMin[3] = { center[0] - 0.5f, center[1] - 0.5f, center[2] - 0.5f };
+            float boundsMax[3] = { center[0] + 0.5f, center[1] + 0.5f, center[2] + 0.5f };
+            aabbs.push_back(boundsMin, boundsMax);
+        }
+
+        const float nearZ = 0.1f, farZ = 100.0f;
+        const float viewProj[4][4] = {
+            { 1.0f, 0.0f, 0.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f, 0.0f },
+            { 0.0f, 0.0f, farZ / (farZ - nearZ), 1.0f },
+            { 0.0f, 0.0f, -nearZ * farZ / (farZ - nearZ), 0.0f },
+        };
+        float planes[6][4];
+        culling::extractFrustumPlanes(viewProj, planes);
+
+        const uint32_t kRayCount = 1024;
+        std::vector<Ray> rays(kRayCount);
+        for (auto& ray : rays) {
+            float direction[3] = { random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f) };
+            float invLength = 1.0f / std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] +
+                direction[2] * direction[2] + 1e-12f);
+            ray = { { random(-100.0f, 100.0f), random(-100.0f, 100.0f), random(-100.0f, 100.0f) },
+                { direction[0] * invLength, direction[1] * invLength, direction[2] * invLength }, 400.0f };
+        }
+
+        auto measureMs = [iterations](auto&& function) {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            for (uint32_t i = 0; i < iterations; ++i) {
+                function();
+            }
+            auto endTime = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(endTime - startTime).count() / std::max(iterations, 1u);
+        };
+
+        Bvh tree;
+        BvhBenchmark result = {};
+        result.itemCount = itemCount;
+        result.threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        result.buildMs = measureMs([&]() { tree.build(aabbs, 1); });
+        result.threadedBuildMs = measureMs([&]() { tree.build(aabbs, result.threadCount); });
+        result.nodeCount = static_cast<uint32_t>(tree.nodes.size());
+        result.refitMs = measureMs([&]() { tree.refit(aabbs); });
+
+        std::vector<uint32_t> visibleIds(itemCount);
+        result.frustumQueryMs = measureMs([&]() { tree.queryFrustum(planes, visibleIds.data()); });
+        result.frustumLinearMs = measureMs([&]() { culling::cullAabbs(aabbs, planes, visibleIds.data()); });
+
+        RayHit hit;
+        result.raycastUs = measureMs([&]() {
+            for (const auto& ray : rays) {
+                tree.raycast(ray, &hit);
+            }
+        }) * 1000.0 / kRayCount;
+
+        // Linear scan is slow, a few rays are enough
+        const uint32_t kLinearRayCount = 16;
+        result.raycastLinearUs = measureMs([&]() {
+            for (uint32_t r = 0; r < kLinearRayCount; ++r) {
+                const Ray& ray = rays[r];
+                float invDirection[3];
+                for (int32_t i = 0; i < 3; ++i) {
+                    invDirection[i] = std::fabs(ray.direction[i]) > 1e-20f ? 1.0f / ray.direction[i] : 1e20f;
+                }
+                float closestDistance = ray.maxDistance, distance;
+                for (uint32_t i = 0; i < itemCount; ++i) {
+                    const float boundsMin[3] = { aabbs.minX[i], aabbs.minY[i], aabbs.minZ[i] };
+                    const float boundsMax[3] = { aabbs.maxX[i], aabbs.maxY[i], aabbs.maxZ[i] };
+                    if (intersectRayAabb(ray.origin, invDirection, boundsMin, boundsMax, closestDistance, &distance)) {
+                        closestDistance = distance;
+                        hit.itemId = i;
+                    }
+                }
+            }
+        }) * 1000.0 / kLinearRayCount;
+
+        uint32_t nearestId;
+        float nearestDistance;
+        result.nearestUs = measureMs([&]() {
+            for (const auto& ray : rays) {
+                tree.findNearest(ray.origin, FLT_MAX, &nearestId, &nearestDistance);
+            }
+        }) * 1000.0 / kRayCount;
+        return result;
+    }
+}
+#endif // BVH_IMPLEMENTATION
@@ -0,0 +1,515 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+///
+/// culling Header - Frustum and Hi-Z occlusion culling, CPU reference of cull_cs.hlsl
+///
+/// All matrices follow the row-vector convention used by the sample (p' = p * M). Matrices read from GPU
+/// buffers (instances, constants) are stored transposed for HLSL, and the reference reads them the same way.
+///
+namespace culling {
+    // Layouts below must match cull_cs.hlsl
+    struct CullingConstants {
+        float matPrevWVP[16];               // Previous frame world-view-projection, transposed, for Hi-Z reprojection
+        float frustumPlanes[6][4];          // Current frame planes, in instance world space
+        uint32_t instanceCount;
+        uint32_t maxDrawCount;
+        uint32_t hizMipCount;
+        uint32_t useOcclusion;
+        float hizSize[2];                   // Previous frame rendered size, the top left of Hi-Z mip 0
+        float padding[2];
+    };
+
+    struct MeshCullData {
+        float boundsMin[3];
+        uint32_t clusterOffset;
+        float boundsMax[3];
+        uint32_t clusterCount;
+    };
+
+    struct ClusterCullData {
+        float boundsMin[3];
+        uint32_t drawTemplateIndex;         // Mesh part draw arguments this cluster belongs to
+        float boundsMax[3];
+        uint32_t startIndex;
+        uint32_t indexCount;
+    };
+
+    struct CulledDraw {
+        uint32_t instanceId;
+        uint32_t clusterId;
+    };
+
+    /// World space AABBs as structure of arrays, so 8 boxes load with a single 256-bit load per component
+    struct AabbSoA {
+        std::vector<float> minX, minY, minZ;
+        std::vector<float> maxX, maxY, maxZ;
+
+        size_t size() const { return minX.size(); }
+        void reserve(size_t count);
+        void push_back(const float boundsMin[3], const float boundsMax[3]);
+    };
+
+    struct FrustumCullingBenchmark {
+        uint32_t aabbCount;
+        uint32_t visibleCount;
+        double scalarMs;                    // Average per culling pass
+        double avx2Ms;                      // Zero when the CPU has no AVX2
+    };
+
+    /// Max depth pyramid, mip 0 is a copy of the depth buffer and each texel of mip N covers 2x2 texels of mip N-1.
+    /// The last row/column of odd sized mips also covers the remaining texel, so coverage is always conservative.
+    struct HiZPyramid {
+        std::vector<std::vector<float>> mips;
+        std::vector<uint32_t> mipWidths;
+        std::vector<uint32_t> mipHeights;
+    };
+
+    void extractFrustumPlanes(const float matrix[4][4], float outPlanes[6][4]);
+
+    uint32_t hizMipCount(uint32_t width, uint32_t height);
+
+    void buildHiZ(const float* depth, uint32_t width, uint32_t height, HiZPyramid* outHiZ);
+
+    bool isAabbInFrustum(const float center[3], const float extent[3], const float planes[6][4]);
+
+    /// hizSize is the rendered top left sub-rect of Hi-Z mip 0 the previous frame covers, as in CullingConstants
+    bool isAabbOccluded(const float center[3], const float extent[3], const float matPrevWVP[16],
+        const float hizSize[2], const HiZPyramid& hiz);
+
+    uint32_t cullDraws(const CullingConstants& constants, const float* instanceTransforms,
+        const uint32_t* instanceMeshIds, const MeshCullData* meshes, const ClusterCullData* clusters,
+        const HiZPyramid* optHiZ, std::vector<CulledDraw>& outDraws);
+
+    /// Local bounds to world space AABB, instanceTransform is transposed as uploaded for HLSL
+    void transformAabb(const float boundsMin[3], const float boundsMax[3], const float* instanceTransform,
+        float outBoundsMin[3], float outBoundsMax[3]);
+
+    bool hasAvx2();
+
+    /// Write ascending indices of the AABBs intersecting the frustum, outVisibleIds must hold aabbs.size() entries
+    uint32_t cullAabbs(const AabbSoA& aabbs, const float planes[6][4], uint32_t* outVisibleIds);
+
+    uint32_t cullAabbsScalar(const AabbSoA& aabbs, const float planes[6][4], uint32_t* outVisibleIds);
+
+    uint32_t cullAabbsAvx2(const AabbSoA& aabbs, const float planes[6][4], uint32_t* outVisibleIds);
+
+    FrustumCullingBenchmark benchmarkFrustumCulling(uint32_t aabbCount, uint32_t iterations);
+}
+
+
+///
+/// Implementation
+///
+#if defined(CULLING_IMPLEMENTATION)
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CULLING_TARGET_AVX2
+#else
+#define CULLING_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+namespace culling {
+    inline void _transformAabb(const float boundsMin[3], const float boundsMax[3], const float* matrix,
+        float outCenter[3], float outExtent[3]) {
+        // Column-major as uploaded for HLSL, so row r / column c is at [c * 4 + r]
+        auto m = [matrix](int32_t r, int32_t c) { return matrix[c * 4 + r]; };
+
+        float center[3], extent[3];
+        for (int32_t i = 0; i < 3; ++i) {
+            center[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+            extent[i] = (boundsMax[i] - boundsMin[i]) * 0.5f;
+        }
+
+        for (int32_t c = 0; c < 3; ++c) {
+            outCenter[c] = center[0] * m(0, c) + center[1] * m(1, c) + center[2] * m(2, c) + m(3, c);
+            outExtent[c] = std::fabs(extent[0] * m(0, c)) + std::fabs(extent[1] * m(1, c)) +
+                std::fabs(extent[2] * m(2, c));
+        }
+    }
+
+
+    void extractFrustumPlanes(const float matrix[4][4], float outPlanes[6][4]) {
+        // Row-vector clip = p * M, so plane coefficients are combinations of M columns. D3D clip z is [0, w].
+        for (int32_t i = 0; i < 4; ++i) {
+            float column0 = matrix[i][0], column1 = matrix[i][1], column2 = matrix[i][2], column3 = matrix[i][3];
+            outPlanes[0][i] = column3 + column0;    // Left
+            outPlanes[1][i] = column3 - column0;    // Right
+            outPlanes[2][i] = column3 + column1;    // Bottom
+            outPlanes[3][i] = column3 - column1;    // Top
+            outPlanes[4][i] = column2;              // Near
+            outPlanes[5][i] = column3 - column2;    // Far
+        }
+
+        for (int32_t i = 0; i < 6; ++i) {
+            float length = std::sqrt(outPlanes[i][0] * outPlanes[i][0] + outPlanes[i][1] * outPlanes[i][1] +
+                outPlanes[i][2] * outPlanes[i][2]);
+            float invLength = length > 0.0f ? 1.0f / length : 0.0f;
+            for (int32_t j = 0; j < 4; ++j) {
+                outPlanes[i][j] *= invLength;
+            }
+        }
+    }
+
+
+    uint32_t hizMipCount(uint32_t width, uint32_t height) {
+        uint32_t mipCount = 1;
+        for (uint32_t size = std::max(width, height); size > 1; size >>= 1) {
+            mipCount++;
+        }
+        return mipCount;
+    }
+
+
+    void buildHiZ(const float* depth, uint32_t width, uint32_t height, HiZPyramid* outHiZ) {
+        uint32_t mipCount = hizMipCount(width, height);
+        outHiZ->mips.resize(mipCount);
+        outHiZ->mipWidths.resize(mipCount);
+        outHiZ->mipHeights.resize(mipCount);
+
+        outHiZ->mips[0].assign(depth, depth + width * height);
+        outHiZ->mipWidths[0] = width;
+        outHiZ->mipHeights[0] = height;
+
+        for (uint32_t mip = 1; mip < mipCount; ++mip) {
+            const std::vector<float>& src = outHiZ->mips[mip - 1];
+            uint32_t srcWidth = outHiZ->mipWidths[mip - 1];
+            uint32_t srcHeight = outHiZ->mipHeights[mip - 1];
+            uint32_t dstWidth = std::max(srcWidth >> 1, 1u);
+            uint32_t dstHeight = std::max(srcHeight >> 1, 1u);
+
+            std::vector<float>& dst = outHiZ->mips[mip];
+            dst.resize(dstWidth * dstHeight);
+            for (uint32_t y = 0; y < dstHeight; ++y) {
+                // Last row/column absorbs any remaining source texels
+                uint32_t srcMinY = y * 2;
+                uint32_t srcMaxY = (y == dstHeight - 1) ? srcHeight - 1 : srcMinY + 1;
+                for (uint32_t x = 0; x < dstWidth; ++x) {
+                    uint32_t srcMinX = x * 2;
+                    uint32_t srcMaxX = (x == dstWidth - 1) ? srcWidth - 1 : srcMinX + 1;
+
+                    float maxDepth = 0.0f;
+                    for (uint32_t sy = srcMinY; sy <= srcMaxY; ++sy) {
+                        for (uint32_t sx = srcMinX; sx <= srcMaxX; ++sx) {
+                            maxDepth = std::max(maxDepth, src[sy * srcWidth + sx]);
+                        }
+                    }
+                    dst[y * dstWidth + x] = maxDepth;
+                }
+            }
+            outHiZ->mipWidths[mip] = dstWidth;
+            outHiZ->mipHeights[mip] = dstHeight;
+        }
+    }
+
+
+    bool isAabbInFrustum(const float center[3], const float extent[3], const float planes[6][4]) {
+        for (int32_t i = 0; i < 6; ++i) {
+            const float* plane = planes[i];
+            float distance = center[0] * plane[0] + center[1] * plane[1] + center[2] * plane[2] + plane[3];
+            float radius = extent[0] * std::fabs(plane[0]) + extent[1] * std::fabs(plane[1]) +
+                extent[2] * std::fabs(plane[2]);
+            if (distance + radius < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    bool isAabbOccluded(const float center[3], const float extent[3], const float matPrevWVP[16],
+        const float hizSize[2], const HiZPyramid& hiz) {
+        auto m = [matPrevWVP](int32_t r, int32_t c) { return matPrevWVP[c * 4 + r]; };
+
+        float minUv[2] = { 1.0f, 1.0f };
+        float maxUv[2] = { 0.0f, 0.0f };
+        float minDepth = 1.0f;
+        for (int32_t i = 0; i < 8; ++i) {
+            float corner[3] = {
+                center[0] + ((i & 1) ? extent[0] : -extent[0]),
+                center[1] + ((i & 2) ? extent[1] : -extent[1]),
+                center[2] + ((i & 4) ? extent[2] : -extent[2]),
+            };
+
+            float clip[4];
+            for (int32_t c = 0; c < 4; ++c) {
+                clip[c] = corner[0] * m(0, c) + corner[1] * m(1, c) + corner[2] * m(2, c) + m(3, c);
+            }
+
+            // Crossing the near plane, can't be reprojected
+            if (clip[3] <= 0.0f) {
+                return false;
+            }
+
+            float u = clip[0] / clip[3] * 0.5f + 0.5f;
+            float v = clip[1] / clip[3] * -0.5f + 0.5f;
+            minUv[0] = std::min(minUv[0], u);
+            minUv[1] = std::min(minUv[1], v);
+            maxUv[0] = std::max(maxUv[0], u);
+            maxUv[1] = std::max(maxUv[1], v);
+            minDepth = std::min(minDepth, clip[2] / clip[3]);
+        }
+
+        // Outside previous frame view, no depth information
+        if (maxUv[0] < 0.0f || maxUv[1] < 0.0f || minUv[0] > 1.0f || minUv[1] > 1.0f) {
+            return false;
+        }
+
+        // Mip 0 texel rect within the rendered sub-rect, then pick the mip where it spans at most 2x2 texels
+        int32_t width = static_cast<int32_t>(hizSize[0]);
+        int32_t height = static_cast<int32_t>(hizSize[1]);
+        int32_t minX = std::min(static_cast<int32_t>(std::clamp(minUv[0], 0.0f, 1.0f) * hizSize[0]), width - 1);
+        int32_t minY = std::min(static_cast<int32_t>(std::clamp(minUv[1], 0.0f, 1.0f) * hizSize[1]), height - 1);
+        int32_t maxX = std::min(static_cast<int32_t>(std::clamp(maxUv[0], 0.0f, 1.0f) * hizSize[0]), width - 1);
+        int32_t maxY = std::min(static_cast<int32_t>(std::clamp(maxUv[1], 0.0f, 1.0f) * hizSize[1]), height - 1);
+
+        uint32_t mipCount = static_cast<uint32_t>(hiz.mips.size());
+        uint32_t mip = 0;
+        while (mip + 1 < mipCount && ((maxX >> mip) - (minX >> mip) > 1 || (maxY >> mip) - (minY >> mip) > 1)) {
+            mip++;
+        }
+
+        uint32_t mipWidth = hiz.mipWidths[mip];
+        uint32_t mipHeight = hiz.mipHeights[mip];
+        const std::vector<float>& mipDepth = hiz.mips[mip];
+        float maxDepth = 0.0f;
+        for (int32_t y = minY >> mip; y <= (maxY >> mip); ++y) {
+            for (int32_t x = minX >> mip; x <= (maxX >> mip); ++x) {
+                uint32_t texelX = std::min(static_cast<uint32_t>(x), mipWidth - 1);
+                uint32_t texelY = std::min(static_cast<uint32_t>(y), mipHeight - 1);
+                maxDepth = std::max(maxDepth, mipDepth[texelY * mipWidth + texelX]);
+            }
+        }
+
+        return minDepth > maxDepth;
+    }
+
+
+    inline bool _isAabbVisible(const CullingConstants& constants, const float boundsMin[3], const float boundsMax[3],
+        const float* instanceTransform, const HiZPyramid* optHiZ) {
+        float center[3], extent[3];
+        _transformAabb(boundsMin, boundsMax, instanceTransform, center, extent);
+
+        if (!isAabbInFrustum(center, extent, constants.frustumPlanes)) {
+            return false;
+        }
+        if (constants.useOcclusion && optHiZ &&
+            isAabbOccluded(center, extent, constants.matPrevWVP, constants.hizSize, *optHiZ)) {
+            return false;
+        }
+        return true;
+    }
+
+
+    uint32_t cullDraws(const CullingConstants& constants, const float* instanceTransforms,
+        const uint32_t* instanceMeshIds, const MeshCullData* meshes, const ClusterCullData* clusters,
+        const HiZPyramid* optHiZ, std::vector<CulledDraw>& outDraws) {
+
+        outDraws.clear();
+        for (uint32_t instanceId = 0; instanceId < constants.instanceCount; ++instanceId) {
+            const float* instanceTransform = instanceTransforms + instanceId * 16;
+            const MeshCullData& mesh = meshes[instanceMeshIds[instanceId]];
+            if (!_isAabbVisible(constants, mesh.boundsMin, mesh.boundsMax, instanceTransform, optHiZ)) {
+                continue;
+            }
+
+            for (uint32_t i = 0; i < mesh.clusterCount; ++i) {
+                uint32_t clusterId = mesh.clusterOffset + i;
+                const ClusterCullData& cluster = clusters[clusterId];
+                if (!_isAabbVisible(constants, cluster.boundsMin, cluster.boundsMax, instanceTransform, optHiZ)) {
+                    continue;
+                }
+                if (outDraws.size() < constants.maxDrawCount) {
+                    outDraws.push_back({ instanceId, clusterId });
+                }
+            }
+        }
+        return static_cast<uint32_t>(outDraws.size());
+    }
+
+
+    void AabbSoA::reserve(size_t count) {
+        for (auto* component : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) {
+            component->reserve(count);
+        }
+    }
+
+    void AabbSoA::push_back(const float boundsMin[3], const float boundsMax[3]) {
+        minX.push_back(boundsMin[0]);
+        minY.push_back(boundsMin[1]);
+        minZ.push_back(boundsMin[2]);
+        maxX.push_back(boundsMax[0]);
+        maxY.push_back(boundsMax[1]);
+        maxZ.push_back(boundsMax[2]);
+    }
+
+
+    void transformAabb(const float boundsMin[3], const float boundsMax[3], const float* instanceTransform,
+        float outBoundsMin[3], float outBoundsMax[3]) {
+        float center[3], extent[3];
+        _transformAabb(boundsMin, boundsMax, instanceTransform, center, extent);
+        for (int32_t i = 0; i < 3; ++i) {
+            outBoundsMin[i] = center[i] - extent[i];
+            outBoundsMax[i] = center[i] + extent[i];
+        }
+    }
+
+
+    bool hasAvx2() {
+#if defined(_MSC_VER)
+        int32_t info[4];
+        __cpuid(info, 1);
+        bool hasOsxsave = (info[2] & (1 << 27)) != 0;
+        bool hasFma = (info[2] & (1 << 12)) != 0;
+        if (!hasOsxsave || !hasFma || (_xgetbv(0) & 0x6) != 0x6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    }
+
+
+    inline bool _isAabbInFrustum(const AabbSoA& aabbs, size_t i, const float planes[6][4]) {
+        for (int32_t j = 0; j < 6; ++j) {
+            // Farthest corner along the plane normal, outside if even that one is behind
+            const float* plane = planes[j];
+            float x = plane[0] > 0.0f ? aabbs.maxX[i] : aabbs.minX[i];
+            float y = plane[1] > 0.0f ? aabbs.maxY[i] : aabbs.minY[i];
+            float z = plane[2] > 0.0f ? aabbs.maxZ[i] : aabbs.minZ[i];
+            if (x * plane[0] + y * plane[1] + z * plane[2] + plane[3] < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    uint32_t cullAabbsScalar(const AabbSoA& aabbs, const float planes[6][4], uint32_t* outVisibleIds) {
+        uint32_t visibleCount = 0;
+        for (size_t i = 0; i < aabbs.size(); ++i) {
+            if (_isAabbInFrustum(aabbs, i, planes)) {
+                outVisibleIds[visibleCount++] = static_cast<uint32_t>(i);
+            }
+        }
+        return visibleCount;
+    }
+
+
+    CULLING_TARGET_AVX2 uint32_t cullAabbsAvx2(const AabbSoA& aabbs, const float planes[6][4],
+        uint32_t* outVisibleIds) {
+        // Planes are shared by all boxes, so farthest corner selection is per plane instead of per box
+        const std::vector<float>* planeX[6];
+        const std::vector<float>* planeY[6];
+        const std::vector<float>* planeZ[6];
+        __m256 planeA[6], planeB[6], planeC[6], planeD[6];
+        for (int32_t j = 0; j < 6; ++j) {
+            planeX[j] = planes[j][0] > 0.0f ? &aabbs.maxX : &aabbs.minX;
+            planeY[j] = planes[j][1] > 0.0f ? &aabbs.maxY : &aabbs.minY;
+            planeZ[j] = planes[j][2] > 0.0f ? &aabbs.maxZ : &aabbs.minZ;
+            planeA[j] = _mm256_set1_ps(planes[j][0]);
+            planeB[j] = _mm256_set1_ps(planes[j][1]);
+            planeC[j] = _mm256_set1_ps(planes[j][2]);
+            planeD[j] = _mm256_set1_ps(planes[j][3]);
+        }
+
+        const __m256 zero = _mm256_setzero_ps();
+        size_t aabbCount = aabbs.size();
+        size_t simdCount = aabbCount & ~size_t(7);
+        uint32_t visibleCount = 0;
+        for (size_t i = 0; i < simdCount; i += 8) {
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int32_t j = 0; j < 6; ++j) {
+                __m256 distance = _mm256_fmadd_ps(_mm256_loadu_ps(planeX[j]->data() + i), planeA[j], planeD[j]);
+                distance = _mm256_fmadd_ps(_mm256_loadu_ps(planeY[j]->data() + i), planeB[j], distance);
+                distance = _mm256_fmadd_ps(_mm256_loadu_ps(planeZ[j]->data() + i), planeC[j], distance);
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+            }
+
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+            while (mask != 0) {
+#if defined(_MSC_VER)
+                unsigned long bit;
+                _BitScanForward(&bit, mask);
+#else
+                uint32_t bit = __builtin_ctz(mask);
+#endif
+                outVisibleIds[visibleCount++] = static_cast<uint32_t>(i + bit);
+                mask &= mask - 1;
+            }
+        }
+
+        for (size_t i = simdCount; i < aabbCount; ++i) {
+            if (_isAabbInFrustum(aabbs, i, planes)) {
+                outVisibleIds[visibleCount++] = static_cast<uint32_t>(i);
+            }
+        }
+        return visibleCount;
+    }
+
+
+    uint32_t cullAabbs(const AabbSoA& aabbs, const float planes[6][4], uint32_t* outVisibleIds) {
+        static const bool isAvx2Supported = hasAvx2();
+        return isAvx2Supported ? cullAabbsAvx2(aabbs, planes, outVisibleIds) :
+            cullAabbsScalar(aabbs, planes, outVisibleIds);
+    }
+
+
+    FrustumCullingBenchmark benchmarkFrustumCulling(uint32_t aabbCount, uint32_t iterations) {
+        // Unit boxes scattered in a 200^3 volume in front of a 90 degrees frustum looking down +Z
+        uint32_t seed = 1;
+        auto random = [&seed](float minValue, float maxValue) {
+            seed = seed * 1664525u + 1013904223u;
+            return minValue + (maxValue - minValue) * static_cast<float>(seed >> 8) / static_cast<float>(1 << 24);
+        };
+
+        AabbSoA aabbs;
+        aabbs.reserve(aabbCount);
+        for (uint32_t i = 0; i < aabbCount; ++i) {
+            float center[3] = { random(-100.0f, 100.0f), random(-100.0f, 100.0f), random(-100.0f, 100.0f) };
+            float boundsMin[3] = { center[0] - 0.5f, center[1] - 0.5f, center[2] - 0.5f };
+            float boundsMax[3] = { center[0] + 0.5f, center[1] + 0.5f, center[2] + 0.5f };
+            aabbs.push_back(boundsMin, boundsMax);
+        }
+
+        const float nearZ = 0.1f, farZ = 100.0f;
+        const float viewProj[4][4] = {
+            { 1.0f, 0.0f, 0.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f, 0.0f },
+            { 0.0f, 0.0f, farZ / (farZ - nearZ), 1.0f },
+            { 0.0f, 0.0f, -nearZ * farZ / (farZ - nearZ), 0.0f },
+        };
+        float planes[6][4];
+        extractFrustumPlanes(viewProj, planes);
+
+        std::vector<uint32_t> visibleIds(aabbCount);
+        auto measureMs = [&](uint32_t (*cullFunc)(const AabbSoA&, const float[6][4], uint32_t*)) {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            for (uint32_t i = 0; i < iterations; ++i) {
+                cullFunc(aabbs, planes, visibleIds.data());
+            }
+            auto endTime = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(endTime - startTime).count() / std::max(iterations, 1u);
+        };
+
+        FrustumCullingBenchmark result = {};
+        result.aabbCount = aabbCount;
+        result.visibleCount = cullAabbsScalar(aabbs, planes, visibleIds.data());
+        result.scalarMs = measureMs(cullAabbsScalar);
+        if (hasAvx2()) {
+            result.avx2Ms = measureMs(cullAabbsAvx2);
+        }
+        return result;
+    }
+}
+#endif // CULLING_IMPLEMENTATION
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+///
+/// drawsort Header - Draw packets ordered by 64-bit sort keys, replayed with redundant state sets skipped
+///
+/// Sort key layout, most significant first, so the most expensive state changes happen least often:
+///   pass (4) | pipeline (10) | root signature (6) | material (14) | geometry (14) | depth (16)
+///
+namespace drawsort {
+    const uint32_t kPassBits = 4;
+    const uint32_t kPipelineBits = 10;
+    const uint32_t kRootSignatureBits = 6;
+    const uint32_t kMaterialBits = 14;
+    const uint32_t kGeometryBits = 14;
+    const uint32_t kDepthBits = 16;
+    static_assert(kPassBits + kPipelineBits + kRootSignatureBits + kMaterialBits + kGeometryBits + kDepthBits == 64,
+        "Sort key must use exactly 64 bits");
+
+    struct DrawPacket {
+        uint32_t pipelineId;
+        uint32_t rootSignatureId;
+        uint32_t materialId;
+        uint32_t geometryId;
+        uint32_t instanceOffset;
+        uint32_t instanceCount;
+        uint32_t userData;                  // Application draw data, e.g. mesh part index
+    };
+
+    /// Draws of a frame, order holds packet indices sorted by key after sort()
+    struct DrawQueue {
+        std::vector<DrawPacket> packets;
+        std::vector<uint64_t> keys;
+        std::vector<uint32_t> order;
+        std::vector<uint64_t> scratchKeys;
+        std::vector<uint32_t> scratchOrder;
+
+        size_t size() const { return packets.size(); }
+        void clear();
+        void push(uint64_t sortKey, const DrawPacket& packet);
+        void sort();
+    };
+
+    struct DrawStateStats {
+        uint32_t drawCount;
+        uint32_t pipelineSets;
+        uint32_t rootSignatureSets;
+        uint32_t materialSets;
+        uint32_t geometrySets;
+
+        /// Sets a naive replay would issue, one of each state per draw, minus the ones actually issued
+        uint32_t avoidedSets() const {
+            return drawCount * 4 - (pipelineSets + rootSignatureSets + materialSets + geometrySets);
+        }
+    };
+
+    /// Last state set on a command list. Each set* returns true when the state differs and must be set.
+    struct StateTracker {
+        uint32_t pipelineId = ~0u;
+        uint32_t rootSignatureId = ~0u;
+        uint32_t materialId = ~0u;
+        uint32_t geometryId = ~0u;
+        DrawStateStats stats = {};
+
+        void reset();
+        bool setPipeline(uint32_t id);
+        bool setRootSignature(uint32_t id);   // Invalidates material and geometry, their root parameters are lost
+        bool setMaterial(uint32_t id);
+        bool setGeometry(uint32_t id);
+    };
+
+    struct SortBenchmark {
+        uint32_t drawCount;
+        double radixSortMs;
+        double stdSortMs;
+    };
+
+    /// depth01 is view depth over far plane, back to front inverts it for blended passes
+    uint64_t makeSortKey(uint32_t pass, uint32_t pipelineId, uint32_t rootSignatureId, uint32_t materialId,
+        uint32_t geometryId, float depth01, bool isBackToFront = false);
+
+    /// LSD radix sort of keys with their packet ids, 8 bits per pass, skipping bytes shared by all keys
+    void radixSort(uint64_t* keys, uint32_t* ids, size_t count, uint64_t* scratchKeys, uint32_t* scratchIds);
+
+    SortBenchmark benchmarkSort(uint32_t drawCount, uint32_t iterations);
+}
+
+
+///
+/// Implementation
+///
+#if defined(DRAWSORT_IMPLEMENTATION)
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+
+namespace drawsort {
+    uint64_t makeSortKey(uint32_t pass, uint32_t pipelineId, uint32_t rootSignatureId, uint32_t materialId,
+        uint32_t geometryId, float depth01, bool isBackToFront) {
+        auto field = [](uint32_t value, uint32_t bits) { return static_cast<uint64_t>(value & ((1u << bits) - 1)); };
+
+        float clampedDepth = std::min(std::max(depth01, 0.0f), 1.0f);
+        uint32_t depth = static_cast<uint32_t>(clampedDepth * ((1 << kDepthBits) - 1) + 0.5f);
+        if (isBackToFront) {
+            depth = ((1 << kDepthBits) - 1) - depth;
+        }
+
+        uint64_t key = field(pass, kPassBits);
+        key = (key << kPipelineBits) | field(pipelineId, kPipelineBits);
+        key = (key << kRootSignatureBits) | field(rootSignatureId, kRootSignatureBits);
+        key = (key << kMaterialBits) | field(materialId, kMaterialBits);
+        key = (key << kGeometryBits) | field(geometryId, kGeometryBits);
+        key = (key << kDepthBits) | field(depth, kDepthBits);
+        return key;
+    }
+
+
+    void radixSort(uint64_t* keys, uint32_t* ids, size_t count, uint64_t* scratchKeys, uint32_t* scratchIds) {
+        // All 8 byte histograms in a single read pass
+        uint32_t histograms[8][256] = {};
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t key = keys[i];
+            for (int32_t byte = 0; byte < 8; ++byte) {
+                histograms[byte][(key >> (byte * 8)) & 0xFF]++;
+            }
+        }
+
+        uint64_t* srcKeys = keys;
+        uint32_t* srcIds = ids;
+        uint64_t* dstKeys = scratchKeys;
+        uint32_t* dstIds = scratchIds;
+        for (int32_t byte = 0; byte < 8; ++byte) {
+            uint32_t* histogram = histograms[byte];
+            uint32_t shift = byte * 8;
+
+            // Unused key fields leave every key in one bucket, nothing to reorder
+            if (count == 0 || histogram[(srcKeys[0] >> shift) & 0xFF] == count) {
+                continue;
+            }
+
+            uint32_t offset = 0;
+            for (int32_t bucket = 0; bucket < 256; ++bucket) {
+                uint32_t bucketCount = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += bucketCount;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t dst = histogram[(srcKeys[i] >> shift) & 0xFF]++;
+                dstKeys[dst] = srcKeys[i];
+                dstIds[dst] = srcIds[i];
+            }
+            std::swap(srcKeys, dstKeys);
+            std::swap(srcIds, dstIds);
+        }
+
+        // Odd number of scatter passes leaves the result in scratch
+        if (srcKeys != keys) {
+            memcpy(keys, srcKeys, count * sizeof(uint64_t));
+            memcpy(ids, srcIds, count * sizeof(uint32_t));
+        }
+    }
+
+
+    void DrawQueue::clear() {
+        packets.clear();
+        keys.clear();
+    }
+
+
+    void DrawQueue::push(uint64_t sortKey, const DrawPacket& packet) {
+        keys.push_back(sortKey);
+        packets.push_back(packet);
+    }
+
+
+    void DrawQueue::sort() {
+        size_t count = packets.size();
+        order.resize(count);
+        std::iota(order.begin(), order.end(), 0u);
+        if (count < 2) {
+            return;
+        }
+
+        scratchKeys.resize(count);
+        scratchOrder.resize(count);
+        radixSort(keys.data(), order.data(), count, scratchKeys.data(), scratchOrder.data());
+    }
+
+
+    void StateTracker::reset() {
+        pipelineId = rootSignatureId = materialId = geometryId = ~0u;
+        stats = {};
+    }
+
+
+    bool StateTracker::setPipeline(uint32_t id) {
+        if (pipelineId == id) {
+            return false;
+        }
+        pipelineId = id;
+        stats.pipelineSets++;
+        return true;
+    }
+
+
+    bool StateTracker::setRootSignature(uint32_t id) {
+        if (rootSignatureId == id) {
+            return false;
+        }
+        rootSignatureId = id;
+        materialId = geometryId = ~0u;
+        stats.rootSignatureSets++;
+        return true;
+    }
+
+
+    bool StateTracker::setMaterial(uint32_t id) {
+        if (materialId == id) {
+            return false;
+        }
+        materialId = id;
+        stats.materialSets++;
+        return true;
+    }
+
+
+    bool StateTracker::setGeometry(uint32_t id) {
+        if (geometryId == id) {
+            return false;
+        }
+        geometryId = id;
+        stats.geometrySets++;
+        return true;
+    }
+
+
+    SortBenchmark benchmarkSort(uint32_t drawCount, uint32_t iterations) {
+        // Few pipelines, more materials and meshes, random depths, like a large opaque pass
+        uint32_t seed = 1;
+        auto random = [&seed](uint32_t maxValue) {
+            seed = seed * 1664525u + 1013904223u;
+            return (seed >> 8) % maxValue;
+        };
+
+        std::vector<uint64_t> sourceKeys(drawCount);
+        for (uint32_t i = 0; i < drawCount; ++i) {
+            sourceKeys[i] = makeSortKey(0, random(8), random(2), random(1024), random(4096),
+                static_cast<float>(random(65536)) / 65535.0f);
+        }
+
+        std::vector<uint64_t> keys(drawCount), scratchKeys(drawCount);
+        std::vector<uint32_t> ids(drawCount), scratchIds(drawCount);
+        auto measureMs = [&](bool isRadixSort) {
+            double totalMs = 0.0;
+            for (uint32_t i = 0; i < iterations; ++i) {
+                keys = sourceKeys;
+                std::iota(ids.begin(), ids.end(), 0u);
+
+                auto startTime = std::chrono::high_resolution_clock::now();
+                if (isRadixSort) {
+                    radixSort(keys.data(), ids.data(), drawCount, scratchKeys.data(), scratchIds.data());
+                }
+                else {
+                    std::sort(ids.begin(), ids.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+                }
+                auto endTime = std::chrono::high_resolution_clock::now();
+                totalMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+            }
+            return totalMs / std::max(iterations, 1u);
+        };
+
+        SortBenchmark result = {};
+        result.drawCount = drawCount;
+        result.radixSortMs = measureMs(true);
+        result.stdSortMs = measureMs(false);
+        return result;
+    }
+}
+#endif // DRAWSORT_IMPLEMENTATION
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdint.h>
+
+
+///
+/// dynres Header - Dynamic resolution controller driven by measured GPU frame times
+///
+/// GPU time is modeled as fixed cost plus a cost proportional to the rendered pixels, so the scale that meets the
+/// budget is the current scale times sqrt(budget / time). Scale drops as soon as a frame is over budget and rises
+/// slowly, and measurements of frames rendered before the last change are skipped since timestamps arrive late.
+///
+namespace dynres {
+    struct ControllerDesc {
+        float budgetMs = 16.0f;             // GPU frame time to stay under
+        float headroom = 0.85f;             // Fraction of the budget aimed for, absorbs noise
+        float minScale = 0.5f;
+        float maxScale = 1.0f;
+        float maxIncrease = 0.02f;          // Largest scale increase per change
+        float deadband = 0.02f;             // Relative scale changes smaller than this are ignored
+        float smoothing = 0.1f;             // Weight of the newest frame time in the filtered time
+        uint32_t latencyFrames = 3;         // Frames between recording and reading back their timestamps
+    };
+
+    struct ResolutionController {
+        ControllerDesc desc;
+        float scale = 1.0f;                 // Applied to both dimensions
+        float filteredMs = 0.0f;
+        uint32_t skipCount = 0;             // Measurements left from frames rendered at an old scale
+
+        void reset(const ControllerDesc& controllerDesc);
+
+        /// Feed the GPU time of a completed frame, returns the scale for the next frame
+        float update(float gpuFrameMs);
+    };
+
+    struct ControllerSimulation {
+        uint32_t frameCount;
+        uint32_t overBudgetFrames;
+        uint32_t longestOverBudgetRun;
+        uint32_t scaleChanges;
+        float averageScale;
+        float minScale;
+    };
+
+    /// Render size for a scale, rounded down to a multiple of 8 pixels and at least 8
+    uint32_t scaledSize(uint32_t maxSize, float scale);
+
+    /// Run the controller on synthetic frame times: fixed cost plus pixel cost at full scale, whose load steps to
+    /// stepFactor times for the middle third of the frames, with deterministic noise
+    ControllerSimulation simulateController(const ControllerDesc& desc, uint32_t frameCount, float fixedMs,
+        float fullScaleMs, float stepFactor, float noise);
+}
+
+
+///
+/// Implementation
+///
+#if defined(DYNRES_IMPLEMENTATION)
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace dynres {
+    void ResolutionController::reset(const ControllerDesc& controllerDesc) {
+        desc = controllerDesc;
+        scale = desc.maxScale;
+        filteredMs = 0.0f;
+        skipCount = desc.latencyFrames;
+    }
+
+
+    float ResolutionController::update(float gpuFrameMs) {
+        if (skipCount > 0) {
+            skipCount--;
+            return scale;
+        }
+
+        // Over budget frames bypass the filter, a spike must not wait for the average to catch up
+        bool isOverBudget = gpuFrameMs > desc.budgetMs;
+        filteredMs = (filteredMs <= 0.0f || isOverBudget) ? gpuFrameMs :
+            filteredMs + (gpuFrameMs - filteredMs) * desc.smoothing;
+
+        float targetMs = desc.budgetMs * desc.headroom;
+        float desiredScale = scale * std::sqrt(targetMs / std::max(filteredMs, 0.01f));
+        desiredScale = std::min(desiredScale, scale + desc.maxIncrease);
+        desiredScale = std::min(std::max(desiredScale, desc.minScale), desc.maxScale);
+        if (std::fabs(desiredScale - scale) < desc.deadband * scale && !isOverBudget) {
+            return scale;
+        }
+
+        if (desiredScale != scale) {
+            scale = desiredScale;
+            filteredMs = 0.0f;
+            skipCount = desc.latencyFrames;
+        }
+        return scale;
+    }
+
+
+    uint32_t scaledSize(uint32_t maxSize, float scale) {
+        uint32_t size = static_cast<uint32_t>(maxSize * scale) & ~7u;
+        return std::min(std::max(size, 8u), maxSize);
+    }
+
+
+    ControllerSimulation simulateController(const ControllerDesc& desc, uint32_t frameCount, float fixedMs,
+        float fullScaleMs, float stepFactor, float noise) {
+        ResolutionController controller;
+        controller.reset(desc);
+
+        uint32_t seed = 1;
+        auto random = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<float>(seed >> 8) / static_cast<float>(1 << 24) * 2.0f - 1.0f;
+        };
+
+        // Timestamps of a frame are read latencyFrames later, so the GPU time seen now is from an older scale
+        std::vector<float> scaleHistory(desc.latencyFrames + 1, controller.scale);
+        ControllerSimulation result = {};
+        result.frameCount = frameCount;
+        result.minScale = controller.scale;
+        uint32_t overBudgetRun = 0;
+        double scaleSum = 0.0;
+        for (uint32_t frame = 0; frame < frameCount; ++frame) {
+            bool isHeavy = frame >= frameCount / 3 && frame < frameCount * 2 / 3;
+            float renderedScale = scaleHistory[frame % scaleHistory.size()];
+            float pixelMs = fullScaleMs * (isHeavy ? stepFactor : 1.0f) * renderedScale * renderedScale;
+            float gpuFrameMs = (fixedMs + pixelMs) * (1.0f + noise * random());
+
+            overBudgetRun = gpuFrameMs > desc.budgetMs ? overBudgetRun + 1 : 0;
+            result.overBudgetFrames += overBudgetRun > 0 ? 1 : 0;
+            result.longestOverBudgetRun = std::max(result.longestOverBudgetRun, overBudgetRun);
+
+            float previousScale = controller.scale;
+            float nextScale = controller.update(gpuFrameMs);
+            result.scaleChanges += nextScale != previousScale ? 1 : 0;
+            result.minScale = std::min(result.minScale, nextScale);
+            scaleHistory[frame % scaleHistory.size()] = nextScale;
+            scaleSum += renderedScale;
+        }
+        result.averageScale = frameCount > 0 ? static_cast<float>(scaleSum / frameCount) : 0.0f;
+        return result;
+    }
+}
+#endif // DYNRES_IMPLEMENTATION
@@ -1,15 +1,42 @@
 #define FASTDX_IMPLEMENTATION
 #include "../../fastdx/fastdx.h"
+#define CULLING_IMPLEMENTATION
+#include "culling.h"
+#define TRANSFORMS_IMPLEMENTATION
+#include "transforms.h"
+#define DRAWSORT_IMPLEMENTATION
+#include "drawsort.h"
+#define OCCLUSION_IMPLEMENTATION
+#include "occlusion.h"
+#define BVH_IMPLEMENTATION
+#include "bvh.h"
+#define DYNRES_IMPLEMENTATION
+#include "dynres.h"
+#define ANIMATION_IMPLEMENTATION
+#include "animation.h"
+#define MORPH_IMPLEMENTATION
+#include "morph.h"
 #include "tiny_gltf/tiny_gltf.h"
 #include <DirectXMath.h>
 #include <filesystem>
 #include <fstream>
+#include <tuple>
 using namespace std;
 
 const int32_t kFrameCount = 3;
 const DXGI_FORMAT kFrameFormat = DXGI_FORMAT_R10G10B10A2_UNORM;
 const D3D12_CLEAR_VALUE kClearDepth = { DXGI_FORMAT_D32_FLOAT, {1.0f, 0} };
 const D3D12_CLEAR_VALUE kClearRenderTarget = { kFrameFormat, { 0.0f, 0.2f, 0.4f, 1.0f } };
+const int32_t kClusterIndexCount = 64 * 3;
+const float kCameraFarZ = 1000.0f;
+const uint32_t kDrawPassDepth = 0;            // Depth prepass draws sort before the main pass
+const uint32_t kDrawPassOpaque = 1;
+const uint32_t kDrawPipelineLess = 0;         // Sort key pipeline ids, see drawPipelines
+const uint32_t kDrawPipelineEqual = 1;
+const uint32_t kDrawPipelineDepthOnly = 2;
+const float kMorphDeltaThreshold = 1e-6f;     // Morph target vertices moving less are not stored
+const uint32_t kSkinBoundsSampleCount = 32;   // Poses of the played clip skinned at load to bound skinned meshes
+const uint32_t kBvhCullingMinItems = 16384;   // Below this the linear AVX2 frustum scan beats the BVH query
 fastdx::WindowProperties windowProp;
 
 fastdx::D3D12DeviceWrapperPtr device;
@@ -20,10 +47,12 @@ fastdx::IDXGISwapChainPtr swapChain;
 fastdx::ID3D12DescriptorHeapPtr swapChainRtvHeap;
 fastdx::ID3D12DescriptorHeapPtr depthStencilViewHeap;
 fastdx::ID3D12PipelineStatePtr pipelineState;
+fastdx::ID3D12PipelineStatePtr depthEqualPipelineState;     // Main pass after the prepass, EQUAL without depth writes
+fastdx::ID3D12PipelineStatePtr depthPrepassPipelineState;   // Position only VS and null PS
 fastdx::ID3D12RootSignaturePtr pipelineRootSignature;
 vector<fastdx::ID3D12ResourcePtr> renderTargets;
 fastdx::ID3D12ResourcePtr depthStencilTarget;
-vector<uint8_t> vertexShader, pixelShader;
+vector<uint8_t> vertexShader, pixelShader, depthPrepassVertexShader;
 fastdx::ID3D12ResourcePtr sceneConstantBuffer[kFrameCount];
 std::vector<fastdx::ID3D12ResourcePtr> uploadBuffers;
 
@@ -35,12 +64,175 @@ uint64_t swapFenceCounter = 0;
 uint64_t swapFenceWaitValue[kFrameCount] = {};
 
 // GlTF Model
-vector<fastdx::ID3D12ResourcePtr> gltfVertexBuffers, gltfIndexBuffers;
-vector<D3D12_INDEX_BUFFER_VIEW> gltfIndexBuffersView;
+struct GltfPrimitive {
+    fastdx::ID3D12ResourcePtr vertexBuffer;
+    fastdx::ID3D12ResourcePtr positionBuffer;       // Position only stream for the depth prepass
+    fastdx::ID3D12ResourcePtr indexBuffer;
+    D3D12_INDEX_BUFFER_VIEW indexBufferView;
+    uint32_t indexCount;
+    int32_t materialId;
+    vector<culling::ClusterCullData> clusters;
+    float boundsMin[3];                 // From POSITION accessor min/max
+    float boundsMax[3];
+    uint32_t cpuCullOffset;             // First world AABB of this mesh part, one per mesh instance
+    uint32_t meshPartId;                // Sort key geometry id is twice this, plus one for the position stream
+    vector<float> occluderPositions;    // XYZ and indices kept on CPU when an occluder node uses this mesh
+    vector<uint16_t> occluderIndices;
+    morph::MorphSet morphTargets;       // Sparse primitive.targets, base and morphed XYZ kept on CPU with them
+    vector<float> morphBasePositions;
+    vector<float> morphBaseNormals;
+    vector<float> morphUvs;             // Interleaved again with the morphed streams on upload
+    vector<float> morphedPositions;
+    vector<float> morphedNormals;
+    vector<uint16_t> skinJoints;        // JOINTS_0 and WEIGHTS_0, 4 per vertex, when a skinned node uses this mesh
+    vector<float> skinWeights;
+    vector<float> skinnedPositions;     // Morphed streams skinned by the palettes of the mesh skin
+    vector<float> skinnedNormals;
+    uint32_t morphUploadOffset;         // Vertices then positions of this primitive in the morph upload buffers
+};
+
+struct GltfMesh {
+    vector<GltfPrimitive> primitives;
+    uint32_t instanceOffset;            // First instance of this mesh in the instance buffer
+    uint32_t instanceCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    int32_t skinId;                     // Skin of its instance nodes, -1 for rigid meshes
+    vector<float> morphWeights;         // One per morph target of its primitives, mesh weights until animated
+    morph::WeightTrack morphAnimation;  // First glTF animation of the weights of its nodes, if any
+    float morphTime;
+    bool isMorphDirty;                  // Weights or skin palettes changed since the vertex buffers were last written
+};
+
+vector<GltfMesh> gltfMeshes;
+vector<uint32_t> gltfInstanceNodes;                 // Transform node of each instance, grouped by mesh
+fastdx::ID3D12ResourcePtr gltfInstanceBuffers[kFrameCount];
+float* gltfInstanceBufferPtrs[kFrameCount];         // Persistently mapped, transposed world of each instance
+fastdx::ID3D12ResourcePtr gltfMorphUploadBuffers[kFrameCount];
+uint8_t* gltfMorphUploadBufferPtrs[kFrameCount];    // Persistently mapped, morphed vertices copied to the meshes
+
+// Occluders, nodes with "occluder": true in their glTF extras, rendered by the CPU occlusion culler
+struct GltfOccluder {
+    uint32_t node;
+    uint32_t meshId;                                // Index in gltfMeshes
+};
+vector<GltfOccluder> gltfOccluders;
+
+// Skins, joints of each glTF skin with the animations targeting them, evaluated into bone palettes in update(). The
+// meshes using a skin are skinned on CPU by updateMorphedMeshes(), after their morph targets.
+struct GltfSkin {
+    animation::Skeleton skeleton;       // Joints in glTF skin order, as referenced by JOINTS_0
+    vector<animation::CompressedClip> clips;    // One per glTF animation with channels on the joints
+    animation::Instances instances;     // Playing the first clip, when there is one
+    vector<float> palettes;             // 3x4 rows per joint, bone palette layout of the skinning sample
+};
+vector<GltfSkin> gltfSkins;
+
+// Scene Transforms, every glTF node under a root animated in update()
+transforms::TransformHierarchy sceneTransforms;
+uint32_t sceneRootNode = 0;
 vector<vector<fastdx::ID3D12ResourcePtr>> gltfMaterialToTextures;
-vector<D3D12_GPU_DESCRIPTOR_HANDLE> gltfTextureDescriptorsHeapStart;
+vector<uint32_t> gltfMaterialTextureOffsets;        // First texture descriptor of each material
+vector<uint8_t> gltfMaterialDepthPrepass;           // Material drawn in the depth prepass, then shaded with EQUAL
 fastdx::ID3D12DescriptorHeapPtr gltfTexturesViewHeap;
 
+// GPU-Driven Draws, one command per mesh part
+struct GltfDrawArguments {
+    uint32_t instanceOffset;                        // Root constants (b1)
+    uint32_t materialTextureOffset;
+    D3D12_GPU_VIRTUAL_ADDRESS vertexBuffer;         // Root SRV (t0)
+    D3D12_INDEX_BUFFER_VIEW indexBufferView;
+    D3D12_DRAW_INDEXED_ARGUMENTS drawIndexed;
+};
+
+static_assert(sizeof(GltfDrawArguments) == 56, "Must match DrawArguments in cull_cs.hlsl");
+
+enum class DrawPath {
+    Direct,                                         // Per mesh part root parameters and draw
+    ExecuteIndirect,                                // Single ExecuteIndirect over GPU draw arguments
+    CpuCulled,                                      // Per mesh part draw of its frustum visible instances
+    GpuCulled,                                      // ExecuteIndirect over visible clusters from cull_cs
+};
+DrawPath drawPath = DrawPath::GpuCulled;
+bool useDrawCountBuffer = true;
+
+fastdx::ID3D12CommandSignaturePtr gltfCommandSignature;
+fastdx::ID3D12ResourcePtr gltfDrawArgumentsBuffer;
+fastdx::ID3D12ResourcePtr gltfDrawCountBuffer;
+uint32_t gltfDrawCount = 0;
+
+// GPU Culling, instances and clusters against frustum and previous frame Hi-Z
+vector<uint8_t> cullShader, hizShader;
+fastdx::ID3D12RootSignaturePtr cullRootSignature, hizRootSignature;
+fastdx::ID3D12PipelineStatePtr cullPipelineState, hizPipelineState;
+fastdx::ID3D12ResourcePtr cullConstantBuffer[kFrameCount];
+fastdx::ID3D12ResourcePtr gltfInstanceMeshIdsBuffer, gltfMeshCullBuffer, gltfClusterCullBuffer;
+fastdx::ID3D12ResourcePtr culledDrawArgumentsBuffer, culledDrawCountBuffer, zeroCountBuffer;
+fastdx::ID3D12ResourcePtr hizTarget;
+fastdx::ID3D12DescriptorHeapPtr cullingViewHeap;    // Depth SRV, Hi-Z mips SRVs, Hi-Z mips UAVs, Hi-Z SRV
+uint32_t hizMipCount = 0;
+uint32_t culledDrawCapacity = 0;
+bool isHiZValid = false;
+DirectX::XMMATRIX prevMatWVP = DirectX::XMMatrixIdentity();
+
+// CPU copies of the cull_cs inputs and readbacks of one frame, compared with culling::cullDraws. The first GPU
+// culled frame with Hi-Z is validated, V validates the next one.
+struct GpuCullingValidation {
+    vector<uint32_t> instanceMeshIds;
+    vector<culling::MeshCullData> meshes;
+    vector<culling::ClusterCullData> clusters;
+    vector<GltfDrawArguments> drawTemplates;        // Same order as gltfDrawArgumentsBuffer
+    culling::CullingConstants constants;            // Of the validated frame
+    fastdx::ID3D12ResourcePtr depthReadbackBuffer;  // Depth the Hi-Z of the validated frame is reduced from
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT depthFootprint;
+    fastdx::ID3D12ResourcePtr drawsReadbackBuffer;  // Culled draw count, then the culled draws at kDrawsOffset
+    static const uint32_t kDrawsOffset = 8;
+};
+GpuCullingValidation gpuCullingValidation;
+bool isGpuCullingValidationPending = true;
+bool isGpuCullingValidating = false;                // Copies recorded in the frame being built
+
+// CPU Culling, world AABB of every mesh part instance tested against the frustum before recording draws
+culling::AabbSoA cpuCullBounds;                     // Grouped by mesh part, then by instance
+vector<uint32_t> cpuCullVisibleIds;
+occlusion::DepthRasterizer cpuOcclusion;            // Low resolution occluders depth, tested after frustum culling
+bool useCpuOcclusionCulling = true;
+bvh::Bvh sceneBvh;                                  // Over cpuCullBounds, refit when transforms change
+bool isSceneBvhStale = false;                       // Transforms changed while only picking reads the BVH
+bool useBvhCulling = false;                         // Chosen at load from the scene size, picking always uses the BVH
+vector<uint32_t> cpuCullVisibleBits;                // BVH query results by id, read back in ascending id order
+fastdx::ID3D12ResourcePtr visibleInstanceBuffer[kFrameCount];
+
+// Depth Prepass, lays down depth of opaque mesh parts so the main pass shades each pixel once
+bool useDepthPrepass = true;
+
+// Dynamic Resolution, scene rendered to a sub-rect of back buffer sized targets, scaled to fit the GPU time budget
+bool useDynamicResolution = true;
+dynres::ResolutionController resolutionController;
+fastdx::ID3D12ResourcePtr sceneColorTarget;                 // Back buffer size, its rendered sub-rect is upscaled
+fastdx::ID3D12DescriptorHeapPtr sceneRtvHeap;
+fastdx::ID3D12DescriptorHeapPtr upscaleViewHeap;            // Scene color SRV
+fastdx::ID3D12RootSignaturePtr upscaleRootSignature;
+fastdx::ID3D12PipelineStatePtr upscalePipelineState;
+vector<uint8_t> upscaleVertexShader, upscalePixelShader;
+fastdx::ID3D12QueryHeapPtr timestampQueryHeap;              // Frame begin and end timestamps per frame in flight
+fastdx::ID3D12ResourcePtr timestampReadbackBuffer;
+uint64_t timestampFrequency = 0;
+bool isTimestampValid[kFrameCount] = {};
+uint32_t renderWidth = 0, renderHeight = 0;                 // Scene sub-rect of the frame being recorded
+uint32_t prevRenderWidth = 0, prevRenderHeight = 0;         // Scene sub-rect in the depth buffer, read by Hi-Z
+uint32_t pendingWidth = 0, pendingHeight = 0;               // Client size of the last WM_SIZE, applied by next draw
+
+// Draw Packets, direct and CPU culled draws sorted each frame so redundant state sets are skipped
+vector<ID3D12PipelineState*> drawPipelines;         // Indexed by sort key pipeline id
+vector<ID3D12RootSignature*> drawRootSignatures;    // Indexed by sort key root signature id
+vector<const GltfPrimitive*> gltfMeshParts;         // Indexed by mesh part id, the draw packets user data
+drawsort::DrawQueue drawQueue;
+drawsort::StateTracker drawStateTracker;
+drawsort::DrawStateStats drawStatsTotal = {};
+uint32_t drawStatsFrameCount = 0;
+uint32_t occlusionCulledTotal = 0;
+
 // Scene Constant Buffer
 struct SceneGlobals { // On x64 we can guarantee 16B alignment
     DirectX::XMMATRIX matW;
@@ -87,6 +279,41 @@ HRESULT readShader(const wstring& filePath, vector<uint8_t>& outShaderData) {
     return file ? S_OK : E_FAIL;
 }
 
+/// Depth and scene color at back buffer size, the largest the dynamic resolution renders at
+void createRenderTargets(uint32_t width, uint32_t height) {
+    D3D12_HEAP_PROPERTIES defaultHeapProps = { D3D12_HEAP_TYPE_DEFAULT };
+    D3D12_RESOURCE_DESC depthStencilResourceDesc = fastdxu::resourceTexDesc(D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+        width, height, 1, DXGI_FORMAT_R32_TYPELESS, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+    depthStencilResourceDesc.MipLevels = 1;     // Typeless, so Hi-Z can also read it as R32_FLOAT
+
+    depthStencilTarget = device->createCommittedResource(defaultHeapProps, D3D12_HEAP_FLAG_NONE,
+        depthStencilResourceDesc, D3D12_RESOURCE_STATE_DEPTH_WRITE, &kClearDepth);
+
+    // Create depth stencil render target view in heap
+    D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
+    depthStencilDesc.Format = DXGI_FORMAT_D32_FLOAT;
+    depthStencilDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+    device->createDepthStencilView(depthStencilTarget, depthStencilDesc,
+        depthStencilViewHeap->GetCPUDescriptorHandleForHeapStart());
+
+    // Scene color, rendered to then sampled by the upscale pass
+    D3D12_RESOURCE_DESC sceneColorDesc = fastdxu::resourceTexDesc(D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+        width, height, 1, kFrameFormat, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+    sceneColorDesc.MipLevels = 1;
+    sceneColorTarget = device->createCommittedResource(defaultHeapProps, D3D12_HEAP_FLAG_NONE,
+        sceneColorDesc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, &kClearRenderTarget);
+
+    D3D12_RENDER_TARGET_VIEW_DESC sceneRtvDesc = {};
+    sceneRtvDesc.Format = kFrameFormat;
+    sceneRtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
+    device->createRenderTargetView(sceneColorTarget, sceneRtvDesc, sceneRtvHeap->GetCPUDescriptorHandleForHeapStart());
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC sceneViewDesc = fastdxu::shaderResourceViewDesc(
+        D3D12_SRV_DIMENSION_TEXTURE2D, kFrameFormat);
+    sceneViewDesc.Texture2D.MipLevels = 1;
+    device->createShaderResourceView(sceneColorTarget, sceneViewDesc, upscaleViewHeap->GetCPUDescriptorHandleForHeapStart());
+}
+
 void initializeD3d(HWND hwnd) {
     // Create a device and queue to dispatch command lists
     device = fastdx::createDevice(D3D_FEATURE_LEVEL_12_2);
@@ -95,6 +322,8 @@ void initializeD3d(HWND hwnd) {
     // Create heaps for render target views, depth stencil and shader parameters
     swapChainRtvHeap = device->createDescriptorHeap(kFrameCount, D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
     depthStencilViewHeap = device->createDescriptorHeap(1, D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
+    sceneRtvHeap = device->createDescriptorHeap(1, D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+    upscaleViewHeap = device->createDescriptorHeap(1, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
     // Create a triple frame buffer swap chain for window
     DXGI_SWAP_CHAIN_DESC1 swapChainDesc = fastdxu::swapChainDesc(hwnd, kFrameCount, kFrameFormat);
@@ -102,21 +331,11 @@ void initializeD3d(HWND hwnd) {
 
     // Create swap chain render targets views in heap
     renderTargets = device->createRenderTargetViews(swapChain, swapChainRtvHeap);
+    windowProp.width = swapChainDesc.Width;
+    windowProp.height = swapChainDesc.Height;
 
-    // Create depth stencil resource
-    D3D12_HEAP_PROPERTIES defaultHeapProps = { D3D12_HEAP_TYPE_DEFAULT };
-    D3D12_RESOURCE_DESC depthStencilResourceDesc = fastdxu::resourceTexDesc(D3D12_RESOURCE_DIMENSION_TEXTURE2D,
-        swapChainDesc.Width, swapChainDesc.Height, 1, DXGI_FORMAT_D32_FLOAT, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
-
-    depthStencilTarget = device->createCommittedResource(defaultHeapProps, D3D12_HEAP_FLAG_NONE,
-        depthStencilResourceDesc, D3D12_RESOURCE_STATE_DEPTH_WRITE, &kClearDepth);
-
-    // Create depth stencil render target view in heap
-    D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
-    depthStencilDesc.Format = DXGI_FORMAT_D32_FLOAT;
-    depthStencilDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
-    device->createDepthStencilView(depthStencilTarget, depthStencilDesc,
-        depthStencilViewHeap->GetCPUDescriptorHandleForHeapStart());
+    // Create depth stencil and scene color resources
+    createRenderTargets(swapChainDesc.Width, swapChainDesc.Height);
 
     // Create one command allocator per frame buffer
     for (int32_t i = 0; i < kFrameCount; ++i) {
@@ -142,6 +361,59 @@ void initializeD3d(HWND hwnd) {
     pipelineDesc.VS = { vertexShader.data(), vertexShader.size() };
     pipelineDesc.PS = { pixelShader.data(), pixelShader.size() };
     pipelineState = device->createGraphicsPipelineState(pipelineDesc);
+
+    // Main pass of mesh parts already in the depth prepass, only the visible surface passes EQUAL
+    pipelineDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_EQUAL;
+    pipelineDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+    depthEqualPipelineState = device->createGraphicsPipelineState(pipelineDesc);
+
+    // Depth prepass, same root signature with the position stream bound in place of the vertex buffer
+    readShader(L"depth_prepass_vs.cso", depthPrepassVertexShader);
+    pipelineDesc.DepthStencilState = fastdxu::defaultDepthStencilDesc();
+    pipelineDesc.VS = { depthPrepassVertexShader.data(), depthPrepassVertexShader.size() };
+    pipelineDesc.PS = {};
+    pipelineDesc.NumRenderTargets = 0;
+    pipelineDesc.RTVFormats[0] = DXGI_FORMAT_UNKNOWN;
+    depthPrepassPipelineState = device->createGraphicsPipelineState(pipelineDesc);
+
+    // Compute pipelines for GPU culling
+    readShader(L"cull_cs.cso", cullShader);
+    readShader(L"hiz_cs.cso", hizShader);
+    cullRootSignature = device->createRootSignature(0, cullShader.data(), cullShader.size());
+    hizRootSignature = device->createRootSignature(0, hizShader.data(), hizShader.size());
+
+    D3D12_COMPUTE_PIPELINE_STATE_DESC computePipelineDesc = {};
+    computePipelineDesc.pRootSignature = cullRootSignature.get();
+    computePipelineDesc.CS = { cullShader.data(), cullShader.size() };
+    cullPipelineState = device->createComputePipelineState(computePipelineDesc);
+
+    computePipelineDesc.pRootSignature = hizRootSignature.get();
+    computePipelineDesc.CS = { hizShader.data(), hizShader.size() };
+    hizPipelineState = device->createComputePipelineState(computePipelineDesc);
+
+    // Upscale of the dynamic resolution scene sub-rect, a fullscreen triangle without depth
+    readShader(L"upscale_vs.cso", upscaleVertexShader);
+    readShader(L"upscale_ps.cso", upscalePixelShader);
+    upscaleRootSignature = device->createRootSignature(0, upscaleVertexShader.data(), upscaleVertexShader.size());
+
+    pipelineDesc = fastdxu::defaultGraphicsPipelineDesc(kFrameFormat);
+    pipelineDesc.pRootSignature = upscaleRootSignature.get();
+    pipelineDesc.VS = { upscaleVertexShader.data(), upscaleVertexShader.size() };
+    pipelineDesc.PS = { upscalePixelShader.data(), upscalePixelShader.size() };
+    pipelineDesc.DepthStencilState.DepthEnable = FALSE;
+    pipelineDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+    upscalePipelineState = device->createGraphicsPipelineState(pipelineDesc);
+
+    // Frame begin and end timestamps, resolved to a readback buffer and read when the frame slot is reused
+    timestampQueryHeap = device->createQueryHeap(kFrameCount * 2, D3D12_QUERY_HEAP_TYPE_TIMESTAMP);
+    D3D12_HEAP_PROPERTIES readbackHeapProps = { D3D12_HEAP_TYPE_READBACK };
+    timestampReadbackBuffer = device->createCommittedResource(readbackHeapProps, D3D12_HEAP_FLAG_NONE,
+        fastdxu::resourceBufferDesc(kFrameCount * 2 * sizeof(uint64_t)), D3D12_RESOURCE_STATE_COPY_DEST, nullptr);
+    commandQueue->GetTimestampFrequency(&timestampFrequency);
+
+    dynres::ControllerDesc controllerDesc;
+    controllerDesc.latencyFrames = kFrameCount;
+    resolutionController.reset(controllerDesc);
 }
 
 void startCommandList() {
@@ -158,6 +430,13 @@ void executeCommandList() {
     commandQueue->ExecuteCommandLists(_countof(commandLists), commandLists);
 }
 
+/// Wait until everything submitted so far is done, for resizes and validation readbacks
+void waitGpuIdle() {
+    commandQueue->Signal(swapFence.get(), swapFenceCounter);
+    swapFence->SetEventOnCompletion(swapFenceCounter++, fenceEvent);
+    WaitForSingleObjectEx(fenceEvent, INFINITE, FALSE);
+}
+
 void waitGpu(bool forceWait = false) {
     // Queue always signal increasing counter values
     commandQueue->Signal(swapFence.get(), swapFenceCounter);
@@ -212,8 +491,9 @@ fastdx::ID3D12ResourcePtr createTextureBufferResource(const D3D12_RESOURCE_DESC&
 // TODO Allow non-GPU upload
 fastdx::ID3D12ResourcePtr createBufferResource(const void* dataPtr, int32_t sizeInBytes, D3D12_RESOURCE_STATES bufferState,
     D3D12_HEAP_TYPE heapType) {
-    // Create D3D12 resource used for CPU to GPU upload
-    D3D12_RESOURCE_DESC bufferDesc = fastdxu::resourceBufferDesc(sizeInBytes);
+    // Create D3D12 resource used for CPU to GPU upload. CreateCommittedResource rejects empty buffers, a scene without
+    // instances or draws still gets a small one so its views and root descriptors stay valid.
+    D3D12_RESOURCE_DESC bufferDesc = fastdxu::resourceBufferDesc(max(sizeInBytes, 16));
     D3D12_HEAP_PROPERTIES uploadHeapProps = { D3D12_HEAP_TYPE_UPLOAD };
     fastdx::ID3D12ResourcePtr cpuToGpuResource = device->createCommittedResource(uploadHeapProps,
         D3D12_HEAP_FLAG_NONE, bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr);
@@ -221,7 +501,9 @@ fastdx::ID3D12ResourcePtr createBufferResource(const void* dataPtr, int32_t size
     // Map and Upload data
     uint8_t* dataMapPtr = nullptr;
     cpuToGpuResource->Map(0, nullptr, reinterpret_cast<void**>(&dataMapPtr));
-    memcpy(dataMapPtr, dataPtr, sizeInBytes);
+    if (sizeInBytes > 0) {
+        memcpy(dataMapPtr, dataPtr, sizeInBytes);
+    }
     cpuToGpuResource->Unmap(0, nullptr);
 
     // CPU/GPU Managed Heap
@@ -250,16 +532,20 @@ fastdx::ID3D12ResourcePtr createBufferResource(const void* dataPtr, int32_t size
     }
 }
 
-void createSceneConstantBuffer() {
+/// Camera view projection for the back buffer aspect ratio, uploaded with the scene globals by update()
+void updateCameraProjection() {
     DirectX::XMFLOAT3 eye(0.0f, 5.0f, 10.0f);
     DirectX::XMFLOAT3 lookAt(0.0f, 0.0f, 0.0f);
     DirectX::XMFLOAT3 upVec(0.0f, 1.0f, 0.0f);
     auto matView = DirectX::XMMatrixLookAtLH(XMLoadFloat3(&eye), XMLoadFloat3(&lookAt), XMLoadFloat3(&upVec));
-    auto matProj = DirectX::XMMatrixPerspectiveFovLH(DirectX::XM_PI / 3.0f, windowProp.aspectRatio(), 0.1f, 1000.0f);
+    auto matProj = DirectX::XMMatrixPerspectiveFovLH(DirectX::XM_PI / 3.0f, windowProp.aspectRatio(), 0.1f, kCameraFarZ);
+    sceneGlobals.matVP = DirectX::XMMatrixTranspose(matView * matProj); // HLSL expects column-major
+}
 
+void createSceneConstantBuffer() {
     uint32_t cbSizeInBytes = sizeof(sceneGlobals);
     sceneGlobals.matW = DirectX::XMMatrixIdentity();
-    sceneGlobals.matVP = DirectX::XMMatrixTranspose(matView * matProj); // HLSL expects column-major
+    updateCameraProjection();
 
     // Create constant buffer resource and its view for shader
     for (int i = 0; i < kFrameCount; ++i) {
@@ -268,20 +554,264 @@ void createSceneConstantBuffer() {
     }
 }
 
-/// Return one VB/IB pair for each mesh part of each mesh
-void loadGltfModelMeshes(const tinygltf::Model& gltfModel, vector<fastdx::ID3D12ResourcePtr>& outVertexBuffers,
-    vector<fastdx::ID3D12ResourcePtr>& outIndexBuffers, vector<D3D12_INDEX_BUFFER_VIEW>& outIndexBuffersView) {
+DirectX::XMMATRIX getGltfNodeTransform(const tinygltf::Node& node) {
+    // Column-major glTF matrix is the transposed row-major DirectX matrix, so load it in order
+    if (node.matrix.size() == 16) {
+        DirectX::XMFLOAT4X4 matrix;
+        for (int32_t i = 0; i < 16; ++i) {
+            matrix.m[i / 4][i % 4] = static_cast<float>(node.matrix[i]);
+        }
+        return DirectX::XMLoadFloat4x4(&matrix);
+    }
 
-    vector<const tinygltf::Mesh*> meshes;
-    for (const auto &scene : gltfModel.scenes) {
-        for (auto sceneNodeId : scene.nodes) {
-            const auto &modelNode = gltfModel.nodes[sceneNodeId];
+    DirectX::XMMATRIX matS = DirectX::XMMatrixIdentity();
+    DirectX::XMMATRIX matR = DirectX::XMMatrixIdentity();
+    DirectX::XMMATRIX matT = DirectX::XMMatrixIdentity();
+    if (node.scale.size() == 3) {
+        matS = DirectX::XMMatrixScaling(static_cast<float>(node.scale[0]), static_cast<float>(node.scale[1]),
+            static_cast<float>(node.scale[2]));
+    }
+    if (node.rotation.size() == 4) {
+        DirectX::XMFLOAT4 quaternion(static_cast<float>(node.rotation[0]), static_cast<float>(node.rotation[1]),
+            static_cast<float>(node.rotation[2]), static_cast<float>(node.rotation[3]));
+        matR = DirectX::XMMatrixRotationQuaternion(DirectX::XMLoadFloat4(&quaternion));
+    }
+    if (node.translation.size() == 3) {
+        matT = DirectX::XMMatrixTranslation(static_cast<float>(node.translation[0]),
+            static_cast<float>(node.translation[1]), static_cast<float>(node.translation[2]));
+    }
+    return matS * matR * matT;
+}
+
+bool isGltfNodeOccluder(const tinygltf::Node& node) {
+    if (!node.extras.IsObject() || !node.extras.Has("occluder")) {
+        return false;
+    }
+    const auto& occluder = node.extras.Get("occluder");
+    return occluder.IsBool() && occluder.Get<bool>();
+}
+
+/// One element of componentCount components as floats, normalized integers mapped to [0, 1] or [-1, 1]
+void readGltfElement(const uint8_t* element, int32_t componentType, bool isNormalized, uint32_t componentCount,
+    float* outValues) {
+    for (uint32_t c = 0; c < componentCount; ++c) {
+        switch (componentType) {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            outValues[c] = reinterpret_cast<const float*>(element)[c];
+            break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            outValues[c] = element[c] * (isNormalized ? 1.0f / 255.0f : 1.0f);
+            break;
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+            outValues[c] = reinterpret_cast<const int8_t*>(element)[c];
+            outValues[c] = isNormalized ? max(outValues[c] / 127.0f, -1.0f) : outValues[c];
+            break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            outValues[c] = reinterpret_cast<const uint16_t*>(element)[c] * (isNormalized ? 1.0f / 65535.0f : 1.0f);
+            break;
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+            outValues[c] = reinterpret_cast<const int16_t*>(element)[c];
+            outValues[c] = isNormalized ? max(outValues[c] / 32767.0f, -1.0f) : outValues[c];
+            break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            outValues[c] = static_cast<float>(reinterpret_cast<const uint32_t*>(element)[c]);
+            break;
+        }
+    }
+}
+
+/// Accessor elements as floats, sparse elements applied over the buffer view or zeros, returns the components per
+/// element. Morph targets usually are sparse accessors without a buffer view.
+uint32_t readGltfAccessor(const tinygltf::Model& gltfModel, int32_t accessorId, vector<float>& outValues) {
+    const auto& accessor = gltfModel.accessors[accessorId];
+    uint32_t componentCount = static_cast<uint32_t>(tinygltf::GetNumComponentsInType(
+        static_cast<uint32_t>(accessor.type)));
+    outValues.assign(accessor.count * componentCount, 0.0f);
+
+    if (accessor.bufferView >= 0) {
+        const auto& bufferView = gltfModel.bufferViews[accessor.bufferView];
+        const uint8_t* dataPtr = gltfModel.buffers[bufferView.buffer].data.data() + bufferView.byteOffset +
+            accessor.byteOffset;
+        int32_t strideInBytes = accessor.ByteStride(bufferView);
+        for (size_t i = 0; i < accessor.count; ++i) {
+            readGltfElement(dataPtr + i * strideInBytes, accessor.componentType, accessor.normalized, componentCount,
+                &outValues[i * componentCount]);
+        }
+    }
+
+    if (accessor.sparse.isSparse) {
+        const auto& sparse = accessor.sparse;
+        const auto& indexView = gltfModel.bufferViews[sparse.indices.bufferView];
+        const auto& valueView = gltfModel.bufferViews[sparse.values.bufferView];
+        const uint8_t* indexPtr = gltfModel.buffers[indexView.buffer].data.data() + indexView.byteOffset +
+            sparse.indices.byteOffset;
+        const uint8_t* valuePtr = gltfModel.buffers[valueView.buffer].data.data() + valueView.byteOffset +
+            sparse.values.byteOffset;
+        size_t indexSize = tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(sparse.indices.componentType));
+        size_t valueSize = componentCount *
+            tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(accessor.componentType));
+        for (int32_t i = 0; i < sparse.count; ++i) {
+            float index;
+            readGltfElement(indexPtr + i * indexSize, sparse.indices.componentType, false, 1, &index);
+            size_t element = static_cast<size_t>(index);
+            if (element < accessor.count) {
+                readGltfElement(valuePtr + i * valueSize, accessor.componentType, accessor.normalized,
+                    componentCount, &outValues[element * componentCount]);
+            }
+        }
+    }
+    return componentCount;
+}
+
+/// Keys of an animation sampler, valuesPerKey floats each. Cubic spline keys are in-tangent, value and out-tangent
+/// triplets, only the values are kept and sampled linearly. Returns the key count.
+uint32_t readGltfSamplerKeys(const tinygltf::Model& gltfModel, const tinygltf::AnimationSampler& sampler,
+    uint32_t valuesPerKey, vector<float>& outTimes, vector<float>& outValues) {
+    readGltfAccessor(gltfModel, sampler.input, outTimes);
+    readGltfAccessor(gltfModel, sampler.output, outValues);
+    uint32_t keyCount = static_cast<uint32_t>(outTimes.size());
+    if (sampler.interpolation == "CUBICSPLINE") {
+        for (uint32_t i = 0; i < keyCount && (i * 3 + 2) * valuesPerKey <= outValues.size(); ++i) {
+            memmove(&outValues[i * valuesPerKey], &outValues[(i * 3 + 1) * valuesPerKey],
+                valuesPerKey * sizeof(float));
+        }
+    }
+    return min(keyCount, static_cast<uint32_t>(outValues.size() / max(valuesPerKey, 1u)));
+}
+
+/// Walk node hierarchy depth first, adding nodes parents first and appending each to its mesh instance list
+void traverseGltfNodes(const tinygltf::Model& gltfModel, int32_t nodeId, int32_t parentNode,
+    transforms::TransformHierarchy& hierarchy, vector<vector<uint32_t>>& outMeshToNodes,
+    vector<vector<uint32_t>>& outMeshToOccluderNodes) {
+
+    const auto& modelNode = gltfModel.nodes[nodeId];
+    DirectX::XMFLOAT4X4 localTransform;
+    DirectX::XMStoreFloat4x4(&localTransform, getGltfNodeTransform(modelNode));
+    uint32_t node = hierarchy.addNode(parentNode, &localTransform.m[0][0]);
+
+    if (modelNode.mesh >= 0) {
+        outMeshToNodes[modelNode.mesh].push_back(node);
+        if (isGltfNodeOccluder(modelNode)) {
+            outMeshToOccluderNodes[modelNode.mesh].push_back(node);
+        }
+    }
 
-            if (modelNode.mesh >= 0) {
-                auto modelMeshId = modelNode.mesh;
-                const auto& modelMesh = gltfModel.meshes[modelMeshId];
-                meshes.push_back(&modelMesh);
+    for (auto childNodeId : modelNode.children) {
+        traverseGltfNodes(gltfModel, childNodeId, static_cast<int32_t>(node), hierarchy, outMeshToNodes,
+            outMeshToOccluderNodes);
+    }
+}
+
+void computeClusterBounds(const uint8_t* vbDataPtr, int32_t vbStrideInBytes, const uint16_t* indices,
+    uint32_t indexCount, float outBoundsMin[3], float outBoundsMax[3]) {
+    for (int32_t i = 0; i < 3; ++i) {
+        outBoundsMin[i] = FLT_MAX;
+        outBoundsMax[i] = -FLT_MAX;
+    }
+    for (uint32_t i = 0; i < indexCount; ++i) {
+        const float* position = reinterpret_cast<const float*>(vbDataPtr + indices[i] * vbStrideInBytes);
+        for (int32_t j = 0; j < 3; ++j) {
+            outBoundsMin[j] = min(outBoundsMin[j], position[j]);
+            outBoundsMax[j] = max(outBoundsMax[j], position[j]);
+        }
+    }
+}
+
+/// Vertices rewritten on CPU, by morph targets, skinning or both
+bool isDeformedPrimitive(const GltfPrimitive& primitive) {
+    return primitive.morphTargets.targetCount() > 0 || !primitive.skinJoints.empty();
+}
+
+/// Default weights of the mesh morph targets and the first animation of the weights of a node using it. Instances of
+/// a mesh share its morphed vertex buffers, so they all take the weights of the first of its nodes that has some,
+/// and per node weights of the others are ignored. Bounds grow by what the weights can move the vertices.
+void loadGltfMorphWeights(const tinygltf::Model& gltfModel, int32_t meshId, GltfMesh& outMesh) {
+    uint32_t targetCount = 0;
+    for (const auto& primitive : outMesh.primitives) {
+        targetCount = max(targetCount, primitive.morphTargets.targetCount());
+    }
+    if (targetCount == 0) {
+        return;
+    }
+    // Node weights replace the mesh ones
+    const vector<double>* defaultWeights = &gltfModel.meshes[meshId].weights;
+    for (const auto& modelNode : gltfModel.nodes) {
+        if (modelNode.mesh == meshId && !modelNode.weights.empty()) {
+            defaultWeights = &modelNode.weights;
+            break;
+        }
+    }
+    outMesh.morphWeights.assign(targetCount, 0.0f);
+    for (uint32_t i = 0; i < min(targetCount, static_cast<uint32_t>(defaultWeights->size())); ++i) {
+        outMesh.morphWeights[i] = static_cast<float>((*defaultWeights)[i]);
+    }
+    // Vertex buffers hold the base mesh, the first drawn frame writes it morphed by these weights
+    outMesh.isMorphDirty = true;
+
+    for (const auto& gltfAnimation : gltfModel.animations) {
+        if (!outMesh.morphAnimation.times.empty()) {
+            break;
+        }
+        for (const auto& channel : gltfAnimation.channels) {
+            if (channel.target_path != "weights" || channel.target_node < 0 ||
+                gltfModel.nodes[channel.target_node].mesh != meshId) {
+                continue;
             }
+            const auto& sampler = gltfAnimation.samplers[channel.sampler];
+            morph::WeightTrack& track = outMesh.morphAnimation;
+            track.targetCount = targetCount;
+            track.isStep = sampler.interpolation == "STEP";
+            uint32_t keyCount = readGltfSamplerKeys(gltfModel, sampler, targetCount, track.times, track.weights);
+            track.times.resize(keyCount);
+            track.weights.resize(size_t(keyCount) * targetCount);
+            break;
+        }
+    }
+
+    // Sampled weights interpolate between keys, so the default weights and the keys bound them
+    vector<float> maxAbsWeights(targetCount);
+    for (uint32_t i = 0; i < targetCount; ++i) {
+        maxAbsWeights[i] = fabsf(outMesh.morphWeights[i]);
+    }
+    for (size_t i = 0; i < outMesh.morphAnimation.weights.size(); ++i) {
+        maxAbsWeights[i % targetCount] = max(maxAbsWeights[i % targetCount], fabsf(outMesh.morphAnimation.weights[i]));
+    }
+    for (auto& primitive : outMesh.primitives) {
+        float extent[3];
+        primitive.morphTargets.positionExtent(maxAbsWeights.data(), extent);
+        auto grow = [&extent](float* boundsMin, float* boundsMax) {
+            for (int32_t i = 0; i < 3; ++i) {
+                boundsMin[i] -= extent[i];
+                boundsMax[i] += extent[i];
+            }
+        };
+        grow(primitive.boundsMin, primitive.boundsMax);
+        for (auto& cluster : primitive.clusters) {
+            grow(cluster.boundsMin, cluster.boundsMax);
+            for (int32_t i = 0; i < 3; ++i) {
+                outMesh.boundsMin[i] = min(outMesh.boundsMin[i], cluster.boundsMin[i]);
+                outMesh.boundsMax[i] = max(outMesh.boundsMax[i], cluster.boundsMax[i]);
+            }
+        }
+    }
+}
+
+/// Return one VB/IB pair for each mesh part of each instanced mesh, all instances nodes grouped by mesh and occluders
+void loadGltfModelMeshes(const tinygltf::Model& gltfModel, int32_t parentNode, transforms::TransformHierarchy& hierarchy,
+    vector<GltfMesh>& outMeshes, vector<uint32_t>& outInstanceNodes, vector<GltfOccluder>& outOccluders) {
+
+    vector<vector<uint32_t>> meshToInstances(gltfModel.meshes.size());
+    vector<vector<uint32_t>> meshToOccluders(gltfModel.meshes.size());
+    vector<int32_t> meshToSkin(gltfModel.meshes.size(), -1);
+    for (const auto& modelNode : gltfModel.nodes) {
+        if (modelNode.mesh >= 0 && modelNode.skin >= 0) {
+            meshToSkin[modelNode.mesh] = modelNode.skin;
+        }
+    }
+    if (!gltfModel.scenes.empty()) {
+        const auto& scene = gltfModel.scenes[max(gltfModel.defaultScene, 0)];
+        for (auto sceneNodeId : scene.nodes) {
+            traverseGltfNodes(gltfModel, sceneNodeId, parentNode, hierarchy, meshToInstances, meshToOccluders);
         }
     }
 
@@ -289,14 +819,50 @@ void loadGltfModelMeshes(const tinygltf::Model& gltfModel, vector<fastdx::ID3D12
     int32_t vbStrideInBytes = (3 + 3 + 2) * sizeof(float);
     int32_t ibStrideInBytes = sizeof(uint16_t);
 
-    for (const auto* mesh : meshes) {
+    for (int32_t meshId = 0; meshId < gltfModel.meshes.size(); ++meshId) {
+        // Upload each mesh once, no matter how many nodes reference it
+        auto& meshInstances = meshToInstances[meshId];
+        if (meshInstances.empty()) {
+            continue;
+        }
+
+        GltfMesh outMesh = {};
+        outMesh.instanceOffset = static_cast<uint32_t>(outInstanceNodes.size());
+        outMesh.instanceCount = static_cast<uint32_t>(meshInstances.size());
+        outMesh.skinId = meshToSkin[meshId];
+        for (int32_t i = 0; i < 3; ++i) {
+            outMesh.boundsMin[i] = FLT_MAX;
+            outMesh.boundsMax[i] = -FLT_MAX;
+        }
+        outInstanceNodes.insert(outInstanceNodes.end(), meshInstances.begin(), meshInstances.end());
+        for (auto occluderNode : meshToOccluders[meshId]) {
+            outOccluders.push_back({ occluderNode, static_cast<uint32_t>(outMeshes.size()) });
+        }
+
         // Each meshParh must have a VB/IB pair
-        for (auto meshPart : mesh->primitives) {
+        for (const auto& meshPart : gltfModel.meshes[meshId].primitives) {
             uint8_t* vbDataPtr = nullptr;
             int32_t vbNumElements = 0;
+            GltfPrimitive outPrimitive = {};
+            bool hasPositionBounds = false;
 
             for (const auto& attrib : meshPart.attributes) {
                 auto attribName = attrib.first;
+                if (outMesh.skinId >= 0 && (attribName == "JOINTS_0" || attribName == "WEIGHTS_0")) {
+                    vector<float> skinValues;
+                    uint32_t componentCount = readGltfAccessor(gltfModel, attrib.second, skinValues);
+                    assert(componentCount == 4);
+                    if (attribName == "JOINTS_0") {
+                        outPrimitive.skinJoints.resize(skinValues.size());
+                        for (size_t i = 0; i < skinValues.size(); ++i) {
+                            outPrimitive.skinJoints[i] = static_cast<uint16_t>(skinValues[i]);
+                        }
+                    }
+                    else {
+                        outPrimitive.skinWeights = std::move(skinValues);
+                    }
+                    continue;
+                }
                 if (attribName != "POSITION" && attribName != "NORMAL" && attribName != "TEXCOORD_0") {
                     continue;
                 }
@@ -318,6 +884,15 @@ void loadGltfModelMeshes(const tinygltf::Model& gltfModel, vector<fastdx::ID3D12
                     assert(vbNumElements == attribAccessor.count);
                 }
 
+                if (attribName == "POSITION" && attribAccessor.minValues.size() == 3 &&
+                    attribAccessor.maxValues.size() == 3) {
+                    for (int32_t i = 0; i < 3; ++i) {
+                        outPrimitive.boundsMin[i] = static_cast<float>(attribAccessor.minValues[i]);
+                        outPrimitive.boundsMax[i] = static_cast<float>(attribAccessor.maxValues[i]);
+                    }
+                    hasPositionBounds = true;
+                }
+
                 uint8_t* vbCopyToPtr = vbDataPtr;
                 if (attribName == "NORMAL") {
                     vbCopyToPtr += 3 * sizeof(float); // skip position
@@ -342,26 +917,583 @@ void loadGltfModelMeshes(const tinygltf::Model& gltfModel, vector<fastdx::ID3D12
 
             int32_t vbSizeInBytes = vbNumElements * vbStrideInBytes;
             int32_t ibSizeInBytes = ibNumElements * ibStrideInBytes;
-            auto vertexBuffer = createBufferResource(vbDataPtr, vbSizeInBytes,
+
+            outPrimitive.vertexBuffer = createBufferResource(vbDataPtr, vbSizeInBytes,
                 D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_HEAP_TYPE_DEFAULT);
-            auto indexBuffer = createBufferResource(ibDataPtr, ibSizeInBytes, D3D12_RESOURCE_STATE_INDEX_BUFFER,
+            outPrimitive.indexBuffer = createBufferResource(ibDataPtr, ibSizeInBytes, D3D12_RESOURCE_STATE_INDEX_BUFFER,
                 D3D12_HEAP_TYPE_DEFAULT);
-            auto indexBufferView = fastdxu::indexBufferView(indexBuffer->GetGPUVirtualAddress(),
+            outPrimitive.indexBufferView = fastdxu::indexBufferView(outPrimitive.indexBuffer->GetGPUVirtualAddress(),
                 ibNumElements * ibStrideInBytes, DXGI_FORMAT_R16_UINT);
+            outPrimitive.indexCount = static_cast<uint32_t>(ibNumElements);
+            // Primitives without a material use the default slot after the glTF materials
+            outPrimitive.materialId = meshPart.material >= 0 ? meshPart.material :
+                static_cast<int32_t>(gltfModel.materials.size());
+
+            // Split mesh part in clusters of triangles, each with its own bounds for culling
+            for (int32_t startIndex = 0; startIndex < ibNumElements; startIndex += kClusterIndexCount) {
+                culling::ClusterCullData cluster = {};
+                cluster.startIndex = static_cast<uint32_t>(startIndex);
+                cluster.indexCount = static_cast<uint32_t>(min(kClusterIndexCount, ibNumElements - startIndex));
+                computeClusterBounds(vbDataPtr, vbStrideInBytes, reinterpret_cast<const uint16_t*>(ibDataPtr) + startIndex,
+                    cluster.indexCount, cluster.boundsMin, cluster.boundsMax);
+
+                for (int32_t i = 0; i < 3; ++i) {
+                    outMesh.boundsMin[i] = min(outMesh.boundsMin[i], cluster.boundsMin[i]);
+                    outMesh.boundsMax[i] = max(outMesh.boundsMax[i], cluster.boundsMax[i]);
+                }
+                outPrimitive.clusters.push_back(cluster);
+            }
+
+            // min/max are required by glTF for POSITION, but fallback to clusters bounds if missing
+            if (!hasPositionBounds) {
+                for (int32_t i = 0; i < 3; ++i) {
+                    outPrimitive.boundsMin[i] = FLT_MAX;
+                    outPrimitive.boundsMax[i] = -FLT_MAX;
+                }
+                for (const auto& cluster : outPrimitive.clusters) {
+                    for (int32_t i = 0; i < 3; ++i) {
+                        outPrimitive.boundsMin[i] = min(outPrimitive.boundsMin[i], cluster.boundsMin[i]);
+                        outPrimitive.boundsMax[i] = max(outPrimitive.boundsMax[i], cluster.boundsMax[i]);
+                    }
+                }
+            }
+
+            // Positions only, for the depth prepass stream
+            vector<float> positions(vbNumElements * 3);
+            for (int32_t i = 0; i < vbNumElements; ++i) {
+                memcpy(&positions[i * 3], vbDataPtr + i * vbStrideInBytes, 3 * sizeof(float));
+            }
+            outPrimitive.positionBuffer = createBufferResource(positions.data(),
+                static_cast<int32_t>(positions.size() * sizeof(float)), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
+                D3D12_HEAP_TYPE_DEFAULT);
+
+            // Skinning needs both attributes for every vertex, without them the primitive stays rigid
+            if (outPrimitive.skinJoints.size() != size_t(vbNumElements) * 4 ||
+                outPrimitive.skinWeights.size() != size_t(vbNumElements) * 4) {
+                outPrimitive.skinJoints.clear();
+                outPrimitive.skinWeights.clear();
+            }
+
+            // Morph targets keep only the vertices they move, applied on CPU over the base positions and normals.
+            // Skinned primitives keep the same base streams, the skinned ones are written next to them.
+            if (!meshPart.targets.empty() || !outPrimitive.skinJoints.empty()) {
+                outPrimitive.morphTargets.vertexCount = static_cast<uint32_t>(vbNumElements);
+                outPrimitive.morphBasePositions = positions;
+                outPrimitive.morphBaseNormals.resize(vbNumElements * 3);
+                outPrimitive.morphUvs.resize(vbNumElements * 2);
+                for (int32_t i = 0; i < vbNumElements; ++i) {
+                    memcpy(&outPrimitive.morphBaseNormals[i * 3], vbDataPtr + i * vbStrideInBytes + 3 * sizeof(float),
+                        3 * sizeof(float));
+                    memcpy(&outPrimitive.morphUvs[i * 2], vbDataPtr + i * vbStrideInBytes + 6 * sizeof(float),
+                        2 * sizeof(float));
+                }
+                vector<float> positionDeltas, normalDeltas;
+                for (const auto& target : meshPart.targets) {
+                    auto positionTarget = target.find("POSITION");
+                    auto normalTarget = target.find("NORMAL");
+                    positionDeltas.clear();
+                    normalDeltas.clear();
+                    if (positionTarget != target.end()) {
+                        readGltfAccessor(gltfModel, positionTarget->second, positionDeltas);
+                    }
+                    if (normalTarget != target.end()) {
+                        readGltfAccessor(gltfModel, normalTarget->second, normalDeltas);
+                    }
+                    // Missing attributes do not move, accessors of another vertex count are padded or cut
+                    positionDeltas.resize(vbNumElements * 3, 0.0f);
+                    normalDeltas.resize(vbNumElements * 3, 0.0f);
+                    outPrimitive.morphTargets.addTarget(positionDeltas.data(), normalDeltas.data(),
+                        kMorphDeltaThreshold);
+                }
+                outPrimitive.morphedPositions = outPrimitive.morphBasePositions;
+                outPrimitive.morphedNormals = outPrimitive.morphBaseNormals;
+                if (!outPrimitive.skinJoints.empty()) {
+                    outPrimitive.skinnedPositions = outPrimitive.morphBasePositions;
+                    outPrimitive.skinnedNormals = outPrimitive.morphBaseNormals;
+                }
+            }
+
+            // Occluders are also rasterized on CPU, keep their positions
+            if (!meshToOccluders[meshId].empty()) {
+                outPrimitive.occluderPositions = std::move(positions);
+                outPrimitive.occluderIndices.assign(reinterpret_cast<const uint16_t*>(ibDataPtr),
+                    reinterpret_cast<const uint16_t*>(ibDataPtr) + ibNumElements);
+            }
 
             SAFE_FREE(vbDataPtr);
             SAFE_FREE(ibDataPtr);
 
-            outVertexBuffers.push_back(vertexBuffer);
-            outIndexBuffers.push_back(indexBuffer);
-            outIndexBuffersView.push_back(indexBufferView);
+            outMesh.primitives.push_back(std::move(outPrimitive));
+        }
+        loadGltfMorphWeights(gltfModel, meshId, outMesh);
+        outMeshes.push_back(std::move(outMesh));
+    }
+}
+
+/// Skeleton of each skin and one clip per animation moving its joints. Root joints are posed in skin space, their
+/// ancestors outside the skin being the transform of the character.
+void loadGltfSkins(const tinygltf::Model& gltfModel, vector<GltfSkin>& outSkins) {
+    vector<int32_t> nodeParents(gltfModel.nodes.size(), -1);
+    for (size_t i = 0; i < gltfModel.nodes.size(); ++i) {
+        for (auto childNodeId : gltfModel.nodes[i].children) {
+            nodeParents[childNodeId] = static_cast<int32_t>(i);
+        }
+    }
+
+    vector<float> inverseBind, times, values;
+    for (const auto& skin : gltfModel.skins) {
+        GltfSkin outSkin;
+        animation::Skeleton& skeleton = outSkin.skeleton;
+        uint32_t jointCount = static_cast<uint32_t>(skin.joints.size());
+        vector<int32_t> nodeToJoint(gltfModel.nodes.size(), -1);
+        for (uint32_t joint = 0; joint < jointCount; ++joint) {
+            nodeToJoint[skin.joints[joint]] = static_cast<int32_t>(joint);
+        }
+
+        inverseBind.clear();
+        if (skin.inverseBindMatrices >= 0) {
+            readGltfAccessor(gltfModel, skin.inverseBindMatrices, inverseBind);
+        }
+        for (uint32_t joint = 0; joint < jointCount; ++joint) {
+            // Nearest ancestor in the skin is the parent joint
+            int32_t node = skin.joints[joint];
+            int32_t parentNode = nodeParents[node];
+            while (parentNode >= 0 && nodeToJoint[parentNode] < 0) {
+                parentNode = nodeParents[parentNode];
+            }
+            skeleton.parents.push_back(parentNode >= 0 ? nodeToJoint[parentNode] : -1);
+
+            // Rest pose of joints no channel animates, decomposed so matrix nodes work too
+            DirectX::XMVECTOR scale, rotation, translation;
+            DirectX::XMMatrixDecompose(&scale, &rotation, &translation, getGltfNodeTransform(gltfModel.nodes[node]));
+            animation::JointPose pose;
+            DirectX::XMStoreFloat4(reinterpret_cast<DirectX::XMFLOAT4*>(pose.rotation), rotation);
+            DirectX::XMStoreFloat3(reinterpret_cast<DirectX::XMFLOAT3*>(pose.translation), translation);
+            DirectX::XMStoreFloat3(reinterpret_cast<DirectX::XMFLOAT3*>(pose.scale), scale);
+            skeleton.restPose.push_back(pose);
+
+            // Column-major glTF matrix, the palette keeps its first three rows
+            bool hasInverseBind = inverseBind.size() >= (joint + 1) * 16;
+            for (int32_t r = 0; r < 3; ++r) {
+                for (int32_t c = 0; c < 4; ++c) {
+                    skeleton.inverseBind.push_back(hasInverseBind ? inverseBind[joint * 16 + c * 4 + r] :
+                        (r == c ? 1.0f : 0.0f));
+                }
+            }
+        }
+        skeleton.computeOrder();
+
+        for (const auto& gltfAnimation : gltfModel.animations) {
+            animation::Clip clip;
+            for (const auto& channel : gltfAnimation.channels) {
+                if (channel.target_node < 0 || nodeToJoint[channel.target_node] < 0) {
+                    continue;
+                }
+                animation::Path path;
+                if (channel.target_path == "rotation") {
+                    path = animation::Path::Rotation;
+                }
+                else if (channel.target_path == "translation") {
+                    path = animation::Path::Translation;
+                }
+                else if (channel.target_path == "scale") {
+                    path = animation::Path::Scale;
+                }
+                else {
+                    continue;
+                }
+
+                const auto& sampler = gltfAnimation.samplers[channel.sampler];
+                uint32_t keyCount = readGltfSamplerKeys(gltfModel, sampler, path == animation::Path::Rotation ? 4 : 3,
+                    times, values);
+                animation::Interpolation interpolation = sampler.interpolation == "STEP" ?
+                    animation::Interpolation::Step : animation::Interpolation::Linear;
+                clip.addTrack(static_cast<uint32_t>(nodeToJoint[channel.target_node]), path, interpolation,
+                    times.data(), values.data(), keyCount);
+            }
+            if (!clip.tracks.empty()) {
+                clip.finalize();
+                outSkin.clips.push_back(animation::compressClip(clip, animation::CompressionSettings()));
+            }
+        }
+
+        if (!outSkin.clips.empty()) {
+            outSkin.instances.add(outSkin.clips, 0, 0.0f);
+        }
+        outSkin.palettes.resize(jointCount * 12);
+        animation::computePalettes(skeleton, skeleton.restPose.data(), outSkin.palettes.data());
+        outSkins.push_back(std::move(outSkin));
+    }
+}
+
+/// Clamp the joints of skinned primitives to their skeleton and bound them by their base vertices skinned at the rest
+/// pose and kSkinBoundsSampleCount times of the played clip. Morph growth of the bounds is kept as a margin on every
+/// axis, as the joints rotate it. Instances keep their node transform, so the skeleton is expected under the same
+/// parent as the skinned node, as exporters write it.
+void loadGltfSkinnedBounds(vector<GltfMesh>& meshes, const vector<GltfSkin>& skins) {
+    for (auto& mesh : meshes) {
+        if (mesh.skinId < 0 || mesh.skinId >= static_cast<int32_t>(skins.size())) {
+            continue;
+        }
+        const GltfSkin& skin = skins[mesh.skinId];
+        vector<float> margins(mesh.primitives.size(), 0.0f);
+        for (size_t p = 0; p < mesh.primitives.size(); ++p) {
+            GltfPrimitive& primitive = mesh.primitives[p];
+            if (primitive.skinJoints.empty()) {
+                continue;
+            }
+            for (auto& joint : primitive.skinJoints) {
+                joint = static_cast<uint16_t>(min(static_cast<uint32_t>(joint), skin.skeleton.jointCount() - 1));
+            }
+            float baseMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+            float baseMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            for (size_t i = 0; i < primitive.morphBasePositions.size(); ++i) {
+                baseMin[i % 3] = min(baseMin[i % 3], primitive.morphBasePositions[i]);
+                baseMax[i % 3] = max(baseMax[i % 3], primitive.morphBasePositions[i]);
+            }
+            for (int32_t i = 0; i < 3; ++i) {
+                float morphGrowth = max(baseMin[i] - primitive.boundsMin[i], primitive.boundsMax[i] - baseMax[i]);
+                margins[p] = max(margins[p], morphGrowth);
+                primitive.boundsMin[i] = FLT_MAX;
+                primitive.boundsMax[i] = -FLT_MAX;
+            }
+        }
+
+        // Rest pose first, then evenly spaced times of the clip the skin plays
+        vector<float> palettes(skin.palettes);
+        animation::Instances instances;
+        if (!skin.clips.empty()) {
+            instances.add(skin.clips, 0, 0.0f);
+        }
+        uint32_t sampleCount = instances.size() > 0 ? kSkinBoundsSampleCount + 1 : 1;
+        for (uint32_t sample = 0; sample < sampleCount; ++sample) {
+            if (sample > 0) {
+                float deltaTime = sample == 1 ? 0.0f : skin.clips[0].duration / kSkinBoundsSampleCount;
+                animation::evaluateInstances(skin.skeleton, skin.clips, instances, deltaTime, nullptr,
+                    palettes.data(), 1);
+            }
+            for (auto& primitive : mesh.primitives) {
+                if (primitive.skinJoints.empty()) {
+                    continue;
+                }
+                animation::skinVertices(palettes.data(), primitive.skinJoints.data(), primitive.skinWeights.data(),
+                    primitive.morphTargets.vertexCount, primitive.morphBasePositions.data(), nullptr,
+                    primitive.skinnedPositions.data(), nullptr);
+                for (size_t i = 0; i < primitive.skinnedPositions.size(); ++i) {
+                    primitive.boundsMin[i % 3] = min(primitive.boundsMin[i % 3], primitive.skinnedPositions[i]);
+                    primitive.boundsMax[i % 3] = max(primitive.boundsMax[i % 3], primitive.skinnedPositions[i]);
+                }
+            }
+        }
+
+        // Clusters move with their joints, each takes the bounds of its whole primitive
+        for (size_t p = 0; p < mesh.primitives.size(); ++p) {
+            GltfPrimitive& primitive = mesh.primitives[p];
+            if (primitive.skinJoints.empty()) {
+                continue;
+            }
+            for (int32_t i = 0; i < 3; ++i) {
+                primitive.boundsMin[i] -= margins[p];
+                primitive.boundsMax[i] += margins[p];
+                mesh.boundsMin[i] = min(mesh.boundsMin[i], primitive.boundsMin[i]);
+                mesh.boundsMax[i] = max(mesh.boundsMax[i], primitive.boundsMax[i]);
+            }
+            for (auto& cluster : primitive.clusters) {
+                memcpy(cluster.boundsMin, primitive.boundsMin, sizeof(cluster.boundsMin));
+                memcpy(cluster.boundsMax, primitive.boundsMax, sizeof(cluster.boundsMax));
+            }
+            // Vertex buffers hold the bind pose, the first drawn frame writes them skinned
+            mesh.isMorphDirty = true;
+        }
+    }
+}
+
+/// One upload buffer per frame in flight, kept mapped so transform updates write straight into them
+void createInstanceBuffers(uint32_t instanceCount) {
+    // At least one element, a scene without instances still binds a valid buffer
+    vector<DirectX::XMFLOAT4X4> emptyTransforms(max(instanceCount, 1u));
+    int32_t instanceBufferSizeInBytes = static_cast<int32_t>(emptyTransforms.size() * sizeof(DirectX::XMFLOAT4X4));
+    for (int32_t i = 0; i < kFrameCount; ++i) {
+        gltfInstanceBuffers[i] = createBufferResource(emptyTransforms.data(), instanceBufferSizeInBytes,
+            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_HEAP_TYPE_UPLOAD);
+        gltfInstanceBuffers[i]->Map(0, nullptr, reinterpret_cast<void**>(&gltfInstanceBufferPtrs[i]));
+    }
+    sceneTransforms.bufferCount = kFrameCount;
+}
+
+/// One upload buffer per frame in flight for the morphed and skinned meshes, interleaved vertices then positions per
+/// primitive
+void createMorphUploadBuffers(vector<GltfMesh>& meshes) {
+    uint32_t uploadSizeInBytes = 0;
+    for (auto& mesh : meshes) {
+        for (auto& primitive : mesh.primitives) {
+            primitive.morphUploadOffset = uploadSizeInBytes;
+            uploadSizeInBytes += isDeformedPrimitive(primitive) ?
+                primitive.morphTargets.vertexCount * (3 + 3 + 2 + 3) * sizeof(float) : 0;
+        }
+    }
+    if (uploadSizeInBytes == 0) {
+        return;
+    }
+    vector<uint8_t> emptyVertices(uploadSizeInBytes);
+    for (int32_t i = 0; i < kFrameCount; ++i) {
+        gltfMorphUploadBuffers[i] = createBufferResource(emptyVertices.data(), static_cast<int32_t>(uploadSizeInBytes),
+            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_HEAP_TYPE_UPLOAD);
+        gltfMorphUploadBuffers[i]->Map(0, nullptr, reinterpret_cast<void**>(&gltfMorphUploadBufferPtrs[i]));
+    }
+}
+
+/// Fill one indirect command per mesh part, matching the root parameters set by the direct path
+void createDrawArgumentsBuffers(const vector<GltfMesh>& meshes, const vector<uint32_t>& materialTextureOffsets,
+    fastdx::ID3D12ResourcePtr* outDrawArgumentsBuffer, fastdx::ID3D12ResourcePtr* outDrawCountBuffer,
+    uint32_t* outDrawCount) {
+
+    vector<GltfDrawArguments> drawArguments;
+    for (const auto& mesh : meshes) {
+        for (const auto& meshPart : mesh.primitives) {
+            GltfDrawArguments arguments = {};
+            arguments.instanceOffset = mesh.instanceOffset;
+            arguments.materialTextureOffset = materialTextureOffsets[meshPart.materialId];
+            arguments.vertexBuffer = meshPart.vertexBuffer->GetGPUVirtualAddress();
+            arguments.indexBufferView = meshPart.indexBufferView;
+            arguments.drawIndexed = { meshPart.indexCount, mesh.instanceCount, 0, 0, 0 };
+            drawArguments.push_back(arguments);
+        }
+    }
+
+    // Also read by cull_cs as draw templates
+    gpuCullingValidation.drawTemplates = drawArguments;
+    uint32_t drawCount = static_cast<uint32_t>(drawArguments.size());
+    *outDrawArgumentsBuffer = createBufferResource(drawArguments.data(),
+        static_cast<int32_t>(drawCount * sizeof(GltfDrawArguments)),
+        D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_HEAP_TYPE_DEFAULT);
+    *outDrawCountBuffer = createBufferResource(&drawCount, sizeof(drawCount), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+        D3D12_HEAP_TYPE_DEFAULT);
+    *outDrawCount = drawCount;
+}
+
+void createCommandSignature() {
+    // Must match GltfDrawArguments layout
+    D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[4] = {};
+    argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+    argumentDescs[0].Constant = { 3, 0, 2 };
+    argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+    argumentDescs[1].ShaderResourceView.RootParameterIndex = 1;
+    argumentDescs[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+    argumentDescs[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+    D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = fastdxu::commandSignatureDesc(sizeof(GltfDrawArguments),
+        argumentDescs, _countof(argumentDescs));
+    gltfCommandSignature = device->createCommandSignature(commandSignatureDesc, pipelineRootSignature);
+}
+
+/// Hi-Z pyramid whose mip 0 matches the depth buffer size, with the views of depth and every mip
+void createHiZResources() {
+    D3D12_HEAP_PROPERTIES defaultHeapProps = { D3D12_HEAP_TYPE_DEFAULT };
+    D3D12_RESOURCE_DESC depthDesc = depthStencilTarget->GetDesc();
+    hizMipCount = culling::hizMipCount(static_cast<uint32_t>(depthDesc.Width), depthDesc.Height);
+    D3D12_RESOURCE_DESC hizDesc = fastdxu::resourceTexDesc(D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+        static_cast<uint32_t>(depthDesc.Width), depthDesc.Height, 1, DXGI_FORMAT_R32_FLOAT,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    hizDesc.MipLevels = static_cast<uint16_t>(hizMipCount);
+    hizTarget = device->createCommittedResource(defaultHeapProps, D3D12_HEAP_FLAG_NONE, hizDesc,
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr);
+
+    cullingViewHeap = device->createDescriptorHeap(2 + hizMipCount * 2, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    size_t descriptorSizeInBytes = device->getDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = cullingViewHeap->GetCPUDescriptorHandleForHeapStart();
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC depthViewDesc = fastdxu::shaderResourceViewDesc(
+        D3D12_SRV_DIMENSION_TEXTURE2D, DXGI_FORMAT_R32_FLOAT);
+    depthViewDesc.Texture2D.MipLevels = 1;
+    device->createShaderResourceView(depthStencilTarget, depthViewDesc, cpuHandle);
+    cpuHandle.ptr += descriptorSizeInBytes;
+
+    for (uint32_t mip = 0; mip < hizMipCount; ++mip) {
+        D3D12_SHADER_RESOURCE_VIEW_DESC hizMipViewDesc = fastdxu::shaderResourceViewDesc(
+            D3D12_SRV_DIMENSION_TEXTURE2D, DXGI_FORMAT_R32_FLOAT);
+        hizMipViewDesc.Texture2D.MostDetailedMip = mip;
+        hizMipViewDesc.Texture2D.MipLevels = 1;
+        device->createShaderResourceView(hizTarget, hizMipViewDesc, cpuHandle);
+        cpuHandle.ptr += descriptorSizeInBytes;
+    }
+    for (uint32_t mip = 0; mip < hizMipCount; ++mip) {
+        D3D12_UNORDERED_ACCESS_VIEW_DESC hizMipUavDesc = fastdxu::unorderedAccessViewDesc(
+            D3D12_UAV_DIMENSION_TEXTURE2D, DXGI_FORMAT_R32_FLOAT);
+        hizMipUavDesc.Texture2D.MipSlice = mip;
+        device->createUnorderedAccessView(hizTarget, nullptr, hizMipUavDesc, cpuHandle);
+        cpuHandle.ptr += descriptorSizeInBytes;
+    }
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC hizViewDesc = fastdxu::shaderResourceViewDesc(
+        D3D12_SRV_DIMENSION_TEXTURE2D, DXGI_FORMAT_R32_FLOAT);
+    hizViewDesc.Texture2D.MipLevels = hizMipCount;
+    device->createShaderResourceView(hizTarget, hizViewDesc, cpuHandle);
+}
+
+/// Upload meshes and clusters bounds, then allocate culled draws output and previous frame Hi-Z pyramid
+void createCullingResources(const vector<GltfMesh>& meshes) {
+    vector<uint32_t> instanceMeshIds;
+    vector<culling::MeshCullData> meshCullData;
+    vector<culling::ClusterCullData> clusterCullData;
+
+    // Same mesh parts order as createDrawArgumentsBuffers, so each cluster can point to its draw template
+    uint32_t drawTemplateIndex = 0;
+    culledDrawCapacity = 0;
+    for (uint32_t meshId = 0; meshId < meshes.size(); ++meshId) {
+        const auto& mesh = meshes[meshId];
+        instanceMeshIds.insert(instanceMeshIds.end(), mesh.instanceCount, meshId);
+
+        culling::MeshCullData cullData = {};
+        memcpy(cullData.boundsMin, mesh.boundsMin, sizeof(cullData.boundsMin));
+        memcpy(cullData.boundsMax, mesh.boundsMax, sizeof(cullData.boundsMax));
+        cullData.clusterOffset = static_cast<uint32_t>(clusterCullData.size());
+
+        for (const auto& meshPart : mesh.primitives) {
+            for (auto cluster : meshPart.clusters) {
+                cluster.drawTemplateIndex = drawTemplateIndex;
+                clusterCullData.push_back(cluster);
+            }
+            drawTemplateIndex++;
+        }
+        cullData.clusterCount = static_cast<uint32_t>(clusterCullData.size()) - cullData.clusterOffset;
+        culledDrawCapacity += cullData.clusterCount * mesh.instanceCount;
+        meshCullData.push_back(cullData);
+    }
+
+    gltfInstanceMeshIdsBuffer = createBufferResource(instanceMeshIds.data(),
+        static_cast<int32_t>(instanceMeshIds.size() * sizeof(uint32_t)), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+        D3D12_HEAP_TYPE_DEFAULT);
+    gltfMeshCullBuffer = createBufferResource(meshCullData.data(),
+        static_cast<int32_t>(meshCullData.size() * sizeof(culling::MeshCullData)),
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_HEAP_TYPE_DEFAULT);
+    gltfClusterCullBuffer = createBufferResource(clusterCullData.data(),
+        static_cast<int32_t>(clusterCullData.size() * sizeof(culling::ClusterCullData)),
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_HEAP_TYPE_DEFAULT);
+
+    uint32_t zeroCount = 0;
+    zeroCountBuffer = createBufferResource(&zeroCount, sizeof(zeroCount), D3D12_RESOURCE_STATE_COPY_SOURCE,
+        D3D12_HEAP_TYPE_DEFAULT);
+
+    // Culled draws are written by cull_cs, then consumed by ExecuteIndirect
+    D3D12_HEAP_PROPERTIES defaultHeapProps = { D3D12_HEAP_TYPE_DEFAULT };
+    culledDrawArgumentsBuffer = device->createCommittedResource(defaultHeapProps, D3D12_HEAP_FLAG_NONE,
+        fastdxu::resourceBufferDesc(max(culledDrawCapacity, 1u) * sizeof(GltfDrawArguments),
+            D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, nullptr);
+    culledDrawCountBuffer = device->createCommittedResource(defaultHeapProps, D3D12_HEAP_FLAG_NONE,
+        fastdxu::resourceBufferDesc(sizeof(uint32_t), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+        D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, nullptr);
+
+    D3D12_HEAP_PROPERTIES readbackHeapProps = { D3D12_HEAP_TYPE_READBACK };
+    gpuCullingValidation.drawsReadbackBuffer = device->createCommittedResource(readbackHeapProps,
+        D3D12_HEAP_FLAG_NONE, fastdxu::resourceBufferDesc(static_cast<uint32_t>(GpuCullingValidation::kDrawsOffset +
+            max(culledDrawCapacity, 1u) * sizeof(GltfDrawArguments))), D3D12_RESOURCE_STATE_COPY_DEST, nullptr);
+    gpuCullingValidation.instanceMeshIds = instanceMeshIds;
+    gpuCullingValidation.meshes = meshCullData;
+    gpuCullingValidation.clusters = clusterCullData;
+
+    for (int32_t i = 0; i < kFrameCount; ++i) {
+        culling::CullingConstants cullingConstants = {};
+        cullConstantBuffer[i] = createBufferResource(&cullingConstants, sizeof(cullingConstants),
+            D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_HEAP_TYPE_UPLOAD);
+    }
+
+    createHiZResources();
+}
+
+/// Transposed world of an instance, same layout as the instance buffer
+DirectX::XMFLOAT4X4 getInstanceTransform(uint32_t instanceId) {
+    DirectX::XMFLOAT4X4 instanceTransform;
+    DirectX::XMStoreFloat4x4(&instanceTransform, DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(
+        reinterpret_cast<const DirectX::XMFLOAT4X4*>(sceneTransforms.world(gltfInstanceNodes[instanceId])))));
+    return instanceTransform;
+}
+
+/// Refresh world AABBs of mesh part instances whose node changed in the last transforms update
+void updateCpuCullBounds(const vector<GltfMesh>& meshes, bool isForced) {
+    for (const auto& mesh : meshes) {
+        for (uint32_t i = 0; i < mesh.instanceCount; ++i) {
+            uint32_t instanceId = mesh.instanceOffset + i;
+            if (!isForced && !sceneTransforms.changedFlags[gltfInstanceNodes[instanceId]]) {
+                continue;
+            }
+
+            DirectX::XMFLOAT4X4 instanceTransform = getInstanceTransform(instanceId);
+            for (const auto& meshPart : mesh.primitives) {
+                float boundsMin[3], boundsMax[3];
+                culling::transformAabb(meshPart.boundsMin, meshPart.boundsMax, &instanceTransform.m[0][0],
+                    boundsMin, boundsMax);
+
+                uint32_t cullId = meshPart.cpuCullOffset + i;
+                cpuCullBounds.minX[cullId] = boundsMin[0];
+                cpuCullBounds.minY[cullId] = boundsMin[1];
+                cpuCullBounds.minZ[cullId] = boundsMin[2];
+                cpuCullBounds.maxX[cullId] = boundsMax[0];
+                cpuCullBounds.maxY[cullId] = boundsMax[1];
+                cpuCullBounds.maxZ[cullId] = boundsMax[2];
+            }
         }
     }
 }
 
+/// Number mesh parts as sort key geometry ids, and register the states draw packets can select
+void createDrawPacketResources(vector<GltfMesh>& meshes) {
+    for (auto& mesh : meshes) {
+        for (auto& meshPart : mesh.primitives) {
+            meshPart.meshPartId = static_cast<uint32_t>(gltfMeshParts.size());
+            gltfMeshParts.push_back(&meshPart);
+        }
+    }
+    drawPipelines = { pipelineState.get(), depthEqualPipelineState.get(), depthPrepassPipelineState.get() };
+    drawRootSignatures = { pipelineRootSignature.get() };
+}
+
+/// World AABB of every mesh part instance, plus per frame buffers for the instances that pass culling
+void createCpuCullingResources(vector<GltfMesh>& meshes) {
+    const float emptyBounds[3] = {};
+    for (auto& mesh : meshes) {
+        for (auto& meshPart : mesh.primitives) {
+            meshPart.cpuCullOffset = static_cast<uint32_t>(cpuCullBounds.size());
+            for (uint32_t i = 0; i < mesh.instanceCount; ++i) {
+                cpuCullBounds.push_back(emptyBounds, emptyBounds);
+            }
+        }
+    }
+    cpuCullVisibleIds.resize(cpuCullBounds.size());
+    cpuCullVisibleBits.resize((cpuCullBounds.size() + 31) / 32);
+    updateCpuCullBounds(meshes, true);
+    sceneBvh.build(cpuCullBounds);
+    useBvhCulling = cpuCullBounds.size() >= kBvhCullingMinItems;
+    cpuOcclusion.resize(320, 192);
+
+    // Worst case every instance of every mesh part is visible
+    vector<DirectX::XMFLOAT4X4> emptyTransforms(max(cpuCullBounds.size(), size_t(1)));
+    for (int32_t i = 0; i < kFrameCount; ++i) {
+        visibleInstanceBuffer[i] = createBufferResource(emptyTransforms.data(),
+            static_cast<int32_t>(emptyTransforms.size() * sizeof(DirectX::XMFLOAT4X4)),
+            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_HEAP_TYPE_UPLOAD);
+    }
+}
+
+/// Opaque materials go through the depth prepass unless their extras set "depthPrepass": false. Masked and blended
+/// ones never do, the null pixel shader of the prepass can't alpha test and blending must not write depth.
+void loadGltfMaterialDepthPrepass(const tinygltf::Model& gltfModel, vector<uint8_t>& outMaterialDepthPrepass) {
+    // One more for the default material, opaque
+    outMaterialDepthPrepass.assign(gltfModel.materials.size() + 1, 1);
+    for (size_t materialId = 0; materialId < gltfModel.materials.size(); ++materialId) {
+        const auto& material = gltfModel.materials[materialId];
+        bool isDepthPrepassed = material.alphaMode == "OPAQUE";
+        if (material.extras.IsObject() && material.extras.Has("depthPrepass")) {
+            const auto& depthPrepass = material.extras.Get("depthPrepass");
+            isDepthPrepassed = isDepthPrepassed && (!depthPrepass.IsBool() || depthPrepass.Get<bool>());
+        }
+        outMaterialDepthPrepass[materialId] = isDepthPrepassed ? 1 : 0;
+    }
+}
+
 void loadGltfModelMaterials(const tinygltf::Model& gltfModel,
     vector<vector<fastdx::ID3D12ResourcePtr>>& outMaterialToTextures,
-    vector<D3D12_GPU_DESCRIPTOR_HANDLE>& outTextureDescriptorsHeapStart,
+    vector<uint32_t>& outMaterialTextureOffsets,
     fastdx::ID3D12DescriptorHeapPtr* outTexturesViewHeap) {
 
     map<int32_t, pair<D3D12_RESOURCE_DESC, fastdx::ID3D12ResourcePtr>> imageIdToTexture;
@@ -395,12 +1527,12 @@ void loadGltfModelMaterials(const tinygltf::Model& gltfModel,
     for (const auto& sampler : gltfModel.samplers) {
     }
 
-    int32_t descriptorsCount = ((gltfModel.materials.size() * 5) + 31) & ~31;
+    int32_t descriptorsCount = (((gltfModel.materials.size() + 1) * 5) + 31) & ~31;
     size_t descriptorSizeInBytes = device->getDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     fastdx::ID3D12DescriptorHeapPtr texturesViewHeap = device->createDescriptorHeap(
         descriptorsCount, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     D3D12_CPU_DESCRIPTOR_HANDLE texturesCpuHandle = texturesViewHeap->GetCPUDescriptorHandleForHeapStart();
-    D3D12_GPU_DESCRIPTOR_HANDLE texturesGpuHandle = texturesViewHeap->GetGPUDescriptorHandleForHeapStart();
+    uint32_t textureDescriptorOffset = 0;
 
     for (auto material : gltfModel.materials) {
         int32_t textureIds[] = {
@@ -410,7 +1542,7 @@ void loadGltfModelMaterials(const tinygltf::Model& gltfModel,
             //, material.emissiveTexture.index      // Not supported
             //, material.occlusionTexture.index     // Not supported
         };
-        outTextureDescriptorsHeapStart.push_back(texturesGpuHandle);
+        outMaterialTextureOffsets.push_back(textureDescriptorOffset);
 
         vector<fastdx::ID3D12ResourcePtr> texturesPtr;
         for (int32_t i=0; i <_countof(textureIds); ++i) {
@@ -432,19 +1564,60 @@ void loadGltfModelMaterials(const tinygltf::Model& gltfModel,
 
             device->createShaderResourceView(texturePtr, imageViewDesc, texturesCpuHandle);
             texturesCpuHandle.ptr += descriptorSizeInBytes;
-            texturesGpuHandle.ptr += descriptorSizeInBytes;
+            textureDescriptorOffset++;
 
             texturesPtr.push_back(texturePtr);
         }
         outMaterialToTextures.push_back(std::move(texturesPtr));
     }
+
+    // Default material for primitives without one, white base color and metallic-roughness
+    const uint8_t whiteTexel[4] = { 255, 255, 255, 255 };
+    auto whiteDesc = fastdxu::resourceTexDesc(D3D12_RESOURCE_DIMENSION_TEXTURE2D, 1, 1, 1, DXGI_FORMAT_R8G8B8A8_UNORM,
+        D3D12_RESOURCE_FLAG_NONE);
+    auto whiteTexture = createTextureBufferResource(whiteDesc, whiteTexel, sizeof(whiteTexel), sizeof(whiteTexel));
+    D3D12_SHADER_RESOURCE_VIEW_DESC whiteViewDesc = fastdxu::shaderResourceViewDesc(D3D12_SRV_DIMENSION_TEXTURE2D,
+        whiteDesc.Format);
+    whiteViewDesc.Texture2D.MipLevels = whiteDesc.MipLevels + 1;
+    outMaterialTextureOffsets.push_back(textureDescriptorOffset);
+    for (int32_t i = 0; i < 2; ++i) {
+        device->createShaderResourceView(whiteTexture, whiteViewDesc, texturesCpuHandle);
+        texturesCpuHandle.ptr += descriptorSizeInBytes;
+        textureDescriptorOffset++;
+    }
+    outMaterialToTextures.push_back({ whiteTexture });
     *outTexturesViewHeap = texturesViewHeap;
 }
 
 void update(float elapsedTimeSec) {
     static float angleY = 0.0f;
     angleY -= elapsedTimeSec * 0.001f;
-    sceneGlobals.matW = DirectX::XMMatrixRotationY(angleY);
+    DirectX::XMFLOAT4X4 rootTransform;
+    DirectX::XMStoreFloat4x4(&rootTransform, DirectX::XMMatrixRotationY(angleY));
+    sceneTransforms.setLocal(sceneRootNode, &rootTransform.m[0][0]);
+
+    // Weights only, the vertices are morphed once per drawn frame by updateMorphedMeshes()
+    for (auto& mesh : gltfMeshes) {
+        if (mesh.morphAnimation.times.empty()) {
+            continue;
+        }
+        mesh.morphTime = fmodf(mesh.morphTime + elapsedTimeSec * 0.001f, max(mesh.morphAnimation.duration(), 1e-3f));
+        morph::sampleWeights(mesh.morphAnimation, mesh.morphTime, mesh.morphWeights.data());
+        mesh.isMorphDirty = true;
+    }
+
+    // Palettes only, like the weights. Elapsed time is in milliseconds.
+    for (auto& skin : gltfSkins) {
+        if (skin.instances.size() > 0) {
+            animation::evaluateInstances(skin.skeleton, skin.clips, skin.instances, elapsedTimeSec * 0.001f, nullptr,
+                skin.palettes.data(), 1);
+        }
+    }
+    for (auto& mesh : gltfMeshes) {
+        if (mesh.skinId >= 0 && gltfSkins[mesh.skinId].instances.size() > 0) {
+            mesh.isMorphDirty = true;
+        }
+    }
 
     uint8_t* dataMapPtr = nullptr;
     sceneConstantBuffer[frameIndex]->Map(0, nullptr, reinterpret_cast<void**>(&dataMapPtr));
@@ -452,63 +1625,869 @@ void update(float elapsedTimeSec) {
     sceneConstantBuffer[frameIndex]->Unmap(0, nullptr);
 }
 
+/// Recompute changed subtrees once per drawn frame, then write them into this frame instance buffer
+void updateSceneTransforms() {
+    if (sceneTransforms.update() > 0) {
+        updateCpuCullBounds(gltfMeshes, false);
+        if (useBvhCulling) {
+            sceneBvh.refit(cpuCullBounds);
+        }
+        else {
+            isSceneBvhStale = true;
+        }
+    }
+    sceneTransforms.writeInstances(gltfInstanceNodes.data(), static_cast<uint32_t>(gltfInstanceNodes.size()),
+        gltfInstanceBufferPtrs[frameIndex]);
+}
+
+/// Morph and skin the meshes whose weights or palettes changed into this frame upload buffer, then copy them over their
+/// vertex and position buffers. Targets at zero weight are skipped. Both go to the CPU copies first, the upload heap
+/// is only written.
+void updateMorphedMeshes() {
+    if (!gltfMorphUploadBuffers[frameIndex]) {
+        return;
+    }
+    uint8_t* uploadPtr = gltfMorphUploadBufferPtrs[frameIndex];
+    vector<const GltfPrimitive*> morphedPrimitives;
+    for (auto& mesh : gltfMeshes) {
+        if (!mesh.isMorphDirty) {
+            continue;
+        }
+        mesh.isMorphDirty = false;
+        for (auto& primitive : mesh.primitives) {
+            if (!isDeformedPrimitive(primitive)) {
+                continue;
+            }
+            const float* positions = primitive.morphBasePositions.data();
+            const float* normals = primitive.morphBaseNormals.data();
+            if (primitive.morphTargets.targetCount() > 0) {
+                morph::applyMorphs(primitive.morphTargets, mesh.morphWeights.data(), positions, normals,
+                    primitive.morphedPositions.data(), primitive.morphedNormals.data());
+                positions = primitive.morphedPositions.data();
+                normals = primitive.morphedNormals.data();
+            }
+            // glTF skins the morphed vertices
+            uint32_t vertexCount = primitive.morphTargets.vertexCount;
+            if (!primitive.skinJoints.empty()) {
+                animation::skinVertices(gltfSkins[mesh.skinId].palettes.data(), primitive.skinJoints.data(),
+                    primitive.skinWeights.data(), vertexCount, positions, normals, primitive.skinnedPositions.data(),
+                    primitive.skinnedNormals.data());
+                positions = primitive.skinnedPositions.data();
+                normals = primitive.skinnedNormals.data();
+            }
+
+            float* vertices = reinterpret_cast<float*>(uploadPtr + primitive.morphUploadOffset);
+            for (uint32_t i = 0; i < vertexCount; ++i) {
+                memcpy(&vertices[i * 8], &positions[i * 3], 3 * sizeof(float));
+                memcpy(&vertices[i * 8 + 3], &normals[i * 3], 3 * sizeof(float));
+                memcpy(&vertices[i * 8 + 6], &primitive.morphUvs[i * 2], 2 * sizeof(float));
+            }
+            memcpy(&vertices[vertexCount * 8], positions, vertexCount * 3 * sizeof(float));
+            morphedPrimitives.push_back(&primitive);
+        }
+    }
+    if (morphedPrimitives.empty()) {
+        return;
+    }
+
+    // Same queue as the previous frames drawing from them, the transitions wait for those reads
+    vector<D3D12_RESOURCE_BARRIER> barriers;
+    for (const GltfPrimitive* primitive : morphedPrimitives) {
+        barriers.push_back(fastdxu::resourceBarrierTransition(primitive->vertexBuffer,
+            D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_COPY_DEST));
+        barriers.push_back(fastdxu::resourceBarrierTransition(primitive->positionBuffer,
+            D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_COPY_DEST));
+    }
+    commandList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+    ID3D12Resource* uploadBuffer = gltfMorphUploadBuffers[frameIndex].get();
+    for (const GltfPrimitive* primitive : morphedPrimitives) {
+        uint64_t vertexCount = primitive->morphTargets.vertexCount;
+        commandList->CopyBufferRegion(primitive->vertexBuffer.get(), 0, uploadBuffer, primitive->morphUploadOffset,
+            vertexCount * 8 * sizeof(float));
+        commandList->CopyBufferRegion(primitive->positionBuffer.get(), 0, uploadBuffer,
+            primitive->morphUploadOffset + vertexCount * 8 * sizeof(float), vertexCount * 3 * sizeof(float));
+    }
+    for (auto& barrier : barriers) {
+        swap(barrier.Transition.StateBefore, barrier.Transition.StateAfter);
+    }
+    commandList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+}
+
+/// Row-vector world-view-projection applied after the instance transforms, same space as culling bounds
+DirectX::XMMATRIX getCullingMatWVP() {
+    return DirectX::XMMatrixTranspose(sceneGlobals.matW) * DirectX::XMMatrixTranspose(sceneGlobals.matVP);
+}
+
+/// Reduce previous frame depth into the Hi-Z pyramid, leaving all its mips readable
+void dispatchHiZ() {
+    static size_t descriptorSizeInBytes = device->getDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle = cullingViewHeap->GetGPUDescriptorHandleForHeapStart();
+
+    D3D12_RESOURCE_BARRIER depthBarrier = fastdxu::resourceBarrierTransition(depthStencilTarget,
+        D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    commandList->ResourceBarrier(1, &depthBarrier);
+
+    commandList->SetPipelineState(hizPipelineState.get());
+    commandList->SetComputeRootSignature(hizRootSignature.get());
+
+    D3D12_RESOURCE_DESC depthDesc = depthStencilTarget->GetDesc();
+    uint32_t srcWidth = static_cast<uint32_t>(depthDesc.Width);
+    uint32_t srcHeight = depthDesc.Height;
+    for (uint32_t mip = 0; mip < hizMipCount; ++mip) {
+        // Mip 0 is a copy of depth, so it has the same size
+        uint32_t dstWidth = (mip == 0) ? srcWidth : max(srcWidth >> 1, 1u);
+        uint32_t dstHeight = (mip == 0) ? srcHeight : max(srcHeight >> 1, 1u);
+        uint32_t hizConstants[] = { srcWidth, srcHeight, dstWidth, dstHeight };
+
+        // Source is depth for mip 0, otherwise previous Hi-Z mip
+        D3D12_GPU_DESCRIPTOR_HANDLE srcHandle = { gpuHandle.ptr + mip * descriptorSizeInBytes };
+        D3D12_GPU_DESCRIPTOR_HANDLE dstHandle = { gpuHandle.ptr + (1 + hizMipCount + mip) * descriptorSizeInBytes };
+        commandList->SetComputeRoot32BitConstants(0, _countof(hizConstants), hizConstants, 0);
+        commandList->SetComputeRootDescriptorTable(1, srcHandle);
+        commandList->SetComputeRootDescriptorTable(2, dstHandle);
+        commandList->Dispatch((dstWidth + 7) / 8, (dstHeight + 7) / 8, 1);
+
+        D3D12_RESOURCE_BARRIER hizBarrier = fastdxu::resourceBarrierTransition(hizTarget,
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, mip);
+        commandList->ResourceBarrier(1, &hizBarrier);
+
+        srcWidth = dstWidth;
+        srcHeight = dstHeight;
+    }
+
+    depthBarrier = fastdxu::resourceBarrierTransition(depthStencilTarget,
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    commandList->ResourceBarrier(1, &depthBarrier);
+}
+
+/// Copy the depth Hi-Z is about to be reduced from, the previous frame depth, into a readback buffer
+void copyDepthForValidation() {
+    D3D12_RESOURCE_DESC depthDesc = depthStencilTarget->GetDesc();
+    uint64_t readbackSizeInBytes = 0;
+    device->d3dDevice()->GetCopyableFootprints(&depthDesc, 0, 1, 0, &gpuCullingValidation.depthFootprint, nullptr,
+        nullptr, &readbackSizeInBytes);
+    D3D12_HEAP_PROPERTIES readbackHeapProps = { D3D12_HEAP_TYPE_READBACK };
+    gpuCullingValidation.depthReadbackBuffer = device->createCommittedResource(readbackHeapProps,
+        D3D12_HEAP_FLAG_NONE, fastdxu::resourceBufferDesc(static_cast<uint32_t>(readbackSizeInBytes)),
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr);
+
+    D3D12_RESOURCE_BARRIER depthBarrier = fastdxu::resourceBarrierTransition(depthStencilTarget,
+        D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    commandList->ResourceBarrier(1, &depthBarrier);
+    D3D12_TEXTURE_COPY_LOCATION srcRegion = { depthStencilTarget.get(), D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX, 0 };
+    D3D12_TEXTURE_COPY_LOCATION dstRegion = { gpuCullingValidation.depthReadbackBuffer.get(),
+        D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT, gpuCullingValidation.depthFootprint };
+    commandList->CopyTextureRegion(&dstRegion, 0, 0, 0, &srcRegion, nullptr);
+    depthBarrier = fastdxu::resourceBarrierTransition(depthStencilTarget, D3D12_RESOURCE_STATE_COPY_SOURCE,
+        D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    commandList->ResourceBarrier(1, &depthBarrier);
+}
+
+/// Copy the culled draw count and draws cull_cs wrote into a readback buffer
+void copyCulledDrawsForValidation() {
+    D3D12_RESOURCE_BARRIER barriers[] = {
+        fastdxu::resourceBarrierTransition(culledDrawArgumentsBuffer,
+            D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_SOURCE),
+        fastdxu::resourceBarrierTransition(culledDrawCountBuffer,
+            D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_SOURCE),
+    };
+    commandList->ResourceBarrier(_countof(barriers), barriers);
+    ID3D12Resource* readbackBuffer = gpuCullingValidation.drawsReadbackBuffer.get();
+    commandList->CopyBufferRegion(readbackBuffer, 0, culledDrawCountBuffer.get(), 0, sizeof(uint32_t));
+    commandList->CopyBufferRegion(readbackBuffer, GpuCullingValidation::kDrawsOffset,
+        culledDrawArgumentsBuffer.get(), 0, max(culledDrawCapacity, 1u) * sizeof(GltfDrawArguments));
+
+    for (auto& barrier : barriers) {
+        swap(barrier.Transition.StateBefore, barrier.Transition.StateAfter);
+    }
+    commandList->ResourceBarrier(_countof(barriers), barriers);
+}
+
+/// Compare the draws cull_cs wrote with culling::cullDraws over the same constants, instances and Hi-Z depth. The GPU
+/// appends draws in any order, so both sides are sorted by instance and index range. Boxes right on a plane or a
+/// depth may round differently, the mismatches are reported rather than asserted.
+void validateGpuCulling() {
+    const GpuCullingValidation& validation = gpuCullingValidation;
+    D3D12_RESOURCE_DESC depthDesc = depthStencilTarget->GetDesc();
+    uint32_t width = static_cast<uint32_t>(depthDesc.Width);
+    uint32_t height = depthDesc.Height;
+    vector<float> depth(width * height);
+    uint8_t* dataMapPtr = nullptr;
+    validation.depthReadbackBuffer->Map(0, nullptr, reinterpret_cast<void**>(&dataMapPtr));
+    for (uint32_t y = 0; y < height; ++y) {
+        memcpy(&depth[y * width], dataMapPtr + validation.depthFootprint.Offset +
+            y * validation.depthFootprint.Footprint.RowPitch, width * sizeof(float));
+    }
+    D3D12_RANGE writtenRange = {};
+    validation.depthReadbackBuffer->Unmap(0, &writtenRange);
+
+    culling::HiZPyramid hiz;
+    culling::buildHiZ(depth.data(), width, height, &hiz);
+    vector<culling::CulledDraw> cpuDraws;
+    culling::cullDraws(validation.constants, gltfInstanceBufferPtrs[frameIndex], validation.instanceMeshIds.data(),
+        validation.meshes.data(), validation.clusters.data(), &hiz, cpuDraws);
+
+    // Instance, index buffer, first index and index count identify a culled draw
+    typedef tuple<uint32_t, uint64_t, uint32_t, uint32_t> DrawKey;
+    vector<DrawKey> cpuKeys, gpuKeys;
+    for (const auto& draw : cpuDraws) {
+        const culling::ClusterCullData& cluster = validation.clusters[draw.clusterId];
+        const GltfDrawArguments& drawTemplate = validation.drawTemplates[cluster.drawTemplateIndex];
+        cpuKeys.emplace_back(draw.instanceId, drawTemplate.indexBufferView.BufferLocation, cluster.startIndex,
+            cluster.indexCount);
+    }
+
+    validation.drawsReadbackBuffer->Map(0, nullptr, reinterpret_cast<void**>(&dataMapPtr));
+    uint32_t gpuDrawCount = min(*reinterpret_cast<const uint32_t*>(dataMapPtr), culledDrawCapacity);
+    const GltfDrawArguments* gpuDraws = reinterpret_cast<const GltfDrawArguments*>(dataMapPtr +
+        GpuCullingValidation::kDrawsOffset);
+    for (uint32_t i = 0; i < gpuDrawCount; ++i) {
+        gpuKeys.emplace_back(gpuDraws[i].instanceOffset, gpuDraws[i].indexBufferView.BufferLocation,
+            gpuDraws[i].drawIndexed.StartIndexLocation, gpuDraws[i].drawIndexed.IndexCountPerInstance);
+    }
+    validation.drawsReadbackBuffer->Unmap(0, &writtenRange);
+
+    sort(cpuKeys.begin(), cpuKeys.end());
+    sort(gpuKeys.begin(), gpuKeys.end());
+    vector<DrawKey> commonKeys;
+    set_intersection(cpuKeys.begin(), cpuKeys.end(), gpuKeys.begin(), gpuKeys.end(), back_inserter(commonKeys));
+    size_t gpuOnlyCount = gpuKeys.size() - commonKeys.size();
+    size_t cpuOnlyCount = cpuKeys.size() - commonKeys.size();
+
+    char message[256];
+    snprintf(message, sizeof(message), "GPU culling %s Hi-Z: %u GPU draws, %zu CPU reference draws, %zu GPU only, "
+        "%zu CPU only, %s\n", validation.constants.useOcclusion ? "with" : "without", gpuDrawCount, cpuKeys.size(),
+        gpuOnlyCount, cpuOnlyCount, gpuOnlyCount + cpuOnlyCount == 0 ? "valid" : "MISMATCH");
+    OutputDebugStringA(message);
+}
+
+/// Cull all instances and their clusters, writing one indirect draw per visible cluster
+void dispatchGpuCulling() {
+    static size_t descriptorSizeInBytes = device->getDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    // Current frame frustum and previous frame reprojection, both in instance world space
+    DirectX::XMMATRIX matWVP = getCullingMatWVP();
+    DirectX::XMFLOAT4X4 matWVPValues;
+    DirectX::XMStoreFloat4x4(&matWVPValues, matWVP);
+
+    culling::CullingConstants cullingConstants = {};
+    DirectX::XMStoreFloat4x4(reinterpret_cast<DirectX::XMFLOAT4X4*>(cullingConstants.matPrevWVP),
+        DirectX::XMMatrixTranspose(prevMatWVP));
+    culling::extractFrustumPlanes(matWVPValues.m, cullingConstants.frustumPlanes);
+    cullingConstants.instanceCount = static_cast<uint32_t>(gltfInstanceNodes.size());
+    cullingConstants.maxDrawCount = culledDrawCapacity;
+    cullingConstants.hizMipCount = hizMipCount;
+    cullingConstants.useOcclusion = isHiZValid ? 1 : 0;
+    cullingConstants.hizSize[0] = static_cast<float>(prevRenderWidth);
+    cullingConstants.hizSize[1] = static_cast<float>(prevRenderHeight);
+    prevMatWVP = matWVP;
+
+    // Validated with Hi-Z, so the occlusion half of the reference runs too
+    isGpuCullingValidating = isGpuCullingValidationPending && isHiZValid;
+    if (isGpuCullingValidating) {
+        gpuCullingValidation.constants = cullingConstants;
+        copyDepthForValidation();
+    }
+
+    uint8_t* dataMapPtr = nullptr;
+    cullConstantBuffer[frameIndex]->Map(0, nullptr, reinterpret_cast<void**>(&dataMapPtr));
+    memcpy(dataMapPtr, &cullingConstants, sizeof(cullingConstants));
+    cullConstantBuffer[frameIndex]->Unmap(0, nullptr);
+
+    ID3D12DescriptorHeap* cullingHeaps[] = { cullingViewHeap.get() };
+    commandList->SetDescriptorHeaps(1, cullingHeaps);
+    if (isHiZValid) {
+        dispatchHiZ();
+    }
+
+    // Reset draw count, then let cull_cs append to it
+    D3D12_RESOURCE_BARRIER barriers[] = {
+        fastdxu::resourceBarrierTransition(culledDrawArgumentsBuffer,
+            D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+        fastdxu::resourceBarrierTransition(culledDrawCountBuffer,
+            D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST),
+    };
+    commandList->ResourceBarrier(_countof(barriers), barriers);
+    commandList->CopyBufferRegion(culledDrawCountBuffer.get(), 0, zeroCountBuffer.get(), 0, sizeof(uint32_t));
+
+    D3D12_RESOURCE_BARRIER countBarrier = fastdxu::resourceBarrierTransition(culledDrawCountBuffer,
+        D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    commandList->ResourceBarrier(1, &countBarrier);
+
+    D3D12_GPU_DESCRIPTOR_HANDLE hizHandle = cullingViewHeap->GetGPUDescriptorHandleForHeapStart();
+    hizHandle.ptr += (1 + hizMipCount * 2) * descriptorSizeInBytes;
+
+    commandList->SetPipelineState(cullPipelineState.get());
+    commandList->SetComputeRootSignature(cullRootSignature.get());
+    commandList->SetComputeRootConstantBufferView(0, cullConstantBuffer[frameIndex]->GetGPUVirtualAddress());
+    commandList->SetComputeRootShaderResourceView(1, gltfInstanceBuffers[frameIndex]->GetGPUVirtualAddress());
+    commandList->SetComputeRootShaderResourceView(2, gltfInstanceMeshIdsBuffer->GetGPUVirtualAddress());
+    commandList->SetComputeRootShaderResourceView(3, gltfMeshCullBuffer->GetGPUVirtualAddress());
+    commandList->SetComputeRootShaderResourceView(4, gltfClusterCullBuffer->GetGPUVirtualAddress());
+    commandList->SetComputeRootShaderResourceView(5, gltfDrawArgumentsBuffer->GetGPUVirtualAddress());
+    commandList->SetComputeRootDescriptorTable(6, hizHandle);
+    commandList->SetComputeRootUnorderedAccessView(7, culledDrawArgumentsBuffer->GetGPUVirtualAddress());
+    commandList->SetComputeRootUnorderedAccessView(8, culledDrawCountBuffer->GetGPUVirtualAddress());
+    commandList->Dispatch((cullingConstants.instanceCount + 63) / 64, 1, 1);
+
+    vector<D3D12_RESOURCE_BARRIER> endBarriers = {
+        fastdxu::resourceBarrierTransition(culledDrawArgumentsBuffer,
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+        fastdxu::resourceBarrierTransition(culledDrawCountBuffer,
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+    };
+    if (isHiZValid) {
+        endBarriers.push_back(fastdxu::resourceBarrierTransition(hizTarget,
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    }
+    commandList->ResourceBarrier(static_cast<uint32_t>(endBarriers.size()), endBarriers.data());
+
+    if (isGpuCullingValidating) {
+        copyCulledDrawsForValidation();
+    }
+}
+
+/// Scene root parameters, bound again whenever the root signature changes
+void setSceneRootParameters(ID3D12Resource* instanceBuffer) {
+    commandList->SetGraphicsRootConstantBufferView(0, sceneConstantBuffer[frameIndex]->GetGPUVirtualAddress());
+    commandList->SetGraphicsRootShaderResourceView(4, instanceBuffer->GetGPUVirtualAddress());
+    commandList->SetGraphicsRootDescriptorTable(2, gltfTexturesViewHeap->GetGPUDescriptorHandleForHeapStart());
+}
+
+/// View depth of a mesh part instance bounds center over far plane, clip w is view depth
+float getViewDepth01(const DirectX::XMFLOAT4X4& matWVP, uint32_t cpuCullId) {
+    float x = (cpuCullBounds.minX[cpuCullId] + cpuCullBounds.maxX[cpuCullId]) * 0.5f;
+    float y = (cpuCullBounds.minY[cpuCullId] + cpuCullBounds.maxY[cpuCullId]) * 0.5f;
+    float z = (cpuCullBounds.minZ[cpuCullId] + cpuCullBounds.maxZ[cpuCullId]) * 0.5f;
+    float w = x * matWVP.m[0][3] + y * matWVP.m[1][3] + z * matWVP.m[2][3] + matWVP.m[3][3];
+    return w / kCameraFarZ;
+}
+
+void pushMeshPartDraw(const GltfPrimitive& meshPart, uint32_t instanceOffset, uint32_t instanceCount, float depth01) {
+    bool isDepthPrepassed = useDepthPrepass && gltfMaterialDepthPrepass[meshPart.materialId];
+
+    drawsort::DrawPacket packet = {};
+    packet.rootSignatureId = 0;
+    packet.instanceOffset = instanceOffset;
+    packet.instanceCount = instanceCount;
+    packet.userData = meshPart.meshPartId;
+    if (isDepthPrepassed) {
+        // No material, and odd geometry ids select the position stream
+        packet.pipelineId = kDrawPipelineDepthOnly;
+        packet.materialId = 0;
+        packet.geometryId = meshPart.meshPartId * 2 + 1;
+        uint64_t sortKey = drawsort::makeSortKey(kDrawPassDepth, packet.pipelineId, packet.rootSignatureId,
+            packet.materialId, packet.geometryId, depth01);
+        drawQueue.push(sortKey, packet);
+    }
+
+    packet.pipelineId = isDepthPrepassed ? kDrawPipelineEqual : kDrawPipelineLess;
+    packet.materialId = gltfMaterialTextureOffsets[meshPart.materialId];
+    packet.geometryId = meshPart.meshPartId * 2;
+
+    // Opaque, so front to back within the same states
+    uint64_t sortKey = drawsort::makeSortKey(kDrawPassOpaque, packet.pipelineId, packet.rootSignatureId,
+        packet.materialId, packet.geometryId, depth01);
+    drawQueue.push(sortKey, packet);
+}
+
+void reportDrawStats(const drawsort::DrawStateStats& frameStats) {
+    drawStatsTotal.drawCount += frameStats.drawCount;
+    drawStatsTotal.pipelineSets += frameStats.pipelineSets;
+    drawStatsTotal.rootSignatureSets += frameStats.rootSignatureSets;
+    drawStatsTotal.materialSets += frameStats.materialSets;
+    drawStatsTotal.geometrySets += frameStats.geometrySets;
+    if (++drawStatsFrameCount < 300) {
+        return;
+    }
+
+    // Per frame average over the last 300 frames
+    char message[256];
+    snprintf(message, sizeof(message), "Draws %u, state sets avoided %u (pipeline %u, root signature %u, "
+        "material %u, geometry %u), occlusion culled %u\n", drawStatsTotal.drawCount / drawStatsFrameCount,
+        drawStatsTotal.avoidedSets() / drawStatsFrameCount, drawStatsTotal.pipelineSets / drawStatsFrameCount,
+        drawStatsTotal.rootSignatureSets / drawStatsFrameCount, drawStatsTotal.materialSets / drawStatsFrameCount,
+        drawStatsTotal.geometrySets / drawStatsFrameCount, occlusionCulledTotal / drawStatsFrameCount);
+    OutputDebugStringA(message);
+    drawStatsTotal = {};
+    drawStatsFrameCount = 0;
+    occlusionCulledTotal = 0;
+}
+
+/// Sort this frame draw packets, then replay them setting only the states that changed
+void submitDrawQueue(ID3D12Resource* instanceBuffer) {
+    drawQueue.sort();
+
+    // draw() already set the first pipeline and root signature
+    drawStateTracker.reset();
+    drawStateTracker.setPipeline(kDrawPipelineLess);
+    drawStateTracker.setRootSignature(0);
+
+    for (uint32_t packetId : drawQueue.order) {
+        const drawsort::DrawPacket& packet = drawQueue.packets[packetId];
+        const GltfPrimitive& meshPart = *gltfMeshParts[packet.userData];
+
+        if (drawStateTracker.setPipeline(packet.pipelineId)) {
+            commandList->SetPipelineState(drawPipelines[packet.pipelineId]);
+        }
+        if (drawStateTracker.setRootSignature(packet.rootSignatureId)) {
+            commandList->SetGraphicsRootSignature(drawRootSignatures[packet.rootSignatureId]);
+            setSceneRootParameters(instanceBuffer);
+        }
+        if (drawStateTracker.setMaterial(packet.materialId)) {
+            commandList->SetGraphicsRoot32BitConstant(3, packet.materialId, 1);
+        }
+        if (drawStateTracker.setGeometry(packet.geometryId)) {
+            ID3D12Resource* vertexStream = (packet.geometryId & 1) ? meshPart.positionBuffer.get() : meshPart.vertexBuffer.get();
+            commandList->IASetIndexBuffer(&meshPart.indexBufferView);
+            commandList->SetGraphicsRootShaderResourceView(1, vertexStream->GetGPUVirtualAddress());
+        }
+
+        commandList->SetGraphicsRoot32BitConstant(3, packet.instanceOffset, 0);
+        commandList->DrawIndexedInstanced(meshPart.indexCount, packet.instanceCount, 0, 0, 0);
+        drawStateTracker.stats.drawCount++;
+    }
+    reportDrawStats(drawStateTracker.stats);
+}
+
+/// Draw each mesh part once for all instances of its mesh, nearest instance gives the sort depth
+void drawDirect() {
+    DirectX::XMFLOAT4X4 matWVPValues;
+    DirectX::XMStoreFloat4x4(&matWVPValues, getCullingMatWVP());
+
+    drawQueue.clear();
+    for (const auto& mesh : gltfMeshes) {
+        for (const auto& meshPart : mesh.primitives) {
+            float depth01 = 1.0f;
+            for (uint32_t i = 0; i < mesh.instanceCount; ++i) {
+                depth01 = min(depth01, getViewDepth01(matWVPValues, meshPart.cpuCullOffset + i));
+            }
+            pushMeshPartDraw(meshPart, mesh.instanceOffset, mesh.instanceCount, depth01);
+        }
+    }
+    submitDrawQueue(gltfInstanceBuffers[frameIndex].get());
+}
+
+/// Rasterize occluders at low resolution, then drop frustum visible mesh part instances hidden behind them
+uint32_t cullCpuOccluded(const DirectX::XMFLOAT4X4& matWVP, uint32_t visibleCount) {
+    cpuOcclusion.beginFrame(matWVP.m);
+    for (const auto& occluder : gltfOccluders) {
+        const auto* matWorld = reinterpret_cast<const float(*)[4]>(sceneTransforms.world(occluder.node));
+        for (const auto& meshPart : gltfMeshes[occluder.meshId].primitives) {
+            cpuOcclusion.renderOccluder(meshPart.occluderPositions.data(), 3 * sizeof(float),
+                meshPart.occluderIndices.data(), static_cast<uint32_t>(meshPart.occluderIndices.size()), matWorld);
+        }
+    }
+    cpuOcclusion.endOccluders();
+
+    // Compact in place, keeping ids ascending
+    uint32_t occlusionVisibleCount = 0;
+    for (uint32_t i = 0; i < visibleCount; ++i) {
+        uint32_t cpuCullId = cpuCullVisibleIds[i];
+        float boundsMin[3] = {
+            cpuCullBounds.minX[cpuCullId], cpuCullBounds.minY[cpuCullId], cpuCullBounds.minZ[cpuCullId] };
+        float boundsMax[3] = {
+            cpuCullBounds.maxX[cpuCullId], cpuCullBounds.maxY[cpuCullId], cpuCullBounds.maxZ[cpuCullId] };
+        if (cpuOcclusion.isAabbVisible(boundsMin, boundsMax)) {
+            cpuCullVisibleIds[occlusionVisibleCount++] = cpuCullId;
+        }
+    }
+    occlusionCulledTotal += visibleCount - occlusionVisibleCount;
+    return occlusionVisibleCount;
+}
+
+/// Draw each mesh part once for its visible instances, gathered contiguously in this frame instance buffer
+void drawCpuCulled() {
+    DirectX::XMFLOAT4X4 matWVPValues;
+    DirectX::XMStoreFloat4x4(&matWVPValues, getCullingMatWVP());
+    float frustumPlanes[6][4];
+    culling::extractFrustumPlanes(matWVPValues.m, frustumPlanes);
+
+    uint32_t visibleCount = 0;
+    if (useBvhCulling) {
+        // Traversal order, draws below need ascending ids. A bit per id costs a pass over size() / 32 words instead
+        // of sorting the visible ids.
+        uint32_t queryCount = sceneBvh.queryFrustum(frustumPlanes, cpuCullVisibleIds.data());
+        for (uint32_t i = 0; i < queryCount; ++i) {
+            cpuCullVisibleBits[cpuCullVisibleIds[i] / 32] |= 1u << (cpuCullVisibleIds[i] % 32);
+        }
+        for (uint32_t word = 0; word < static_cast<uint32_t>(cpuCullVisibleBits.size()); ++word) {
+            for (uint32_t bits = cpuCullVisibleBits[word]; bits != 0; bits &= bits - 1) {
+                unsigned long bit;
+                _BitScanForward(&bit, bits);
+                cpuCullVisibleIds[visibleCount++] = word * 32 + bit;
+            }
+            cpuCullVisibleBits[word] = 0;
+        }
+    }
+    else {
+        visibleCount = culling::cullAabbs(cpuCullBounds, frustumPlanes, cpuCullVisibleIds.data());
+    }
+    if (useCpuOcclusionCulling && !gltfOccluders.empty()) {
+        visibleCount = cullCpuOccluded(matWVPValues, visibleCount);
+    }
+
+    DirectX::XMFLOAT4X4* visibleTransforms = nullptr;
+    visibleInstanceBuffer[frameIndex]->Map(0, nullptr, reinterpret_cast<void**>(&visibleTransforms));
+    commandList->SetGraphicsRootShaderResourceView(4, visibleInstanceBuffer[frameIndex]->GetGPUVirtualAddress());
+
+    // Visible ids are ascending and bounds are grouped by mesh part, so each mesh part owns a contiguous run
+    drawQueue.clear();
+    uint32_t visibleIndex = 0;
+    for (const auto& mesh : gltfMeshes) {
+        for (const auto& meshPart : mesh.primitives) {
+            uint32_t instanceOffset = visibleIndex;
+            uint32_t cullEnd = meshPart.cpuCullOffset + mesh.instanceCount;
+            float depth01 = 1.0f;
+            for (; visibleIndex < visibleCount && cpuCullVisibleIds[visibleIndex] < cullEnd; ++visibleIndex) {
+                uint32_t cpuCullId = cpuCullVisibleIds[visibleIndex];
+                uint32_t instanceId = mesh.instanceOffset + (cpuCullId - meshPart.cpuCullOffset);
+                transforms::storeTransposed(sceneTransforms.world(gltfInstanceNodes[instanceId]),
+                    &visibleTransforms[visibleIndex].m[0][0]);
+                depth01 = min(depth01, getViewDepth01(matWVPValues, cpuCullId));
+            }
+
+            uint32_t instanceCount = visibleIndex - instanceOffset;
+            if (instanceCount > 0) {
+                pushMeshPartDraw(meshPart, instanceOffset, instanceCount, depth01);
+            }
+        }
+    }
+    visibleInstanceBuffer[frameIndex]->Unmap(0, nullptr);
+
+    submitDrawQueue(visibleInstanceBuffer[frameIndex].get());
+}
+
+/// Ray from the near to the far plane through a window pixel, in the space of the culling bounds
+bvh::Ray getPickRay(int32_t x, int32_t y) {
+    float ndcX = (x + 0.5f) / windowProp.width * 2.0f - 1.0f;
+    float ndcY = 1.0f - (y + 0.5f) / windowProp.height * 2.0f;
+    DirectX::XMMATRIX matInvWVP = DirectX::XMMatrixInverse(nullptr, getCullingMatWVP());
+    DirectX::XMVECTOR nearPoint = DirectX::XMVector3TransformCoord(DirectX::XMVectorSet(ndcX, ndcY, 0.0f, 1.0f), matInvWVP);
+    DirectX::XMVECTOR farPoint = DirectX::XMVector3TransformCoord(DirectX::XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), matInvWVP);
+
+    // Unnormalized direction, so the far plane is at distance 1
+    bvh::Ray ray = {};
+    DirectX::XMStoreFloat3(reinterpret_cast<DirectX::XMFLOAT3*>(ray.origin), nearPoint);
+    DirectX::XMStoreFloat3(reinterpret_cast<DirectX::XMFLOAT3*>(ray.direction), DirectX::XMVectorSubtract(farPoint, nearPoint));
+    ray.maxDistance = 1.0f;
+    return ray;
+}
+
+void reportPick(const char* queryName, uint32_t cpuCullId, float distance) {
+    for (uint32_t meshId = 0; meshId < gltfMeshes.size(); ++meshId) {
+        const auto& mesh = gltfMeshes[meshId];
+        for (uint32_t meshPartId = 0; meshPartId < mesh.primitives.size(); ++meshPartId) {
+            uint32_t cullOffset = mesh.primitives[meshPartId].cpuCullOffset;
+            if (cpuCullId >= cullOffset && cpuCullId < cullOffset + mesh.instanceCount) {
+                char message[256];
+                snprintf(message, sizeof(message), "%s: mesh %u, part %u, instance %u, distance %.3f\n", queryName, meshId,
+                    meshPartId, cpuCullId - cullOffset, distance);
+                OutputDebugStringA(message);
+                return;
+            }
+        }
+    }
+}
+
+/// Resizes are applied by the next draw. Left click picks the first mesh part instance under the cursor, right click
+/// the one nearest to the near plane point. V validates the next GPU culled frame against the CPU reference.
+void onWindowMessage(UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (msg == WM_KEYDOWN && wParam == 'V') {
+        isGpuCullingValidationPending = true;
+        return;
+    }
+    if (msg == WM_SIZE) {
+        uint32_t width = LOWORD(lParam);
+        uint32_t height = HIWORD(lParam);
+        bool isResized = width != static_cast<uint32_t>(windowProp.width) || height != static_cast<uint32_t>(windowProp.height);
+        if (wParam != SIZE_MINIMIZED && width > 0 && height > 0 && isResized) {
+            pendingWidth = width;
+            pendingHeight = height;
+        }
+        return;
+    }
+    if (msg != WM_LBUTTONDOWN && msg != WM_RBUTTONDOWN) {
+        return;
+    }
+
+    if (isSceneBvhStale) {
+        sceneBvh.refit(cpuCullBounds);
+        isSceneBvhStale = false;
+    }
+    bvh::Ray ray = getPickRay(static_cast<int16_t>(LOWORD(lParam)), static_cast<int16_t>(HIWORD(lParam)));
+    float directionLength = sqrtf(ray.direction[0] * ray.direction[0] + ray.direction[1] * ray.direction[1] +
+        ray.direction[2] * ray.direction[2]);
+    if (msg == WM_LBUTTONDOWN) {
+        bvh::RayHit hit;
+        if (sceneBvh.raycast(ray, &hit)) {
+            reportPick("Picked", hit.itemId, hit.distance * directionLength);
+        }
+    }
+    else {
+        uint32_t nearestId;
+        float nearestDistance;
+        if (sceneBvh.findNearest(ray.origin, directionLength, &nearestId, &nearestDistance)) {
+            reportPick("Nearest", nearestId, nearestDistance);
+        }
+    }
+}
+
+/// Wait for the GPU to go idle, then resize the swap chain to the last WM_SIZE and recreate size dependent targets
+void resizeRenderTargets() {
+    waitGpuIdle();
+
+    // Back buffers must all be released before resizing
+    renderTargets.clear();
+    swapChain->ResizeBuffers(kFrameCount, pendingWidth, pendingHeight, kFrameFormat, 0);
+    renderTargets = device->createRenderTargetViews(swapChain, swapChainRtvHeap);
+    frameIndex = swapChain->GetCurrentBackBufferIndex();
+
+    windowProp.width = pendingWidth;
+    windowProp.height = pendingHeight;
+    pendingWidth = pendingHeight = 0;
+    createRenderTargets(windowProp.width, windowProp.height);
+    createHiZResources();
+    updateCameraProjection();
+
+    // Depth and timestamps still in flight belong to the old size
+    isHiZValid = false;
+    for (int32_t i = 0; i < kFrameCount; ++i) {
+        isTimestampValid[i] = false;
+    }
+}
+
+/// Feed the GPU time of the last frame recorded in this frame slot, its fence has passed, then size the scene sub-rect
+void updateRenderResolution() {
+    if (useDynamicResolution && isTimestampValid[frameIndex]) {
+        D3D12_RANGE readRange = { frameIndex * 2 * sizeof(uint64_t), (frameIndex + 1) * 2 * sizeof(uint64_t) };
+        uint8_t* dataMapPtr = nullptr;
+        timestampReadbackBuffer->Map(0, &readRange, reinterpret_cast<void**>(&dataMapPtr));
+        const uint64_t* timestamps = reinterpret_cast<const uint64_t*>(dataMapPtr + readRange.Begin);
+        float gpuFrameMs = static_cast<float>(timestamps[1] - timestamps[0]) * 1000.0f / timestampFrequency;
+        D3D12_RANGE writeRange = {};
+        timestampReadbackBuffer->Unmap(0, &writeRange);
+
+        resolutionController.update(gpuFrameMs);
+    }
+
+    float renderScale = useDynamicResolution ? resolutionController.scale : 1.0f;
+    renderWidth = dynres::scaledSize(static_cast<uint32_t>(windowProp.width), renderScale);
+    renderHeight = dynres::scaledSize(static_cast<uint32_t>(windowProp.height), renderScale);
+}
+
+/// Bilinear upscale of the scene sub-rect to the whole back buffer
+void drawUpscale(D3D12_CPU_DESCRIPTOR_HANDLE frameRtvHandle) {
+    D3D12_VIEWPORT viewport = { 0, 0, static_cast<float>(windowProp.width), static_cast<float>(windowProp.height),
+        D3D12_MIN_DEPTH, D3D12_MAX_DEPTH };
+    D3D12_RECT scissorRect = { 0, 0, windowProp.width, windowProp.height };
+
+    // uv over the back buffer maps to the rendered sub-rect, clamped so the stale texels past it are never filtered in
+    float upscaleConstants[] = {
+        static_cast<float>(renderWidth) / windowProp.width, static_cast<float>(renderHeight) / windowProp.height,
+        (renderWidth - 0.5f) / windowProp.width, (renderHeight - 0.5f) / windowProp.height,
+    };
+
+    commandList->SetPipelineState(upscalePipelineState.get());
+    commandList->SetGraphicsRootSignature(upscaleRootSignature.get());
+    ID3D12DescriptorHeap* upscaleHeaps[] = { upscaleViewHeap.get() };
+    commandList->SetDescriptorHeaps(1, upscaleHeaps);
+    commandList->SetGraphicsRoot32BitConstants(0, _countof(upscaleConstants), upscaleConstants, 0);
+    commandList->SetGraphicsRootDescriptorTable(1, upscaleViewHeap->GetGPUDescriptorHandleForHeapStart());
+
+    commandList->RSSetViewports(1, &viewport);
+    commandList->RSSetScissorRects(1, &scissorRect);
+    commandList->OMSetRenderTargets(1, &frameRtvHandle, FALSE, nullptr);
+    commandList->DrawInstanced(3, 1, 0, 0);
+}
+
 void draw() {
     static D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = swapChainRtvHeap->GetCPUDescriptorHandleForHeapStart();
     static D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle = depthStencilViewHeap->GetCPUDescriptorHandleForHeapStart();
+    static D3D12_CPU_DESCRIPTOR_HANDLE sceneRtvHandle = sceneRtvHeap->GetCPUDescriptorHandleForHeapStart();
     static size_t heapDescriptorSize = device->getDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-    D3D12_CPU_DESCRIPTOR_HANDLE frameRtvHandle = { rtvHandle.ptr + frameIndex * heapDescriptorSize };
 
     static D3D12_RESOURCE_BARRIER transitionBarrier = fastdxu::resourceBarrierTransition(nullptr);
 
+    if (pendingWidth > 0) {
+        resizeRenderTargets();
+    }
+    D3D12_CPU_DESCRIPTOR_HANDLE frameRtvHandle = { rtvHandle.ptr + frameIndex * heapDescriptorSize };
+
+    updateSceneTransforms();
+    updateRenderResolution();
+
     startCommandList();
     {
+        commandList->EndQuery(timestampQueryHeap.get(), D3D12_QUERY_TYPE_TIMESTAMP, frameIndex * 2);
+        updateMorphedMeshes();
+
+        if (drawPath == DrawPath::GpuCulled) {
+            dispatchGpuCulling();
+        }
+
         // Present->RenderTarget barrier
         transitionBarrier.Transition.pResource = renderTargets[frameIndex].get();
         transitionBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
         transitionBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
         commandList->ResourceBarrier(1, &transitionBarrier);
 
-        D3D12_VIEWPORT viewport = { 0, 0, static_cast<float>(windowProp.width), static_cast<float>(windowProp.height),
+        // Dynamic resolution renders the scene to the top left sub-rect of the scene target, upscaled at the end
+        D3D12_CPU_DESCRIPTOR_HANDLE sceneTargetHandle = useDynamicResolution ? sceneRtvHandle : frameRtvHandle;
+        if (useDynamicResolution) {
+            D3D12_RESOURCE_BARRIER sceneBarrier = fastdxu::resourceBarrierTransition(sceneColorTarget,
+                D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
+            commandList->ResourceBarrier(1, &sceneBarrier);
+        }
+
+        D3D12_VIEWPORT viewport = { 0, 0, static_cast<float>(renderWidth), static_cast<float>(renderHeight),
             D3D12_MIN_DEPTH, D3D12_MAX_DEPTH };
-        D3D12_RECT scissorRect = { 0, 0, windowProp.width, windowProp.height };
+        D3D12_RECT scissorRect = { 0, 0, static_cast<LONG>(renderWidth), static_cast<LONG>(renderHeight) };
 
         commandList->SetPipelineState(pipelineState.get());
         commandList->RSSetViewports(1, &viewport);
         commandList->RSSetScissorRects(1, &scissorRect);
-        commandList->OMSetRenderTargets(1, &frameRtvHandle, FALSE, &dsvHandle);
+        commandList->OMSetRenderTargets(1, &sceneTargetHandle, FALSE, &dsvHandle);
 
-        commandList->ClearRenderTargetView(frameRtvHandle, kClearRenderTarget.Color, 0, nullptr);
+        // Whole depth is cleared, Hi-Z reads the far plane past the sub-rect and stays conservative
+        commandList->ClearRenderTargetView(sceneTargetHandle, kClearRenderTarget.Color, 1, &scissorRect);
         commandList->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH,
             kClearDepth.DepthStencil.Depth, kClearDepth.DepthStencil.Stencil, 0, nullptr);
 
         commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
         commandList->SetGraphicsRootSignature(pipelineRootSignature.get());
-        commandList->SetGraphicsRootConstantBufferView(0, sceneConstantBuffer[frameIndex]->GetGPUVirtualAddress());
 
-        // Draw all mesh parts
+        // Textures must use descriptor table, materials index into it
         ID3D12DescriptorHeap* shaderTexturesHeaps[] = { gltfTexturesViewHeap.get() };
         commandList->SetDescriptorHeaps(1, shaderTexturesHeaps);
-        for (int i = 0; i < gltfIndexBuffers.size(); ++i) {
-            commandList->IASetIndexBuffer(&gltfIndexBuffersView[i]);
-            commandList->SetGraphicsRootShaderResourceView(1, gltfVertexBuffers[i]->GetGPUVirtualAddress());
+        setSceneRootParameters(gltfInstanceBuffers[frameIndex].get());
 
-            // Textures must use descriptor table
-            commandList->SetGraphicsRootDescriptorTable(2, gltfTextureDescriptorsHeapStart[i]);
-            commandList->DrawIndexedInstanced(gltfIndexBuffersView[i].SizeInBytes / sizeof(uint16_t), 1, 0, 0, 0);
+        // Draw all mesh parts, once for all instances of their mesh
+        if (drawPath == DrawPath::GpuCulled) {
+            commandList->ExecuteIndirect(gltfCommandSignature.get(), culledDrawCapacity,
+                culledDrawArgumentsBuffer.get(), 0, culledDrawCountBuffer.get(), 0);
+        }
+        else if (drawPath == DrawPath::CpuCulled) {
+            drawCpuCulled();
+        }
+        else if (drawPath == DrawPath::ExecuteIndirect) {
+            commandList->ExecuteIndirect(gltfCommandSignature.get(), gltfDrawCount, gltfDrawArgumentsBuffer.get(), 0,
+                useDrawCountBuffer ? gltfDrawCountBuffer.get() : nullptr, 0);
+        }
+        else {
+            drawDirect();
+        }
+
+        if (useDynamicResolution) {
+            D3D12_RESOURCE_BARRIER sceneBarrier = fastdxu::resourceBarrierTransition(sceneColorTarget,
+                D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            commandList->ResourceBarrier(1, &sceneBarrier);
+            drawUpscale(frameRtvHandle);
         }
 
         // RenderTarget->Present barrier
         transitionBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
         transitionBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
         commandList->ResourceBarrier(1, &transitionBarrier);
+
+        commandList->EndQuery(timestampQueryHeap.get(), D3D12_QUERY_TYPE_TIMESTAMP, frameIndex * 2 + 1);
+        commandList->ResolveQueryData(timestampQueryHeap.get(), D3D12_QUERY_TYPE_TIMESTAMP, frameIndex * 2, 2,
+            timestampReadbackBuffer.get(), frameIndex * 2 * sizeof(uint64_t));
     }
     executeCommandList();
+    if (isGpuCullingValidating) {
+        waitGpuIdle();
+        validateGpuCulling();
+        isGpuCullingValidating = false;
+        isGpuCullingValidationPending = false;
+    }
+    isHiZValid = true;
+    isTimestampValid[frameIndex] = true;
+    prevRenderWidth = renderWidth;
+    prevRenderHeight = renderHeight;
 
     swapChain->Present(1, 0);
     waitGpu();
 }
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    // CPU culling, sorting and scene structure benchmarks, results go to the debugger output
+    if (strstr(lpCmdLine, "-benchmark") != nullptr) {
+        for (uint32_t aabbCount : { 16384u, 131072u, 1048576u }) {
+            culling::FrustumCullingBenchmark result = culling::benchmarkFrustumCulling(aabbCount, 100);
+            char message[256];
+            snprintf(message, sizeof(message), "Frustum culling %u AABBs, %u visible: scalar %.3fms, AVX2 %.3fms\n",
+                result.aabbCount, result.visibleCount, result.scalarMs, result.avx2Ms);
+            OutputDebugStringA(message);
+        }
+        for (uint32_t aabbCount : { 16384u, 131072u }) {
+            occlusion::OcclusionBenchmark result = occlusion::benchmarkOcclusion(aabbCount, 100);
+            char message[256];
+            snprintf(message, sizeof(message), "Occlusion %ux%u, %u occluder triangles: scalar %.3fms, AVX2 %.3fms, "
+                "%u AABBs tested in %.3fms, %u outside the frustum, %u occluded\n", result.width, result.height,
+                result.triangleCount, result.scalarRasterMs, result.avx2RasterMs, result.aabbCount, result.testMs,
+                result.frustumCulledCount, result.occludedCount);
+            OutputDebugStringA(message);
+        }
+        for (uint32_t drawCount : { 16384u, 131072u }) {
+            drawsort::SortBenchmark result = drawsort::benchmarkSort(drawCount, 100);
+            char message[256];
+            snprintf(message, sizeof(message), "Draw sort %u keys: radix %.3fms, std::sort %.3fms\n",
+                result.drawCount, result.radixSortMs, result.stdSortMs);
+            OutputDebugStringA(message);
+        }
+        for (uint32_t nodeCount : { 131072u, 1048576u }) {
+            transforms::HierarchyBenchmark result = transforms::benchmarkHierarchyUpdate(nodeCount, 100);
+            char message[256];
+            snprintf(message, sizeof(message), "Transforms %u nodes: full update %.3fms, 1%% update %.3fms, "
+                "instance write %.3fms\n", result.nodeCount, result.fullUpdateMs, result.partialUpdateMs,
+                result.writeMs);
+            OutputDebugStringA(message);
+        }
+        for (uint32_t itemCount : { 131072u, 1048576u }) {
+            bvh::BvhBenchmark result = bvh::benchmarkBvh(itemCount, 10);
+            char message[256];
+            snprintf(message, sizeof(message), "BVH %u AABBs, %u nodes: build %.3fms, %u threads %.3fms, refit %.3fms, "
+                "frustum %.3fms (linear %.3fms), ray %.3fus (linear %.3fus), nearest %.3fus\n", result.itemCount,
+                result.nodeCount, result.buildMs, result.threadCount, result.threadedBuildMs, result.refitMs,
+                result.frustumQueryMs, result.frustumLinearMs, result.raycastUs, result.raycastLinearUs, result.nearestUs);
+            OutputDebugStringA(message);
+        }
+        for (uint32_t characterCount : { 1024u, 8192u }) {
+            animation::AnimationBenchmark result = animation::benchmarkAnimation(characterCount, 20);
+            char message[512];
+            snprintf(message, sizeof(message), "Animation %u characters, %u joints, %u tracks: scalar sampling %.3fms, "
+                "SSE sampling %.3fms, evaluate %.3fms, %u threads %.3fms, rotation error %g, compressed %zu to %zu "
+                "bytes, sampling %.3fms, %u threads %.3fms, rotation error %g, vector error %g\n",
+                result.characterCount, result.jointCount, result.trackCount, result.scalarSampleMs, result.sampleMs,
+                result.evaluateMs, result.threadCount, result.threadedEvaluateMs, result.maxRotationError,
+                result.rawBytes, result.compressedBytes, result.compressedSampleMs, result.threadCount,
+                result.compressedEvaluateMs, result.maxCompressedRotationError, result.maxCompressedVectorError);
+            OutputDebugStringA(message);
+        }
+        for (uint32_t vertexCount : { 16384u, 65536u }) {
+            morph::MorphBenchmark result = morph::benchmarkMorph(vertexCount, 52, 8, 100);
+            char message[256];
+            snprintf(message, sizeof(message), "Morph %u vertices, %u of %u targets moving %u vertices each: dense "
+                "%.3fms, sparse %.3fms, SSE %.3fms, %zu to %zu bytes, error %g\n", result.vertexCount,
+                result.activeTargetCount, result.targetCount, result.movedVertexCount, result.denseMs, result.scalarMs,
+                result.sseMs, result.denseBytes, result.sparseBytes, result.maxError);
+            OutputDebugStringA(message);
+        }
+        for (float stepFactor : { 1.5f, 3.0f }) {
+            dynres::ControllerDesc controllerDesc;
+            dynres::ControllerSimulation result = dynres::simulateController(controllerDesc, 3000, 4.0f, 12.0f,
+                stepFactor, 0.1f);
+            char message[256];
+            snprintf(message, sizeof(message), "Dynamic resolution %u frames, %.1fx load step: %u over budget, "
+                "longest run %u, %u scale changes, average scale %.3f, min scale %.3f\n", result.frameCount, stepFactor,
+                result.overBudgetFrames, result.longestOverBudgetRun, result.scaleChanges, result.averageScale,
+                result.minScale);
+            OutputDebugStringA(message);
+        }
+        return 0;
+    }
+
     HWND hwnd = fastdx::createWindow(windowProp);
     fastdx::onWindowDestroy = []() {
         waitGpu(true);
@@ -519,8 +2498,23 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     {
         tinygltf::Model gltfCubeModel;
         readGltfModel(L"Cube.gltf", &gltfCubeModel);
-        loadGltfModelMeshes(gltfCubeModel, gltfVertexBuffers, gltfIndexBuffers, gltfIndexBuffersView);
-        loadGltfModelMaterials(gltfCubeModel, gltfMaterialToTextures, gltfTextureDescriptorsHeapStart, &gltfTexturesViewHeap);
+        const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+        sceneRootNode = sceneTransforms.addNode(-1, identity);
+        loadGltfModelMeshes(gltfCubeModel, static_cast<int32_t>(sceneRootNode), sceneTransforms, gltfMeshes,
+            gltfInstanceNodes, gltfOccluders);
+        loadGltfSkins(gltfCubeModel, gltfSkins);
+        loadGltfSkinnedBounds(gltfMeshes, gltfSkins);
+        sceneTransforms.update();
+        createInstanceBuffers(static_cast<uint32_t>(gltfInstanceNodes.size()));
+        createMorphUploadBuffers(gltfMeshes);
+        loadGltfModelMaterials(gltfCubeModel, gltfMaterialToTextures, gltfMaterialTextureOffsets, &gltfTexturesViewHeap);
+        loadGltfMaterialDepthPrepass(gltfCubeModel, gltfMaterialDepthPrepass);
+        createDrawArgumentsBuffers(gltfMeshes, gltfMaterialTextureOffsets, &gltfDrawArgumentsBuffer,
+            &gltfDrawCountBuffer, &gltfDrawCount);
+        createCommandSignature();
+        createCullingResources(gltfMeshes);
+        createCpuCullingResources(gltfMeshes);
+        createDrawPacketResources(gltfMeshes);
 
         createSceneConstantBuffer();
     }
@@ -528,5 +2522,6 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     waitGpu(true);
     uploadBuffers.clear();
 
+    fastdx::onWindowMessage = onWindowMessage;
     return fastdx::runMainLoop(update, draw);
 }
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+///
+/// morph Header - Sparse morph targets (blend shapes) applied to positions and normals with SSE
+///
+/// A target only stores the vertices it moves: their indices, increasing, and an xyz0 position and normal delta each,
+/// so a face shape touching a few hundred vertices costs a few kilobytes whatever the size of the mesh. Applying a set
+/// restores the vertices any target moves from the base mesh, then adds the deltas of targets with a non zero weight,
+/// reading nothing of the others. Vertices no target moves are never touched, the output keeps the base mesh there.
+///
+/// Weight animations are glTF "weights" channels, each key holds one weight per target of the set.
+///
+namespace morph {
+    struct MorphTarget {
+        uint32_t deltaOffset;               // First entry of the target in MorphSet indices
+        uint32_t deltaCount;
+    };
+
+    struct MorphSet {
+        uint32_t vertexCount = 0;
+        std::vector<MorphTarget> targets;
+        std::vector<uint32_t> indices;      // Moved vertices of each target, increasing within a target
+        std::vector<float> deltas;          // 8 floats per index, position xyz0 then normal xyz0
+        std::vector<uint32_t> movedVertices;    // Vertices moved by any target, increasing
+
+        uint32_t targetCount() const { return static_cast<uint32_t>(targets.size()); }
+
+        /// Dense deltas, vertexCount xyz each, normals may be null. Vertices whose position and normal deltas are
+        /// all within threshold are dropped.
+        void addTarget(const float* positionDeltas, const float* optNormalDeltas, float threshold);
+
+        size_t sizeInBytes() const;
+
+        /// How far weights up to maxAbsWeights, one per target, can move a vertex along each axis. Growing the base
+        /// mesh bounds by it keeps them conservative for every morph within those weights.
+        void positionExtent(const float* maxAbsWeights, float outExtent[3]) const;
+    };
+
+    struct WeightTrack {
+        uint32_t targetCount = 0;
+        bool isStep = false;
+        std::vector<float> times;           // Seconds, increasing
+        std::vector<float> weights;         // targetCount per key
+
+        float duration() const { return times.empty() ? 0.0f : times.back(); }
+    };
+
+    struct MorphBenchmark {
+        uint32_t vertexCount;
+        uint32_t targetCount;
+        uint32_t activeTargetCount;         // Targets with a non zero weight
+        uint32_t movedVertexCount;          // Per target
+        double denseMs;                     // Every target over every vertex, zero weights included
+        double scalarMs;                    // Sparse, active targets only
+        double sseMs;
+        size_t denseBytes;                  // Dense deltas of all targets
+        size_t sparseBytes;
+        float maxError;                     // Largest difference of SSE to dense positions and normals
+    };
+
+    /// Weights at time, wrapped in the track duration and clamped to its keys
+    void sampleWeights(const WeightTrack& track, float time, float* outWeights);
+
+    /// Reference, one component at a time. Positions and normals are vertexCount xyz, normals may be null on input
+    /// and output.
+    void applyMorphsScalar(const MorphSet& set, const float* weights, const float* basePositions,
+        const float* optBaseNormals, float* outPositions, float* optOutNormals);
+
+    /// Deltas scaled and added with SSE, three components of a vertex at once
+    void applyMorphs(const MorphSet& set, const float* weights, const float* basePositions,
+        const float* optBaseNormals, float* outPositions, float* optOutNormals);
+
+    MorphBenchmark benchmarkMorph(uint32_t vertexCount, uint32_t targetCount, uint32_t activeTargetCount,
+        uint32_t iterations);
+}
+
+
+///
+/// Implementation
+///
+
+#if defined(MORPH_IMPLEMENTATION)
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <emmintrin.h>
+
+namespace morph {
+    const uint32_t kDeltaStride = 8;
+
+    void MorphSet::addTarget(const float* positionDeltas, const float* optNormalDeltas, float threshold) {
+        MorphTarget target = { static_cast<uint32_t>(indices.size()), 0 };
+        std::vector<uint32_t> targetVertices;
+        for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+            const float* position = positionDeltas + size_t(vertex) * 3;
+            const float* normal = optNormalDeltas ? optNormalDeltas + size_t(vertex) * 3 : nullptr;
+            bool isMoved = false;
+            for (uint32_t c = 0; c < 3; ++c) {
+                isMoved |= std::abs(position[c]) > threshold || (normal && std::abs(normal[c]) > threshold);
+            }
+            if (!isMoved) {
+                continue;
+            }
+            indices.push_back(vertex);
+            targetVertices.push_back(vertex);
+            float delta[kDeltaStride] = { position[0], position[1], position[2], 0.0f,
+                normal ? normal[0] : 0.0f, normal ? normal[1] : 0.0f, normal ? normal[2] : 0.0f, 0.0f };
+            deltas.insert(deltas.end(), delta, delta + kDeltaStride);
+        }
+        target.deltaCount = static_cast<uint32_t>(targetVertices.size());
+        targets.push_back(target);
+
+        std::vector<uint32_t> merged;
+        std::set_union(movedVertices.begin(), movedVertices.end(), targetVertices.begin(), targetVertices.end(),
+            std::back_inserter(merged));
+        movedVertices = std::move(merged);
+    }
+
+    size_t MorphSet::sizeInBytes() const {
+        return targets.size() * sizeof(MorphTarget) + indices.size() * sizeof(uint32_t) +
+            deltas.size() * sizeof(float) + movedVertices.size() * sizeof(uint32_t);
+    }
+
+    void MorphSet::positionExtent(const float* maxAbsWeights, float outExtent[3]) const {
+        outExtent[0] = outExtent[1] = outExtent[2] = 0.0f;
+        for (uint32_t t = 0; t < targetCount(); ++t) {
+            float targetExtent[3] = {};
+            for (uint32_t i = targets[t].deltaOffset; i < targets[t].deltaOffset + targets[t].deltaCount; ++i) {
+                for (uint32_t c = 0; c < 3; ++c) {
+                    targetExtent[c] = std::max(targetExtent[c], std::abs(deltas[size_t(i) * kDeltaStride + c]));
+                }
+            }
+            for (uint32_t c = 0; c < 3; ++c) {
+                outExtent[c] += targetExtent[c] * maxAbsWeights[t];
+            }
+        }
+    }
+
+    void sampleWeights(const WeightTrack& track, float time, float* outWeights) {
+        uint32_t keyCount = static_cast<uint32_t>(track.times.size());
+        if (keyCount == 0) {
+            return;
+        }
+        float duration = track.duration();
+        if (duration > 0.0f) {
+            time = std::fmod(time, duration);
+            time = time < 0.0f ? time + duration : time;
+        }
+
+        const float* upper = std::upper_bound(track.times.data(), track.times.data() + keyCount, time);
+        uint32_t nextKey = std::min(static_cast<uint32_t>(upper - track.times.data()), keyCount - 1);
+        uint32_t key = nextKey > 0 ? nextKey - 1 : 0;
+        float keyTime = track.times[key];
+        float nextKeyTime = track.times[nextKey];
+        float factor = track.isStep || nextKeyTime <= keyTime ? (time >= nextKeyTime ? 1.0f : 0.0f) :
+            std::min(std::max((time - keyTime) / (nextKeyTime - keyTime), 0.0f), 1.0f);
+
+        const float* weights = track.weights.data() + size_t(key) * track.targetCount;
+        const float* nextWeights = track.weights.data() + size_t(nextKey) * track.targetCount;
+        for (uint32_t i = 0; i < track.targetCount; ++i) {
+            outWeights[i] = weights[i] + (nextWeights[i] - weights[i]) * factor;
+        }
+    }
+
+    inline void _restoreMoved(const MorphSet& set, const float* base, float* out) {
+        for (uint32_t vertex : set.movedVertices) {
+            memcpy(out + size_t(vertex) * 3, base + size_t(vertex) * 3, 3 * sizeof(float));
+        }
+    }
+
+    void applyMorphsScalar(const MorphSet& set, const float* weights, const float* basePositions,
+        const float* optBaseNormals, float* outPositions, float* optOutNormals) {
+        bool hasNormals = optBaseNormals && optOutNormals;
+        _restoreMoved(set, basePositions, outPositions);
+        if (hasNormals) {
+            _restoreMoved(set, optBaseNormals, optOutNormals);
+        }
+
+        for (uint32_t t = 0; t < set.targetCount(); ++t) {
+            float weight = weights[t];
+            if (weight == 0.0f) {
+                continue;
+            }
+            const MorphTarget& target = set.targets[t];
+            for (uint32_t i = target.deltaOffset; i < target.deltaOffset + target.deltaCount; ++i) {
+                const float* delta = &set.deltas[size_t(i) * kDeltaStride];
+                float* position = outPositions + size_t(set.indices[i]) * 3;
+                for (uint32_t c = 0; c < 3; ++c) {
+                    position[c] += delta[c] * weight;
+                }
+                if (hasNormals) {
+                    float* normal = optOutNormals + size_t(set.indices[i]) * 3;
+                    for (uint32_t c = 0; c < 3; ++c) {
+                        normal[c] += delta[4 + c] * weight;
+                    }
+                }
+            }
+        }
+    }
+
+    /// xyz of a vertex without touching the next one, so neighbors updated back to back never overlap
+    inline __m128 _loadXyz(const float* p) {
+        __m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(p)));
+        return _mm_movelh_ps(xy, _mm_load_ss(p + 2));
+    }
+
+    inline void _storeXyz(float* p, __m128 value) {
+        _mm_store_sd(reinterpret_cast<double*>(p), _mm_castps_pd(value));
+        _mm_store_ss(p + 2, _mm_movehl_ps(value, value));
+    }
+
+    void applyMorphs(const MorphSet& set, const float* weights, const float* basePositions,
+        const float* optBaseNormals, float* outPositions, float* optOutNormals) {
+        bool hasNormals = optBaseNormals && optOutNormals;
+        _restoreMoved(set, basePositions, outPositions);
+        if (hasNormals) {
+            _restoreMoved(set, optBaseNormals, optOutNormals);
+        }
+
+        for (uint32_t t = 0; t < set.targetCount(); ++t) {
+            if (weights[t] == 0.0f) {
+                continue;
+            }
+            const MorphTarget& target = set.targets[t];
+            const uint32_t* indices = set.indices.data() + target.deltaOffset;
+            const float* deltas = set.deltas.data() + size_t(target.deltaOffset) * kDeltaStride;
+            __m128 weight = _mm_set1_ps(weights[t]);
+            for (uint32_t i = 0; i < target.deltaCount; ++i) {
+                const float* delta = deltas + size_t(i) * kDeltaStride;
+                float* position = outPositions + size_t(indices[i]) * 3;
+                _storeXyz(position, _mm_add_ps(_loadXyz(position), _mm_mul_ps(_mm_loadu_ps(delta), weight)));
+                if (hasNormals) {
+                    float* normal = optOutNormals + size_t(indices[i]) * 3;
+                    _storeXyz(normal, _mm_add_ps(_loadXyz(normal), _mm_mul_ps(_mm_loadu_ps(delta + 4), weight)));
+                }
+            }
+        }
+    }
+
+    MorphBenchmark benchmarkMorph(uint32_t vertexCount, uint32_t targetCount, uint32_t activeTargetCount,
+        uint32_t iterations) {
+        // Face like targets, each moving a random window of 1/64 of the vertices, the first activeTargetCount weighted
+        const uint32_t movedVertexCount = std::max(vertexCount / 64, 1u);
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> deltaDistribution(-0.01f, 0.01f);
+        std::uniform_int_distribution<uint32_t> windowDistribution(0, vertexCount - movedVertexCount);
+
+        std::vector<float> basePositions(size_t(vertexCount) * 3), baseNormals(size_t(vertexCount) * 3);
+        for (size_t i = 0; i < basePositions.size(); ++i) {
+            basePositions[i] = deltaDistribution(random) * 100.0f;
+            baseNormals[i] = deltaDistribution(random) * 100.0f;
+        }
+        MorphSet set;
+        set.vertexCount = vertexCount;
+        std::vector<float> densePositions(size_t(targetCount) * vertexCount * 3, 0.0f);
+        std::vector<float> denseNormals(densePositions.size(), 0.0f);
+        for (uint32_t t = 0; t < targetCount; ++t) {
+            float* positions = &densePositions[size_t(t) * vertexCount * 3];
+            float* normals = &denseNormals[size_t(t) * vertexCount * 3];
+            uint32_t first = windowDistribution(random);
+            for (uint32_t vertex = first; vertex < first + movedVertexCount; ++vertex) {
+                for (uint32_t c = 0; c < 3; ++c) {
+                    positions[vertex * 3 + c] = deltaDistribution(random);
+                    normals[vertex * 3 + c] = deltaDistribution(random);
+                }
+            }
+            set.addTarget(positions, normals, 0.0f);
+        }
+        std::vector<float> weights(targetCount, 0.0f);
+        for (uint32_t t = 0; t < std::min(activeTargetCount, targetCount); ++t) {
+            weights[t] = 0.25f + 0.5f * t / std::max(activeTargetCount, 1u);
+        }
+
+        auto measureMs = [&](auto&& function) {
+            function();
+            auto startTime = std::chrono::high_resolution_clock::now();
+            for (uint32_t i = 0; i < iterations; ++i) {
+                function();
+            }
+            auto endTime = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(endTime - startTime).count() / std::max(iterations, 1u);
+        };
+
+        MorphBenchmark result = {};
+        result.vertexCount = vertexCount;
+        result.targetCount = targetCount;
+        result.activeTargetCount = std::min(activeTargetCount, targetCount);
+        result.movedVertexCount = movedVertexCount;
+        result.denseBytes = (densePositions.size() + denseNormals.size()) * sizeof(float);
+        result.sparseBytes = set.sizeInBytes();
+
+        std::vector<float> densePositionsOut(basePositions.size()), denseNormalsOut(baseNormals.size());
+        result.denseMs = measureMs([&]() {
+            memcpy(densePositionsOut.data(), basePositions.data(), basePositions.size() * sizeof(float));
+            memcpy(denseNormalsOut.data(), baseNormals.data(), baseNormals.size() * sizeof(float));
+            for (uint32_t t = 0; t < targetCount; ++t) {
+                const float* positions = &densePositions[size_t(t) * vertexCount * 3];
+                const float* normals = &denseNormals[size_t(t) * vertexCount * 3];
+                for (size_t i = 0; i < size_t(vertexCount) * 3; ++i) {
+                    densePositionsOut[i] += positions[i] * weights[t];
+                    denseNormalsOut[i] += normals[i] * weights[t];
+                }
+            }
+        });
+
+        std::vector<float> positionsOut = basePositions, normalsOut = baseNormals;
+        result.scalarMs = measureMs([&]() {
+            applyMorphsScalar(set, weights.data(), basePositions.data(), baseNormals.data(), positionsOut.data(),
+                normalsOut.data());
+        });
+        result.sseMs = measureMs([&]() {
+            applyMorphs(set, weights.data(), basePositions.data(), baseNormals.data(), positionsOut.data(),
+                normalsOut.data());
+        });
+        for (size_t i = 0; i < positionsOut.size(); ++i) {
+            result.maxError = std::max(result.maxError, std::abs(positionsOut[i] - densePositionsOut[i]));
+            result.maxError = std::max(result.maxError, std::abs(normalsOut[i] - denseNormalsOut[i]));
+        }
+        return result;
+    }
+}
+#endif // MORPH_IMPLEMENTATION
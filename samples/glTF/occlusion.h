@@ -0,0 +1,479 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+///
+/// occlusion Header - CPU software occlusion culling with a low resolution hierarchical depth buffer
+///
+/// Occluder meshes are rasterized at low resolution into a D3D depth buffer (0 near, 1 far), 8 pixels per AVX2
+/// iteration. The farthest depth of each 8x8 tile is then gathered, so most bounds tests finish at tile level.
+/// Matrices are row-major with the row-vector convention (p' = p * M). No GPU or window is required.
+///
+namespace occlusion {
+    const uint32_t kTileSize = 8;
+
+    struct OcclusionStats {
+        uint32_t occluderTriangleCount;
+        uint32_t testedCount;
+        uint32_t occludedCount;
+    };
+
+    struct OcclusionBenchmark {
+        uint32_t width;
+        uint32_t height;
+        uint32_t triangleCount;
+        uint32_t aabbCount;
+        uint32_t frustumCulledCount;        // Rejected by the frustum before the depth test
+        uint32_t occludedCount;             // Inside the frustum but hidden by occluders
+        double scalarRasterMs;
+        double avx2RasterMs;                // Zero when the CPU has no AVX2
+        double testMs;
+    };
+
+    struct DepthRasterizer {
+        uint32_t width = 0;                 // Multiple of kTileSize
+        uint32_t height = 0;
+        uint32_t tileCountX = 0;
+        uint32_t tileCountY = 0;
+        std::vector<float> depth;           // Row-major, 1 where no occluder was rendered
+        std::vector<float> tileMaxDepth;    // Farthest depth of each tile, valid after endOccluders()
+        float matViewProj[4][4] = {};
+        OcclusionStats stats = {};
+        bool useAvx2 = false;
+
+        /// Size is rounded up to whole tiles
+        void resize(uint32_t width, uint32_t height);
+
+        /// Clear depth and stats, occluders and bounds tests of this frame use matViewProj
+        void beginFrame(const float matViewProj[4][4]);
+
+        void renderOccluder(const float* positions, uint32_t positionStrideInBytes, const uint16_t* indices,
+            uint32_t indexCount, const float matWorld[4][4]);
+
+        /// Build tile depths, call once after all occluders and before testing
+        void endOccluders();
+
+        /// False when a world space AABB is entirely behind rendered occluders or outside the viewport
+        bool isAabbVisible(const float boundsMin[3], const float boundsMax[3]);
+    };
+
+    OcclusionBenchmark benchmarkOcclusion(uint32_t aabbCount, uint32_t iterations);
+}
+
+
+///
+/// Implementation
+///
+#if defined(OCCLUSION_IMPLEMENTATION)
+#include "culling.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define OCCLUSION_TARGET_AVX2
+#else
+#define OCCLUSION_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+namespace occlusion {
+    // Screen space triangle, x/y in pixels and z as D3D depth, with edge and depth plane equations
+    struct _TriangleSetup {
+        float edgeA[3], edgeB[3], edgeC[3]; // Inside when A * x + B * y + C >= 0 for all edges
+        float depthDx, depthDy, depthC;     // depth = depthDx * x + depthDy * y + depthC
+        int32_t minX, maxX, minY, maxY;     // Covered pixels, inclusive
+    };
+
+
+    inline void _multiply(const float a[4][4], const float b[4][4], float outMatrix[4][4]) {
+        for (int32_t r = 0; r < 4; ++r) {
+            for (int32_t c = 0; c < 4; ++c) {
+                outMatrix[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c] + a[r][3] * b[3][c];
+            }
+        }
+    }
+
+
+    inline void _transform(const float position[3], const float matrix[4][4], float outClip[4]) {
+        for (int32_t c = 0; c < 4; ++c) {
+            outClip[c] = position[0] * matrix[0][c] + position[1] * matrix[1][c] + position[2] * matrix[2][c] +
+                matrix[3][c];
+        }
+    }
+
+
+    inline bool _setupTriangle(const float v0[3], const float v1[3], const float v2[3], uint32_t width,
+        uint32_t height, _TriangleSetup* outSetup) {
+        // Orient counter-clockwise in y-down screen space, occluders are rendered two-sided
+        float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v2[0] - v0[0]) * (v1[1] - v0[1]);
+        if (area == 0.0f) {
+            return false;
+        }
+        const float* vertices[3] = { v0, area > 0.0f ? v1 : v2, area > 0.0f ? v2 : v1 };
+        area = std::fabs(area);
+
+        for (int32_t i = 0; i < 3; ++i) {
+            const float* a = vertices[i];
+            const float* b = vertices[(i + 1) % 3];
+            outSetup->edgeA[i] = -(b[1] - a[1]);
+            outSetup->edgeB[i] = b[0] - a[0];
+
+            // Same origin for both triangles sharing an edge, so their edge values are exact negations and no
+            // pixel along the edge is missed by both
+            bool isOriginA = a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]);
+            const float* origin = isOriginA ? a : b;
+            outSetup->edgeC[i] = -(outSetup->edgeA[i] * origin[0] + outSetup->edgeB[i] * origin[1]);
+        }
+
+        const float* a = vertices[0];
+        const float* b = vertices[1];
+        const float* c = vertices[2];
+        outSetup->depthDx = ((b[2] - a[2]) * (c[1] - a[1]) - (c[2] - a[2]) * (b[1] - a[1])) / area;
+        outSetup->depthDy = ((c[2] - a[2]) * (b[0] - a[0]) - (b[2] - a[2]) * (c[0] - a[0])) / area;
+        outSetup->depthC = a[2] - outSetup->depthDx * a[0] - outSetup->depthDy * a[1];
+
+        // Pixel centers are at +0.5
+        float minX = std::min({ a[0], b[0], c[0] });
+        float maxX = std::max({ a[0], b[0], c[0] });
+        float minY = std::min({ a[1], b[1], c[1] });
+        float maxY = std::max({ a[1], b[1], c[1] });
+        outSetup->minX = std::max(static_cast<int32_t>(std::ceil(minX - 0.5f)), 0);
+        outSetup->maxX = std::min(static_cast<int32_t>(std::floor(maxX - 0.5f)), static_cast<int32_t>(width) - 1);
+        outSetup->minY = std::max(static_cast<int32_t>(std::ceil(minY - 0.5f)), 0);
+        outSetup->maxY = std::min(static_cast<int32_t>(std::floor(maxY - 0.5f)), static_cast<int32_t>(height) - 1);
+        return outSetup->minX <= outSetup->maxX && outSetup->minY <= outSetup->maxY;
+    }
+
+
+    inline void _rasterizeScalar(const _TriangleSetup& setup, uint32_t width, float* depth) {
+        for (int32_t y = setup.minY; y <= setup.maxY; ++y) {
+            float py = y + 0.5f;
+            float* depthRow = depth + y * width;
+            for (int32_t x = setup.minX; x <= setup.maxX; ++x) {
+                float px = x + 0.5f;
+                bool isInside = true;
+                for (int32_t i = 0; i < 3; ++i) {
+                    isInside &= setup.edgeA[i] * px + setup.edgeB[i] * py + setup.edgeC[i] >= 0.0f;
+                }
+                if (isInside) {
+                    float z = setup.depthDx * px + setup.depthDy * py + setup.depthC;
+                    depthRow[x] = std::min(depthRow[x], z);
+                }
+            }
+        }
+    }
+
+
+    OCCLUSION_TARGET_AVX2 inline void _rasterizeAvx2(const _TriangleSetup& setup, uint32_t width, float* depth) {
+        // Rows are processed in aligned blocks of 8 pixels, width is a multiple of 8 so blocks never overflow
+        const __m256 pixelOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        __m256 edgeA[3], edgeB[3], edgeC[3];
+        for (int32_t i = 0; i < 3; ++i) {
+            edgeA[i] = _mm256_set1_ps(setup.edgeA[i]);
+            edgeB[i] = _mm256_set1_ps(setup.edgeB[i]);
+            edgeC[i] = _mm256_set1_ps(setup.edgeC[i]);
+        }
+        __m256 depthDx = _mm256_set1_ps(setup.depthDx);
+        __m256 depthDy = _mm256_set1_ps(setup.depthDy);
+        __m256 depthC = _mm256_set1_ps(setup.depthC);
+        const __m256 zero = _mm256_setzero_ps();
+
+        int32_t startX = setup.minX & ~7;
+        for (int32_t y = setup.minY; y <= setup.maxY; ++y) {
+            __m256 py = _mm256_set1_ps(y + 0.5f);
+            __m256 edgeRow[3];
+            for (int32_t i = 0; i < 3; ++i) {
+                edgeRow[i] = _mm256_fmadd_ps(edgeB[i], py, edgeC[i]);
+            }
+            __m256 depthRow = _mm256_fmadd_ps(depthDy, py, depthC);
+
+            float* depthPtr = depth + y * width;
+            for (int32_t x = startX; x <= setup.maxX; x += 8) {
+                __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), pixelOffsets);
+                __m256 inside = _mm256_cmp_ps(_mm256_fmadd_ps(edgeA[0], px, edgeRow[0]), zero, _CMP_GE_OQ);
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_fmadd_ps(edgeA[1], px, edgeRow[1]), zero, _CMP_GE_OQ));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_fmadd_ps(edgeA[2], px, edgeRow[2]), zero, _CMP_GE_OQ));
+                if (_mm256_testz_ps(inside, inside)) {
+                    continue;
+                }
+
+                __m256 z = _mm256_fmadd_ps(depthDx, px, depthRow);
+                __m256 currentDepth = _mm256_loadu_ps(depthPtr + x);
+                __m256 nearestDepth = _mm256_min_ps(currentDepth, z);
+                _mm256_storeu_ps(depthPtr + x, _mm256_blendv_ps(currentDepth, nearestDepth, inside));
+            }
+        }
+    }
+
+
+    void DepthRasterizer::resize(uint32_t newWidth, uint32_t newHeight) {
+        tileCountX = (newWidth + kTileSize - 1) / kTileSize;
+        tileCountY = (newHeight + kTileSize - 1) / kTileSize;
+        width = tileCountX * kTileSize;
+        height = tileCountY * kTileSize;
+        depth.assign(width * height, 1.0f);
+        tileMaxDepth.assign(tileCountX * tileCountY, 1.0f);
+        useAvx2 = culling::hasAvx2();
+    }
+
+
+    void DepthRasterizer::beginFrame(const float newMatViewProj[4][4]) {
+        memcpy(matViewProj, newMatViewProj, sizeof(matViewProj));
+        std::fill(depth.begin(), depth.end(), 1.0f);
+        std::fill(tileMaxDepth.begin(), tileMaxDepth.end(), 1.0f);
+        stats = {};
+    }
+
+
+    void DepthRasterizer::renderOccluder(const float* positions, uint32_t positionStrideInBytes,
+        const uint16_t* indices, uint32_t indexCount, const float matWorld[4][4]) {
+        float matWorldViewProj[4][4];
+        _multiply(matWorld, matViewProj, matWorldViewProj);
+
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+            float clip[3][4];
+            for (int32_t j = 0; j < 3; ++j) {
+                const float* position = reinterpret_cast<const float*>(
+                    reinterpret_cast<const uint8_t*>(positions) + indices[i + j] * positionStrideInBytes);
+                _transform(position, matWorldViewProj, clip[j]);
+            }
+
+            // Clip against the near plane (z >= 0), result is a triangle or a quad
+            float polygon[4][4];
+            int32_t polygonCount = 0;
+            for (int32_t j = 0; j < 3; ++j) {
+                const float* a = clip[j];
+                const float* b = clip[(j + 1) % 3];
+                if (a[2] >= 0.0f) {
+                    memcpy(polygon[polygonCount++], a, sizeof(float) * 4);
+                }
+                if ((a[2] >= 0.0f) != (b[2] >= 0.0f)) {
+                    // Always from the inside vertex, so an edge shared by two triangles clips to the same point
+                    const float* inside = a[2] >= 0.0f ? a : b;
+                    const float* outside = a[2] >= 0.0f ? b : a;
+                    float t = inside[2] / (inside[2] - outside[2]);
+                    for (int32_t c = 0; c < 4; ++c) {
+                        polygon[polygonCount][c] = inside[c] + (outside[c] - inside[c]) * t;
+                    }
+                    polygonCount++;
+                }
+            }
+            if (polygonCount < 3) {
+                continue;
+            }
+
+            float screen[4][3];
+            for (int32_t j = 0; j < polygonCount; ++j) {
+                float invW = 1.0f / std::max(polygon[j][3], 1e-6f);
+                screen[j][0] = (polygon[j][0] * invW * 0.5f + 0.5f) * width;
+                screen[j][1] = (polygon[j][1] * invW * -0.5f + 0.5f) * height;
+                screen[j][2] = polygon[j][2] * invW;
+            }
+
+            for (int32_t j = 1; j + 1 < polygonCount; ++j) {
+                _TriangleSetup setup;
+                if (!_setupTriangle(screen[0], screen[j], screen[j + 1], width, height, &setup)) {
+                    continue;
+                }
+                if (useAvx2) {
+                    _rasterizeAvx2(setup, width, depth.data());
+                }
+                else {
+                    _rasterizeScalar(setup, width, depth.data());
+                }
+            }
+            stats.occluderTriangleCount++;
+        }
+    }
+
+
+    void DepthRasterizer::endOccluders() {
+        for (uint32_t tileY = 0; tileY < tileCountY; ++tileY) {
+            for (uint32_t tileX = 0; tileX < tileCountX; ++tileX) {
+                float maxDepth = 0.0f;
+                for (uint32_t y = 0; y < kTileSize; ++y) {
+                    const float* depthRow = depth.data() + (tileY * kTileSize + y) * width + tileX * kTileSize;
+                    for (uint32_t x = 0; x < kTileSize; ++x) {
+                        maxDepth = std::max(maxDepth, depthRow[x]);
+                    }
+                }
+                tileMaxDepth[tileY * tileCountX + tileX] = maxDepth;
+            }
+        }
+    }
+
+
+    bool DepthRasterizer::isAabbVisible(const float boundsMin[3], const float boundsMax[3]) {
+        stats.testedCount++;
+
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        float minDepth = 1.0f;
+        for (int32_t i = 0; i < 8; ++i) {
+            float corner[3] = {
+                (i & 1) ? boundsMax[0] : boundsMin[0],
+                (i & 2) ? boundsMax[1] : boundsMin[1],
+                (i & 4) ? boundsMax[2] : boundsMin[2],
+            };
+            float clip[4];
+            _transform(corner, matViewProj, clip);
+
+            // Crossing the near plane, too close to be hidden
+            if (clip[2] < 0.0f || clip[3] <= 0.0f) {
+                return true;
+            }
+
+            float invW = 1.0f / clip[3];
+            float x = (clip[0] * invW * 0.5f + 0.5f) * width;
+            float y = (clip[1] * invW * -0.5f + 0.5f) * height;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            minDepth = std::min(minDepth, clip[2] * invW);
+        }
+
+        // Every pixel the projected bounds touch
+        int32_t pixelMinX = std::max(static_cast<int32_t>(std::floor(minX)), 0);
+        int32_t pixelMaxX = std::min(static_cast<int32_t>(std::floor(maxX)), static_cast<int32_t>(width) - 1);
+        int32_t pixelMinY = std::max(static_cast<int32_t>(std::floor(minY)), 0);
+        int32_t pixelMaxY = std::min(static_cast<int32_t>(std::floor(maxY)), static_cast<int32_t>(height) - 1);
+        if (pixelMinX > pixelMaxX || pixelMinY > pixelMaxY) {
+            stats.occludedCount++;
+            return false;
+        }
+
+        for (int32_t tileY = pixelMinY / kTileSize; tileY <= pixelMaxY / static_cast<int32_t>(kTileSize); ++tileY) {
+            for (int32_t tileX = pixelMinX / kTileSize; tileX <= pixelMaxX / static_cast<int32_t>(kTileSize); ++tileX) {
+                // Whole tile nearer than the bounds
+                if (tileMaxDepth[tileY * tileCountX + tileX] < minDepth) {
+                    continue;
+                }
+
+                int32_t startX = std::max(pixelMinX, tileX * static_cast<int32_t>(kTileSize));
+                int32_t endX = std::min(pixelMaxX, (tileX + 1) * static_cast<int32_t>(kTileSize) - 1);
+                int32_t startY = std::max(pixelMinY, tileY * static_cast<int32_t>(kTileSize));
+                int32_t endY = std::min(pixelMaxY, (tileY + 1) * static_cast<int32_t>(kTileSize) - 1);
+                for (int32_t y = startY; y <= endY; ++y) {
+                    for (int32_t x = startX; x <= endX; ++x) {
+                        if (depth[y * width + x] >= minDepth) {
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+
+        stats.occludedCount++;
+        return false;
+    }
+
+
+    OcclusionBenchmark benchmarkOcclusion(uint32_t aabbCount, uint32_t iterations) {
+        // Dense interior, rows of tessellated walls at increasing depth with unit boxes scattered between them
+        const uint32_t kWallCount = 16;
+        const uint32_t kWallSegments = 16;
+        std::vector<float> positions;
+        std::vector<uint16_t> indices;
+        for (uint32_t y = 0; y <= kWallSegments; ++y) {
+            for (uint32_t x = 0; x <= kWallSegments; ++x) {
+                positions.insert(positions.end(), { -8.0f + x, -8.0f + y, 0.0f });
+            }
+        }
+        for (uint32_t y = 0; y < kWallSegments; ++y) {
+            for (uint32_t x = 0; x < kWallSegments; ++x) {
+                uint16_t i0 = static_cast<uint16_t>(y * (kWallSegments + 1) + x);
+                uint16_t i1 = static_cast<uint16_t>(i0 + 1);
+                uint16_t i2 = static_cast<uint16_t>(i0 + kWallSegments + 1);
+                uint16_t i3 = static_cast<uint16_t>(i2 + 1);
+                indices.insert(indices.end(), { i0, i1, i2, i1, i3, i2 });
+            }
+        }
+
+        // Walls alternate left/right, so each one hides part of the next ones
+        std::vector<std::vector<float>> wallMatrices;
+        for (uint32_t i = 0; i < kWallCount; ++i) {
+            float offsetX = (i % 2) ? 4.0f : -4.0f;
+            wallMatrices.push_back({ 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, offsetX, 0, 5.0f + i * 4.0f, 1 });
+        }
+
+        const float nearZ = 0.1f, farZ = 100.0f;
+        const float viewProj[4][4] = {
+            { 1.0f, 0.0f, 0.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f, 0.0f },
+            { 0.0f, 0.0f, farZ / (farZ - nearZ), 1.0f },
+            { 0.0f, 0.0f, -nearZ * farZ / (farZ - nearZ), 0.0f },
+        };
+
+        uint32_t seed = 1;
+        auto random = [&seed](float minValue, float maxValue) {
+            seed = seed * 1664525u + 1013904223u;
+            return minValue + (maxValue - minValue) * static_cast<float>(seed >> 8) / static_cast<float>(1 << 24);
+        };
+        std::vector<float> aabbs(aabbCount * 6);
+        for (uint32_t i = 0; i < aabbCount; ++i) {
+            float center[3] = { random(-20.0f, 20.0f), random(-10.0f, 10.0f), random(6.0f, 70.0f) };
+            for (int32_t j = 0; j < 3; ++j) {
+                aabbs[i * 6 + j] = center[j] - 0.5f;
+                aabbs[i * 6 + 3 + j] = center[j] + 0.5f;
+            }
+        }
+
+        DepthRasterizer rasterizer;
+        rasterizer.resize(320, 192);
+        auto renderOccludersMs = [&]() {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            for (uint32_t i = 0; i < iterations; ++i) {
+                rasterizer.beginFrame(viewProj);
+                for (const auto& wallMatrix : wallMatrices) {
+                    rasterizer.renderOccluder(positions.data(), sizeof(float) * 3, indices.data(),
+                        static_cast<uint32_t>(indices.size()), reinterpret_cast<const float(*)[4]>(wallMatrix.data()));
+                }
+                rasterizer.endOccluders();
+            }
+            auto endTime = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(endTime - startTime).count() / std::max(iterations, 1u);
+        };
+
+        OcclusionBenchmark result = {};
+        result.width = rasterizer.width;
+        result.height = rasterizer.height;
+        result.aabbCount = aabbCount;
+
+        bool hasAvx2 = rasterizer.useAvx2;
+        rasterizer.useAvx2 = false;
+        result.scalarRasterMs = renderOccludersMs();
+        if (hasAvx2) {
+            rasterizer.useAvx2 = true;
+            result.avx2RasterMs = renderOccludersMs();
+        }
+        result.triangleCount = rasterizer.stats.occluderTriangleCount;
+
+        // Same order as the renderer, frustum first so off-screen boxes are not reported as occluded
+        float planes[6][4];
+        culling::extractFrustumPlanes(viewProj, planes);
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < aabbCount; ++i) {
+            const float* boundsMin = &aabbs[i * 6];
+            const float* boundsMax = &aabbs[i * 6 + 3];
+            float center[3], extent[3];
+            for (int32_t j = 0; j < 3; ++j) {
+                center[j] = (boundsMin[j] + boundsMax[j]) * 0.5f;
+                extent[j] = (boundsMax[j] - boundsMin[j]) * 0.5f;
+            }
+            if (!culling::isAabbInFrustum(center, extent, planes)) {
+                result.frustumCulledCount++;
+            } else if (!rasterizer.isAabbVisible(boundsMin, boundsMax)) {
+                result.occludedCount++;
+            }
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        result.testMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+        return result;
+    }
+}
+#endif // OCCLUSION_IMPLEMENTATION
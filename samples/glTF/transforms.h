@@ -0,0 +1,257 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+///
+/// transforms Header - Scene transform hierarchy with incremental world updates
+///
+/// Nodes are stored as structure of arrays and sorted parents first, so a single forward pass propagates dirty
+/// flags and recomputes world matrices. Matrices are row-major with the row-vector convention (p' = p * M), and
+/// are transposed only when written to GPU instance buffers.
+///
+namespace transforms {
+    struct alignas(16) Matrix {
+        float m[16];
+    };
+
+    struct TransformHierarchy {
+        std::vector<int32_t> parents;       // Always lower than the node index, -1 for roots
+        std::vector<Matrix> localMatrices;
+        std::vector<Matrix> worldMatrices;
+        std::vector<uint8_t> dirtyFlags;    // Local changed since last update
+        std::vector<uint8_t> changedFlags;  // World recomputed by last update
+        std::vector<uint8_t> pendingWrites; // Instance buffers still holding an old world
+        uint32_t bufferCount = 1;           // Instance buffers written round-robin, one per frame in flight
+
+        size_t size() const { return parents.size(); }
+        void reserve(size_t count);
+
+        /// Parent must already exist, which keeps the hierarchy sorted
+        uint32_t addNode(int32_t parent, const float localMatrix[16]);
+
+        void setLocal(uint32_t node, const float localMatrix[16]);
+
+        const float* world(uint32_t node) const { return worldMatrices[node].m; }
+
+        /// Recompute world matrices of dirty nodes and their subtrees, returns how many were recomputed
+        uint32_t update();
+
+        /// Write transposed world matrices of instances not yet up to date in this buffer. Each node must back at
+        /// most one instance. outMappedTransforms is 16B aligned, usually a persistently mapped upload buffer.
+        uint32_t writeInstances(const uint32_t* instanceNodes, uint32_t instanceCount, float* outMappedTransforms);
+    };
+
+    struct HierarchyBenchmark {
+        uint32_t nodeCount;
+        double fullUpdateMs;                // All roots animated, whole hierarchy recomputed
+        double partialUpdateMs;             // 1% of roots animated
+        double writeMs;                     // Transposed write of all instances
+    };
+
+    void multiply(const float* a, const float* b, float* outMatrix);
+
+    void storeTransposed(const float* matrix, float* outMatrix);
+
+    HierarchyBenchmark benchmarkHierarchyUpdate(uint32_t nodeCount, uint32_t iterations);
+}
+
+
+///
+/// Implementation
+///
+#if defined(TRANSFORMS_IMPLEMENTATION)
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+
+namespace transforms {
+    void multiply(const float* a, const float* b, float* outMatrix) {
+        // Row i of a * b is the sum of b rows weighted by row i of a
+        __m128 b0 = _mm_load_ps(b + 0);
+        __m128 b1 = _mm_load_ps(b + 4);
+        __m128 b2 = _mm_load_ps(b + 8);
+        __m128 b3 = _mm_load_ps(b + 12);
+        for (int32_t i = 0; i < 4; ++i) {
+            __m128 row = _mm_mul_ps(_mm_set1_ps(a[i * 4 + 0]), b0);
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 1]), b1));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 2]), b2));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 3]), b3));
+            _mm_store_ps(outMatrix + i * 4, row);
+        }
+    }
+
+
+    void storeTransposed(const float* matrix, float* outMatrix) {
+        __m128 row0 = _mm_load_ps(matrix + 0);
+        __m128 row1 = _mm_load_ps(matrix + 4);
+        __m128 row2 = _mm_load_ps(matrix + 8);
+        __m128 row3 = _mm_load_ps(matrix + 12);
+        _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+        // Streaming stores, destination is usually write-combined upload memory
+        _mm_stream_ps(outMatrix + 0, row0);
+        _mm_stream_ps(outMatrix + 4, row1);
+        _mm_stream_ps(outMatrix + 8, row2);
+        _mm_stream_ps(outMatrix + 12, row3);
+    }
+
+
+    void TransformHierarchy::reserve(size_t count) {
+        parents.reserve(count);
+        localMatrices.reserve(count);
+        worldMatrices.reserve(count);
+        dirtyFlags.reserve(count);
+        changedFlags.reserve(count);
+        pendingWrites.reserve(count);
+    }
+
+
+    uint32_t TransformHierarchy::addNode(int32_t parent, const float localMatrix[16]) {
+        assert(parent < static_cast<int32_t>(size()));
+        Matrix local;
+        memcpy(local.m, localMatrix, sizeof(local.m));
+
+        parents.push_back(parent);
+        localMatrices.push_back(local);
+        worldMatrices.push_back(local);
+        dirtyFlags.push_back(1);
+        changedFlags.push_back(0);
+        pendingWrites.push_back(0);
+        return static_cast<uint32_t>(size() - 1);
+    }
+
+
+    void TransformHierarchy::setLocal(uint32_t node, const float localMatrix[16]) {
+        memcpy(localMatrices[node].m, localMatrix, sizeof(Matrix::m));
+        dirtyFlags[node] = 1;
+    }
+
+
+    uint32_t TransformHierarchy::update() {
+        uint32_t updatedCount = 0;
+        size_t nodeCount = size();
+        for (size_t i = 0; i < nodeCount; ++i) {
+            // Parents come first, so their changed flag is final by the time children read it
+            int32_t parent = parents[i];
+            uint8_t isDirty = dirtyFlags[i] | (parent >= 0 ? changedFlags[parent] : 0);
+            changedFlags[i] = isDirty;
+            if (!isDirty) {
+                continue;
+            }
+
+            if (parent >= 0) {
+                multiply(localMatrices[i].m, worldMatrices[parent].m, worldMatrices[i].m);
+            }
+            else {
+                worldMatrices[i] = localMatrices[i];
+            }
+            dirtyFlags[i] = 0;
+            pendingWrites[i] = static_cast<uint8_t>(bufferCount);
+            updatedCount++;
+        }
+        return updatedCount;
+    }
+
+
+    uint32_t TransformHierarchy::writeInstances(const uint32_t* instanceNodes, uint32_t instanceCount,
+        float* outMappedTransforms) {
+        uint32_t writeCount = 0;
+        for (uint32_t i = 0; i < instanceCount; ++i) {
+            uint32_t node = instanceNodes[i];
+            if (pendingWrites[node] == 0) {
+                continue;
+            }
+            storeTransposed(worldMatrices[node].m, outMappedTransforms + i * 16);
+            pendingWrites[node]--;
+            writeCount++;
+        }
+        _mm_sfence();
+        return writeCount;
+    }
+
+
+    HierarchyBenchmark benchmarkHierarchyUpdate(uint32_t nodeCount, uint32_t iterations) {
+        // Roots with 7 children each and 8 grandchildren per child, like many small rigid models
+        const uint32_t kChildCount = 7;
+        const uint32_t kGrandchildCount = 8;
+        const uint32_t kNodesPerRoot = 1 + kChildCount * (1 + kGrandchildCount);
+        const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+        TransformHierarchy hierarchy;
+        hierarchy.reserve(nodeCount + kNodesPerRoot);
+        std::vector<uint32_t> roots;
+        while (hierarchy.size() < nodeCount) {
+            float local[16];
+            memcpy(local, identity, sizeof(local));
+            local[12] = static_cast<float>(roots.size() % 256);
+            local[14] = static_cast<float>(roots.size() / 256);
+
+            uint32_t root = hierarchy.addNode(-1, local);
+            roots.push_back(root);
+            for (uint32_t i = 0; i < kChildCount; ++i) {
+                local[12] = 0.1f * i;
+                local[14] = 0.0f;
+                uint32_t child = hierarchy.addNode(static_cast<int32_t>(root), local);
+                for (uint32_t j = 0; j < kGrandchildCount; ++j) {
+                    hierarchy.addNode(static_cast<int32_t>(child), local);
+                }
+            }
+        }
+        hierarchy.update();
+
+        std::vector<uint32_t> instanceNodes(hierarchy.size());
+        for (uint32_t i = 0; i < instanceNodes.size(); ++i) {
+            instanceNodes[i] = i;
+        }
+        std::vector<Matrix> instanceBuffer(hierarchy.size());
+
+        auto animateRoots = [&](uint32_t frame, uint32_t rootStep) {
+            float angle = 0.01f * frame;
+            float local[16];
+            memcpy(local, identity, sizeof(local));
+            local[0] = std::cos(angle);
+            local[2] = -std::sin(angle);
+            local[8] = std::sin(angle);
+            local[10] = std::cos(angle);
+            for (size_t i = 0; i < roots.size(); i += rootStep) {
+                local[12] = hierarchy.localMatrices[roots[i]].m[12];
+                local[14] = hierarchy.localMatrices[roots[i]].m[14];
+                hierarchy.setLocal(roots[i], local);
+            }
+        };
+        auto measureMs = [&](uint32_t rootStep, bool isWrite) {
+            double totalMs = 0.0;
+            for (uint32_t frame = 0; frame < iterations; ++frame) {
+                animateRoots(frame, rootStep);
+                auto startTime = std::chrono::high_resolution_clock::now();
+                if (isWrite) {
+                    hierarchy.update();
+                    hierarchy.pendingWrites.assign(hierarchy.size(), 1);
+                    startTime = std::chrono::high_resolution_clock::now();
+                    hierarchy.writeInstances(instanceNodes.data(), static_cast<uint32_t>(instanceNodes.size()),
+                        instanceBuffer[0].m);
+                }
+                else {
+                    hierarchy.update();
+                }
+                auto endTime = std::chrono::high_resolution_clock::now();
+                totalMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+            }
+            return totalMs / std::max(iterations, 1u);
+        };
+
+        HierarchyBenchmark result = {};
+        result.nodeCount = static_cast<uint32_t>(hierarchy.size());
+        result.fullUpdateMs = measureMs(1, false);
+        result.partialUpdateMs = measureMs(100, false);
+        result.writeMs = measureMs(1, true);
+        return result;
+    }
+}
+#endif // TRANSFORMS_IMPLEMENTATION